@@ -861,6 +861,7 @@ void bind_alert()
        "dht_stats_alert", no_init)
        .add_property("active_requests", &dht_stats_active_requests)
        .add_property("routing_table", &dht_stats_routing_table)
+       .add_property("bootstrap_time", make_getter(&dht_stats_alert::bootstrap_time, by_value()))
         ;
 
     class_<dht_immutable_item_alert, bases<alert>, noncopyable>(
@@ -36,6 +36,7 @@ void bind_session_settings()
         .value("disable_os_cache_for_aligned_files", settings_pack::disable_os_cache_for_aligned_files)
 #endif
         .value("disable_os_cache", settings_pack::disable_os_cache)
+        .value("direct_io", settings_pack::direct_io)
     ;
 
     enum_<settings_pack::bandwidth_mixed_algo_t>("bandwidth_mixed_algo_t")
@@ -43,6 +44,11 @@ void bind_session_settings()
         .value("peer_proportional", settings_pack::peer_proportional)
     ;
 
+    enum_<settings_pack::utp_congestion_control_t>("utp_congestion_control_t")
+        .value("ledbat", settings_pack::ledbat)
+        .value("ledbat_plus_plus", settings_pack::ledbat_plus_plus)
+    ;
+
     enum_<settings_pack::enc_policy>("enc_policy")
         .value("pe_forced", settings_pack::pe_forced)
         .value("pe_enabled", settings_pack::pe_enabled)
@@ -172,6 +172,8 @@ struct peer_conn
 		, fast_extension(false)
 		, blocks_received(0)
 		, blocks_sent(0)
+		, messages_received(0)
+		, messages_sent(0)
 		, num_pieces(num_pieces)
 		, start_time(clock_type::now())
 		, churn(churn_)
@@ -241,6 +243,9 @@ struct peer_conn
 	bool fast_extension;
 	int blocks_received;
 	int blocks_sent;
+	// the number of peer protocol messages (not counting the handshake)
+	int messages_received;
+	int messages_sent;
 	int num_pieces;
 	time_point start_time;
 	time_point end_time;
@@ -405,6 +410,7 @@ struct peer_conn
 		error_code ec;
 		boost::asio::async_write(s, boost::asio::buffer(m, sizeof(msg) - 1)
 			, std::bind(&peer_conn::on_req_sent, this, m, _1, _2));
+		++messages_sent;
 
 		++outstanding_requests;
 		++block;
@@ -438,6 +444,7 @@ struct peer_conn
 		if (time == 0) time = 1;
 		float up = (std::int64_t(blocks_sent) * 0x4000) / time / 1000.f;
 		float down = (std::int64_t(blocks_received) * 0x4000) / time / 1000.f;
+		float msgs = (messages_sent + messages_received) * 1000.f / time;
 		error_code e;
 
 		char ep_str[200];
@@ -450,8 +457,8 @@ struct peer_conn
 #endif
 			std::snprintf(ep_str, sizeof(ep_str), "%s:%d", addr.to_string(e).c_str()
 				, s.local_endpoint(e).port());
-		std::printf("%s ep: %s sent: %d received: %d duration: %d ms up: %.1fMB/s down: %.1fMB/s\n"
-			, tmp, ep_str, blocks_sent, blocks_received, time, up, down);
+		std::printf("%s ep: %s sent: %d received: %d duration: %d ms up: %.1fMB/s down: %.1fMB/s msgs: %.0f/s\n"
+			, tmp, ep_str, blocks_sent, blocks_received, time, up, down, msgs);
 		if (seed) --num_seeds;
 	}
 
@@ -518,6 +525,7 @@ struct peer_conn
 			close("ERROR RECEIVE MESSAGE: %s", ec);
 			return;
 		}
+		++messages_received;
 		char* ptr = (char*)buffer;
 		int msg = read_uint8(ptr);
 
@@ -715,6 +723,7 @@ struct peer_conn
 		vec[1] = boost::asio::buffer(write_buffer, length);
 		boost::asio::async_write(s, vec, std::bind(&peer_conn::on_have_all_sent, this, _1, _2));
 		++blocks_sent;
+		++messages_sent;
 		if (churn && (blocks_sent % churn) == 0 && seed) {
 			outstanding_requests = 0;
 			restarting = true;
@@ -729,6 +738,7 @@ struct peer_conn
 		write_uint8(4, ptr);
 		write_uint32(static_cast<int>(piece), ptr);
 		boost::asio::async_write(s, boost::asio::buffer(write_buf_proto, 9), std::bind(&peer_conn::on_have_all_sent, this, _1, _2));
+		++messages_sent;
 	}
 };
 
@@ -1103,8 +1113,10 @@ int main(int argc, char* argv[])
 
 	float up = 0.f;
 	float down = 0.f;
+	float msgs = 0.f;
 	std::uint64_t total_sent = 0;
 	std::uint64_t total_received = 0;
+	std::uint64_t total_messages = 0;
 
 	for (std::vector<peer_conn*>::iterator i = conns.begin()
 		, end(conns.end()); i != end; ++i)
@@ -1113,6 +1125,9 @@ int main(int argc, char* argv[])
 		int time = int(total_milliseconds(p->end_time - p->start_time));
 		if (time == 0) time = 1;
 		total_sent += p->blocks_sent;
+		total_received += p->blocks_received;
+		total_messages += p->messages_sent + p->messages_received;
+		msgs += (p->messages_sent + p->messages_received) * 1000.f / time;
 		up += (std::int64_t(p->blocks_sent) * 0x4000) / time / 1000.f;
 		down += (std::int64_t(p->blocks_received) * 0x4000) / time / 1000.f;
 		delete p;
@@ -1122,10 +1137,11 @@ int main(int argc, char* argv[])
 		"suggests: %d suggested-requests: %d\n"
 		"total sent: %.1f %% received: %.1f %%\n"
 		"rate sent: %.1f MB/s received: %.1f MB/s\n"
+		"messages: %d rate: %.0f messages/s\n"
 		, int(num_suggest), int(num_suggested_requests)
 		, total_sent * 0x4000 * 100.f / float(ti.total_size())
 		, total_received * 0x4000 * 100.f / float(ti.total_size())
-		, up, down);
+		, up, down, int(total_messages), msgs);
 
 	return 0;
 }
@@ -2294,7 +2294,8 @@ namespace libtorrent {
 		// internal
 		dht_stats_alert(aux::stack_allocator& alloc
 			, std::vector<dht_routing_bucket> table
-			, std::vector<dht_lookup> requests);
+			, std::vector<dht_lookup> requests
+			, time_duration bootstrap);
 
 		TORRENT_DEFINE_ALERT(dht_stats_alert, 83)
 
@@ -2307,6 +2308,12 @@ namespace libtorrent {
 		// contains information about every bucket in the DHT routing
 		// table.
 		std::vector<dht_routing_bucket> const routing_table;
+
+		// the time it took for the slowest of the DHT nodes (there is one
+		// per listen socket) to complete its initial bootstrap, since the
+		// DHT was started. Nodes that are still bootstrapping are not
+		// included. Zero if no node has completed bootstrapping yet.
+		time_duration const bootstrap_time;
 	};
 
 	// posted every time an incoming request from a peer is accepted and queued
@@ -36,15 +36,18 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/config.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/aux_/throw.hpp"
+#include "libtorrent/error_code.hpp"
 
+#include <cerrno>
 #include <fcntl.h>
+#include <unistd.h>
 
 namespace libtorrent { namespace aux {
 
 	struct dev_random
 	{
-		dev_random()
-			: m_fd(open("/dev/random", O_RDONLY))
+		explicit dev_random(char const* path = "/dev/random")
+			: m_fd(open(path, O_RDONLY))
 		{
 			if (m_fd < 0)
 			{
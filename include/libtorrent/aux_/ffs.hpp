@@ -36,6 +36,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdint>
 #include "libtorrent/export.hpp"
 #include "libtorrent/span.hpp"
+#include "libtorrent/assert.hpp"
+
+#if defined _MSC_VER
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <intrin.h>
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+#endif
 
 namespace libtorrent { namespace aux {
 
@@ -61,6 +68,25 @@ namespace libtorrent { namespace aux {
 	// this function statically determines if hardware or software is used
 	// and expect the range to be in big-endian byte order
 	TORRENT_EXTRA_EXPORT int count_trailing_ones(span<std::uint32_t const> buf);
+
+	// returns the index of the lowest set bit in the host-order word ``v``.
+	// ``v`` must not be 0. This is used in tight loops iterating over the set
+	// bits of a word, so it's defined inline
+	inline int count_trailing_zeros(std::uint32_t const v)
+	{
+		TORRENT_ASSERT(v != 0);
+#if TORRENT_HAS_BUILTIN_CTZ
+		return __builtin_ctz(v);
+#elif defined _MSC_VER
+		unsigned long pos;
+		_BitScanForward(&pos, v);
+		return int(pos);
+#else
+		int ret = 0;
+		for (std::uint32_t w = v; (w & 1) == 0; w >>= 1) ++ret;
+		return ret;
+#endif
+	}
 }}
 
 #endif // TORRENT_FFS_HPP_INCLUDE
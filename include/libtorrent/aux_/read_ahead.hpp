@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_READ_AHEAD_HPP_INCLUDE
+#define TORRENT_READ_AHEAD_HPP_INCLUDE
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/units.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace libtorrent { namespace aux {
+
+	// detects streams of reads of consecutive pieces in a torrent, and
+	// decides which pieces to read into the cache ahead of them. Peers
+	// downloading pieces in order and streaming (time critical) reads form
+	// such streams. A few streams are tracked per torrent, to tell
+	// interleaved sequential readers apart.
+	//
+	// The number of pieces read ahead of a stream starts at one and doubles
+	// every time the stream reaches a piece that was read ahead while it's
+	// still in the cache, up to a limit. If a piece that was read ahead has
+	// been evicted by the time it's requested, the cache can't hold that
+	// many pieces and the window is halved. Once it drops to zero, the
+	// stream has to prove itself sequential again.
+	//
+	// This is not thread safe, it's only used from the network thread.
+	struct TORRENT_EXTRA_EXPORT read_ahead_predictor
+	{
+		struct decision
+		{
+			// the pieces to read into the cache, [first, end). This range is
+			// empty if there's nothing to read ahead
+			piece_index_t first{0};
+			piece_index_t end{0};
+
+			// true if the read was of a piece that had been read ahead
+			bool read_ahead = false;
+		};
+
+		// records a read from ``piece``. ``hit`` is true if the block was
+		// found in the cache (or was already being read into it).
+		// ``sequential`` is set by readers known to read pieces in order, in
+		// which case read-ahead starts right away. ``max_pieces`` is the most
+		// pieces to read ahead of a stream and ``end_piece`` is the number of
+		// pieces in the torrent.
+		decision on_read(piece_index_t piece, bool hit, bool sequential
+			, int max_pieces, piece_index_t end_piece);
+
+		// the number of consecutive pieces a stream needs to read before it's
+		// considered sequential
+		static constexpr int min_run = 3;
+
+		// the max number of streams tracked at the same time
+		static constexpr int max_streams = 4;
+
+	private:
+
+		struct stream
+		{
+			// the last piece read by this stream, -1 if the stream is unused
+			piece_index_t piece{-1};
+
+			// the pieces that have been read ahead of this stream and not yet
+			// reached by it, [ahead_start, ahead_end)
+			piece_index_t ahead_start{0};
+			piece_index_t ahead_end{0};
+
+			// the number of consecutive pieces read
+			int run = 0;
+
+			// the number of pieces to keep read ahead
+			int window = 0;
+
+			// the value of m_clock when this stream was last used, the least
+			// recently used stream is replaced by new ones
+			std::uint32_t last_use = 0;
+		};
+
+		std::array<stream, max_streams> m_streams;
+		std::uint32_t m_clock = 0;
+	};
+}}
+
+#endif // TORRENT_READ_AHEAD_HPP_INCLUDE
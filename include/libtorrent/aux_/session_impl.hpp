@@ -413,6 +413,7 @@ namespace aux {
 				sha1_hash const& info_hash, sha1_hash const& xor_mask) override;
 
 			void add_obfuscated_hash(sha1_hash const& obfuscated, std::weak_ptr<torrent> const& t) override;
+			dh_key_pool& dh_keys() override;
 #endif
 
 			void on_lsd_announce(error_code const& e);
@@ -618,6 +619,7 @@ namespace aux {
 			int next_port() const;
 
 			void deferred_submit_jobs() override;
+			void deferred_send(std::shared_ptr<peer_connection> p) override;
 
 			ses_buffer_holder allocate_buffer() override;
 			torrent_peer* allocate_peer_entry(int type);
@@ -709,6 +711,7 @@ namespace aux {
 			void update_auto_sequential();
 			void update_max_failcount();
 			void update_resolver_cache_timeout();
+			void update_dh_key_pool_size();
 
 			void update_upnp();
 			void update_natpmp();
@@ -743,6 +746,7 @@ namespace aux {
 			void init_dht();
 
 			void submit_disk_jobs();
+			void flush_deferred_sends();
 
 			void on_trigger_auto_manage();
 
@@ -841,6 +845,10 @@ namespace aux {
 			// this maps obfuscated hashes to torrents. It's only
 			// used when encryption is enabled
 			torrent_map m_obfuscated_torrents;
+
+			// keypairs for the encrypted handshake, generated ahead of time.
+			// Created the first time it's needed
+			std::unique_ptr<dh_key_pool> m_dh_key_pool;
 #endif
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -1261,6 +1269,11 @@ namespace aux {
 			// it means we don't need to post another one
 			bool m_deferred_submit_disk_jobs = false;
 
+			// peers that have messages queued up to be sent at the end of this
+			// turn of the network thread. They are all flushed by a single
+			// posted handler
+			std::vector<std::shared_ptr<peer_connection>> m_deferred_sends;
+
 			// this is set to true when a torrent auto-manage
 			// event is triggered, and reset whenever the message
 			// is delivered and the auto-manage is executed.
@@ -81,6 +81,7 @@ namespace libtorrent {
 	struct torrent_peer_allocator_interface;
 	struct counters;
 	struct resolver_interface;
+	class dh_key_pool;
 
 #ifndef TORRENT_DISABLE_DHT
 namespace dht {
@@ -195,6 +196,10 @@ namespace libtorrent { namespace aux {
 
 		virtual void deferred_submit_jobs() = 0;
 
+		// calls flush_deferred_send() on the peer at the end of this network
+		// thread turn
+		virtual void deferred_send(std::shared_ptr<peer_connection> p) = 0;
+
 		virtual std::uint16_t listen_port() const = 0;
 		virtual std::uint16_t ssl_listen_port() const = 0;
 
@@ -300,6 +305,7 @@ namespace libtorrent { namespace aux {
 			sha1_hash const& info_hash, sha1_hash const& xor_mask) = 0;
 		virtual void add_obfuscated_hash(sha1_hash const& obfuscated
 			, std::weak_ptr<torrent> const& t) = 0;
+		virtual dh_key_pool& dh_keys() = 0;
 #endif
 
 #ifndef TORRENT_DISABLE_DHT
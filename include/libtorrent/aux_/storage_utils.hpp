@@ -108,6 +108,7 @@ namespace libtorrent {
 		, aux::vector<std::uint8_t, file_index_t> const& file_priority
 		, stat_cache& stat
 		, std::string const& save_path
+		, int stat_threads
 		, storage_error& ec);
 }}
 
@@ -156,6 +156,23 @@ TORRENT_EXTRA_EXPORT char const* parse_int(char const* start
 	, char const* end, char delimiter, std::int64_t& val
 	, bdecode_errors::error_code_enum& ec);
 
+struct bdecode_node;
+
+namespace aux {
+
+	// returns the number of leading decimal digits in the 8 bytes starting
+	// at ``p`` (0 - 8), examining all of them at once
+	TORRENT_EXTRA_EXPORT int count_leading_digits8(char const* p);
+
+	// decodes ``buffer`` into ``ret``, reusing the memory ``ret`` already
+	// holds for its tokens. ``scan_words`` enables scanning the digits of
+	// integers and string length prefixes 8 bytes at a time. Disabling it
+	// is only useful to test the two against each other
+	TORRENT_EXTRA_EXPORT void bdecode_impl(span<char const> buffer
+		, bdecode_node& ret, error_code& ec, int* error_pos
+		, int depth_limit, int token_limit, bool scan_words);
+}
+
 namespace detail {
 
 // internal
@@ -255,6 +272,10 @@ struct TORRENT_EXPORT bdecode_node
 	TORRENT_EXPORT friend bdecode_node bdecode(span<char const> buffer
 		, error_code& ec, int* error_pos, int depth_limit, int token_limit);
 
+	friend void aux::bdecode_impl(span<char const> buffer
+		, bdecode_node& ret, error_code& ec, int* error_pos
+		, int depth_limit, int token_limit, bool scan_words);
+
 	// creates a default constructed node, it will have the type ``none_t``.
 	bdecode_node();
 
@@ -0,0 +1,224 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_BENCODE_WRITER_HPP_INCLUDED
+#define TORRENT_BENCODE_WRITER_HPP_INCLUDED
+
+#include <cstdint>
+#include <algorithm>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/assert.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/span.hpp"
+#include "libtorrent/string_view.hpp"
+
+#if TORRENT_USE_ASSERTS
+#include <string>
+#include <vector>
+#endif
+
+namespace libtorrent {
+
+	// bencode_writer encodes a bencoded structure directly into an output
+	// iterator, without first building an entry tree. It does not allocate
+	// any memory of its own, so writing into a reused buffer (or a
+	// ``char*`` into a buffer large enough) is allocation free.
+	//
+	// Dictionaries and lists are opened with open_dict() and open_list() and
+	// terminated by close(). Every value in a dictionary must be preceded by
+	// its key, and the keys of a dictionary must be written in sorted order
+	// (comparing the raw bytes), as required by the bencoding specification.
+	// The structure is verified in debug builds::
+	//
+	//	std::vector<char> buf;
+	//	auto w = make_bencode_writer(std::back_inserter(buf));
+	//	w.open_dict();
+	//	w.add("a", 1);
+	//	w.key("b");
+	//	w.open_list();
+	//	w.string("foo");
+	//	w.close();
+	//	w.close();
+	template <class OutIt>
+	struct bencode_writer
+	{
+		explicit bencode_writer(OutIt out) : m_out(std::move(out)) {}
+
+		void open_dict()
+		{
+			pre_value();
+			detail::write_char(m_out, 'd');
+#if TORRENT_USE_ASSERTS
+			m_scopes.push_back('d');
+			m_last_key.emplace_back();
+			m_has_key.push_back(false);
+#endif
+		}
+
+		void open_list()
+		{
+			pre_value();
+			detail::write_char(m_out, 'l');
+#if TORRENT_USE_ASSERTS
+			m_scopes.push_back('l');
+			m_last_key.emplace_back();
+			m_has_key.push_back(false);
+#endif
+		}
+
+		// terminates the innermost open dictionary or list
+		void close()
+		{
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(!m_scopes.empty());
+			TORRENT_ASSERT(!m_need_value);
+			m_scopes.pop_back();
+			m_last_key.pop_back();
+			m_has_key.pop_back();
+#endif
+			detail::write_char(m_out, 'e');
+		}
+
+		// writes the key of the next dictionary entry. It must compare
+		// greater than the previous key in this dictionary
+		void key(string_view const k)
+		{
+#if TORRENT_USE_ASSERTS
+			TORRENT_ASSERT(!m_scopes.empty() && m_scopes.back() == 'd');
+			TORRENT_ASSERT(!m_need_value);
+			TORRENT_ASSERT(!m_has_key.back() || string_view(m_last_key.back()) < k);
+			m_last_key.back().assign(k.data(), k.size());
+			m_has_key.back() = true;
+			m_need_value = true;
+#endif
+			write_string(k);
+		}
+
+		void integer(std::int64_t const v)
+		{
+			pre_value();
+			detail::write_char(m_out, 'i');
+			detail::write_integer(m_out, v);
+			detail::write_char(m_out, 'e');
+		}
+
+		void string(string_view const s)
+		{
+			pre_value();
+			write_string(s);
+		}
+
+		// writes the length prefix of a string. The caller is expected to
+		// write exactly ``len`` bytes of string content through out() before
+		// writing anything else. This is useful to encode strings directly
+		// from some other representation, without a temporary copy
+		void string_header(std::size_t const len)
+		{
+			pre_value();
+			detail::write_integer(m_out, len);
+			detail::write_char(m_out, ':');
+		}
+
+		// writes an already bencoded value verbatim
+		void preformatted(span<char const> const buf)
+		{
+			pre_value();
+			m_out = std::copy(buf.begin(), buf.end(), m_out);
+		}
+
+		// encodes the entry ``e`` as the next value
+		void value(entry const& e)
+		{
+			pre_value();
+			detail::bencode_recursive(m_out, e);
+		}
+
+		// convenience functions to write a key followed by its value
+		void add(string_view const k, std::int64_t const v)
+		{
+			key(k);
+			integer(v);
+		}
+
+		void add(string_view const k, string_view const v)
+		{
+			key(k);
+			string(v);
+		}
+
+		// the underlying output iterator, referring to where the next byte
+		// will be written
+		OutIt& out() { return m_out; }
+
+	private:
+
+		void write_string(string_view const s)
+		{
+			detail::write_integer(m_out, s.size());
+			detail::write_char(m_out, ':');
+			m_out = std::copy(s.begin(), s.end(), m_out);
+		}
+
+		void pre_value()
+		{
+#if TORRENT_USE_ASSERTS
+			// a value in a dictionary must be preceded by a key
+			TORRENT_ASSERT(m_scopes.empty() || m_scopes.back() == 'l' || m_need_value);
+			m_need_value = false;
+#endif
+		}
+
+		OutIt m_out;
+
+#if TORRENT_USE_ASSERTS
+		// the open dictionaries ('d') and lists ('l'), innermost last
+		std::vector<char> m_scopes;
+
+		// the last key written to each open dictionary, to verify they are
+		// sorted
+		std::vector<std::string> m_last_key;
+		std::vector<bool> m_has_key;
+
+		// set when a key has been written, but not its value
+		bool m_need_value = false;
+#endif
+	};
+
+	template <class OutIt>
+	bencode_writer<OutIt> make_bencode_writer(OutIt out)
+	{
+		return bencode_writer<OutIt>(std::move(out));
+	}
+}
+
+#endif // TORRENT_BENCODE_WRITER_HPP_INCLUDED
@@ -393,6 +393,24 @@ namespace detail {
 	TORRENT_EXPORT void add_files(file_storage& fs, std::string const& file
 		, std::uint32_t flags = 0);
 
+	// controls the threads and the I/O used by set_piece_hashes() to read and
+	// hash the files.
+	struct TORRENT_EXPORT piece_hash_settings
+	{
+		// the number of threads reading the files. Each reader reads
+		// ``read_size`` bytes at a time, in order of their offset in the torrent
+		int reader_threads = 2;
+
+		// the number of threads computing the SHA-1 hashes of the pieces that
+		// have been read. 0 means one thread per hardware thread.
+		int hasher_threads = 0;
+
+		// the number of bytes each reader reads in one go. This is rounded up
+		// to a multiple of the piece size. Up to ``reader_threads +
+		// hasher_threads`` such buffers may be allocated at any given time.
+		int read_size = 4 * 1024 * 1024;
+	};
+
 	// This function will assume that the files added to the torrent file exists at path
 	// ``p``, read those files and hash the content and set the hashes in the ``create_torrent``
 	// object. The optional function ``f`` is called in between every hash that is set. ``f``
@@ -400,8 +418,17 @@ namespace detail {
 	//
 	// 	void Fun(int);
 	//
+	// ``f`` is always called from the thread calling set_piece_hashes(), with the
+	// number of pieces completed so far. The pieces are read and hashed by a
+	// separate set of threads per call, controlled by ``settings``, so multiple
+	// torrents can be hashed concurrently by calling set_piece_hashes() from
+	// different threads.
+	//
 	// The overloads that don't take an ``error_code&`` may throw an exception in case of a
 	// file error, the other overloads sets the error code to reflect the error, if any.
+	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
+		, piece_hash_settings const& settings
+		, std::function<void(piece_index_t)> const& f, error_code& ec);
 	TORRENT_EXPORT void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec);
 	inline void set_piece_hashes(create_torrent& t, std::string const& p, error_code& ec)
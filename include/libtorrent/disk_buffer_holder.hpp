@@ -62,6 +62,9 @@ namespace libtorrent {
 	// this buffer has been released, ``get()`` will return nullptr.
 	struct TORRENT_EXTRA_EXPORT disk_buffer_holder
 	{
+		// construct an empty holder
+		disk_buffer_holder() noexcept = default;
+
 		// internal
 		disk_buffer_holder(buffer_allocator_interface& alloc, char* buf) noexcept;
 
@@ -97,7 +100,9 @@ namespace libtorrent {
 		// swap pointers of two disk buffer holders.
 		void swap(disk_buffer_holder& h) noexcept
 		{
-			TORRENT_ASSERT(h.m_allocator == m_allocator);
+			TORRENT_ASSERT(h.m_allocator == m_allocator
+				|| h.m_allocator == nullptr || m_allocator == nullptr);
+			std::swap(h.m_allocator, m_allocator);
 			std::swap(h.m_buf, m_buf);
 			std::swap(h.m_ref, m_ref);
 		}
@@ -111,8 +116,8 @@ namespace libtorrent {
 
 	private:
 
-		buffer_allocator_interface* m_allocator;
-		char* m_buf;
+		buffer_allocator_interface* m_allocator = nullptr;
+		char* m_buf = nullptr;
 		aux::block_cache_reference m_ref;
 	};
 
@@ -94,6 +94,13 @@ namespace libtorrent {
 			std::unique_lock<std::mutex> l(m_pool_mutex);
 			return m_in_use;
 		}
+
+		// the max number of buffers the cache may use
+		int max_use() const
+		{
+			std::unique_lock<std::mutex> l(m_pool_mutex);
+			return m_max_use;
+		}
 		int num_to_evict(int num_needed = 0);
 
 		void set_settings(aux::session_settings const& sett);
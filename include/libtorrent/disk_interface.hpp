@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "libtorrent/units.hpp"
 #include "libtorrent/disk_buffer_holder.hpp"
@@ -45,6 +46,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/storage_defs.hpp"
 #include "libtorrent/time.hpp"
 #include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/peer_request.hpp"
+#include "libtorrent/span.hpp"
 
 namespace libtorrent {
 
@@ -117,6 +120,14 @@ namespace libtorrent {
 	using pool_file_status = open_file_state;
 #endif
 
+	// one block passed to disk_interface::async_write_blocks()
+	struct disk_write_block
+	{
+		peer_request r;
+		disk_buffer_holder buffer;
+		std::function<void(storage_error const&)> handler;
+	};
+
 	struct TORRENT_EXTRA_EXPORT disk_interface
 	{
 		enum flags_t : std::uint8_t
@@ -143,6 +154,26 @@ namespace libtorrent {
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
 			, std::uint8_t flags = 0) = 0;
+
+		// write a block that was received directly into a buffer returned by
+		// allocate_receive_buffer(). This saves copying it
+		virtual void async_write(storage_index_t storage, peer_request const& r
+			, disk_buffer_holder buffer
+			, std::function<void(storage_error const&)> handler
+			, std::uint8_t flags = 0) = 0;
+
+		// write a run of contiguous blocks of one piece, received into buffers
+		// returned by allocate_receive_buffer(). The blocks are inserted into
+		// the cache together and share one flush. Each block's handler is
+		// called when that block has been written
+		virtual void async_write_blocks(storage_index_t storage
+			, span<disk_write_block> blocks, std::uint8_t flags = 0) = 0;
+
+		// allocate a buffer to receive a block into. If the disk cache is full,
+		// an empty buffer is returned (and ``o`` will be notified once it
+		// drains)
+		virtual disk_buffer_holder allocate_receive_buffer(
+			std::shared_ptr<disk_observer> o) = 0;
 		virtual void async_hash(storage_index_t storage, piece_index_t piece, std::uint8_t flags
 			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler, void* requester) = 0;
 		virtual void async_move_storage(storage_index_t storage, std::string p, std::uint8_t flags
@@ -114,7 +114,12 @@ namespace libtorrent {
 
 			// this job is currently being performed, or it's hanging
 			// on a cache piece that may be flushed soon
-			in_progress = 0x20
+			in_progress = 0x20,
+
+			// this is a read issued by the disk thread itself, to read a
+			// piece into the cache ahead of a sequential reader. The whole
+			// piece is read and the job has no one to report back to
+			read_ahead = 0x40
 		};
 
 		// for write jobs, returns true if its block
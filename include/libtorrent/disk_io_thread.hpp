@@ -46,6 +46,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/disk_interface.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
+#include "libtorrent/aux_/read_ahead.hpp"
 
 #include <mutex>
 #include <condition_variable>
@@ -304,6 +305,14 @@ namespace aux {
 			, char const* buf, std::shared_ptr<disk_observer> o
 			, std::function<void(storage_error const&)> handler
 			, std::uint8_t flags = 0) override;
+		void async_write(storage_index_t storage, peer_request const& r
+			, disk_buffer_holder buffer
+			, std::function<void(storage_error const&)> handler
+			, std::uint8_t flags = 0) override;
+		void async_write_blocks(storage_index_t storage
+			, span<disk_write_block> blocks, std::uint8_t flags = 0) override;
+		disk_buffer_holder allocate_receive_buffer(
+			std::shared_ptr<disk_observer> o) override;
 		void async_hash(storage_index_t storage, piece_index_t piece, std::uint8_t flags
 			, std::function<void(piece_index_t, sha1_hash const&, storage_error const&)> handler, void* requester) override;
 		void async_move_storage(storage_index_t storage, std::string p, std::uint8_t flags
@@ -358,6 +367,11 @@ namespace aux {
 
 		int prep_read_job_impl(disk_io_job* j, bool check_fence = true);
 
+		// called from async_read() to issue read jobs for the pieces
+		// following a sequential reader's
+		void maybe_read_ahead(storage_index_t storage, piece_index_t piece
+			, bool hit, std::uint8_t flags);
+
 		void maybe_issue_queued_read_jobs(cached_piece_entry* pe,
 			jobqueue_t& completed_jobs);
 		status_t do_read(disk_io_job* j, jobqueue_t& completed_jobs);
@@ -444,6 +458,16 @@ namespace aux {
 		int flush_range(cached_piece_entry* p, int start, int end
 			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
 
+		// assumes l is locked (cache std::mutex), and that the caller holds
+		// a piece_refcount on every piece. Writes out all dirty blocks of the
+		// pieces. The pieces are sorted by storage and piece index, and runs
+		// of adjacent pieces of the same storage are flushed together, in
+		// offset order, so that blocks that are contiguous on disk are
+		// written with a single writev(). Each flush is capped at
+		// m_flush_batch_blocks. Returns the number of blocks flushed
+		int flush_coalesced(span<cached_piece_entry*> pieces
+			, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l);
+
 		// low level flush operations, used by flush_range
 		int build_iovec(cached_piece_entry* pe, int start, int end
 			, span<iovec_t> iov, span<int> flushing, int block_base_index = 0);
@@ -533,6 +557,14 @@ namespace aux {
 		// disk cache
 		mutable std::mutex m_cache_mutex;
 		block_cache m_disk_cache;
+
+		// the max number of blocks flush_coalesced() writes in one go. It
+		// grows while flushes complete well within the latency target and
+		// shrinks when they take too long, to balance the fewer seeks of
+		// large writes against holding up the disk thread. There is a single
+		// value, shared by all disk threads, since they all write to the same
+		// disks. Protected by m_cache_mutex
+		int m_flush_batch_blocks;
 		enum
 		{
 			cache_check_idle,
@@ -587,6 +619,10 @@ namespace aux {
 		// indices into m_torrents to empty slots
 		std::vector<storage_index_t> m_free_slots;
 
+		// the sequential read detection for each storage in m_torrents. This
+		// is only used from the network thread
+		aux::vector<aux::read_ahead_predictor, storage_index_t> m_read_ahead;
+
 #if TORRENT_USE_ASSERTS
 		int m_magic = 0x1337;
 		std::atomic<bool> m_jobs_aborted{false};
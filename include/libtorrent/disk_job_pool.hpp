@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_DISK_JOB_POOL
 
 #include "libtorrent/config.hpp"
+#include "libtorrent/span.hpp"
 #include <mutex>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
@@ -50,6 +51,9 @@ namespace libtorrent {
 		~disk_job_pool();
 
 		disk_io_job* allocate_job(int type);
+		// allocates one job of ``type`` for every slot in ``jobs``, taking the
+		// mutex once. Returns false (and allocates nothing) on failure
+		bool allocate_jobs(int type, span<disk_io_job*> jobs);
 		void free_job(disk_io_job* j);
 		void free_jobs(disk_io_job** j, int num);
 
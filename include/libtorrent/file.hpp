@@ -177,6 +177,13 @@ namespace libtorrent {
 			// when creating a file, set the executable attribute
 			attribute_executable = 0x400,
 
+			// read and write data directly from and to the disk, bypassing
+			// the operating system's page cache, where supported. Only the
+			// parts of reads and writes whose file offset, buffer address and
+			// size are aligned to direct_io_alignment are performed directly.
+			// Unaligned heads and tails go through the page cache.
+			direct_io = 0x800,
+
 			// the mask of all attribute bits
 			attribute_mask = attribute_hidden | attribute_executable
 		};
@@ -203,12 +210,27 @@ namespace libtorrent {
 		// belongs to a data-region
 		std::int64_t sparse_end(std::int64_t start) const;
 
+		// deallocate the storage backing the specified range of the file,
+		// without changing its size. The range reads back as zeroes. Fails
+		// with operation_not_supported if the operating system or filesystem
+		// doesn't support it
+		bool punch_hole(std::int64_t offset, std::int64_t len, error_code& ec);
+
 		handle_type native_handle() const { return m_file_handle; }
 
+		// the alignment of file offsets, buffers and sizes required for a
+		// read or write to bypass the page cache, in direct_io mode
+		static constexpr int direct_io_alignment = 4096;
+
 	private:
 
 		handle_type m_file_handle;
 
+		// when opened in direct_io mode, this is a second handle to the
+		// file, opened to bypass the page cache. It's invalid if direct I/O
+		// isn't supported
+		handle_type m_direct_handle;
+
 		std::uint32_t m_open_mode;
 #if defined TORRENT_WINDOWS
 		static bool has_manage_volume_privs;
@@ -36,11 +36,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <map>
 #include <mutex>
 #include <vector>
+#include <array>
+#include <atomic>
 
 #include "libtorrent/file.hpp"
 #include "libtorrent/aux_/time.hpp"
 #include "libtorrent/units.hpp"
 #include "libtorrent/storage_defs.hpp"
+#include "libtorrent/linked_list.hpp"
 #include "libtorrent/disk_interface.hpp" // for open_file_state
 
 namespace libtorrent {
@@ -53,6 +56,10 @@ namespace libtorrent {
 	// not opening more file handles than specified. Given multiple threads,
 	// each with the ability to lock a file handle (via smart pointer), there
 	// may be windows where more file handles are open.
+	//
+	// The handles are spread over a number of independently locked shards,
+	// so that disk threads accessing different files don't contend on a
+	// single mutex. Files are evicted in approximate LRU order.
 	struct TORRENT_EXPORT file_pool : boost::noncopyable
 	{
 		// ``size`` specifies the number of allowed files handles
@@ -101,26 +108,52 @@ namespace libtorrent {
 
 	private:
 
-		file_handle remove_oldest(std::unique_lock<std::mutex>&);
+		// closes the least recently used file of all shards. The file
+		// handle is returned, to be destructed by the caller, after
+		// releasing any locks.
+		file_handle remove_oldest();
 
-		int m_size;
+		std::atomic<int> m_size;
 		bool m_low_prio_io = false;
 
-		struct lru_file_entry
+		using key_type = std::pair<storage_index_t, file_index_t>;
+
+		struct lru_file_entry : list_node<lru_file_entry>
 		{
+			explicit lru_file_entry(key_type const& k) : key(k) {}
+			key_type key;
 			file_handle file_ptr;
 			time_point const opened{aux::time_now()};
 			time_point last_use{opened};
 			std::uint32_t mode = 0;
 		};
 
-		// maps storage pointer, file index pairs to the
-		// lru entry for the file
-		std::map<std::pair<storage_index_t, file_index_t>, lru_file_entry> m_files;
+		struct shard
+		{
+			// maps storage pointer, file index pairs to the
+			// lru entry for the file
+			std::map<key_type, lru_file_entry> files;
+
+			// the entries in ``files``, the most recently used first
+			linked_list<lru_file_entry> lru;
+
+			mutable std::mutex mutex;
+		};
+
+		// must be a power of 2
+		static constexpr int num_shards = 32;
+
+		shard& shard_for(storage_index_t st, file_index_t file_index);
+
+		std::array<shard, num_shards> m_shards;
+
+		// the total number of open files, across all shards
+		std::atomic<int> m_num_files{0};
+
 #if TORRENT_USE_ASSERTS
 		std::vector<std::pair<std::string, void const*>> m_deleted_storages;
+		mutable std::mutex m_deleted_mutex;
 #endif
-		mutable std::mutex m_mutex;
 	};
 }
 
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include <unordered_set>
+#include <unordered_map>
 #include <ctime>
 #include <cstdint>
 
@@ -131,6 +132,7 @@ namespace libtorrent {
 
 		enum {
 			name_is_owned = (1 << 12) - 1,
+			name_in_arena = (1 << 12) - 2,
 			not_a_symlink = (1 << 15) - 1
 		};
 
@@ -150,9 +152,10 @@ namespace libtorrent {
 
 		// the number of characters in the name. If this is
 		// name_is_owned, name is 0-terminated and owned by this object
-		// (i.e. it should be freed in the destructor). If
-		// the len is not name_is_owned, the name pointer does not belong
-		// to this object, and it's not 0-terminated
+		// (i.e. it should be freed in the destructor). If it's
+		// name_in_arena, name is 0-terminated and points into the
+		// file_storage's name arena. Otherwise, the name pointer does not
+		// belong to this object, and it's not 0-terminated
 		std::uint64_t name_len:12;
 		std::uint64_t pad_file:1;
 		std::uint64_t hidden_attribute:1;
@@ -424,6 +427,10 @@ namespace libtorrent {
 			swap(ti.m_file_base, m_file_base);
 #endif
 			swap(ti.m_paths, m_paths);
+			swap(ti.m_path_index, m_path_index);
+			swap(ti.m_name_arena, m_name_arena);
+			swap(ti.m_file_offset_index, m_file_offset_index);
+			swap(ti.m_offset_index_shift, m_offset_index_shift);
 			swap(ti.m_name, m_name);
 			swap(ti.m_total_size, m_total_size);
 			swap(ti.m_num_pieces, m_num_pieces);
@@ -586,6 +593,14 @@ namespace libtorrent {
 			, bool set_name = true);
 		void reorder_file(int index, int dst);
 
+		// copies the name into m_name_arena and points e to it
+		void set_file_name(internal_file_entry& e, string_view name);
+
+		// extends m_file_offset_index with the buckets starting within the
+		// file at ``index``, which must be the last file indexed
+		void index_file_offset(file_index_t index);
+		void rebuild_offset_index();
+
 		// the list of files that this torrent consists of
 		aux::vector<internal_file_entry, file_index_t> m_files;
 
@@ -625,6 +640,24 @@ namespace libtorrent {
 		// entry appended, to form full file paths
 		aux::vector<std::string> m_paths;
 
+		// maps the hash of each path in m_paths to its index, to find
+		// existing paths in constant time when adding files
+		std::unordered_multimap<std::uint32_t, int> m_path_index;
+
+		// the 0-terminated names of the files, for names that aren't
+		// borrowed from the torrent file. Entries with name_len set to
+		// name_in_arena point into this buffer, which saves an allocation
+		// per file. If the buffer is reallocated (or copied), the name
+		// pointers are updated
+		std::vector<char> m_name_arena;
+
+		// used to narrow down the search for the file at a given offset.
+		// Entry i is the index of the file containing the offset
+		// ``i << m_offset_index_shift``. The shift is chosen to keep the
+		// number of entries at most the number of files
+		aux::vector<file_index_t> m_file_offset_index;
+		int m_offset_index_shift = 0;
+
 		// name of torrent. For multi-file torrents
 		// this is always the root directory
 		std::string m_name;
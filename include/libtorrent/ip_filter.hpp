@@ -41,6 +41,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <tuple>
 #include <iterator> // for next
 #include <limits>
+#include <algorithm> // for upper_bound, sort
+#include <queue>
 
 #include "libtorrent/address.hpp"
 #include "libtorrent/assert.hpp"
@@ -129,6 +131,12 @@ namespace detail {
 	// this is the generic implementation of
 	// a filter for a specific address type.
 	// it works with IPv4 and IPv6
+	//
+	// the ranges are kept in one of two representations. While rules are
+	// being added, they live in a std::set, where inserting in any order is
+	// cheap. compact() moves them into a sorted vector, which is smaller
+	// and faster to look up in. Adding a rule to a compacted filter first
+	// moves the ranges back into the set.
 	template<class Addr>
 	class filter_impl
 	{
@@ -142,6 +150,12 @@ namespace detail {
 
 		void add_rule(Addr first, Addr last, std::uint32_t const flags)
 		{
+			if (!m_compact.empty())
+			{
+				m_access_list.insert(m_compact.begin(), m_compact.end());
+				m_compact.clear();
+				m_compact.shrink_to_fit();
+			}
 			TORRENT_ASSERT(!m_access_list.empty());
 			TORRENT_ASSERT(first < last || first == last);
 
@@ -195,8 +209,93 @@ namespace detail {
 			TORRENT_ASSERT(!m_access_list.empty());
 		}
 
+		// has the same effect as calling add_rule() for each of ``rules`` in
+		// order, but sorts them and merges them with the existing ranges in
+		// a single pass. The filter is left compacted
+		void add_rules(std::vector<ip_range<Addr>> const& rules)
+		{
+			if (rules.empty()) return;
+
+			// the existing ranges are the background the rules are applied
+			// on top of
+			std::vector<range> base;
+			if (!m_compact.empty()) base.swap(m_compact);
+			else base.assign(m_access_list.begin(), m_access_list.end());
+			m_access_list.clear();
+			TORRENT_ASSERT(!base.empty() && base.front().start == zero<Addr>());
+
+			// a rule takes effect at its first address and stops right after
+			// its last one. Rules ending at the last address never stop
+			struct event
+			{
+				Addr addr;
+				int rule;
+				bool start;
+			};
+			std::vector<event> events;
+			events.reserve(rules.size() * 2);
+			for (int i = 0; i < int(rules.size()); ++i)
+			{
+				auto const& r = rules[std::size_t(i)];
+				TORRENT_ASSERT(r.first < r.last || r.first == r.last);
+				events.push_back({r.first, i, true});
+				if (r.last != max_addr<Addr>())
+					events.push_back({plus_one(r.last), i, false});
+			}
+			std::sort(events.begin(), events.end()
+				, [](event const& lhs, event const& rhs) { return lhs.addr < rhs.addr; });
+
+			// the rules covering the current address. The one added last takes
+			// precedence. Rules that have stopped are removed once they get to
+			// the top
+			std::priority_queue<int> active;
+			std::vector<bool> stopped(rules.size(), false);
+			std::uint32_t base_access = 0;
+
+			auto b = base.begin();
+			auto e = events.begin();
+			Addr addr = zero<Addr>();
+			for (;;)
+			{
+				for (; b != base.end() && b->start == addr; ++b)
+					base_access = b->access;
+				for (; e != events.end() && e->addr == addr; ++e)
+				{
+					if (e->start) active.push(e->rule);
+					else stopped[std::size_t(e->rule)] = true;
+				}
+				while (!active.empty() && stopped[std::size_t(active.top())])
+					active.pop();
+
+				std::uint32_t const access = active.empty() ? base_access
+					: rules[std::size_t(active.top())].flags;
+				if (m_compact.empty() || m_compact.back().access != access)
+					m_compact.emplace_back(addr, access);
+
+				if (b == base.end() && e == events.end()) break;
+				if (b == base.end()) addr = e->addr;
+				else if (e == events.end()) addr = b->start;
+				else addr = (std::min)(b->start, e->addr);
+			}
+		}
+
+		void compact()
+		{
+			if (m_access_list.empty()) return;
+			m_compact.assign(m_access_list.begin(), m_access_list.end());
+			m_access_list.clear();
+		}
+
 		std::uint32_t access(Addr const& addr) const
 		{
+			if (!m_compact.empty())
+			{
+				auto i = std::upper_bound(m_compact.begin(), m_compact.end(), addr
+					, [](Addr const& a, range const& r) { return a < r.start; });
+				TORRENT_ASSERT(i != m_compact.begin());
+				return std::prev(i)->access;
+			}
+
 			TORRENT_ASSERT(!m_access_list.empty());
 			auto i = m_access_list.upper_bound(addr);
 			if (i != m_access_list.begin()) --i;
@@ -208,12 +307,23 @@ namespace detail {
 
 		template <class ExternalAddressType>
 		std::vector<ip_range<ExternalAddressType>> export_filter() const
+		{
+			if (!m_compact.empty())
+				return export_ranges<ExternalAddressType>(m_compact);
+			return export_ranges<ExternalAddressType>(m_access_list);
+		}
+
+	private:
+
+		template <class ExternalAddressType, class Container>
+		static std::vector<ip_range<ExternalAddressType>> export_ranges(
+			Container const& access_list)
 		{
 			std::vector<ip_range<ExternalAddressType>> ret;
-			ret.reserve(m_access_list.size());
+			ret.reserve(access_list.size());
 
-			for (auto i = m_access_list.begin()
-				, end(m_access_list.end()); i != end;)
+			for (auto i = access_list.begin()
+				, end(access_list.end()); i != end;)
 			{
 				ip_range<ExternalAddressType> r;
 				r.first = ExternalAddressType(i->start);
@@ -230,8 +340,6 @@ namespace detail {
 			return ret;
 		}
 
-	private:
-
 		struct range
 		{
 			range(Addr addr, std::uint32_t a = 0) : start(addr), access(a) {} // NOLINT
@@ -244,6 +352,10 @@ namespace detail {
 		};
 
 		std::set<range> m_access_list;
+
+		// when the filter is compacted, this holds all ranges and
+		// m_access_list is empty
+		std::vector<range> m_compact;
 	};
 
 }
@@ -280,12 +392,28 @@ struct TORRENT_EXPORT ip_filter
 	// precedence.
 	void add_rule(address first, address last, std::uint32_t flags);
 
+	// Adds all of ``rules`` to the filter. The result is the same as calling
+	// add_rule() for each of them in order, so later rules take precedence
+	// over earlier ones they overlap. Rather than inserting the rules one at
+	// a time, they are sorted and merged with the existing ones in a single
+	// pass, which is much faster for large block lists. The filter is left
+	// compacted (see compact()).
+	void add_rules(std::vector<ip_range<address>> const& rules);
+
 	// Returns the access permissions for the given address (``addr``). The permission
 	// can currently be 0 or ``ip_filter::blocked``. The complexity of this operation
 	// is O(``log`` n), where n is the minimum number of non-overlapping ranges to describe
 	// the current filter.
 	std::uint32_t access(address const& addr) const;
 
+	// Converts the filter into a representation that uses less memory and
+	// is faster to look up addresses in. This is meant to be called once all
+	// rules have been added. Adding more rules to a compacted filter still
+	// works, but the first add_rule() call after compact() is O(n). The
+	// session compacts its copy of the filter in set_ip_filter(), before
+	// handing it to the network thread.
+	void compact();
+
 #if TORRENT_USE_IPV6
 	using filter_tuple_t = std::tuple<std::vector<ip_range<address_v4>>
 		, std::vector<ip_range<address_v6>>>;
@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #define TORRENT_DHT_TRACKER
 
 #include <functional>
+#include <map>
+#include <memory>
 
 #include <libtorrent/kademlia/node.hpp>
 #include <libtorrent/kademlia/dos_blocker.hpp>
@@ -130,7 +132,8 @@ namespace libtorrent { namespace dht {
 		void dht_status(session_status& s);
 #endif
 		void dht_status(std::vector<dht_routing_bucket>& table
-			, std::vector<dht_lookup>& requests);
+			, std::vector<dht_lookup>& requests
+			, time_duration& bootstrap_time);
 		void update_stats_counters(counters& c) const;
 
 		void incoming_error(error_code const& ec, udp::endpoint const& ep);
@@ -151,6 +154,11 @@ namespace libtorrent { namespace dht {
 
 			node dht;
 			deadline_timer connection_timer;
+
+			// the time it took this node to complete its first bootstrap,
+			// counted from when the DHT was started (or the node was added, if
+			// the DHT was already running). Negative while still bootstrapping
+			time_duration bootstrap_time;
 		};
 		using tracker_nodes_t = std::map<aux::session_listen_socket*, tracker_node>;
 
@@ -158,6 +166,68 @@ namespace libtorrent { namespace dht {
 		{ return shared_from_this(); }
 
 		void connection_timeout(tracker_node& n, error_code const& e);
+		void bootstrap_done(aux::session_listen_socket* s, time_point start
+			, find_data::nodes_callback const& f
+			, std::vector<std::pair<node_entry, std::string>> const& nodes);
+
+		// a lookup running on every node of one address family. Identical
+		// lookups requested while it's in flight subscribe to it rather than
+		// starting traversals of their own. The results it has reported so
+		// far are replayed to late subscribers, so they see the same sequence
+		// of callbacks as the first requester
+		template <typename... Args>
+		struct shared_lookup
+		{
+			using callback = std::function<void(Args const&...)>;
+
+			void subscribe(callback cb)
+			{
+				for (auto const& h : history) h(cb);
+				subscribers.push_back(std::move(cb));
+			}
+
+			void post(Args const&... args)
+			{
+				history.emplace_back([=](callback const& cb) { cb(args...); });
+				// a subscriber may request the same lookup again from its
+				// callback, which subscribes to this one
+				auto const subs = subscribers;
+				for (auto const& cb : subs) cb(args...);
+			}
+
+			std::vector<callback> subscribers;
+			std::vector<std::function<void(callback const&)>> history;
+
+			// the number of node traversals this lookup started, and the
+			// number of them still running
+			int traversals = 0;
+			int active = 0;
+		};
+
+		// the target of a lookup and the address family it runs in
+		using lookup_key = std::pair<sha1_hash, std::string>;
+
+		template <typename Lookup>
+		using lookup_map = std::map<lookup_key, std::shared_ptr<Lookup>>;
+
+		using peers_lookup = shared_lookup<std::vector<tcp::endpoint>>;
+		using immutable_lookup = shared_lookup<item>;
+		using mutable_lookup = shared_lookup<item, bool>;
+
+		// subscribes to the lookup of ``target`` in every address family,
+		// starting the ones that aren't in flight by calling ``start`` for
+		// each node of the family. ``make_cb`` is passed the total number of
+		// node traversals the subscriber will hear from and returns its
+		// callback
+		template <typename Lookup, typename MakeCallback, typename Start>
+		void run_lookup(lookup_map<Lookup>& lookups, sha1_hash const& target
+			, MakeCallback const& make_cb, Start const& start);
+
+		// called when one node traversal of a lookup completes. Once they all
+		// have, the lookup is no longer in flight
+		template <typename Lookup>
+		void lookup_done(lookup_map<Lookup>& lookups, lookup_key const& key
+			, std::shared_ptr<Lookup> const& l);
 		void refresh_timeout(error_code const& e);
 		void refresh_key(error_code const& e);
 		void update_storage_node_ids();
@@ -191,6 +261,11 @@ namespace libtorrent { namespace dht {
 		// used to resolve hostnames for nodes
 		udp::resolver m_host_resolver;
 
+		// the get_peers and get_item lookups in flight
+		lookup_map<peers_lookup> m_peers_lookups;
+		lookup_map<immutable_lookup> m_immutable_lookups;
+		lookup_map<mutable_lookup> m_mutable_lookups;
+
 		// state for the send rate limit
 		int m_send_quota;
 		time_point m_last_tick;
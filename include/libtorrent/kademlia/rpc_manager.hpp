@@ -33,7 +33,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #ifndef RPC_MANAGER_HPP
 #define RPC_MANAGER_HPP
 
-#include <unordered_map>
+#include <vector>
+#include <deque>
 #include <cstdint>
 
 #include "libtorrent/aux_/disable_warnings_push.hpp"
@@ -108,6 +109,11 @@ public:
 
 	int num_allocated_observers() const { return m_allocated_observers; }
 
+	// the number of requests that have been sent and are still waiting for
+	// a response (or a timeout)
+	int num_transactions() const
+	{ return int(m_transactions.size() - m_free_slots.size()); }
+
 	void update_node_id(node_id const& id) { m_our_id = id; }
 
 private:
@@ -115,9 +121,40 @@ private:
 	void* allocate_observer();
 	void free_observer(void* ptr);
 
+	// picks a free slot in the transaction table and returns a transaction
+	// ID mapping to it. Returns -1 if the table is full
+	int allocate_transaction_id();
+	observer_ptr remove_transaction(std::uint16_t tid);
+	observer* find_transaction(std::uint16_t tid) const;
+
 	mutable boost::pool<> m_pool_allocator;
 
-	std::unordered_multimap<int, observer_ptr> m_transactions;
+	// outstanding transactions, indexed by the low bits of the transaction
+	// ID. The size is always a power of two. The remaining high bits of the
+	// transaction ID are random, to make it hard to spoof responses. When the
+	// table grows, every entry keeps a unique slot, since the index only gains
+	// one more of the bits of its (unique) transaction ID.
+	std::vector<observer_ptr> m_transactions;
+
+	// indices of the unused slots in m_transactions
+	std::vector<std::uint16_t> m_free_slots;
+
+	struct timeout_entry
+	{
+		time_point sent;
+		observer const* o;
+		std::uint16_t tid;
+	};
+
+	// every transaction in the order it was sent. Since the timeouts are
+	// the same for all transactions, the ones that have timed out are always
+	// at the front. Entries whose transaction has already completed are left
+	// in here until they reach the front, and are skipped then
+	std::deque<timeout_entry> m_timeout_queue;
+
+	// the entries in m_timeout_queue before this index have been considered
+	// for a short timeout already
+	int m_short_timeout_cursor;
 
 	aux::session_listen_socket* m_sock;
 	socket_manager* m_sock_man;
@@ -71,6 +71,12 @@ namespace libtorrent {
 	// whenever the element at the cursor is removed, the
 	// cursor is bumped to the next occupied element
 
+	// in addition to the elements, each slot has a mark bit.
+	// the bits are stored in 32 bit words, which lets
+	// next_marked() skip over unmarked runs a word at a time.
+	// A mark is cleared when its element is removed or
+	// replaced
+
 	class TORRENT_EXTRA_EXPORT packet_buffer
 	{
 	public:
@@ -94,14 +100,35 @@ namespace libtorrent {
 
 		index_type span() const { return (m_last - m_first) & 0xffff; }
 
+		// set or clear the mark of the element at idx. It's
+		// a no-op if there is no element at idx
+		void mark(index_type idx);
+		void unmark(index_type idx);
+		bool marked(index_type idx) const;
+
+		// the number of elements currently marked
+		int num_marked() const { return m_num_marked; }
+
+		// returns the lowest marked index in the range [idx, end),
+		// or end if there is none
+		index_type next_marked(index_type idx, index_type end) const;
+
 #if TORRENT_USE_INVARIANT_CHECKS
 		void check_invariant() const;
 #endif
 
 	private:
+		bool slot_marked(std::uint32_t slot) const
+		{ return (m_marked[slot / 32] >> (slot % 32)) & 1; }
+		void clear_slot_mark(std::uint32_t slot);
+
 		aux::unique_ptr<packet_ptr[], index_type> m_storage;
 		std::uint32_t m_capacity = 0;
 
+		// one bit per slot in m_storage
+		aux::unique_ptr<std::uint32_t[], index_type> m_marked;
+		int m_num_marked = 0;
+
 		// this is the total number of elements that are occupied
 		// in the array
 		int m_size = 0;
@@ -36,13 +36,14 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include <mutex>
-#include <unordered_map>
+#include <memory>
 #include <cstdint>
 
 #include "libtorrent/config.hpp"
 #include "libtorrent/file.hpp"
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/units.hpp"
+#include "libtorrent/aux_/vector.hpp"
 
 namespace libtorrent {
 
@@ -71,25 +72,63 @@ namespace libtorrent {
 		void export_file(std::function<void(std::int64_t, span<char>)> f
 			, std::int64_t offset, std::int64_t size, error_code& ec);
 
-		// flush the metadata
+		// write the parts of the header that have changed to disk
 		void flush_metadata(error_code& ec);
 
 	private:
 
-		void open_file(std::uint32_t mode, error_code& ec);
-		void flush_metadata_impl(error_code& ec);
+		// the state of a slot in the part file
+		struct slot_state
+		{
+			// the number of reads and writes in progress against this slot
+			int refs = 0;
 
-		std::string m_path;
-		std::string m_name;
+			// the piece stored in this slot was freed while there was I/O in
+			// progress. The slot is released once the last of it completes
+			bool free_pending = false;
+
+			// the slot is on the free list, but the space it occupies in the
+			// file has not been deallocated yet
+			bool needs_punch = false;
+		};
+
+		void open_file(std::uint32_t mode, error_code& ec);
+		void flush_metadata_impl(std::unique_lock<std::mutex>& l, error_code& ec);
 
 		// allocate a slot and return the slot index
 		slot_index_t allocate_slot(piece_index_t piece);
 
+		// update the slot the piece is stored in, and mark the part of the
+		// header holding it as dirty
+		void set_slot(piece_index_t piece, slot_index_t slot);
+
+		// release a reference to the slot, taken before performing I/O
+		// against it
+		void release_slot(slot_index_t slot);
+
+		// add the slot to the free list, once nothing is referencing it
+		// anymore
+		void free_slot(slot_index_t slot);
+
+		std::int64_t slot_offset(slot_index_t const slot) const
+		{
+			return std::int64_t(m_header_size)
+				+ std::int64_t(static_cast<int>(slot)) * m_piece_size;
+		}
+
+		std::string m_path;
+		std::string m_name;
+
 		// this mutex must be held while accessing the data
 		// structure. Not while reading or writing from the file though!
 		// it's important to support multithreading
 		std::mutex m_mutex;
 
+		// this is held while writing the header to disk, to keep writes of
+		// the same part of the header in order. It must be acquired before
+		// m_mutex
+		std::mutex m_flush_mutex;
+
 		// this is a list of unallocated slots in the part file
 		// within the m_num_allocated range
 		std::vector<slot_index_t> m_free_slots;
@@ -109,16 +148,32 @@ namespace libtorrent {
 		// payload data from
 		int m_header_size;
 
+		// the number of pieces currently stored in the part file
+		int m_num_pieces = 0;
+
 		// if this is true, the metadata in memory has changed since
 		// we last saved or read it from disk. It means that we
 		// need to flush the metadata before closing the file
 		bool m_dirty_metadata = false;
 
-		// maps a piece index to the part-file slot it is stored in
-		std::unordered_map<piece_index_t, slot_index_t> m_piece_map;
+		// this is cleared the first time punching a hole in the file fails
+		// because the filesystem doesn't support it
+		bool m_punch_holes = true;
+
+		// maps a piece index to the part-file slot it is stored in, or -1 if
+		// it's not in the part file
+		aux::vector<slot_index_t, piece_index_t> m_piece_map;
+
+		aux::vector<slot_state, slot_index_t> m_slots;
+
+		// one bit per block of the header, set for the blocks that have
+		// changed since they were last written to disk
+		std::vector<bool> m_dirty_blocks;
 
-		// this is the file handle to the part file
-		file m_file;
+		// this is the file handle to the part file. Reads and writes are
+		// performed on a copy of the pointer, without holding the mutex, so
+		// the file may be re-opened while they are in progress
+		std::shared_ptr<file> m_file;
 	};
 }
 
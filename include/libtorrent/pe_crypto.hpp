@@ -51,7 +51,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <list>
 #include <array>
+#include <vector>
 #include <cstdint>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 namespace libtorrent {
 
@@ -61,6 +65,19 @@ namespace libtorrent {
 
 	TORRENT_EXTRA_EXPORT std::array<char, 96> export_key(key_t const& k);
 
+	// returns (base ^ exponent) % prime, where prime is the fixed prime used
+	// by the MSE key exchange
+	TORRENT_EXTRA_EXPORT key_t dh_powm(key_t const& base, key_t const& exponent);
+
+	// a random DH secret and its corresponding public key
+	struct dh_keypair
+	{
+		key_t secret;
+		key_t public_key;
+	};
+
+	TORRENT_EXTRA_EXPORT dh_keypair generate_dh_keypair();
+
 	// RC4 state from libtomcrypt
 	struct rc4 {
 		int x, y;
@@ -72,6 +89,7 @@ namespace libtorrent {
 	{
 	public:
 		dh_key_exchange();
+		explicit dh_key_exchange(dh_keypair const& kp);
 		bool good() const { return true; }
 
 		// Get local public key
@@ -97,6 +115,46 @@ namespace libtorrent {
 		sha1_hash m_xor_mask;
 	};
 
+	// a pool of DH keypairs generated ahead of time by a background thread.
+	// Generating the local keypair is the most expensive part of setting up
+	// an encrypted connection. This keeps it off the network thread, which
+	// matters when accepting a burst of encrypted connections. Each keypair
+	// is handed out once.
+	class TORRENT_EXTRA_EXPORT dh_key_pool
+	{
+	public:
+		explicit dh_key_pool(int size);
+		~dh_key_pool();
+		dh_key_pool(dh_key_pool const&) = delete;
+		dh_key_pool& operator=(dh_key_pool const&) = delete;
+
+		// takes a keypair out of the pool. If the pool is empty, a keypair
+		// is generated in the calling thread. Returns true if the keypair
+		// was precomputed. The background thread is started on the first call
+		bool get(dh_keypair& kp);
+
+		// sets the number of keypairs to keep ready. 0 disables the pool
+		void set_size(int size);
+
+		// the number of keypairs currently ready
+		int num_keys() const;
+
+		// stops and joins the background thread. After this, get() always
+		// generates keypairs inline
+		void stop();
+
+	private:
+
+		void thread_fun();
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::vector<dh_keypair> m_keys;
+		int m_max_keys;
+		bool m_abort = false;
+		std::thread m_thread;
+	};
+
 	struct TORRENT_EXTRA_EXPORT encryption_handler
 	{
 		std::tuple<int, span<span<char const>>>
@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/peer_class_set.hpp"
 #include "libtorrent/aux_/session_settings.hpp"
 #include "libtorrent/disk_observer.hpp"
+#include "libtorrent/disk_interface.hpp" // for disk_write_block
 #include "libtorrent/peer_connection_interface.hpp"
 #include "libtorrent/socket.hpp" // for tcp::endpoint
 #include "libtorrent/io_service_fwd.hpp"
@@ -548,6 +549,8 @@ namespace aux {
 		void incoming_bitfield(typed_bitfield<piece_index_t> const& bits);
 		void incoming_request(peer_request const& r);
 		void incoming_piece(peer_request const& p, char const* data);
+		// the block was received directly into a disk buffer
+		void incoming_piece(peer_request const& p, disk_buffer_holder data);
 		void incoming_piece_fragment(int bytes);
 		void start_receive_piece(peer_request const& r);
 		void incoming_cancel(peer_request const& r);
@@ -623,6 +626,13 @@ namespace aux {
 		void send_buffer(span<char const> buf, std::uint32_t flags = 0);
 		void setup_send();
 
+		// messages appended to the send buffer are not written right away.
+		// Instead the socket write is deferred to the end of the current
+		// network thread turn, so that all messages produced during the turn
+		// go out in a single write
+		void defer_send();
+		void flush_deferred_send();
+
 		template <typename Holder>
 		void append_send_buffer(Holder buffer, int size)
 		{
@@ -682,6 +692,10 @@ namespace aux {
 
 	protected:
 
+		// allocate a disk buffer to receive the payload of a piece message
+		// into. Returns an empty buffer if the disk cache is full
+		disk_buffer_holder allocate_receive_buffer();
+
 		virtual void get_specific_peer_info(peer_info& p) const = 0;
 
 		virtual void write_choke() = 0;
@@ -752,6 +766,11 @@ namespace aux {
 
 		void do_update_interest();
 		void fill_send_buffer();
+		void incoming_piece_impl(peer_request const& p, char const* data
+			, disk_buffer_holder buffer);
+		void pick_after_incoming_piece(torrent& t, bool redundant);
+		void queue_write(torrent& t, peer_request const& p, disk_buffer_holder buffer);
+		void flush_pending_writes();
 		void on_disk_read_complete(disk_buffer_holder disk_block, int flags
 			, storage_error const& error, peer_request const& r, time_point issue_time);
 		void on_disk_write_complete(storage_error const& error
@@ -770,6 +789,12 @@ namespace aux {
 		// from this peer
 		aux::vector<pending_block> m_download_queue;
 
+		// blocks received into disk buffers during the current receive batch.
+		// They are contiguous blocks of one piece, and are handed to the disk
+		// thread as one job by flush_pending_writes()
+		std::vector<disk_write_block> m_pending_writes;
+		std::shared_ptr<torrent> m_pending_writes_torrent;
+
 		// the queue of requests we have got
 		// from this peer that haven't been issued
 		// to the disk thread yet
@@ -1159,6 +1184,21 @@ namespace aux {
 		// outstanding requests need to increase at the same pace to keep up.
 		bool m_slow_start:1;
 
+		// set while this peer is waiting for its deferred send to be flushed
+		// at the end of the network thread turn. See defer_send()
+		bool m_send_deferred:1;
+
+		// set while on_receive_data() feeds a batch of received messages to
+		// on_receive(). Picking new blocks to request after an incoming piece
+		// is deferred until the whole batch has been handled, so a read
+		// containing many PIECE messages only runs the picker once
+		bool m_in_receive_batch:1;
+
+		// set when a piece was received in the current receive batch, and
+		// whether any of those pieces was not redundant
+		bool m_batch_pick_pending:1;
+		bool m_batch_pick_useful:1;
+
 		template <class Handler>
 		aux::allocating_handler<Handler, TORRENT_READ_HANDLER_MAX_SIZE>
 			make_read_handler(Handler const& handler)
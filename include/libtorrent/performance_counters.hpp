@@ -80,7 +80,9 @@ namespace libtorrent {
 
 			// the number of times the piece picker was
 			// successfully invoked, split by the reason
-			// it was invoked
+			// it was invoked. The incoming_* picks are
+			// counted once per batch of PIECE messages
+			// received in a single read
 			reject_piece_picks,
 			unchoke_piece_picks,
 			incoming_redundant_piece_picks,
@@ -191,6 +193,11 @@ namespace libtorrent {
 			num_write_ops,
 			num_read_ops,
 			num_read_back,
+			num_read_ahead_pieces,
+			num_read_ahead_hits,
+			num_read_ahead_misses,
+			num_write_batches,
+			num_write_batch_blocks,
 
 			disk_read_time,
 			disk_write_time,
@@ -216,6 +223,36 @@ namespace libtorrent {
 			recv_failed_bytes,
 			recv_redundant_bytes,
 
+			// UDP tracker requests that didn't need to send their own connect
+			// message, because another request to the same tracker did
+			udp_tracker_connects_saved,
+
+			// UDP tracker scrapes that were sent as part of another scrape
+			// message to the same tracker
+			udp_tracker_scrapes_batched,
+
+			// piece payload bytes copied from peer receive buffers into disk
+			// buffers, and bytes received directly into disk buffers
+			recv_payload_copied_bytes,
+			recv_payload_zero_copy_bytes,
+
+			// bytes of partially received messages moved to the front of peer
+			// receive buffers, and bytes that were left in place and consumed
+			// without ever being moved
+			recv_buffer_bytes_moved,
+			recv_buffer_move_bytes_saved,
+
+			// the number of writes issued on peer sockets, and the number of
+			// times sending was deferred to the end of the network thread's turn
+			// to coalesce more messages into the same write
+			peer_socket_writes,
+			peer_sends_deferred,
+
+			// the number of DH keypairs for encrypted handshakes taken from the
+			// precomputed pool, and the number generated on demand
+			dh_keys_precomputed,
+			dh_keys_generated,
+
 			dht_messages_in,
 			dht_messages_in_dropped,
 			dht_messages_out,
@@ -255,6 +292,7 @@ namespace libtorrent {
 			utp_payload_pkts_out,
 			utp_invalid_pkts_in,
 			utp_redundant_pkts_in,
+			utp_payload_bytes_buffered,
 
 			// the buffer sizes accepted by
 			// socket send calls. The larger
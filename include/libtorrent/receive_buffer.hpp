@@ -38,6 +38,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <libtorrent/sliding_average.hpp>
 
 #include <climits>
+#include <utility>
 
 namespace libtorrent {
 
@@ -48,7 +49,6 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 	int packet_size() const { return m_packet_size; }
 	int packet_bytes_remaining() const
 	{
-		TORRENT_ASSERT(m_recv_start == 0);
 		TORRENT_ASSERT(m_packet_size > 0);
 		return m_packet_size - m_recv_pos;
 	}
@@ -68,6 +68,12 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 	void received(int bytes_transferred)
 	{
 		TORRENT_ASSERT(m_packet_size > 0);
+		if (m_disk_recv_buffer_size > 0)
+		{
+			m_disk_recv_end += bytes_transferred;
+			TORRENT_ASSERT(m_disk_recv_end <= m_disk_recv_buffer_size);
+			return;
+		}
 		m_recv_end += bytes_transferred;
 		TORRENT_ASSERT(m_recv_pos <= int(m_recv_buffer.size()));
 	}
@@ -77,7 +83,23 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 	int advance_pos(int bytes);
 
 	// has the read cursor reached the end cursor?
-	bool pos_at_end() { return m_recv_pos == m_recv_end; }
+	bool pos_at_end() { return m_recv_start + m_recv_pos == m_recv_end + m_disk_recv_end; }
+
+	// returns true if the remainder of the current packet can be received
+	// into a disk buffer. i.e. nothing past the current packet has been
+	// received yet and it doesn't already have a disk buffer
+	bool can_assign_disk_buffer() const;
+
+	// receive the last ``size`` bytes of the current packet into ``buffer``
+	// rather than into the receive buffer. Any of those bytes that have been
+	// received already are moved into it
+	void assign_disk_buffer(disk_buffer_holder buffer, int size);
+	bool has_disk_buffer() const { return m_disk_recv_buffer_size > 0; }
+
+	// once the current packet is complete, this returns the disk buffer
+	// holding the end of it. It's still accounted for until the packet is
+	// cut from the receive buffer
+	disk_buffer_holder release_disk_buffer();
 
 	// size = the packet size to remove from the receive buffer
 	// packet_size = the next packet size to receive in the buffer
@@ -85,7 +107,8 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 	void cut(int size, int packet_size, int offset = 0);
 
 	// return the interval between the start of the buffer to the read cursor.
-	// This is the "current" packet.
+	// This is the "current" packet. If part of it is received into a disk
+	// buffer, only the part before that is returned
 	span<char const> get() const;
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
@@ -98,8 +121,12 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 #endif
 
 	// the purpose of this function is to free up and cut off all messages
-	// in the receive buffer that have been parsed and processed.
-	void normalize(int force_shrink = 0);
+	// in the receive buffer that have been parsed and processed. The
+	// remaining bytes are only moved to the front of the buffer if there's
+	// not enough room after them to receive the rest of the current packet.
+	// returns (bytes moved, bytes an earlier call left in place that have
+	// been consumed since, without ever being moved)
+	std::pair<int, int> normalize(int force_shrink = 0);
 	bool normalized() const { return m_recv_start == 0; }
 
 	void reset(int packet_size);
@@ -110,7 +137,8 @@ struct TORRENT_EXTRA_EXPORT receive_buffer
 		TORRENT_ASSERT(m_recv_end >= m_recv_start);
 		TORRENT_ASSERT(m_recv_end <= int(m_recv_buffer.size()));
 		TORRENT_ASSERT(m_recv_start <= int(m_recv_buffer.size()));
-		TORRENT_ASSERT(m_recv_start + m_recv_pos <= int(m_recv_buffer.size()));
+		TORRENT_ASSERT(m_recv_start + m_recv_pos - m_disk_recv_end <= int(m_recv_buffer.size()));
+		TORRENT_ASSERT(m_disk_recv_end <= m_disk_recv_buffer_size);
 	}
 #endif
 
@@ -118,6 +146,11 @@ private:
 	// explicitly disallow assignment, to silence msvc warning
 	receive_buffer& operator=(receive_buffer const&);
 
+	// adds the bytes normalize() left in place that have been consumed (up
+	// to consumed_end) to m_bytes_not_moved, and forgets about the rest,
+	// since they're about to be moved
+	void account_deferred(int consumed_end);
+
 	// m_recv_buffer.data() (start of actual receive buffer)
 	// |
 	// |      m_recv_start (start of current packet)
@@ -157,6 +190,21 @@ private:
 	sliding_average<20> m_watermark;
 
 	buffer m_recv_buffer;
+
+	// when receiving a piece message, its payload may be received directly
+	// into a disk buffer. m_disk_recv_buffer_size is the number of bytes at
+	// the end of the current packet that go into it (0 if there is no disk
+	// buffer) and m_disk_recv_end the number of them received so far
+	disk_buffer_holder m_disk_recv_buffer;
+	int m_disk_recv_buffer_size = 0;
+	int m_disk_recv_end = 0;
+
+	// the range of bytes in m_recv_buffer the last call to normalize() left
+	// in place, and the number of bytes from such ranges that were consumed
+	// without being moved, but not yet reported by normalize()
+	int m_deferred_start = 0;
+	int m_deferred_end = 0;
+	int m_bytes_not_moved = 0;
 };
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
@@ -207,6 +255,21 @@ struct crypto_receive_buffer
 
 	span<char> mutable_buffer(std::size_t bytes);
 
+	// disk buffers are only used when there's no crypto layer below the
+	// bittorrent protocol
+	bool can_assign_disk_buffer() const
+	{
+		return m_recv_pos == INT_MAX && m_connection_buffer.can_assign_disk_buffer();
+	}
+	void assign_disk_buffer(disk_buffer_holder buffer, int size)
+	{
+		TORRENT_ASSERT(m_recv_pos == INT_MAX);
+		m_connection_buffer.assign_disk_buffer(std::move(buffer), size);
+	}
+	bool has_disk_buffer() const { return m_connection_buffer.has_disk_buffer(); }
+	disk_buffer_holder release_disk_buffer()
+	{ return m_connection_buffer.release_disk_buffer(); }
+
 private:
 	// explicitly disallow assignment, to silence msvc warning
 	crypto_receive_buffer& operator=(crypto_receive_buffer const&);
@@ -37,6 +37,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <boost/asio/ip/tcp.hpp>
 #include "libtorrent/aux_/disable_warnings_pop.hpp"
 
+#include <algorithm>
 #include <unordered_map>
 #include <vector>
 
@@ -59,20 +60,45 @@ struct TORRENT_EXTRA_EXPORT resolver final : resolver_interface
 
 	virtual void set_cache_timeout(seconds timeout) override;
 
+	// the number of lookups handed to the system resolver.
+	// internal, exposed for the unit test
+	int num_lookups() const { return m_num_lookups; }
+
 private:
 
 	void on_lookup(error_code const& ec, tcp::resolver::iterator i
-		, resolver_interface::callback_t h, std::string hostname);
+		, std::string hostname, bool abortable);
+
+	// issues a lookup for host, unless one is already in flight. When it
+	// completes, all handlers queued up for the host are called. Passing
+	// an empty handler refreshes the cache entry without waiting for it
+	void start_lookup(std::string const& host, bool abortable
+		, resolver_interface::callback_t const& h);
 
 	struct dns_cache_entry
 	{
+		// the time of the last successful lookup
 		time_point last_seen;
 		std::vector<address> addresses;
+
+		// if the last lookup failed, this is the error and last_failure is
+		// when it happened. Failures are cached for a shorter time than
+		// successful lookups
+		time_point last_failure;
+		error_code error;
+
+		time_point last_used() const
+		{ return error ? std::max(last_seen, last_failure) : last_seen; }
 	};
 
 	std::unordered_map<std::string, dns_cache_entry> m_cache;
 	io_service& m_ios;
 
+	// handlers waiting for a lookup that's in flight, keyed by hostname. There
+	// is only ever one outstanding lookup per hostname and resolver. The first
+	// map is for m_resolver and the second for m_critical_resolver
+	std::unordered_map<std::string, std::vector<callback_t>> m_pending[2];
+
 	// all lookups in this resolver are aborted on shutdown.
 	tcp::resolver m_resolver;
 
@@ -84,6 +110,8 @@ private:
 
 	// timeout of cache entries
 	time_duration m_timeout;
+
+	int m_num_lookups;
 };
 
 }
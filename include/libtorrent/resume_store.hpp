@@ -0,0 +1,189 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef TORRENT_RESUME_STORE_HPP_INCLUDED
+#define TORRENT_RESUME_STORE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+
+#include "libtorrent/config.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/sha1_hash.hpp"
+#include "libtorrent/units.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+
+namespace libtorrent {
+
+	struct torrent_status;
+
+	// resume_store keeps the resume state of all torrents in a session in a
+	// single file, with one fixed-layout binary record per torrent. Rather
+	// than re-encoding and saving the full resume data of a torrent every
+	// time it changes, completed pieces and updated statistics are written
+	// to its record in place, typically touching a single page of the file.
+	//
+	// A record holds the piece bitfield, file and piece priorities, limits,
+	// flags, save path, name and transfer statistics of a torrent. It does
+	// *not* hold the torrent's metadata (the .torrent file), trackers, web
+	// seeds or peers. Those rarely change and are expected to be saved by the
+	// application separately.
+	//
+	// When opened, the file is memory mapped (where supported), to make
+	// loading the state of a large number of torrents cheap.
+	//
+	// The store stays consistent if the process is terminated at any point.
+	// To also survive the system crashing or losing power, call flush().
+	// Changes made after the last call to flush() may then be lost, in which
+	// case the affected torrents revert to an earlier state, never to an
+	// inconsistent one.
+	//
+	// A resume_store must not be used from multiple threads concurrently.
+	struct TORRENT_EXPORT resume_store
+	{
+		// opens the store at ``path``, creating it if it doesn't exist. If
+		// the file exists but is not a resume store, ``ec`` is set to
+		// errors::invalid_file_tag.
+		resume_store(std::string const& path, error_code& ec);
+
+		// flushes the store (see flush()) and closes it
+		~resume_store();
+
+		resume_store(resume_store const&) = delete;
+		resume_store& operator=(resume_store const&) = delete;
+
+		// returns the info-hashes of all torrents in the store
+		std::vector<sha1_hash> torrents() const;
+
+		// returns the resume state of the torrent with the specified
+		// info-hash, including all pieces and statistics updated since it was
+		// last saved. If the torrent is not in the store, ``ec`` is set to
+		// errors::invalid_torrent_handle.
+		add_torrent_params load(sha1_hash const& info_hash, error_code& ec) const;
+
+		// writes the complete resume state in ``atp``, replacing any previous
+		// state of the torrent. The info-hash is taken from ``atp.ti``, if
+		// set, otherwise from ``atp.info_hash``.
+		void save(add_torrent_params const& atp, error_code& ec);
+
+		// records that ``piece`` has been downloaded and passed the hash
+		// check, typically in response to a piece_finished_alert. The
+		// torrent must already be in the store.
+		void piece_finished(sha1_hash const& info_hash, piece_index_t piece
+			, error_code& ec);
+
+		// updates the transfer statistics of the torrent ``st`` refers to,
+		// as returned by torrent_handle::status() or posted in a
+		// state_update_alert. The torrent must already be in the store.
+		void update_stats(torrent_status const& st, error_code& ec);
+
+		// removes the torrent from the store
+		void remove(sha1_hash const& info_hash, error_code& ec);
+
+		// makes sure all changes have been written to the disk. Space taken
+		// by the previous versions of records replaced by save() is released
+		// by this call.
+		void flush(error_code& ec);
+
+	private:
+
+		struct record
+		{
+			// the position and size of the slot the record is stored in
+			std::int64_t offset;
+			std::uint32_t slot_size;
+
+			// the number of bytes of the checksummed part of the record
+			std::uint32_t body_size;
+
+			// incremented for every record written to the store. If there is
+			// more than one record for the same torrent, the highest one is
+			// the current one
+			std::uint64_t sequence;
+
+			int num_pieces;
+
+			// the number of entries in the piece log, and how many of them are
+			// in use
+			int log_capacity;
+			int log_used;
+
+			// the sequence number of the most recent statistics update. The
+			// update slots are used alternately
+			std::uint32_t stats_sequence;
+		};
+
+		struct slot
+		{
+			std::int64_t offset;
+			std::uint32_t size;
+		};
+
+		slot allocate_slot(std::uint32_t size);
+		void free_slot(slot s, error_code& ec);
+
+		// returns the bytes of the record, either pointing into the file
+		// mapping or read into ``buf``
+		span<char const> read_record(record const& r, std::vector<char>& buf
+			, error_code& ec) const;
+
+		std::string m_path;
+		mutable file m_file;
+
+		// the offset where the next record is appended
+		std::int64_t m_file_size = 0;
+
+		// the highest record sequence number in use
+		std::uint64_t m_sequence = 0;
+
+		std::unordered_map<sha1_hash, record> m_records;
+
+		// slots that are no longer in use and can be reused, by size
+		std::multimap<std::uint32_t, std::int64_t> m_free_slots;
+
+		// records that have been replaced by a newer copy. They are freed by
+		// the next flush(), once the new copy is known to be on disk
+		std::vector<std::pair<sha1_hash, slot>> m_replaced;
+
+		// the file mapped into memory, as it was when it was opened. Reading
+		// records from here saves a system call per torrent when loading all
+		// of them. Null if memory mapping is not supported
+		char const* m_map = nullptr;
+		std::size_t m_map_size = 0;
+	};
+}
+
+#endif // TORRENT_RESUME_STORE_HPP_INCLUDED
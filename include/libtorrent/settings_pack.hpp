@@ -984,6 +984,18 @@ namespace libtorrent {
 			//   potentially evict all other processes' cache by simply handling
 			//   high throughput and large files. If libtorrent's read cache is
 			//   disabled, enabling this may reduce performance.
+			// direct_io
+			//   Reads and writes bypass the OS cache entirely (``O_DIRECT``),
+			//   leaving libtorrent's disk cache as the only cache, so data isn't
+			//   kept in RAM twice. Only the parts of reads and writes aligned to
+			//   4 kiB are performed directly, the unaligned head or tail of a
+			//   file still goes through the OS cache. Files that don't start at
+			//   an aligned offset in the torrent (use pad files) are effectively
+			//   cached. Writes are synchronous to the disk. Where ``O_DIRECT``
+			//   is not available, this uses ``F_NOCACHE`` on macOS and behaves
+			//   like enable_os_cache elsewhere. ``disk_io_read_mode`` applies
+			//   to files opened for reading only, ``disk_io_write_mode`` to
+			//   files opened for writing, which are also used for reading.
 			//
 			// One reason to disable caching is that it may help the operating
 			// system from growing its file cache indefinitely.
@@ -1633,6 +1645,41 @@ namespace libtorrent {
 			// as zero.
 			resolver_cache_timeout,
 
+			// ``utp_congestion_control`` selects the congestion controller used
+			// by uTP sockets when sending. See utp_congestion_control_t. This
+			// defaults to ``ledbat``.
+			utp_congestion_control,
+
+			// ``dh_key_pool_size`` is the number of Diffie-Hellman keypairs
+			// for encrypted connections to generate ahead of time, on a
+			// background thread. Generating a keypair is CPU intensive, and the
+			// pool lets a burst of encrypted handshakes be served without
+			// stalling the network thread. Set to 0 to generate every keypair
+			// when it's needed. The pool is not available in simulator builds,
+			// nor on Windows builds using libgcrypt, which lack a thread safe
+			// source of randomness. There, keypairs are always generated when
+			// needed.
+			dh_key_pool_size,
+
+			// ``stat_threads`` is the number of threads a disk job may use to
+			// query the size of the files of a torrent when checking resume
+			// data and initializing its storage. On network filesystems and
+			// spinning disks each stat() call is dominated by latency, and
+			// issuing them in parallel shortens startup considerably. Set to 1
+			// to stat files one at a time on the disk thread.
+			stat_threads,
+
+			// ``read_ahead_pieces`` is the max number of pieces to read into
+			// the cache ahead of a sequential reader. Peers requesting pieces
+			// in order and streaming (time critical) reads are detected per
+			// torrent, and the pieces following theirs are read in the
+			// background, a whole piece at a time. The number of pieces read
+			// ahead grows up to this limit as long as they are still in the
+			// cache when requested, and shrinks when they have been evicted.
+			// It's also limited to a quarter of the cache. Set to 0 to disable
+			// read-ahead. It has no effect when the read cache is disabled.
+			read_ahead_pieces,
+
 			max_int_setting_internal
 		};
 
@@ -1667,7 +1714,8 @@ namespace libtorrent {
 #else
 			deprecated = 1,
 #endif
-			disable_os_cache = 2
+			disable_os_cache = 2,
+			direct_io = 3
 		};
 
 		enum bandwidth_mixed_algo_t
@@ -1680,6 +1728,21 @@ namespace libtorrent {
 			peer_proportional = 1
 		};
 
+		enum utp_congestion_control_t
+		{
+			// the congestion controller described in RFC 6817. It grows the
+			// congestion window linearly, proportional to how far below the
+			// target delay (``utp_target_delay``) the queuing delay is
+			ledbat = 0,
+
+			// LEDBAT++ (draft-irtf-iccrg-ledbat-plus-plus). It scales its gain
+			// down on long RTT links, backs off multiplicatively when above the
+			// target delay and periodically slows down to let the bottleneck
+			// queue drain. This makes competing uTP flows share the link more
+			// fairly and keeps the queuing delay closer to the target
+			ledbat_plus_plus = 1
+		};
+
 		// the encoding policy options for use with
 		// settings_pack::out_enc_policy and settings_pack::in_enc_policy.
 		enum enc_policy
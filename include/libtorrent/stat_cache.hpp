@@ -57,6 +57,15 @@ namespace libtorrent {
 		std::int64_t get_filesize(file_index_t i, file_storage const& fs
 			, std::string const& save_path, error_code& ec);
 
+		// queries the size of all files in ``files`` that aren't already in
+		// the cache, from up to ``num_threads`` threads (including the calling
+		// one), and records the results. Subsequent calls to get_filesize() for
+		// these files are served from the cache. Each stat() call on a network
+		// filesystem or a cold disk is dominated by latency, issuing them in
+		// parallel hides most of it.
+		void prefetch(file_storage const& fs, std::string const& save_path
+			, std::vector<file_index_t> const& files, int num_threads);
+
 		void set_dirty(file_index_t i);
 
 		void clear();
@@ -421,6 +421,11 @@ namespace libtorrent {
 			error_code error;
 		};
 		void read_piece(piece_index_t piece);
+
+		// ``disk_flags`` are passed on to the disk reads. Reads of pieces
+		// consumed in order (streaming) set disk_interface::sequential_access,
+		// to have the disk thread read the following pieces ahead of time
+		void read_piece_impl(piece_index_t piece, std::uint8_t disk_flags);
 		void on_disk_read_complete(disk_buffer_holder block, int flags, storage_error const& se
 			, peer_request const& r, std::shared_ptr<read_piece_struct> rp);
 
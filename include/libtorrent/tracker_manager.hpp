@@ -44,6 +44,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <map>
 
 #ifdef TORRENT_USE_OPENSSL
 #include "libtorrent/aux_/disable_warnings_push.hpp"
@@ -382,6 +383,20 @@ namespace libtorrent {
 			std::shared_ptr<udp_tracker_connection> c
 			, std::uint32_t tid);
 
+		// returns true if another request is already sending a connect message
+		// to this UDP tracker. In that case, c will have its request restarted
+		// once that connect completes (or fails). If false is returned, the
+		// caller is expected to send the connect message and then call
+		// udp_connect_done()
+		bool wait_for_udp_connect(address const& tracker
+			, std::shared_ptr<udp_tracker_connection> const& c);
+
+		// c is the request that sent the connect message. If it succeeded,
+		// scrape requests that were waiting for it are batched into as few
+		// scrape messages as possible
+		void udp_connect_done(std::shared_ptr<udp_tracker_connection> const& c
+			, bool success);
+
 		aux::session_settings const& settings() const { return m_settings; }
 		resolver_interface& host_resolver() { return m_host_resolver; }
 
@@ -400,6 +415,10 @@ namespace libtorrent {
 
 		std::vector<std::shared_ptr<http_tracker_connection>> m_http_conns;
 
+		// UDP trackers we're currently sending a connect message to, mapping to
+		// the requests waiting for the resulting connection ID
+		std::map<address, std::vector<std::weak_ptr<udp_tracker_connection>>> m_udp_connecting;
+
 		send_fun_t m_send_fun;
 		send_fun_hostname_t m_send_fun_hostname;
 		resolver_interface& m_host_resolver;
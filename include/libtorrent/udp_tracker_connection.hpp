@@ -64,6 +64,13 @@ namespace libtorrent {
 
 		std::uint32_t transaction_id() const { return m_transaction_id; }
 
+		// a scrape message may carry several info-hashes (BEP 15). The
+		// request is the limit: 16 bytes of header plus 20 bytes per
+		// info-hash, which for 74 info-hashes is 1496 bytes, just under a
+		// 1500 byte MTU. The response (8 + 12 bytes per info-hash) is
+		// smaller, don't derive the batch size from it
+		static constexpr int max_scrape_batch = 74;
+
 	private:
 
 		enum class action_t : std::uint8_t
@@ -82,6 +89,22 @@ namespace libtorrent {
 
 		void update_transaction_id();
 
+		// if we're the request sending the connect message to m_target, let
+		// the tracker_manager know we're done, so that other requests waiting
+		// for it can proceed
+		void release_connect(bool success);
+
+		bool is_scrape() const
+		{ return (tracker_req().kind & tracker_request::scrape_request) != 0; }
+
+		// c is a scrape request to the same tracker. Its info-hash is added
+		// to our scrape message and it's completed along with us
+		void add_to_scrape_batch(std::shared_ptr<udp_tracker_connection> c);
+
+		// restarts the requests in m_scrape_batch, to be sent on their own.
+		// This is used when our own request fails or is aborted
+		void release_scrape_batch();
+
 		void name_lookup(error_code const& error
 			, std::vector<address> const& addresses, int port);
 		void timeout(error_code const& error);
@@ -127,6 +150,18 @@ namespace libtorrent {
 		action_t m_state;
 
 		bool m_abort;
+
+		// scrape requests whose info-hashes are sent in our scrape message, in
+		// the order they're sent
+		std::vector<std::shared_ptr<udp_tracker_connection>> m_scrape_batch;
+
+		// true if other requests to the same tracker may be waiting for the
+		// connect message we sent
+		bool m_connecting = false;
+
+		// true while our info-hash is sent as part of another request's
+		// scrape message
+		bool m_batched = false;
 	};
 
 }
@@ -111,6 +111,7 @@ namespace libtorrent {
 		int connect_timeout() const { return m_sett.get_int(settings_pack::utp_connect_timeout); }
 		int min_timeout() const { return m_sett.get_int(settings_pack::utp_min_timeout); }
 		int loss_multiplier() const { return m_sett.get_int(settings_pack::utp_loss_multiplier); }
+		int congestion_control() const { return m_sett.get_int(settings_pack::utp_congestion_control); }
 
 		void mtu_for_dest(address const& addr, int& link_mtu, int& utp_mtu);
 		int num_sockets() const { return int(m_utp_sockets.size()); }
@@ -40,6 +40,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/time.hpp"
 #include "libtorrent/close_reason.hpp"
+#include "libtorrent/span.hpp"
 
 #include <functional>
 
@@ -71,6 +72,38 @@ namespace libtorrent {
 	TORRENT_EXTRA_EXPORT bool compare_less_wrap(std::uint32_t lhs
 		, std::uint32_t rhs, std::uint32_t mask);
 
+	// writes the offsets of the bits set in the selective ACK bitmask to
+	// ``offsets``, in ascending order. Bit 0 of the first byte has offset 0.
+	// Only the first ``num_bits`` bits are considered, and ``offsets`` must
+	// have room for that many entries. Returns the number of offsets written
+	TORRENT_EXTRA_EXPORT int sack_bit_offsets(span<std::uint8_t const> bitmask
+		, int num_bits, span<std::uint16_t> offsets);
+
+	// the congestion control state updated by ledbat_plus_plus(). ``cwnd`` is
+	// the congestion window in bytes, as a fixed point value with 16 bits
+	// fraction. ``ssthres`` is the slow-start threshold in bytes. The time
+	// points track the periodic slowdowns: when the last one started, when the
+	// current one ends (min_time() when not slowing down) and when the next
+	// one is due (min_time() if it hasn't been scheduled yet)
+	struct ledbat_state
+	{
+		std::int64_t cwnd = 0;
+		std::int32_t ssthres = 0;
+		bool slow_start = true;
+		time_point slowdown_start = min_time();
+		time_point slowdown_end = min_time();
+		time_point next_slowdown = min_time();
+	};
+
+	// updates ``s`` for an ACK of ``acked_bytes`` bytes, as described in
+	// draft-irtf-iccrg-ledbat-plus-plus. ``delay`` and ``target_delay`` are
+	// the measured and target queuing delay in microseconds, ``rtt`` is the
+	// round trip time in milliseconds and ``bytes_in_flight`` is the number of
+	// bytes still in flight, not counting the acked ones
+	TORRENT_EXTRA_EXPORT void ledbat_plus_plus(ledbat_state& s, int acked_bytes
+		, int delay, int target_delay, int rtt, int mtu, int bytes_in_flight
+		, time_point now);
+
 	struct utp_socket_manager;
 
 	// internal: the point of the bif_endian_int is two-fold
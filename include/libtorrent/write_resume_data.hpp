@@ -37,6 +37,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/export.hpp"
 #include "libtorrent/bencode.hpp"
 
+#include <vector>
+
 namespace libtorrent {
 
 	struct add_torrent_params;
@@ -46,6 +48,13 @@ namespace libtorrent {
 	// into a bencoded structure
 	TORRENT_EXPORT entry write_resume_data(add_torrent_params const& atp);
 	TORRENT_EXPORT std::vector<char> write_resume_data_buf(add_torrent_params const& atp);
+
+	// encodes the resume data in ``atp`` directly into ``buf``, appending to
+	// it, without building an intermediate entry. Reusing the same buffer
+	// when saving resume data for many torrents avoids allocating memory for
+	// each of them.
+	TORRENT_EXPORT void write_resume_data_buf(add_torrent_params const& atp
+		, std::vector<char>& buf);
 }
 
 #endif
@@ -38,6 +38,13 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/session.hpp"
 #include "libtorrent/session_stats.hpp"
 #include "libtorrent/torrent_info.hpp"
+#include "libtorrent/file_pool.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include <thread>
+#include <atomic>
+#include <chrono>
 
 using namespace lt;
 
@@ -138,3 +145,124 @@ TORRENT_TEST(file_pool_size)
 	TEST_CHECK(ran_to_completion);
 }
 
+
+namespace {
+
+file_storage make_files(int const num_files)
+{
+	file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+	{
+		char filename[50];
+		std::snprintf(filename, sizeof(filename), "file_pool_test/file-%d", i);
+		fs.add_file(filename, 0x400);
+	}
+	fs.set_piece_length(0x4000);
+	fs.set_num_pieces(int((fs.total_size() + 0x3fff) / 0x4000));
+	return fs;
+}
+
+std::string setup_dir()
+{
+	std::string const path = current_working_directory();
+	error_code ec;
+	remove_all(combine_path(path, "file_pool_test"), ec);
+	create_directory(combine_path(path, "file_pool_test"), ec);
+	TEST_CHECK(!ec);
+	return path;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(file_pool_sharded_limit)
+{
+	std::string const path = setup_dir();
+	file_storage const fs = make_files(100);
+	file_pool pool(10);
+
+	// open the files of two storages, spread over the shards
+	for (int st = 0; st < 2; ++st)
+	{
+		for (file_index_t i(0); i < fs.end_file(); ++i)
+		{
+			error_code ec;
+			auto const f = pool.open_file(storage_index_t(st), path, i, fs
+				, file::read_write, ec);
+			TEST_CHECK(f);
+			TEST_CHECK(!ec);
+		}
+	}
+
+	int const open = int(pool.get_status(storage_index_t(0)).size()
+		+ pool.get_status(storage_index_t(1)).size());
+	TEST_CHECK(open < 10);
+	TEST_CHECK(open > 0);
+
+	// looking up an already open file returns the same handle
+	std::vector<open_file_state> const status = pool.get_status(storage_index_t(1));
+	TEST_CHECK(!status.empty());
+	for (std::size_t i = 1; i < status.size(); ++i)
+		TEST_CHECK(status[i - 1].file_index < status[i].file_index);
+	error_code ec;
+	auto const f1 = pool.open_file(storage_index_t(1), path
+		, status.front().file_index, fs, file::read_write, ec);
+	auto const f2 = pool.open_file(storage_index_t(1), path
+		, status.front().file_index, fs, file::read_write, ec);
+	TEST_CHECK(f1 == f2);
+
+	pool.release(storage_index_t(1));
+	TEST_CHECK(pool.get_status(storage_index_t(1)).empty());
+
+	pool.resize(2);
+	TEST_CHECK(pool.get_status(storage_index_t(0)).size() <= 2);
+
+	pool.release();
+	TEST_CHECK(pool.get_status(storage_index_t(0)).empty());
+}
+
+// measures the throughput of looking up already open files from many
+// threads at once
+TORRENT_TEST(file_pool_lookup_benchmark)
+{
+	std::string const path = setup_dir();
+	int const num_files = 200;
+	file_storage const fs = make_files(num_files);
+	file_pool pool(num_files * 2);
+
+	for (file_index_t i(0); i < fs.end_file(); ++i)
+	{
+		error_code ec;
+		TEST_CHECK(pool.open_file(storage_index_t(0), path, i, fs
+			, file::read_write, ec));
+	}
+
+	int const num_threads = 16;
+	int const lookups_per_thread = 200000;
+	std::atomic<int> failures{0};
+	std::vector<std::thread> threads;
+
+	auto const start = std::chrono::steady_clock::now();
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&, t]
+		{
+			for (int i = 0; i < lookups_per_thread; ++i)
+			{
+				error_code ec;
+				file_index_t const idx((i * 7 + t * 13) % num_files);
+				if (!pool.open_file(storage_index_t(0), path, idx, fs
+					, file::read_write, ec))
+					++failures;
+			}
+		});
+	}
+	for (auto& t : threads) t.join();
+	auto const end = std::chrono::steady_clock::now();
+
+	TEST_EQUAL(failures, 0);
+	TEST_EQUAL(int(pool.get_status(storage_index_t(0)).size()), num_files);
+
+	double const seconds = std::chrono::duration<double>(end - start).count();
+	std::printf("%d threads: %.0f lookups/s\n", num_threads
+		, double(num_threads) * lookups_per_thread / std::max(seconds, 1e-6));
+}
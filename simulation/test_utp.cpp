@@ -35,14 +35,135 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/alert_types.hpp"
 #include "libtorrent/time.hpp" // for clock_type
 
+#include "libtorrent/peer_info.hpp"
+#include "libtorrent/torrent_handle.hpp"
+
 #include "test.hpp"
 #include "setup_swarm.hpp"
 #include "settings.hpp"
+#include "simulator/queue.hpp"
 #include <fstream>
 #include <iostream>
 
 using namespace lt;
 
+namespace {
+
+// a network where every node has a link with the given bandwidth (bytes per
+// second), one-way latency and tail-drop queue size (bytes) in each direction.
+// A small queue causes packet loss when the sender overshoots
+struct link_config : sim::default_config
+{
+	link_config(int const rate, lt::milliseconds const latency, int const queue_size)
+		: m_rate(rate), m_latency(latency), m_queue_size(queue_size) {}
+
+	sim::route incoming_route(lt::address ip) override
+	{
+		auto it = m_incoming.find(ip);
+		if (it != m_incoming.end()) return sim::route().append(it->second);
+		it = m_incoming.insert(it, std::make_pair(ip, std::make_shared<sim::queue>(
+			std::ref(m_sim->get_io_service()), m_rate
+			, lt::duration_cast<sim::chrono::high_resolution_clock::duration>(m_latency)
+			, m_queue_size, "link in")));
+		return sim::route().append(it->second);
+	}
+
+	sim::route outgoing_route(lt::address ip) override
+	{
+		auto it = m_outgoing.find(ip);
+		if (it != m_outgoing.end()) return sim::route().append(it->second);
+		it = m_outgoing.insert(it, std::make_pair(ip, std::make_shared<sim::queue>(
+			std::ref(m_sim->get_io_service()), m_rate
+			, lt::duration_cast<sim::chrono::high_resolution_clock::duration>(m_latency)
+			, m_queue_size, "link out")));
+		return sim::route().append(it->second);
+	}
+
+private:
+	int m_rate;
+	lt::milliseconds m_latency;
+	int m_queue_size;
+};
+
+struct transfer_result
+{
+	lt::time_duration download_time = lt::seconds(0);
+	// the highest request round-trip time (in milliseconds) the downloader
+	// saw. It's dominated by the queuing delay the sender causes
+	int max_rtt = 0;
+};
+
+// download the test torrent over uTP from a seed using the specified
+// congestion controller
+transfer_result run_transfer(int const algorithm, link_config& cfg)
+{
+	sim::simulation sim{cfg};
+
+	lt::settings_pack pack = settings();
+	utp_only(pack);
+	pack.set_int(settings_pack::utp_congestion_control, algorithm);
+
+	lt::add_torrent_params atp;
+	atp.flags &= ~lt::add_torrent_params::flag_paused;
+	atp.flags &= ~lt::add_torrent_params::flag_auto_managed;
+
+	lt::time_point const start_time = lt::clock_type::now();
+	transfer_result ret;
+
+	setup_swarm(2, swarm_test::download, sim, pack, atp
+		// add session
+		, [](lt::settings_pack&) {}
+		// add torrent
+		, [](lt::add_torrent_params&) {}
+		// on alert
+		, [&](lt::alert const* a, lt::session&) {
+			if (lt::alert_cast<lt::torrent_finished_alert>(a))
+				ret.download_time = lt::clock_type::now() - start_time;
+		}
+		// terminate
+		, [&](int const ticks, lt::session& ses) -> bool
+		{
+			auto const handles = ses.get_torrents();
+			if (!handles.empty())
+			{
+				std::vector<lt::peer_info> peers;
+				handles[0].get_peer_info(peers);
+				for (auto const& pi : peers)
+					ret.max_rtt = std::max(ret.max_rtt, pi.rtt);
+			}
+
+			if (ticks > 200)
+			{
+				TEST_ERROR("timeout");
+				return true;
+			}
+			return ret.download_time > lt::seconds(0);
+		});
+
+	return ret;
+}
+
+void test_congestion_control(int const rate, lt::milliseconds const latency
+	, int const queue_size)
+{
+	for (int const algorithm : {settings_pack::ledbat, settings_pack::ledbat_plus_plus})
+	{
+		link_config cfg(rate, latency, queue_size);
+		transfer_result const r = run_transfer(algorithm, cfg);
+
+		std::int64_t const ms = lt::total_milliseconds(r.download_time);
+		std::printf("congestion control: %s rate: %d kB/s latency: %d ms queue: %d kB "
+			"download time: %d ms max rtt: %d ms\n"
+			, algorithm == settings_pack::ledbat ? "LEDBAT" : "LEDBAT++"
+			, rate / 1000, int(latency.count()), queue_size / 1000
+			, int(ms), r.max_rtt);
+
+		TEST_CHECK(ms > 0);
+	}
+}
+
+} // anonymous namespace
+
 TORRENT_TEST(utp)
 {
 	// TODO: 3 simulate packet loss
@@ -85,3 +206,15 @@ TORRENT_TEST(utp)
 		});
 }
 
+
+TORRENT_TEST(utp_congestion_control_high_rtt)
+{
+	// a long fat pipe with a deep queue
+	test_congestion_control(1000 * 1000, lt::milliseconds(150), 1000 * 1000);
+}
+
+TORRENT_TEST(utp_congestion_control_lossy)
+{
+	// a shallow queue, overshooting the link capacity causes packet loss
+	test_congestion_control(200 * 1000, lt::milliseconds(20), 8 * 1000);
+}
@@ -1761,18 +1761,21 @@ namespace {
 
 	dht_stats_alert::dht_stats_alert(aux::stack_allocator&
 		, std::vector<dht_routing_bucket> table
-		, std::vector<dht_lookup> requests)
+		, std::vector<dht_lookup> requests
+		, time_duration const bootstrap)
 		: alert()
 		, active_requests(std::move(requests))
 		, routing_table(std::move(table))
+		, bootstrap_time(bootstrap)
 	{}
 
 	std::string dht_stats_alert::message() const
 	{
 		char buf[2048];
-		std::snprintf(buf, sizeof(buf), "DHT stats: reqs: %d buckets: %d"
+		std::snprintf(buf, sizeof(buf), "DHT stats: reqs: %d buckets: %d bootstrap: %d ms"
 			, int(active_requests.size())
-			, int(routing_table.size()));
+			, int(routing_table.size())
+			, int(total_milliseconds(bootstrap_time)));
 		return buf;
 	}
 
@@ -33,11 +33,15 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/aux_/alloca.hpp"
 #include "libtorrent/aux_/numeric_cast.hpp"
+#include "libtorrent/aux_/ffs.hpp"
 #include <limits>
-#include <cstring> // for memset
+#include <algorithm> // for min
+#include <cstring> // for memset and memcpy
 #include <cstdio> // for snprintf
 #include <cinttypes> // for PRId64 et.al.
 
+#include <boost/detail/endian.hpp> // for BIG_ENDIAN and LITTLE_ENDIAN macros
+
 #ifndef BOOST_SYSTEM_NOEXCEPT
 #define BOOST_SYSTEM_NOEXCEPT throw()
 #endif
@@ -100,11 +104,70 @@ namespace {
 		return start;
 	}
 
+	// loads 8 bytes as a little endian integer, i.e. the first byte ends up
+	// in the least significant position regardless of the host byte order
+	std::uint64_t load_le64(char const* p)
+	{
+		std::uint64_t ret;
+#if defined BOOST_LITTLE_ENDIAN
+		std::memcpy(&ret, p, sizeof(ret));
+#else
+		ret = 0;
+		for (int i = 7; i >= 0; --i)
+			ret = (ret << 8) | std::uint8_t(p[i]);
+#endif
+		return ret;
+	}
+
+	// returns the number of leading decimal digits among the 8 bytes at p,
+	// by classifying all of them at once
+	int leading_digits(char const* p)
+	{
+		std::uint64_t const ones = 0x0101010101010101ULL;
+		std::uint64_t const w = load_le64(p);
+		// for a digit, the high nibble is 3 and the low nibble is at most 9,
+		// i.e. adding 6 to it does not carry into the high nibble. Any byte
+		// that's not a digit has at least one bit set in "bad"
+		std::uint64_t const bad = ((w & (0xf0 * ones)) ^ (0x30 * ones))
+			| (((w & (0x0f * ones)) + 0x06 * ones) & (0xf0 * ones));
+		if (bad == 0) return 8;
+		// set the top bit of every byte that has any bit set, without
+		// carrying between bytes
+		std::uint64_t const mask = (((bad & (0x7f * ones)) + 0x7f * ones) | bad)
+			& (0x80 * ones);
+		std::uint32_t const low = std::uint32_t(mask);
+		int const bit = low != 0 ? aux::count_trailing_zeros(low)
+			: 32 + aux::count_trailing_zeros(std::uint32_t(mask >> 32));
+		return bit / 8;
+	}
+
+	// like check_integer(), but handles the common case of a short integer by
+	// examining 8 bytes at a time. Anything else (including all errors) is
+	// left to check_integer()
+	char const* check_integer_words(char const* start, char const* end
+		, bdecode_errors::error_code_enum& e)
+	{
+		// leave room for a '-' followed by 8 bytes
+		if (end - start >= 9)
+		{
+			char const* digits_start = start;
+			if (*digits_start == '-') ++digits_start;
+			int const digits = leading_digits(digits_start);
+			if (digits > 0 && digits < 8 && digits_start[digits] == 'e')
+				return digits_start + digits;
+		}
+		return check_integer(start, end, e);
+	}
+
 	struct stack_frame
 	{
-		explicit stack_frame(int const t): token(std::uint32_t(t)), state(0) {}
+		stack_frame(int const t, bool const d)
+			: token(std::uint32_t(t)), dict(d), state(0) {}
 		// this is an index into m_tokens
-		std::uint32_t token:31;
+		std::uint32_t token:30;
+		// set if this is a dictionary (as opposed to a list). This saves us
+		// from looking up the token for every item we parse
+		std::uint32_t dict:1;
 		// this is used for dictionaries to indicate whether we're
 		// reading a key or a vale. 0 means key 1 is value
 		std::uint32_t state:1;
@@ -119,6 +182,13 @@ namespace {
 
 	} // anonymous namespace
 
+namespace aux {
+
+	int count_leading_digits8(char const* p)
+	{
+		return leading_digits(p);
+	}
+}
 
 	// fills in 'val' with what the string between start and the
 	// first occurrence of the delimiter is interpreted as an int.
@@ -648,25 +718,44 @@ namespace {
 	} TORRENT_WHILE_0
 
 	int bdecode(char const* start, char const* end, bdecode_node& ret
-		, error_code& ec, int* error_pos, int const depth_limit, int token_limit)
+		, error_code& ec, int* error_pos, int const depth_limit, int const token_limit)
 	{
-		ret = bdecode({start, static_cast<size_t>(end - start)}, ec, error_pos, depth_limit, token_limit);
+		// decode straight into ret, rather than assigning it a new node. This
+		// lets callers that decode many messages into the same node (like the
+		// DHT) reuse the token vector instead of allocating a new one every time
+		aux::bdecode_impl({start, static_cast<size_t>(end - start)}, ret, ec
+			, error_pos, depth_limit, token_limit, true);
 		return ec ? -1 : 0;
 	}
 
 	bdecode_node bdecode(span<char const> buffer
-		, error_code& ec, int* error_pos, int depth_limit, int token_limit)
+		, error_code& ec, int* error_pos, int const depth_limit, int const token_limit)
 	{
 		bdecode_node ret;
+		aux::bdecode_impl(buffer, ret, ec, error_pos, depth_limit, token_limit, true);
+		return ret;
+	}
+
+	void aux::bdecode_impl(span<char const> buffer, bdecode_node& ret
+		, error_code& ec, int* error_pos, int const depth_limit, int token_limit
+		, bool const scan_words)
+	{
+		ret.clear();
 		ec.clear();
 
 		if (buffer.size() > bdecode_token::max_offset)
 		{
 			if (error_pos) *error_pos = 0;
 			ec = bdecode_errors::limit_exceeded;
-			return ret;
+			return;
 		}
 
+		// avoid growing the token vector one step at a time for small
+		// messages. Most tokens take up more than 8 bytes of the buffer, so
+		// this is usually enough for the whole message
+		if (ret.m_tokens.capacity() == 0)
+			ret.m_tokens.reserve(std::min(buffer.size() / 8 + 4, std::size_t(1024)));
+
 		// this is the stack of bdecode_token indices, into m_tokens.
 		// sp is the stack pointer, as index into the array, stack
 		int sp = 0;
@@ -698,8 +787,7 @@ namespace {
 
 			// if we're currently parsing a dictionary, assert that
 			// every other node is a string.
-			if (current_frame > 0
-				&& ret.m_tokens[stack[current_frame - 1].token].type == bdecode_token::dict)
+			if (current_frame > 0 && stack[current_frame - 1].dict)
 			{
 				if (stack[current_frame - 1].state == 0)
 				{
@@ -713,7 +801,7 @@ namespace {
 			switch (t)
 			{
 				case 'd':
-					stack[sp++] = stack_frame(int(ret.m_tokens.size()));
+					stack[sp++] = stack_frame(int(ret.m_tokens.size()), true);
 					// we push it into the stack so that we know where to fill
 					// in the next_node field once we pop this node off the stack.
 					// i.e. get to the node following the dictionary in the buffer
@@ -721,7 +809,7 @@ namespace {
 					++start;
 					break;
 				case 'l':
-					stack[sp++] = stack_frame(int(ret.m_tokens.size()));
+					stack[sp++] = stack_frame(int(ret.m_tokens.size()), false);
 					// we push it into the stack so that we know where to fill
 					// in the next_node field once we pop this node off the stack.
 					// i.e. get to the node following the list in the buffer
@@ -733,7 +821,9 @@ namespace {
 					char const* const int_start = start;
 					bdecode_errors::error_code_enum e = bdecode_errors::no_error;
 					// +1 here to point to the first digit, rather than 'i'
-					start = check_integer(start + 1, end, e);
+					start = scan_words
+						? check_integer_words(start + 1, end, e)
+						: check_integer(start + 1, end, e);
 					if (e)
 					{
 						// in order to gracefully terminate the tree,
@@ -757,9 +847,7 @@ namespace {
 					if (sp == 0)
 						TORRENT_FAIL_BDECODE(bdecode_errors::unexpected_eof);
 
-					if (sp > 0
-						&& ret.m_tokens[stack[sp - 1].token].type == bdecode_token::dict
-						&& stack[sp - 1].state == 1)
+					if (sp > 0 && stack[sp - 1].dict && stack[sp - 1].state == 1)
 					{
 						// this means we're parsing a dictionary and about to parse a
 						// value associated with a key. Instead, we got a termination
@@ -794,11 +882,25 @@ namespace {
 
 					std::int64_t len = t - '0';
 					char const* const str_start = start;
-					++start;
-					bdecode_errors::error_code_enum e = bdecode_errors::no_error;
-					start = parse_int(start, end, ':', len, e);
-					if (e)
-						TORRENT_FAIL_BDECODE(e);
+					int const digits = scan_words && end - start >= 8
+						? leading_digits(start) : 8;
+					if (digits < 8 && start[digits] == ':')
+					{
+						// the common case of a length prefix shorter than 8
+						// digits, all of them known to be valid. It cannot
+						// overflow
+						for (int i = 1; i < digits; ++i)
+							len = len * 10 + (start[i] - '0');
+						start += digits;
+					}
+					else
+					{
+						++start;
+						bdecode_errors::error_code_enum e = bdecode_errors::no_error;
+						start = parse_int(start, end, ':', len, e);
+						if (e)
+							TORRENT_FAIL_BDECODE(e);
+					}
 
 					// remaining buffer size excluding ':'
 					ptrdiff_t const buff_size = end - start - 1;
@@ -823,8 +925,7 @@ namespace {
 				}
 			}
 
-			if (current_frame > 0
-				&& ret.m_tokens[stack[current_frame - 1].token].type == bdecode_token::dict)
+			if (current_frame > 0 && stack[current_frame - 1].dict)
 			{
 				// the next item we parse is the opposite
 				stack[current_frame - 1].state = ~stack[current_frame - 1].state;
@@ -845,8 +946,7 @@ done:
 
 			// we may need to insert a dummy token to properly terminate the tree,
 			// in case we just parsed a key to a dict and failed in the value
-			if (ret.m_tokens[stack[sp].token].type == bdecode_token::dict
-				&& stack[sp].state == 1)
+			if (stack[sp].dict && stack[sp].state == 1)
 			{
 				// insert an empty dictionary as the value
 				ret.m_tokens.push_back({start - orig_start, 2, bdecode_token::dict});
@@ -865,8 +965,6 @@ done:
 		ret.m_buffer = orig_start;
 		ret.m_buffer_size = int(start - orig_start);
 		ret.m_root_tokens = ret.m_tokens.data();
-
-		return ret;
 	}
 
 	namespace {
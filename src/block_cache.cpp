@@ -414,6 +414,15 @@ void block_cache::cache_hit(cached_piece_entry* p, void* requester, bool volatil
 	// frequently requested, when in fact it's only a single peer
 	std::uint16_t target_queue = cached_piece_entry::read_lru2;
 
+	// pieces read ahead of a sequential reader don't have a requester. The
+	// first read from such piece is not a repeated use of it
+	if (p->last_requester == nullptr && requester != nullptr
+		&& p->cache_state == cached_piece_entry::read_lru1)
+	{
+		p->last_requester = requester;
+		return;
+	}
+
 	if (p->last_requester == requester || requester == nullptr)
 	{
 		// if it's the same requester and the piece isn't in
@@ -492,7 +492,12 @@ namespace {
 			peer_log(peer_log_alert::info, "ENCRYPTION", "initiating encrypted handshake");
 #endif
 
-		m_dh_key_exchange.reset(new (std::nothrow) dh_key_exchange);
+		dh_keypair kp;
+		bool const precomputed = m_ses.dh_keys().get(kp);
+		stats_counters().inc_stats_counter(precomputed
+			? counters::dh_keys_precomputed : counters::dh_keys_generated);
+
+		m_dh_key_exchange.reset(new (std::nothrow) dh_key_exchange(kp));
 		if (!m_dh_key_exchange || !m_dh_key_exchange->good())
 		{
 			disconnect(errors::no_memory, op_encryption);
@@ -1175,6 +1180,19 @@ namespace {
 			// has been received
 			start_receive_piece(p);
 			if (is_disconnecting()) return;
+
+			// unless the payload has been received already, receive the rest
+			// of it straight into a disk buffer. This saves copying it out of
+			// the receive buffer once it's complete
+			if (!merkle && p.length > 0
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+				&& m_enc_handler.is_recv_plaintext()
+#endif
+				&& m_recv_buffer.can_assign_disk_buffer())
+			{
+				disk_buffer_holder buffer = allocate_receive_buffer();
+				if (buffer) m_recv_buffer.assign_disk_buffer(std::move(buffer), p.length);
+			}
 		}
 
 		incoming_piece_fragment(piece_bytes);
@@ -1223,7 +1241,10 @@ namespace {
 			}
 		}
 
-		incoming_piece(p, recv_buffer.begin() + header_size);
+		if (m_recv_buffer.has_disk_buffer())
+			incoming_piece(p, m_recv_buffer.release_disk_buffer());
+		else
+			incoming_piece(p, recv_buffer.begin() + header_size);
 	}
 
 	// -----------------------------
@@ -33,21 +33,23 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/create_torrent.hpp"
 #include "libtorrent/utf8.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_to_wstring
-#include "libtorrent/disk_io_thread.hpp"
 #include "libtorrent/aux_/merkle.hpp" // for merkle_*()
 #include "libtorrent/torrent_info.hpp"
 #include "libtorrent/announce_entry.hpp"
-#include "libtorrent/performance_counters.hpp" // for counters
-#include "libtorrent/alert_manager.hpp"
 #include "libtorrent/aux_/path.hpp"
+#include "libtorrent/file.hpp"
+#include "libtorrent/error_code.hpp"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <functional>
 #include <memory>
-
-using namespace std::placeholders;
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring> // for memset
 
 namespace libtorrent {
 
@@ -158,44 +160,229 @@ namespace {
 			}
 		}
 
-		struct hash_state
+		// a range of pieces read by a reader thread, waiting to be hashed
+		struct read_chunk
 		{
+			piece_index_t first_piece;
+			int num_pieces;
+			std::vector<char> buffer;
+		};
+
+		// the state shared by the reader and hasher threads of one
+		// set_piece_hashes() call
+		struct hash_pipeline
+		{
+			hash_pipeline(create_torrent& t, std::string const& p
+				, int const chunk_pieces, int const buffers)
+				: ct(t)
+				, fs(t.files())
+				, path(p)
+				, pieces_per_chunk(chunk_pieces)
+				, num_chunks((fs.num_pieces() + chunk_pieces - 1) / chunk_pieces)
+				, max_buffered(buffers)
+			{}
+
 			create_torrent& ct;
-			storage_holder storage;
-			disk_io_thread& iothread;
-			piece_index_t piece_counter;
-			piece_index_t completed_piece;
-			std::function<void(piece_index_t)> const& f;
-			error_code& ec;
+			file_storage const& fs;
+			std::string const& path;
+			int const pieces_per_chunk;
+			int const num_chunks;
+
+			// the max number of chunks that have been claimed by a reader but
+			// not yet hashed
+			int const max_buffered;
+
+			// everything below is protected by this mutex
+			std::mutex mutex;
+
+			// signalled when a chunk is queued, when the last reader exits and
+			// on abort
+			std::condition_variable work_cond;
+
+			// signalled when a chunk has been hashed and its buffer freed, and
+			// on abort
+			std::condition_variable space_cond;
+
+			// signalled when pieces have completed, and on abort
+			std::condition_variable progress_cond;
+
+			// chunks read, in the order they completed
+			std::deque<read_chunk> queue;
+
+			// the index of the next chunk to read
+			int next_chunk = 0;
+
+			int buffered = 0;
+			int readers_running = 0;
+			int completed_pieces = 0;
+
+			// set on the first error, or when the caller gives up. All threads
+			// exit as soon as they see it
+			bool abort = false;
+			error_code error;
+
+			void fail(error_code const& ec)
+			{
+				std::lock_guard<std::mutex> l(mutex);
+				if (!error) error = ec;
+				abort = true;
+				work_cond.notify_all();
+				space_cond.notify_all();
+				progress_cond.notify_all();
+			}
 		};
 
-		void on_hash(piece_index_t const piece, sha1_hash const& piece_hash
-			, storage_error const& error, hash_state* st)
+		// read ``buf.size()`` bytes at torrent offset ``offset`` into ``buf``.
+		// ``f`` and ``open_file`` remember the file that was read last, since
+		// subsequent reads will most likely continue in the same file
+		void read_range(hash_pipeline& hp, file& f, file_index_t& open_file
+			, piece_index_t const piece, span<char> buf, error_code& ec)
 		{
-			if (error)
+			std::vector<file_slice> const slices = hp.fs.map_block(piece, 0
+				, int(buf.size()));
+			for (auto const& s : slices)
 			{
-				// on error
-				st->ec = error.ec;
-				st->iothread.abort(true);
-				return;
+				span<char> dst = buf.first(std::size_t(s.size));
+				buf = buf.subspan(std::size_t(s.size));
+
+				// pad files are not stored on disk, they're all zeros
+				if (hp.fs.pad_file_at(s.file_index))
+				{
+					std::memset(dst.data(), 0, dst.size());
+					continue;
+				}
+
+				if (open_file != s.file_index)
+				{
+					f.close();
+					open_file = file_index_t(-1);
+					if (!f.open(hp.fs.file_path(s.file_index, hp.path)
+						, file::read_only, ec))
+						return;
+					open_file = s.file_index;
+				}
+
+				std::int64_t file_offset = s.offset;
+				while (!dst.empty())
+				{
+					iovec_t iov;
+					iov.iov_base = dst.data();
+					iov.iov_len = dst.size();
+					std::int64_t const ret = f.readv(file_offset, iov, ec);
+					if (ec) return;
+					if (ret <= 0)
+					{
+						// the file is shorter than it's supposed to be
+						ec = errors::file_too_short;
+						return;
+					}
+					dst = dst.subspan(std::size_t(ret));
+					file_offset += ret;
+				}
 			}
-			st->ct.set_hash(piece, sha1_hash(piece_hash));
-			st->f(st->completed_piece);
-			++st->completed_piece;
-			if (st->piece_counter < st->ct.files().end_piece())
+		}
+
+		void reader_thread(hash_pipeline& hp)
+		{
+			file f;
+			file_index_t open_file(-1);
+			int const piece_length = hp.fs.piece_length();
+
+			for (;;)
 			{
-				st->iothread.async_hash(st->storage, st->piece_counter
-					, disk_interface::sequential_access
-					, std::bind(&on_hash, _1, _2, _3, st), nullptr);
-				++st->piece_counter;
+				int chunk;
+				{
+					std::unique_lock<std::mutex> l(hp.mutex);
+					hp.space_cond.wait(l, [&hp]
+						{ return hp.abort || hp.buffered < hp.max_buffered; });
+					if (hp.abort || hp.next_chunk == hp.num_chunks) break;
+					chunk = hp.next_chunk++;
+					++hp.buffered;
+				}
+
+				read_chunk c;
+				c.first_piece = piece_index_t(chunk * hp.pieces_per_chunk);
+				c.num_pieces = std::min(hp.pieces_per_chunk
+					, hp.fs.num_pieces() - static_cast<int>(c.first_piece));
+				std::int64_t const offset = std::int64_t(static_cast<int>(c.first_piece))
+					* piece_length;
+				std::int64_t const size = std::min(std::int64_t(c.num_pieces) * piece_length
+					, hp.fs.total_size() - offset);
+				c.buffer.resize(std::size_t(size));
+
+				error_code ec;
+				read_range(hp, f, open_file, c.first_piece, c.buffer, ec);
+				if (ec)
+				{
+					hp.fail(ec);
+					break;
+				}
+
+				std::lock_guard<std::mutex> l(hp.mutex);
+				hp.queue.push_back(std::move(c));
+				hp.work_cond.notify_one();
 			}
-			else
+
+			std::lock_guard<std::mutex> l(hp.mutex);
+			--hp.readers_running;
+			if (hp.readers_running == 0) hp.work_cond.notify_all();
+		}
+
+		void hasher_thread(hash_pipeline& hp)
+		{
+			for (;;)
 			{
-				st->iothread.abort(true);
+				read_chunk c;
+				{
+					std::unique_lock<std::mutex> l(hp.mutex);
+					hp.work_cond.wait(l, [&hp]
+						{ return hp.abort || !hp.queue.empty() || hp.readers_running == 0; });
+					if (hp.abort || hp.queue.empty()) break;
+					c = std::move(hp.queue.front());
+					hp.queue.pop_front();
+				}
+
+				char const* ptr = c.buffer.data();
+				piece_index_t const end(static_cast<int>(c.first_piece) + c.num_pieces);
+				for (piece_index_t i = c.first_piece; i < end; ++i)
+				{
+					int const size = hp.fs.piece_size(i);
+					// every thread sets different pieces
+					hp.ct.set_hash(i, hasher(ptr, size).final());
+					ptr += size;
+				}
+
+				std::lock_guard<std::mutex> l(hp.mutex);
+				--hp.buffered;
+				hp.completed_pieces += c.num_pieces;
+				hp.space_cond.notify_one();
+				hp.progress_cond.notify_one();
 			}
-			st->iothread.submit_jobs();
 		}
 
+		// makes sure all threads have exited before the pipeline they
+		// reference goes out of scope, even if the progress callback throws
+		struct join_threads
+		{
+			join_threads(hash_pipeline& p, std::vector<std::thread>& t)
+				: hp(p), threads(t) {}
+			~join_threads()
+			{
+				{
+					std::lock_guard<std::mutex> l(hp.mutex);
+					hp.abort = true;
+					hp.work_cond.notify_all();
+					hp.space_cond.notify_all();
+				}
+				for (auto& t : threads) t.join();
+			}
+			join_threads(join_threads const&) = delete;
+			join_threads& operator=(join_threads const&) = delete;
+
+			hash_pipeline& hp;
+			std::vector<std::thread>& threads;
+		};
+
 	} // anonymous namespace
 
 #if TORRENT_USE_WSTRING
@@ -248,9 +435,13 @@ namespace {
 	void set_piece_hashes(create_torrent& t, std::string const& p
 		, std::function<void(piece_index_t)> const& f, error_code& ec)
 	{
-		// optimized path
-		io_service ios;
+		set_piece_hashes(t, p, piece_hash_settings(), f, ec);
+	}
 
+	void set_piece_hashes(create_torrent& t, std::string const& p
+		, piece_hash_settings const& settings
+		, std::function<void(piece_index_t)> const& f, error_code& ec)
+	{
 #if TORRENT_USE_UNC_PATHS
 		std::string path = canonicalize_path(p);
 #else
@@ -269,35 +460,44 @@ namespace {
 			return;
 		}
 
-		counters cnt;
-		disk_io_thread disk_thread(ios, cnt);
-
-		storage_params params;
-		params.files = &t.files();
-		params.mapped_files = nullptr;
-		params.path = path;
-		params.mode = storage_mode_sparse;
-
-		storage_holder storage = disk_thread.new_torrent(default_storage_constructor, std::move(params), std::shared_ptr<void>());
-
-		settings_pack sett;
-		sett.set_int(settings_pack::cache_size, 0);
-		sett.set_int(settings_pack::aio_threads, 1);
-
-		disk_thread.set_settings(&sett);
-
-		int const piece_read_ahead = std::max(1, 15 * 1024 * 1024 / t.piece_length());
-
-		hash_state st = { t, std::move(storage), disk_thread, piece_index_t(0), piece_index_t(0), f, ec };
-		for (piece_index_t i(0); i < piece_index_t(piece_read_ahead); ++i)
+		int const piece_length = t.piece_length();
+		int const num_readers = std::max(1, settings.reader_threads);
+		int const num_hashers = settings.hasher_threads > 0
+			? settings.hasher_threads
+			: std::max(1, int(std::thread::hardware_concurrency()));
+		int const chunk_pieces = std::max(1
+			, (settings.read_size + piece_length - 1) / piece_length);
+		int const num_pieces = t.files().num_pieces();
+
+		hash_pipeline hp(t, path, chunk_pieces, num_readers + num_hashers);
+		hp.readers_running = num_readers;
+
+		std::vector<std::thread> threads;
+		threads.reserve(std::size_t(num_readers + num_hashers));
+		join_threads join(hp, threads);
+		for (int i = 0; i < num_readers; ++i)
+			threads.emplace_back(&reader_thread, std::ref(hp));
+		for (int i = 0; i < num_hashers; ++i)
+			threads.emplace_back(&hasher_thread, std::ref(hp));
+
+		// report progress on this thread, as the pieces complete
+		int reported = 0;
+		std::unique_lock<std::mutex> l(hp.mutex);
+		for (;;)
 		{
-			disk_thread.async_hash(st.storage, i, disk_interface::sequential_access
-				, std::bind(&on_hash, _1, _2, _3, &st), nullptr);
-			++st.piece_counter;
-			if (st.piece_counter >= t.files().end_piece()) break;
+			hp.progress_cond.wait(l, [&]
+				{ return hp.abort || hp.completed_pieces > reported; });
+			int const completed = hp.completed_pieces;
+			bool const done = hp.abort || completed == num_pieces;
+			l.unlock();
+			for (; reported < completed; ++reported)
+				f(piece_index_t(reported));
+			if (done) break;
+			l.lock();
 		}
-		disk_thread.submit_jobs();
-		ios.run(ec);
+
+		l.lock();
+		ec = hp.error;
 	}
 
 	create_torrent::~create_torrent() = default;
@@ -54,6 +54,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/array.hpp"
 
 #include <functional>
+#include <algorithm>
 
 #include <boost/variant/get.hpp>
 
@@ -183,6 +184,12 @@ namespace libtorrent {
 	scoped_unlocker_impl<Lock> scoped_unlock(Lock& l)
 	{ return scoped_unlocker_impl<Lock>(l); }
 
+	// the bounds (in blocks) and the latency target for the size of the
+	// writes issued by flush_coalesced()
+	int const min_flush_batch_blocks = 64;
+	int const max_flush_batch_blocks = 1024;
+	time_duration const flush_latency_target = milliseconds(100);
+
 	} // anonymous namespace
 
 // ------- disk_io_thread ------
@@ -195,6 +202,7 @@ namespace libtorrent {
 		, m_hash_io_jobs(*this)
 		, m_hash_threads(m_hash_io_jobs, ios)
 		, m_disk_cache(block_size, ios, std::bind(&disk_io_thread::trigger_cache_trim, this))
+		, m_flush_batch_blocks(min_flush_batch_blocks)
 		, m_stats_counters(cnt)
 		, m_ios(ios)
 	{
@@ -225,6 +233,7 @@ namespace libtorrent {
 			storage_index_t const idx = m_torrents.end_index();
 			m_torrents.emplace_back(std::move(storage));
 			m_torrents.back()->set_storage_index(idx);
+			m_read_ahead.emplace_back();
 			return storage_holder(idx, *this);
 		}
 		else
@@ -232,6 +241,7 @@ namespace libtorrent {
 			storage_index_t const idx = m_free_slots.back();
 			m_free_slots.pop_back();
 			(m_torrents[idx] = std::move(storage))->set_storage_index(idx);
+			m_read_ahead[idx] = aux::read_ahead_predictor();
 			return storage_holder(idx, *this);
 		}
 	}
@@ -808,6 +818,109 @@ namespace libtorrent {
 		return iov_len;
 	}
 
+	int disk_io_thread::flush_coalesced(span<cached_piece_entry*> pieces
+		, jobqueue_t& completed_jobs, std::unique_lock<std::mutex>& l)
+	{
+		TORRENT_ASSERT(l.owns_lock());
+		if (pieces.empty()) return 0;
+
+		std::sort(pieces.begin(), pieces.end()
+			, [](cached_piece_entry const* lhs, cached_piece_entry const* rhs)
+			{
+				if (lhs->storage != rhs->storage)
+					return std::less<storage_interface*>()(lhs->storage.get(), rhs->storage.get());
+				return lhs->piece < rhs->piece;
+			});
+
+		// a run is never larger than max_flush_batch_blocks, unless it's a
+		// single piece larger than that
+		int max_run_blocks = max_flush_batch_blocks;
+		for (auto pe : pieces)
+			max_run_blocks = std::max(max_run_blocks, int(pe->blocks_in_piece));
+
+		TORRENT_ALLOCA(iov, iovec_t, max_run_blocks);
+		TORRENT_ALLOCA(flushing, int, max_run_blocks);
+		// this is the offset into iov and flushing for each piece of the run
+		TORRENT_ALLOCA(iovec_offset, int, max_flush_batch_blocks + 1);
+
+		int const num_pieces = int(pieces.size());
+		int ret = 0;
+		int i = 0;
+		while (i < num_pieces)
+		{
+			cached_piece_entry* const first = pieces[i];
+			int const blocks_in_piece = first->blocks_in_piece;
+
+			// find the run of adjacent pieces starting at i. Only the last
+			// piece of a torrent may have fewer blocks, and it can only be
+			// last in a run, so every piece in the run starts at a multiple
+			// of blocks_in_piece blocks from the first one
+			int end = i + 1;
+			int run_blocks = blocks_in_piece;
+			while (end < num_pieces
+				&& pieces[end]->storage == first->storage
+				&& static_cast<int>(pieces[end]->piece) == static_cast<int>(pieces[end - 1]->piece) + 1
+				&& run_blocks + blocks_in_piece <= m_flush_batch_blocks)
+			{
+				run_blocks += blocks_in_piece;
+				++end;
+			}
+
+			int iov_len = 0;
+			for (int k = i; k < end; ++k)
+			{
+				cached_piece_entry* pe = pieces[k];
+				iovec_offset[k - i] = iov_len;
+				if (pe->num_dirty == 0) continue;
+#if TORRENT_USE_ASSERTS
+				pe->piece_log.push_back(piece_log_t(piece_log_t::flush_range, -1));
+#endif
+				iov_len += build_iovec(pe, 0, pe->blocks_in_piece
+					, iov.subspan(iov_len), flushing.subspan(iov_len)
+					, (k - i) * blocks_in_piece);
+			}
+			iovec_offset[end - i] = iov_len;
+
+			if (iov_len > 0)
+			{
+				storage_error error;
+				time_point const start_time = clock_type::now();
+				{
+					// unlock while we're performing the actual disk I/O
+					// then lock again
+					auto unlock = scoped_unlock(l);
+					flush_iovec(first, iov, flushing, iov_len, error);
+				}
+				time_duration const elapsed = clock_type::now() - start_time;
+
+				for (int k = i; k < end; ++k)
+				{
+					int const block_diff = iovec_offset[k - i + 1] - iovec_offset[k - i];
+					if (block_diff == 0) continue;
+					iovec_flushed(pieces[k], flushing.subspan(iovec_offset[k - i]).data()
+						, block_diff, (k - i) * blocks_in_piece, error, completed_jobs);
+				}
+				ret += iov_len;
+
+				// a short run (because the pieces weren't adjacent) doesn't tell
+				// us whether a larger one would still be fast enough
+				if (elapsed > flush_latency_target)
+					m_flush_batch_blocks = std::max(m_flush_batch_blocks / 2, min_flush_batch_blocks);
+				else if (elapsed < flush_latency_target / 2
+					&& run_blocks + blocks_in_piece > m_flush_batch_blocks)
+					m_flush_batch_blocks = std::min(m_flush_batch_blocks * 2, max_flush_batch_blocks);
+			}
+			i = end;
+		}
+
+		// if the cache is under high pressure, we need to evict
+		// the blocks we just flushed to make room for more write pieces
+		int const evict = m_disk_cache.num_to_evict(0);
+		if (evict > 0) m_disk_cache.try_evict_blocks(evict);
+
+		return ret;
+	}
+
 	void disk_io_thread::fail_jobs(storage_error const& e, jobqueue_t& jobs_)
 	{
 		jobqueue_t jobs;
@@ -877,6 +990,30 @@ namespace libtorrent {
 				piece_index.push_back(p->piece);
 			}
 
+			if ((flags & flush_write_cache) && !(flags & flush_delete_cache))
+			{
+				// write out all dirty pieces in offset order first, so that
+				// adjacent pieces end up in the same write
+				std::vector<cached_piece_entry*> dirty;
+				for (auto idx : piece_index)
+				{
+					cached_piece_entry* pe = m_disk_cache.find_piece(storage, idx);
+					if (pe == nullptr || pe->num_dirty == 0) continue;
+#if TORRENT_USE_ASSERTS
+					pe->piece_log.push_back(piece_log_t(piece_log_t::flushing, -1));
+#endif
+					++pe->piece_refcount;
+					dirty.push_back(pe);
+				}
+				flush_coalesced(dirty, completed_jobs, l);
+				for (auto pe : dirty)
+				{
+					TORRENT_PIECE_ASSERT(pe->piece_refcount > 0, pe);
+					--pe->piece_refcount;
+					m_disk_cache.maybe_free_piece(pe);
+				}
+			}
+
 			for (auto idx : piece_index)
 			{
 				cached_piece_entry* pe = m_disk_cache.find_piece(storage, idx);
@@ -977,7 +1114,10 @@ namespace libtorrent {
 		if (num == 0 || m_stats_counters[counters::num_writing_threads] > 0) return;
 
 		// if we still need to flush blocks, start over and flush
-		// everything in LRU order (degrade to lru cache eviction)
+		// everything (degrade to lru cache eviction). The pieces are written
+		// in offset order rather than LRU order, to coalesce adjacent ones
+		std::vector<cached_piece_entry*> to_flush;
+		to_flush.reserve(pieces.size());
 		for (auto const& p : pieces)
 		{
 			cached_piece_entry* pe = m_disk_cache.find_piece(p.first, p.second);
@@ -995,10 +1135,15 @@ namespace libtorrent {
 			pe->piece_log.push_back(piece_log_t(piece_log_t::try_flush_write_blocks2, -1));
 #endif
 			++pe->piece_refcount;
+			to_flush.push_back(pe);
+		}
 
-			num -= flush_range(pe, 0, INT_MAX, completed_jobs, l);
-			--pe->piece_refcount;
+		flush_coalesced(to_flush, completed_jobs, l);
 
+		for (auto pe : to_flush)
+		{
+			TORRENT_PIECE_ASSERT(pe->piece_refcount > 0, pe);
+			--pe->piece_refcount;
 			m_disk_cache.maybe_free_piece(pe);
 		}
 	}
@@ -1042,9 +1187,10 @@ namespace libtorrent {
 			if (num_flush == 200) break;
 		}
 
+		flush_coalesced({to_flush.data(), std::size_t(num_flush)}, completed_jobs, l);
+
 		for (int i = 0; i < num_flush; ++i)
 		{
-			flush_range(to_flush[i], 0, INT_MAX, completed_jobs, l);
 			TORRENT_ASSERT(to_flush[i]->piece_refcount > 0);
 			--to_flush[i]->piece_refcount;
 			m_disk_cache.maybe_free_piece(to_flush[i]);
@@ -1264,8 +1410,10 @@ namespace libtorrent {
 		int const block_size = m_disk_cache.block_size();
 		int const piece_size = j->storage->files().piece_size(j->piece);
 		int const blocks_in_piece = (piece_size + block_size - 1) / block_size;
+		// read-ahead jobs read the whole piece
 		int const iov_len = m_disk_cache.pad_job(j, blocks_in_piece
-			, m_settings.get_int(settings_pack::read_cache_line_size));
+			, (j->flags & disk_io_job::read_ahead) ? INT_MAX
+			: m_settings.get_int(settings_pack::read_cache_line_size));
 
 		TORRENT_ALLOCA(iov, iovec_t, iov_len);
 
@@ -1278,6 +1426,8 @@ namespace libtorrent {
 		if (pe == nullptr)
 		{
 			l.unlock();
+			// there's no point in reading ahead past the cache
+			if (j->flags & disk_io_job::read_ahead) return status_t::no_error;
 			return do_uncached_read(j);
 		}
 		TORRENT_PIECE_ASSERT(pe->outstanding_read == 1, pe);
@@ -1289,7 +1439,8 @@ namespace libtorrent {
 
 		if (ret < 0)
 		{
-			status_t const s = do_uncached_read(j);
+			status_t const s = (j->flags & disk_io_job::read_ahead)
+				? status_t::no_error : do_uncached_read(j);
 
 			std::unique_lock<std::mutex> l2(m_cache_mutex);
 			pe = m_disk_cache.find_piece(j);
@@ -1594,6 +1745,64 @@ namespace libtorrent {
 				add_job(j);
 				break;
 		}
+
+		maybe_read_ahead(storage, r.piece, ret != 1, flags);
+	}
+
+	void disk_io_thread::maybe_read_ahead(storage_index_t const storage
+		, piece_index_t const piece, bool const hit, std::uint8_t const flags)
+	{
+		if (!m_settings.get_bool(settings_pack::use_read_cache)
+			|| m_settings.get_int(settings_pack::cache_size) == 0)
+			return;
+
+		std::shared_ptr<storage_interface> const st = m_torrents[storage]->shared_from_this();
+		file_storage const& fs = st->files();
+
+		// don't let a single stream take up more than a quarter of the cache
+		int const blocks_per_piece = (fs.piece_length() + m_disk_cache.block_size() - 1)
+			/ m_disk_cache.block_size();
+		int const max_pieces = std::min(m_settings.get_int(settings_pack::read_ahead_pieces)
+			, m_disk_cache.max_use() / 4 / blocks_per_piece);
+
+		aux::read_ahead_predictor::decision const d = m_read_ahead[storage].on_read(
+			piece, hit, (flags & disk_interface::sequential_access) != 0
+			, max_pieces, fs.end_piece());
+
+		if (d.read_ahead)
+		{
+			m_stats_counters.inc_stats_counter(hit
+				? counters::num_read_ahead_hits : counters::num_read_ahead_misses);
+		}
+
+		for (piece_index_t p = d.first; p < d.end; ++p)
+		{
+			disk_io_job* j = allocate_job(disk_io_job::read);
+			j->storage = st;
+			j->piece = p;
+			j->d.io.offset = 0;
+			j->d.io.buffer_size = std::uint16_t(std::min(fs.piece_size(p)
+				, m_disk_cache.block_size()));
+			j->argument = disk_buffer_holder(*this, nullptr);
+			// there's no handler to call, the callback is left empty
+			j->flags = disk_io_job::read_ahead | disk_interface::sequential_access;
+
+			std::unique_lock<std::mutex> l(m_cache_mutex);
+			// pieces that are already (partially) cached are left alone, not
+			// to disturb their place in the cache
+			if (m_disk_cache.find_piece(j) != nullptr)
+			{
+				l.unlock();
+				free_job(j);
+				continue;
+			}
+			int const ret = prep_read_job_impl(j);
+			l.unlock();
+
+			if (ret == 0) free_job(j);
+			else if (ret == 1) add_job(j);
+			m_stats_counters.inc_stats_counter(counters::num_read_ahead_pieces);
+		}
 	}
 
 	// this function checks to see if a read job is a cache hit,
@@ -1685,6 +1894,34 @@ namespace libtorrent {
 		if (!buffer) aux::throw_ex<std::bad_alloc>();
 		std::memcpy(buffer.get(), buf, aux::numeric_cast<std::size_t>(r.length));
 
+		async_write(storage, r, std::move(buffer), std::move(handler), flags);
+		return exceeded;
+	}
+
+	disk_buffer_holder disk_io_thread::allocate_receive_buffer(
+		std::shared_ptr<disk_observer> o)
+	{
+		bool exceeded = false;
+		disk_buffer_holder buffer(*this, m_disk_cache.allocate_buffer(exceeded, o, "receive buffer"));
+
+		// if the cache is full, let the caller take the regular path, which
+		// will block the peer until it drains
+		if (exceeded) buffer.reset();
+		return buffer;
+	}
+
+	void disk_io_thread::async_write(storage_index_t const storage, peer_request const& r
+		, disk_buffer_holder buffer
+		, std::function<void(storage_error const&)> handler
+		, std::uint8_t const flags)
+	{
+		TORRENT_ASSERT(r.length <= m_disk_cache.block_size());
+		TORRENT_ASSERT(r.length <= 16 * 1024);
+		TORRENT_ASSERT(buffer);
+
+		m_stats_counters.inc_stats_counter(counters::num_write_batches);
+		m_stats_counters.inc_stats_counter(counters::num_write_batch_blocks);
+
 		disk_io_job* j = allocate_job(disk_io_job::write);
 		j->storage = m_torrents[storage]->shared_from_this();
 		j->piece = r.piece;
@@ -1733,7 +1970,7 @@ namespace libtorrent {
 			DLOG("blocked job: %s (torrent: %d total: %d)\n"
 				, job_action_name[j->action], j->storage ? j->storage->num_blocked() : 0
 				, int(m_stats_counters[counters::blocked_disk_jobs]));
-			return exceeded;
+			return;
 		}
 
 		std::unique_lock<std::mutex> l(m_cache_mutex);
@@ -1759,12 +1996,88 @@ namespace libtorrent {
 
 			// if we added the block (regardless of whether we also
 			// issued a flush job or not), we're done.
-			return exceeded;
+			return;
 		}
 		l.unlock();
 
 		add_job(j);
-		return exceeded;
+	}
+
+	void disk_io_thread::async_write_blocks(storage_index_t const storage
+		, span<disk_write_block> blocks, std::uint8_t const flags)
+	{
+		if (blocks.empty()) return;
+
+		m_stats_counters.inc_stats_counter(counters::num_write_batches);
+		m_stats_counters.inc_stats_counter(counters::num_write_batch_blocks
+			, int(blocks.size()));
+
+		TORRENT_ALLOCA(jobs, disk_io_job*, blocks.size());
+		if (!allocate_jobs(disk_io_job::write, jobs)) aux::throw_ex<std::bad_alloc>();
+
+		std::shared_ptr<storage_interface> st = m_torrents[storage]->shared_from_this();
+		piece_index_t const piece = blocks[0].r.piece;
+		for (std::size_t i = 0; i < blocks.size(); ++i)
+		{
+			disk_write_block& b = blocks[i];
+			TORRENT_ASSERT(b.r.piece == piece);
+			TORRENT_ASSERT(i == 0 || b.r.start == blocks[i - 1].r.start + blocks[i - 1].r.length);
+			TORRENT_ASSERT(b.r.length <= m_disk_cache.block_size());
+			TORRENT_ASSERT((b.r.start % m_disk_cache.block_size()) == 0);
+			TORRENT_ASSERT(b.buffer);
+
+			disk_io_job* j = jobs[i];
+			j->storage = st;
+			j->piece = piece;
+			j->d.io.offset = b.r.start;
+			j->d.io.buffer_size = std::uint16_t(b.r.length);
+			j->argument = std::move(b.buffer);
+			j->callback = std::move(b.handler);
+			j->flags = flags;
+		}
+
+		// jobs that couldn't be inserted into the cache are queued one by one,
+		// like in async_write(). Blocked jobs are held by the storage and
+		// released once its fence is lowered
+		int num_unblocked = 0;
+		for (disk_io_job* j : jobs)
+		{
+			if (j->storage->is_blocked(j))
+			{
+				m_stats_counters.inc_stats_counter(counters::blocked_disk_jobs);
+				continue;
+			}
+			jobs[std::size_t(num_unblocked++)] = j;
+		}
+
+		int num_uncached = 0;
+		cached_piece_entry* dpe = nullptr;
+		std::unique_lock<std::mutex> l(m_cache_mutex);
+		for (int i = 0; i < num_unblocked; ++i)
+		{
+			disk_io_job* j = jobs[std::size_t(i)];
+			TORRENT_ASSERT(m_disk_cache.find_piece(j) == nullptr
+				|| m_disk_cache.find_piece(j)->hashing_done == 0);
+			cached_piece_entry* const pe = m_disk_cache.add_dirty_block(j);
+			if (pe) dpe = pe;
+			else jobs[std::size_t(num_uncached++)] = j;
+		}
+
+		bool const flush = dpe != nullptr && dpe->outstanding_flush == 0;
+		if (flush) dpe->outstanding_flush = 1;
+		l.unlock();
+
+		if (flush)
+		{
+			disk_io_job* j = allocate_job(disk_io_job::flush_hashed);
+			j->storage = st;
+			j->piece = piece;
+			j->flags = flags;
+			add_job(j);
+		}
+
+		for (int i = 0; i < num_uncached; ++i)
+			add_job(jobs[std::size_t(i)]);
 	}
 
 	void disk_io_thread::async_hash(storage_index_t const storage
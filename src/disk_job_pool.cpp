@@ -68,6 +68,36 @@ namespace libtorrent {
 		return ptr;
 	}
 
+	bool disk_job_pool::allocate_jobs(int const type, span<disk_io_job*> jobs)
+	{
+		std::unique_lock<std::mutex> l(m_job_mutex);
+		for (std::size_t i = 0; i < jobs.size(); ++i)
+		{
+			jobs[i] = static_cast<disk_io_job*>(m_job_pool.malloc());
+			if (jobs[i] == nullptr)
+			{
+				for (std::size_t k = 0; k < i; ++k) m_job_pool.free(jobs[k]);
+				return false;
+			}
+		}
+		m_job_pool.set_next_size(100);
+		int const num = int(jobs.size());
+		m_jobs_in_use += num;
+		if (type == disk_io_job::read) m_read_jobs += num;
+		else if (type == disk_io_job::write) m_write_jobs += num;
+		l.unlock();
+
+		for (disk_io_job*& j : jobs)
+		{
+			new (j) disk_io_job;
+			j->action = static_cast<disk_io_job::action_t>(type);
+#if TORRENT_USE_ASSERTS
+			j->in_use = true;
+#endif
+		}
+		return true;
+	}
+
 	void disk_job_pool::free_job(disk_io_job* j)
 	{
 		TORRENT_ASSERT(j);
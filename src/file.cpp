@@ -499,13 +499,17 @@ namespace libtorrent {
 	bool file::has_manage_volume_privs = get_manage_volume_privs();
 #endif
 
+	constexpr int file::direct_io_alignment;
+
 	file::file()
 		: m_file_handle(INVALID_HANDLE_VALUE)
+		, m_direct_handle(INVALID_HANDLE_VALUE)
 		, m_open_mode(0)
 	{}
 
 	file::file(std::string const& path, std::uint32_t const mode, error_code& ec)
 		: m_file_handle(INVALID_HANDLE_VALUE)
+		, m_direct_handle(INVALID_HANDLE_VALUE)
 		, m_open_mode(0)
 	{
 		// the return value is not important, since the
@@ -660,6 +664,18 @@ namespace libtorrent {
 		}
 #endif
 
+#ifdef O_DIRECT
+		if (mode & direct_io)
+		{
+			// reads and writes that are not suitably aligned are performed
+			// through the normal handle. If the filesystem doesn't support
+			// O_DIRECT, all of them are
+			m_direct_handle = ::open(file_path.c_str()
+				, mode_array[mode & rw_mask] | open_mode | O_DIRECT
+				, permissions);
+		}
+#endif
+
 #ifdef F_NOCACHE
 		// for BSD/Mac
 		if (mode & no_cache)
@@ -672,6 +688,14 @@ namespace libtorrent {
 			fcntl(native_handle(), F_NODIRECT, &yes);
 #endif
 		}
+#ifndef O_DIRECT
+		else if (mode & direct_io)
+		{
+			// F_NOCACHE makes aligned reads and writes bypass the cache
+			int yes = 1;
+			fcntl(native_handle(), F_NOCACHE, &yes);
+		}
+#endif
 #endif
 
 #ifdef POSIX_FADV_RANDOM
@@ -781,9 +805,12 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 #else
 		if (m_file_handle != INVALID_HANDLE_VALUE)
 			::close(m_file_handle);
+		if (m_direct_handle != INVALID_HANDLE_VALUE)
+			::close(m_direct_handle);
 #endif
 
 		m_file_handle = INVALID_HANDLE_VALUE;
+		m_direct_handle = INVALID_HANDLE_VALUE;
 
 		m_open_mode = 0;
 	}
@@ -946,6 +973,78 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 #endif // USE_PREADV
 	}
 
+#ifdef O_DIRECT
+	// performs as much as possible of the operation through the direct I/O
+	// handle. That's the leading buffers whose addresses and sizes are
+	// aligned, provided the file offset is aligned. The remainder is
+	// performed through the normal handle
+	template <class Fun>
+	std::int64_t direct_iov(Fun f, handle_type const direct_fd, handle_type const fd
+		, std::int64_t const file_offset, span<iovec_t const> bufs, error_code& ec)
+	{
+		std::size_t const mask = std::size_t(file::direct_io_alignment - 1);
+
+		TORRENT_ALLOCA(direct, iovec_t, bufs.size());
+		std::size_t num_direct = 0;
+		std::size_t direct_bytes = 0;
+		if ((std::size_t(file_offset) & mask) == 0)
+		{
+			for (auto const& b : bufs)
+			{
+				if ((reinterpret_cast<std::uintptr_t>(b.iov_base) & mask) != 0) break;
+				std::size_t const len = b.iov_len & ~mask;
+				if (len == 0) break;
+				direct[num_direct].iov_base = b.iov_base;
+				direct[num_direct].iov_len = len;
+				++num_direct;
+				direct_bytes += len;
+				if (len != b.iov_len) break;
+			}
+		}
+
+		std::int64_t ret = 0;
+		if (num_direct > 0)
+		{
+			ret = iov(f, direct_fd, file_offset
+				, span<iovec_t const>(direct.data(), num_direct), ec);
+			if (ret < 0)
+			{
+				// the device may require a larger alignment than we assume.
+				// Fall back to the normal handle
+				if (ec != boost::system::errc::invalid_argument) return -1;
+				ec.clear();
+				return iov(f, fd, file_offset, bufs, ec);
+			}
+
+			// a short read means we hit the end of the file
+			if (ret < std::int64_t(direct_bytes)) return ret;
+		}
+
+		// the unaligned remainder
+		TORRENT_ALLOCA(rest, iovec_t, bufs.size());
+		std::size_t num_rest = 0;
+		std::size_t skip = direct_bytes;
+		for (auto const& b : bufs)
+		{
+			if (skip >= b.iov_len)
+			{
+				skip -= b.iov_len;
+				continue;
+			}
+			rest[num_rest].iov_base = static_cast<char*>(b.iov_base) + skip;
+			rest[num_rest].iov_len = b.iov_len - skip;
+			++num_rest;
+			skip = 0;
+		}
+		if (num_rest == 0) return ret;
+
+		std::int64_t const tail = iov(f, fd, file_offset + ret
+			, span<iovec_t const>(rest.data(), num_rest), ec);
+		if (tail < 0) return -1;
+		return ret + tail;
+	}
+#endif // O_DIRECT
+
 	} // anonymous namespace
 
 	// this has to be thread safe and atomic. i.e. on posix systems it has to be
@@ -966,6 +1065,19 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		TORRENT_ASSERT(!bufs.empty());
 		TORRENT_ASSERT(is_open());
 
+#ifdef O_DIRECT
+		if (m_direct_handle != INVALID_HANDLE_VALUE)
+		{
+#if TORRENT_USE_PREADV
+			return direct_iov(&::preadv, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#elif TORRENT_USE_PREAD
+			return direct_iov(&::pread, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#else
+			return direct_iov(&::read, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#endif
+		}
+#endif
+
 #if TORRENT_USE_PREADV
 		TORRENT_UNUSED(flags);
 
@@ -1022,6 +1134,19 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 
 		ec.clear();
 
+#ifdef O_DIRECT
+		if (m_direct_handle != INVALID_HANDLE_VALUE)
+		{
+#if TORRENT_USE_PREADV
+			return direct_iov(&::pwritev, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#elif TORRENT_USE_PREAD
+			return direct_iov(&::pwrite, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#else
+			return direct_iov(&::write, m_direct_handle, native_handle(), file_offset, bufs, ec);
+#endif
+		}
+#endif
+
 #if TORRENT_USE_PREADV
 		TORRENT_UNUSED(flags);
 
@@ -1352,6 +1477,59 @@ typedef struct _FILE_ALLOCATED_RANGE_BUFFER {
 		return start;
 #else
 		return start;
+#endif
+	}
+
+	bool file::punch_hole(std::int64_t const offset, std::int64_t const len
+		, error_code& ec)
+	{
+		TORRENT_ASSERT(offset >= 0);
+		TORRENT_ASSERT(len >= 0);
+		TORRENT_ASSERT(is_open());
+		if (len == 0) return true;
+
+#ifdef TORRENT_WINDOWS
+		// this only deallocates the range if the file is sparse. i.e. it was
+		// opened with the sparse flag
+		FILE_ZERO_DATA_INFORMATION zero;
+		zero.FileOffset.QuadPart = offset;
+		zero.BeyondFinalZero.QuadPart = offset + len;
+		DWORD temp;
+		overlapped_t ol;
+		BOOL const ret = ::DeviceIoControl(native_handle(), FSCTL_SET_ZERO_DATA
+			, &zero, sizeof(zero), 0, 0, &temp, &ol.ol);
+		if (ret == FALSE)
+		{
+			DWORD const error = GetLastError();
+			if (error != ERROR_IO_PENDING)
+			{
+				ec.assign(error, system_category());
+				return false;
+			}
+			if (ol.wait(native_handle(), ec) == -1) return false;
+		}
+		return true;
+#elif defined FALLOC_FL_PUNCH_HOLE
+		if (fallocate(native_handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE
+			, offset, len) != 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		return true;
+#elif defined F_PUNCHHOLE
+		fpunchhole_t hole = {};
+		hole.fp_offset = offset;
+		hole.fp_length = len;
+		if (fcntl(native_handle(), F_PUNCHHOLE, &hole) != 0)
+		{
+			ec.assign(errno, system_category());
+			return false;
+		}
+		return true;
+#else
+		ec.assign(boost::system::errc::operation_not_supported, generic_category());
+		return false;
 #endif
 	}
 }
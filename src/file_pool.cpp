@@ -44,12 +44,25 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <limits>
+#include <algorithm>
 
 namespace libtorrent {
 
+	constexpr int file_pool::num_shards;
+
 	file_pool::file_pool(int size) : m_size(size) {}
 	file_pool::~file_pool() = default;
 
+	file_pool::shard& file_pool::shard_for(storage_index_t const st
+		, file_index_t const file_index)
+	{
+		// spread the files of a single storage over all shards too
+		std::uint32_t h = static_cast<std::uint32_t>(st) * 0x9e3779b1U
+			+ std::uint32_t(static_cast<int>(file_index));
+		h ^= h >> 16;
+		return m_shards[h & (num_shards - 1)];
+	}
+
 #ifdef TORRENT_WINDOWS
 	void set_low_priority(file_handle const& f)
 	{
@@ -108,24 +121,34 @@ namespace libtorrent {
 		// time. We don't want to hold the std::mutex for that.
 		file_handle defer_destruction;
 
-		std::unique_lock<std::mutex> l(m_mutex);
-
 #if TORRENT_USE_ASSERTS
-		// we're not allowed to open a file
-		// from a deleted storage!
-		TORRENT_ASSERT(std::find(m_deleted_storages.begin(), m_deleted_storages.end()
-			, std::make_pair(fs.name(), static_cast<void const*>(&fs)))
-			== m_deleted_storages.end());
+		{
+			// we're not allowed to open a file
+			// from a deleted storage!
+			std::lock_guard<std::mutex> l(m_deleted_mutex);
+			TORRENT_ASSERT(std::find(m_deleted_storages.begin(), m_deleted_storages.end()
+				, std::make_pair(fs.name(), static_cast<void const*>(&fs)))
+				== m_deleted_storages.end());
+		}
 #endif
 
 		TORRENT_ASSERT(is_complete(p));
 		TORRENT_ASSERT((m & file::rw_mask) == file::read_only
 			|| (m & file::rw_mask) == file::read_write);
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i != m_files.end())
+
+		shard& s = shard_for(st, file_index);
+		std::unique_lock<std::mutex> l(s.mutex);
+
+		auto const i = s.files.find(std::make_pair(st, file_index));
+		if (i != s.files.end())
 		{
 			lru_file_entry& e = i->second;
 			e.last_use = aux::time_now();
+			if (s.lru.front() != &e)
+			{
+				s.lru.erase(&e);
+				s.lru.push_front(&e);
+			}
 
 			// if we asked for a file in write mode,
 			// and the cached file is is not opened in
@@ -152,30 +175,34 @@ namespace libtorrent {
 			return e.file_ptr;
 		}
 
-		lru_file_entry e;
-		e.file_ptr = std::make_shared<file>();
-		if (!e.file_ptr)
+		file_handle file_ptr = std::make_shared<file>();
+		if (!file_ptr)
 		{
 			ec = error_code(boost::system::errc::not_enough_memory, generic_category());
 			return file_handle();
 		}
 		std::string full_path = fs.file_path(file_index, p);
-		if (!e.file_ptr->open(full_path, m, ec))
+		if (!file_ptr->open(full_path, m, ec))
 			return file_handle();
 #ifdef TORRENT_WINDOWS
 		if (m_low_prio_io)
-			set_low_priority(e.file_ptr);
+			set_low_priority(file_ptr);
 #endif
-		e.mode = m;
-		file_handle file_ptr = e.file_ptr;
-		m_files.insert(std::make_pair(std::make_pair(st, file_index), e));
 		TORRENT_ASSERT(file_ptr->is_open());
 
-		if (int(m_files.size()) >= m_size)
+		auto const key = std::make_pair(st, file_index);
+		lru_file_entry& e = s.files.emplace(key, lru_file_entry(key)).first->second;
+		e.file_ptr = file_ptr;
+		e.mode = m;
+		s.lru.push_front(&e);
+		int const num_files = ++m_num_files;
+		l.unlock();
+
+		if (num_files >= m_size)
 		{
 			// the file cache is at its maximum size, close
 			// the least recently used (lru) file from it
-			defer_destruction = remove_oldest(l);
+			defer_destruction = remove_oldest();
 		}
 		return file_ptr;
 	}
@@ -210,11 +237,12 @@ namespace libtorrent {
 	std::vector<open_file_state> file_pool::get_status(storage_index_t const st) const
 	{
 		std::vector<open_file_state> ret;
+		for (auto const& s : m_shards)
 		{
-			std::unique_lock<std::mutex> l(m_mutex);
+			std::unique_lock<std::mutex> l(s.mutex);
 
-			auto const start = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-			auto const end = m_files.upper_bound(std::make_pair(st
+			auto const start = s.files.lower_bound(std::make_pair(st, file_index_t(0)));
+			auto const end = s.files.upper_bound(std::make_pair(st
 				, std::numeric_limits<file_index_t>::max()));
 
 			for (auto i = start; i != end; ++i)
@@ -223,19 +251,39 @@ namespace libtorrent {
 					, i->second.last_use});
 			}
 		}
+		std::sort(ret.begin(), ret.end()
+			, [](open_file_state const& lhs, open_file_state const& rhs)
+			{ return lhs.file_index < rhs.file_index; });
 		return ret;
 	}
 
-	file_handle file_pool::remove_oldest(std::unique_lock<std::mutex>&)
+	file_handle file_pool::remove_oldest()
 	{
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.last_use < rhs.second.last_use; });
-		if (i == m_files.end()) return file_handle();
+		// the least recently used file of every shard is at the back of its
+		// LRU list. Find the oldest of those
+		shard* oldest = nullptr;
+		time_point oldest_use = max_time();
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
+			lru_file_entry const* e = s.lru.back();
+			if (e == nullptr || e->last_use >= oldest_use) continue;
+			oldest_use = e->last_use;
+			oldest = &s;
+		}
+		if (oldest == nullptr) return file_handle();
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		// the shard may have changed since we looked at it, in which case we
+		// close what is now its least recently used file
+		std::unique_lock<std::mutex> l(oldest->mutex);
+		lru_file_entry* e = oldest->lru.back();
+		if (e == nullptr) return file_handle();
+
+		file_handle file_ptr = std::move(e->file_ptr);
+		key_type const key = e->key;
+		oldest->lru.erase(e);
+		oldest->files.erase(key);
+		--m_num_files;
 
 		// closing a file may be long running operation (mac os x)
 		// let the calling function destruct it after releasing the mutex
@@ -244,13 +292,16 @@ namespace libtorrent {
 
 	void file_pool::release(storage_index_t const st, file_index_t file_index)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		shard& s = shard_for(st, file_index);
+		std::unique_lock<std::mutex> l(s.mutex);
 
-		auto const i = m_files.find(std::make_pair(st, file_index));
-		if (i == m_files.end()) return;
+		auto const i = s.files.find(std::make_pair(st, file_index));
+		if (i == s.files.end()) return;
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		file_handle file_ptr = std::move(i->second.file_ptr);
+		s.lru.erase(&i->second);
+		s.files.erase(i);
+		--m_num_files;
 
 		// closing a file may take a long time (mac os x), so make sure
 		// we're not holding the mutex
@@ -262,31 +313,46 @@ namespace libtorrent {
 	// storage, or all if none is specified.
 	void file_pool::release()
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-		m_files.clear();
-		l.unlock();
+		for (auto& s : m_shards)
+		{
+			std::vector<file_handle> to_close;
+			std::unique_lock<std::mutex> l(s.mutex);
+			for (auto& f : s.files)
+				to_close.push_back(std::move(f.second.file_ptr));
+			m_num_files -= int(s.files.size());
+			s.lru.get_all();
+			s.files.clear();
+			l.unlock();
+			// the files are closed here while the lock is not held
+		}
 	}
 
 	void file_pool::release(storage_index_t const st)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		std::vector<file_handle> to_close;
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
 
-		auto const begin = m_files.lower_bound(std::make_pair(st, file_index_t(0)));
-		auto const end = m_files.upper_bound(std::make_pair(st
-				, std::numeric_limits<file_index_t>::max()));
+			auto const begin = s.files.lower_bound(std::make_pair(st, file_index_t(0)));
+			auto const end = s.files.upper_bound(std::make_pair(st
+					, std::numeric_limits<file_index_t>::max()));
 
-		std::vector<file_handle> to_close;
-		for (auto it = begin; it != end; ++it)
-			to_close.push_back(std::move(it->second.file_ptr));
-		if (!to_close.empty()) m_files.erase(begin, end);
-		l.unlock();
-		// the files are closed here while the lock is not held
+			for (auto it = begin; it != end; ++it)
+			{
+				to_close.push_back(std::move(it->second.file_ptr));
+				s.lru.erase(&it->second);
+				--m_num_files;
+			}
+			s.files.erase(begin, end);
+		}
+		// the files are closed here while no lock is held
 	}
 
 #if TORRENT_USE_ASSERTS
 	void file_pool::mark_deleted(file_storage const& fs)
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		std::unique_lock<std::mutex> l(m_deleted_mutex);
 		m_deleted_storages.push_back(std::make_pair(fs.name()
 			, static_cast<void const*>(&fs)));
 		if(m_deleted_storages.size() > 100)
@@ -295,12 +361,14 @@ namespace libtorrent {
 
 	bool file_pool::assert_idle_files(storage_index_t const st) const
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
-
-		for (auto const& i : m_files)
+		for (auto const& s : m_shards)
 		{
-			if (i.first.first == st && !i.second.file_ptr.unique())
-				return false;
+			std::unique_lock<std::mutex> l(s.mutex);
+			for (auto const& i : s.files)
+			{
+				if (i.first.first == st && !i.second.file_ptr.unique())
+					return false;
+			}
 		}
 		return true;
 	}
@@ -308,38 +376,54 @@ namespace libtorrent {
 
 	void file_pool::resize(int size)
 	{
-		// these are destructed _after_ the mutex is released
-		std::vector<file_handle> defer_destruction;
-
-		std::unique_lock<std::mutex> l(m_mutex);
-
 		TORRENT_ASSERT(size > 0);
 
 		if (size == m_size) return;
 		m_size = size;
-		if (int(m_files.size()) <= m_size) return;
+
+		// these are destructed after the shard mutexes are released
+		std::vector<file_handle> defer_destruction;
 
 		// close the least recently used files
-		while (int(m_files.size()) > m_size)
-			defer_destruction.push_back(remove_oldest(l));
+		while (m_num_files > m_size)
+		{
+			file_handle f = remove_oldest();
+			if (!f) break;
+			defer_destruction.push_back(std::move(f));
+		}
 	}
 
 	void file_pool::close_oldest()
 	{
-		std::unique_lock<std::mutex> l(m_mutex);
+		// this is called rarely (every close_file_interval), so it's fine
+		// to look through all files to find the one opened first
+		shard* oldest = nullptr;
+		key_type oldest_key;
+		time_point oldest_open = max_time();
+		for (auto& s : m_shards)
+		{
+			std::unique_lock<std::mutex> l(s.mutex);
+			for (auto const& f : s.files)
+			{
+				if (f.second.opened >= oldest_open) continue;
+				oldest_open = f.second.opened;
+				oldest_key = f.first;
+				oldest = &s;
+			}
+		}
+		if (oldest == nullptr) return;
 
-		using value_type = decltype(m_files)::value_type;
-		auto const i = std::min_element(m_files.begin(), m_files.end()
-			, [] (value_type const& lhs, value_type const& rhs)
-				{ return lhs.second.opened < rhs.second.opened; });
-		if (i == m_files.end()) return;
+		std::unique_lock<std::mutex> l(oldest->mutex);
+		auto const i = oldest->files.find(oldest_key);
+		if (i == oldest->files.end()) return;
 
-		file_handle file_ptr = i->second.file_ptr;
-		m_files.erase(i);
+		file_handle file_ptr = std::move(i->second.file_ptr);
+		oldest->lru.erase(&i->second);
+		oldest->files.erase(i);
+		--m_num_files;
 
 		// closing a file may be long running operation (mac os x)
 		l.unlock();
 		file_ptr.reset();
-		l.lock();
 	}
 }
@@ -64,18 +64,101 @@ namespace libtorrent {
 
 	file_storage::~file_storage() = default;
 
-	// even though this copy constructor and the copy assignment
-	// operator are identical to what the compiler would have
-	// generated, they are put here to explicitly make them part
-	// of libtorrent and properly exported by the .dll.
-	file_storage::file_storage(file_storage const&) = default;
-	file_storage& file_storage::operator=(file_storage const&) = default;
+	file_storage::file_storage(file_storage const& f)
+		: m_piece_length(f.m_piece_length)
+		, m_num_pieces(f.m_num_pieces)
+		, m_files(f.m_files)
+		, m_file_hashes(f.m_file_hashes)
+		, m_symlinks(f.m_symlinks)
+		, m_mtime(f.m_mtime)
+#ifndef TORRENT_NO_DEPRECATE
+		, m_file_base(f.m_file_base)
+#endif
+		, m_paths(f.m_paths)
+		, m_path_index(f.m_path_index)
+		, m_name_arena(f.m_name_arena)
+		, m_file_offset_index(f.m_file_offset_index)
+		, m_offset_index_shift(f.m_offset_index_shift)
+		, m_name(f.m_name)
+		, m_total_size(f.m_total_size)
+	{
+		// the copied entries still point into the other object's name arena
+		for (auto& e : m_files)
+		{
+			if (e.name_len != internal_file_entry::name_in_arena) continue;
+			e.name = m_name_arena.data() + (e.name - f.m_name_arena.data());
+		}
+	}
+
+	file_storage& file_storage::operator=(file_storage const& f)
+	{
+		if (this == &f) return *this;
+		file_storage tmp(f);
+		swap(tmp);
+		return *this;
+	}
 
 	void file_storage::reserve(int num_files)
 	{
 		m_files.reserve(num_files);
 	}
 
+	void file_storage::set_file_name(internal_file_entry& e, string_view const name)
+	{
+		TORRENT_ASSERT(m_name_arena.empty()
+			|| name.data() < m_name_arena.data()
+			|| name.data() >= m_name_arena.data() + m_name_arena.size());
+
+		char const* const old_base = m_name_arena.data();
+		std::size_t const pos = m_name_arena.size();
+		m_name_arena.insert(m_name_arena.end(), name.begin(), name.end());
+		m_name_arena.push_back('\0');
+		if (pos > 0 && m_name_arena.data() != old_base)
+		{
+			// the arena was reallocated, update the names pointing into it
+			for (auto& f : m_files)
+			{
+				if (f.name_len != internal_file_entry::name_in_arena) continue;
+				f.name = m_name_arena.data() + (f.name - old_base);
+			}
+		}
+
+		// free the current name, if it's owned
+		e.set_name(nullptr);
+		e.name = m_name_arena.data() + pos;
+		e.name_len = internal_file_entry::name_in_arena;
+	}
+
+	void file_storage::index_file_offset(file_index_t const index)
+	{
+		internal_file_entry const& e = m_files[index];
+		std::int64_t const end = std::int64_t(e.offset + e.size);
+		int const num_indexed = static_cast<int>(index) + 1;
+
+		// keep the number of buckets no greater than the number of files, by
+		// doubling the bucket size (and dropping every other bucket)
+		while ((end >> m_offset_index_shift) > num_indexed)
+		{
+			++m_offset_index_shift;
+			int const new_size = (m_file_offset_index.end_index() + 1) / 2;
+			for (int i = 1; i < new_size; ++i)
+				m_file_offset_index[i] = m_file_offset_index[i * 2];
+			m_file_offset_index.resize(new_size);
+		}
+
+		// the buckets starting within this file
+		while ((std::int64_t(m_file_offset_index.size()) << m_offset_index_shift) < end)
+			m_file_offset_index.push_back(index);
+	}
+
+	void file_storage::rebuild_offset_index()
+	{
+		m_file_offset_index.clear();
+		m_offset_index_shift = 0;
+		for (file_index_t i(0); i < end_file(); ++i)
+			index_file_offset(i);
+	}
+
 	int file_storage::piece_size(piece_index_t const index) const
 	{
 		TORRENT_ASSERT_PRECOND(index >= piece_index_t(0) && index < end_piece());
@@ -108,7 +191,7 @@ namespace {
 		if (is_complete(path))
 		{
 			TORRENT_ASSERT(set_name);
-			e.set_name(path.c_str());
+			set_file_name(e, path);
 			e.path_index = -2;
 			return;
 		}
@@ -133,7 +216,7 @@ namespace {
 		}
 		if (branch_len <= 0)
 		{
-			if (set_name) e.set_name(leaf);
+			if (set_name) set_file_name(e, leaf);
 			e.path_index = -1;
 			return;
 		}
@@ -154,14 +237,19 @@ namespace {
 		}
 
 		// do we already have this path in the path list?
-		auto p = std::find_if(m_paths.rbegin(), m_paths.rend()
-			, [&] (std::string const& str)
+		boost::crc_32_type crc;
+		crc.process_bytes(branch_path, aux::numeric_cast<std::size_t>(branch_len));
+		std::uint32_t const path_hash = crc.checksum();
+		auto const range = m_path_index.equal_range(path_hash);
+		auto const p = std::find_if(range.first, range.second
+			, [&] (std::pair<std::uint32_t const, int> const& i)
 			{
+				std::string const& str = m_paths[i.second];
 				if (int(str.size()) != branch_len) return false;
 				return std::memcmp(str.c_str(), branch_path, aux::numeric_cast<std::size_t>(branch_len)) == 0;
 			});
 
-		if (p == m_paths.rend())
+		if (p == range.second)
 		{
 			// no, we don't. add it
 			e.path_index = int(m_paths.size());
@@ -170,13 +258,14 @@ namespace {
 			// poor man's emplace back
 			m_paths.resize(m_paths.size() + 1);
 			m_paths.back().assign(branch_path, aux::numeric_cast<std::size_t>(branch_len));
+			m_path_index.emplace(path_hash, e.path_index);
 		}
 		else
 		{
 			// yes we do. use it
-			e.path_index = int(p.base() - m_paths.begin() - 1);
+			e.path_index = p->second;
 		}
-		if (set_name) e.set_name(leaf);
+		if (set_name) set_file_name(e, leaf);
 	}
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -292,7 +381,7 @@ namespace {
 
 		// we have limited space in the length field. truncate string
 		// if it's too long
-		if (string_len >= name_is_owned) string_len = name_is_owned - 1;
+		if (string_len >= name_in_arena) string_len = name_in_arena - 1;
 
 		// free the current string, before assigning the new one
 		if (name_len == name_is_owned) free(const_cast<char*>(name));
@@ -315,7 +404,8 @@ namespace {
 
 	string_view internal_file_entry::filename() const
 	{
-		if (name_len != name_is_owned) return {name, std::size_t(name_len)};
+		if (name_len != name_is_owned && name_len != name_in_arena)
+			return {name, std::size_t(name_len)};
 		return name ? string_view(name) : string_view();
 	}
 
@@ -323,7 +413,8 @@ namespace {
 	{
 		for (auto& f : m_files)
 		{
-			if (f.name_len == internal_file_entry::name_is_owned) continue;
+			if (f.name_len == internal_file_entry::name_is_owned
+				|| f.name_len == internal_file_entry::name_in_arena) continue;
 			f.name += off;
 		}
 
@@ -409,8 +500,23 @@ namespace {
 		target.offset = aux::numeric_cast<std::uint64_t>(offset);
 		TORRENT_ASSERT(!compare_file_offset(target, m_files.front()));
 
-		auto file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
+		// the file is somewhere between the files containing the start of
+		// this bucket and the start of the next one
+		auto first = m_files.begin();
+		auto last = m_files.end();
+		int const bucket = int(offset >> m_offset_index_shift);
+		if (bucket < m_file_offset_index.end_index())
+		{
+			first += static_cast<int>(m_file_offset_index[bucket]);
+			if (bucket + 1 < m_file_offset_index.end_index())
+				last = m_files.begin() + static_cast<int>(m_file_offset_index[bucket + 1]) + 1;
+		}
+		else if (!m_file_offset_index.empty())
+		{
+			first += static_cast<int>(m_file_offset_index.back());
+		}
+
+		auto file_iter = std::upper_bound(first, last, target, compare_file_offset);
 
 		TORRENT_ASSERT(file_iter != m_files.begin());
 		--file_iter;
@@ -424,7 +530,8 @@ namespace {
 
 	int file_storage::file_name_len(file_index_t const index) const
 	{
-		if (m_files[index].name_len == internal_file_entry::name_is_owned)
+		if (m_files[index].name_len == internal_file_entry::name_is_owned
+			|| m_files[index].name_len == internal_file_entry::name_in_arena)
 			return -1;
 		return m_files[index].name_len;
 	}
@@ -447,11 +554,8 @@ namespace {
 		if (std::int64_t(target.offset) + size > m_total_size)
 			size = aux::numeric_cast<int>(m_total_size - std::int64_t(target.offset));
 
-		auto file_iter = std::upper_bound(
-			m_files.begin(), m_files.end(), target, compare_file_offset);
-
-		TORRENT_ASSERT(file_iter != m_files.begin());
-		--file_iter;
+		auto file_iter = m_files.begin() + static_cast<int>(
+			file_index_at_offset(std::int64_t(target.offset)));
 
 		std::int64_t file_offset = target.offset - file_iter->offset;
 		for (; size > 0; file_offset -= file_iter->size, ++file_iter)
@@ -584,6 +688,7 @@ namespace {
 
 		e.size = aux::numeric_cast<std::uint64_t>(file_size);
 		e.offset = aux::numeric_cast<std::uint64_t>(m_total_size);
+		index_file_offset(last_file());
 		e.pad_file = (file_flags & file_storage::flag_pad_file) != 0;
 		e.hidden_attribute = (file_flags & file_storage::flag_hidden) != 0;
 		e.executable_attribute = (file_flags & file_storage::flag_executable) != 0;
@@ -1072,6 +1177,7 @@ namespace {
 			}
 		}
 		m_total_size = off;
+		rebuild_offset_index();
 	}
 
 	void file_storage::add_pad_file(int const size
@@ -1091,7 +1197,7 @@ namespace {
 		std::snprintf(name, sizeof(name), ".pad" TORRENT_SEPARATOR_STR "%d"
 			, pad_file_counter);
 		std::string path = combine_path(m_name, name);
-		e.set_name(path.c_str());
+		set_file_name(e, path);
 		e.pad_file = true;
 		offset += size;
 		++pad_file_counter;
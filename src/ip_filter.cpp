@@ -52,6 +52,35 @@ namespace libtorrent {
 			TORRENT_ASSERT_FAIL();
 	}
 
+	void ip_filter::add_rules(std::vector<ip_range<address>> const& rules)
+	{
+		std::vector<ip_range<address_v4::bytes_type>> rules4;
+#if TORRENT_USE_IPV6
+		std::vector<ip_range<address_v6::bytes_type>> rules6;
+#endif
+		for (auto const& r : rules)
+		{
+			if (r.first.is_v4())
+			{
+				TORRENT_ASSERT(r.last.is_v4());
+				rules4.push_back({r.first.to_v4().to_bytes(), r.last.to_v4().to_bytes(), r.flags});
+			}
+#if TORRENT_USE_IPV6
+			else if (r.first.is_v6())
+			{
+				TORRENT_ASSERT(r.last.is_v6());
+				rules6.push_back({r.first.to_v6().to_bytes(), r.last.to_v6().to_bytes(), r.flags});
+			}
+#endif
+			else
+				TORRENT_ASSERT_FAIL();
+		}
+		m_filter4.add_rules(rules4);
+#if TORRENT_USE_IPV6
+		m_filter6.add_rules(rules6);
+#endif
+	}
+
 	std::uint32_t ip_filter::access(address const& addr) const
 	{
 		if (addr.is_v4())
@@ -64,6 +93,14 @@ namespace libtorrent {
 #endif
 	}
 
+	void ip_filter::compact()
+	{
+		m_filter4.compact();
+#if TORRENT_USE_IPV6
+		m_filter6.compact();
+#endif
+	}
+
 	ip_filter::filter_tuple_t ip_filter::export_filter() const
 	{
 #if TORRENT_USE_IPV6
@@ -150,7 +150,9 @@ namespace libtorrent { namespace dht {
 			n.first->second.connection_timer.expires_from_now(seconds(1), ec);
 			n.first->second.connection_timer.async_wait(
 				std::bind(&dht_tracker::connection_timeout, self(), std::ref(n.first->second), _1));
-			n.first->second.dht.bootstrap(std::vector<udp::endpoint>(), find_data::nodes_callback());
+			n.first->second.dht.bootstrap(std::vector<udp::endpoint>()
+				, std::bind(&dht_tracker::bootstrap_done, self(), s, clock_type::now()
+				, find_data::nodes_callback(), _1));
 		}
 	}
 
@@ -158,6 +160,13 @@ namespace libtorrent { namespace dht {
 	{
 		TORRENT_ASSERT(m_nodes.count(s) == 1);
 		m_nodes.erase(s);
+
+		// the traversals of the removed node won't complete. Lookups already
+		// in flight keep serving their subscribers, but new requests start
+		// lookups of their own
+		m_peers_lookups.clear();
+		m_immutable_lookups.clear();
+		m_mutable_lookups.clear();
 	}
 
 	void dht_tracker::start(find_data::nodes_callback const& f)
@@ -166,17 +175,20 @@ namespace libtorrent { namespace dht {
 		error_code ec;
 		refresh_key(ec);
 
+		time_point const now = clock_type::now();
 		for (auto& n : m_nodes)
 		{
 			n.second.connection_timer.expires_from_now(seconds(1), ec);
 			n.second.connection_timer.async_wait(
 				std::bind(&dht_tracker::connection_timeout, self(), std::ref(n.second), _1));
+			n.second.bootstrap_time = seconds(-1);
+			auto cb = std::bind(&dht_tracker::bootstrap_done, self(), n.first, now, f, _1);
 #if TORRENT_USE_IPV6
 			if (n.first->get_local_endpoint().protocol() == tcp::v6())
-				n.second.dht.bootstrap(concat(m_state.nodes6, m_state.nodes), f);
+				n.second.dht.bootstrap(concat(m_state.nodes6, m_state.nodes), cb);
 			else
 #endif
-				n.second.dht.bootstrap(concat(m_state.nodes, m_state.nodes6), f);
+				n.second.dht.bootstrap(concat(m_state.nodes, m_state.nodes6), cb);
 		}
 
 		m_refresh_timer.expires_from_now(seconds(5), ec);
@@ -214,10 +226,15 @@ namespace libtorrent { namespace dht {
 #endif
 
 	void dht_tracker::dht_status(std::vector<dht_routing_bucket>& table
-		, std::vector<dht_lookup>& requests)
+		, std::vector<dht_lookup>& requests
+		, time_duration& bootstrap_time)
 	{
+		bootstrap_time = seconds(0);
 		for (auto& n : m_nodes)
+		{
 			n.second.dht.status(table, requests);
+			bootstrap_time = std::max(bootstrap_time, n.second.bootstrap_time);
+		}
 	}
 
 	void dht_tracker::update_stats_counters(counters& c) const
@@ -247,6 +264,94 @@ namespace libtorrent { namespace dht {
 		timer.async_wait(std::bind(&dht_tracker::connection_timeout, self(), std::ref(n), _1));
 	}
 
+	void dht_tracker::bootstrap_done(aux::session_listen_socket* s
+		, time_point const start
+		, find_data::nodes_callback const& f
+		, std::vector<std::pair<node_entry, std::string>> const& nodes)
+	{
+		// the node may have been removed while it was bootstrapping
+		auto n = m_nodes.find(s);
+		if (n != m_nodes.end() && n->second.bootstrap_time < seconds(0))
+		{
+			n->second.bootstrap_time = clock_type::now() - start;
+#ifndef TORRENT_DISABLE_LOGGING
+			if (m_log->should_log(dht_logger::tracker))
+			{
+				m_log->log(dht_logger::tracker, "%s DHT bootstrap done [ time: %d ms nodes: %d ]"
+					, n->second.dht.protocol_family_name()
+					, int(total_milliseconds(n->second.bootstrap_time))
+					, std::get<0>(n->second.dht.size()));
+			}
+#endif
+		}
+		if (f) f(nodes);
+	}
+
+	template <typename Lookup, typename MakeCallback, typename Start>
+	void dht_tracker::run_lookup(lookup_map<Lookup>& lookups, sha1_hash const& target
+		, MakeCallback const& make_cb, Start const& start)
+	{
+		// the lookup of each address family, and the nodes to start it on if
+		// it's not in flight yet
+		std::vector<std::pair<std::shared_ptr<Lookup>, std::vector<node*>>> families;
+		std::vector<lookup_key> keys;
+		for (auto& n : m_nodes)
+		{
+			node& dht = n.second.dht;
+			lookup_key key(target, dht.protocol_family_name());
+			auto const k = std::find(keys.begin(), keys.end(), key);
+			if (k != keys.end())
+			{
+				auto& f = families[std::size_t(k - keys.begin())];
+				if (!f.second.empty()) f.second.push_back(&dht);
+				continue;
+			}
+
+			auto const i = lookups.find(key);
+			if (i != lookups.end())
+			{
+				families.emplace_back(i->second, std::vector<node*>());
+			}
+			else
+			{
+				auto l = std::make_shared<Lookup>();
+				lookups.emplace(key, l);
+				families.emplace_back(std::move(l), std::vector<node*>{&dht});
+			}
+			keys.push_back(std::move(key));
+		}
+
+		int traversals = 0;
+		for (auto& f : families)
+		{
+			if (!f.second.empty())
+			{
+				f.first->traversals = int(f.second.size());
+				f.first->active = f.first->traversals;
+			}
+			traversals += f.first->traversals;
+		}
+
+		auto const cb = make_cb(traversals);
+		for (std::size_t i = 0; i < families.size(); ++i)
+		{
+			auto const& l = families[i].first;
+			l->subscribe(cb);
+			for (node* n : families[i].second)
+				start(*n, l, keys[i]);
+		}
+	}
+
+	template <typename Lookup>
+	void dht_tracker::lookup_done(lookup_map<Lookup>& lookups, lookup_key const& key
+		, std::shared_ptr<Lookup> const& l)
+	{
+		TORRENT_ASSERT(l->active > 0);
+		if (--l->active > 0) return;
+		auto const i = lookups.find(key);
+		if (i != lookups.end() && i->second == l) lookups.erase(i);
+	}
+
 	void dht_tracker::refresh_timeout(error_code const& e)
 	{
 		if (e || !m_running) return;
@@ -304,9 +409,17 @@ namespace libtorrent { namespace dht {
 	void dht_tracker::get_peers(sha1_hash const& ih
 		, std::function<void(std::vector<tcp::endpoint> const&)> f)
 	{
-		std::function<void(std::vector<std::pair<node_entry, std::string>> const&)> empty;
-		for (auto& n : m_nodes)
-			n.second.dht.get_peers(ih, f, empty, false);
+		auto self_ = self();
+		run_lookup(m_peers_lookups, ih
+			, [&f](int) -> peers_lookup::callback { return f; }
+			, [&self_](node& n, std::shared_ptr<peers_lookup> const& l, lookup_key const& key)
+			{
+				n.get_peers(key.first
+					, [l](std::vector<tcp::endpoint> const& peers) { l->post(peers); }
+					, [self_, l, key](std::vector<std::pair<node_entry, std::string>> const&)
+					{ self_->lookup_done(self_->m_peers_lookups, key, l); }
+					, false);
+			});
 	}
 
 	void dht_tracker::announce(sha1_hash const& ih, int listen_port, int flags
@@ -399,9 +512,21 @@ namespace libtorrent { namespace dht {
 	void dht_tracker::get_item(sha1_hash const& target
 		, std::function<void(item const&)> cb)
 	{
-		auto ctx = std::make_shared<get_immutable_item_ctx>(int(m_nodes.size()));
-		for (auto& n : m_nodes)
-			n.second.dht.get_item(target, std::bind(&get_immutable_item_callback, _1, ctx, cb));
+		auto self_ = self();
+		run_lookup(m_immutable_lookups, target
+			, [&cb](int const traversals) -> immutable_lookup::callback
+			{
+				auto ctx = std::make_shared<get_immutable_item_ctx>(traversals);
+				return std::bind(&get_immutable_item_callback, _1, ctx, cb);
+			}
+			, [&self_](node& n, std::shared_ptr<immutable_lookup> const& l, lookup_key const& key)
+			{
+				n.get_item(key.first, [self_, l, key](item const& it)
+				{
+					l->post(it);
+					self_->lookup_done(self_->m_immutable_lookups, key, l);
+				});
+			});
 	}
 
 	// key is a 32-byte binary string, the public key to look up.
@@ -410,9 +535,22 @@ namespace libtorrent { namespace dht {
 		, std::function<void(item const&, bool)> cb
 		, std::string salt)
 	{
-		auto ctx = std::make_shared<get_mutable_item_ctx>(int(m_nodes.size()));
-		for (auto& n : m_nodes)
-			n.second.dht.get_item(key, salt, std::bind(&get_mutable_item_callback, _1, _2, ctx, cb));
+		auto self_ = self();
+		run_lookup(m_mutable_lookups, item_target_id(salt, key)
+			, [&cb](int const traversals) -> mutable_lookup::callback
+			{
+				auto ctx = std::make_shared<get_mutable_item_ctx>(traversals);
+				return std::bind(&get_mutable_item_callback, _1, _2, ctx, cb);
+			}
+			, [&](node& n, std::shared_ptr<mutable_lookup> const& l, lookup_key const& lk)
+			{
+				n.get_item(key, salt, [self_, l, lk](item const& it, bool const authoritative)
+				{
+					l->post(it, authoritative);
+					if (authoritative)
+						self_->lookup_done(self_->m_mutable_lookups, lk, l);
+				});
+			});
 	}
 
 	void dht_tracker::put_item(entry const& data
@@ -547,6 +685,7 @@ namespace libtorrent { namespace dht {
 		, dht_storage_interface& storage)
 		: dht(s, sock, settings, nid, observer, cnt, get_foreign_node, storage)
 		, connection_timer(ios)
+		, bootstrap_time(seconds(-1))
 	{}
 
 	std::vector<std::pair<node_id, udp::endpoint>> dht_tracker::live_nodes(node_id const& nid)
@@ -52,6 +52,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <type_traits>
 #include <functional>
+#include <algorithm>
 
 #ifndef TORRENT_DISABLE_LOGGING
 #include <cinttypes> // for PRId64 et.al.
@@ -135,6 +136,16 @@ void observer::set_id(node_id const& id)
 	if (m_algorithm) m_algorithm->resort_result(this);
 }
 
+namespace {
+
+	// transaction IDs are 15 bits
+	constexpr int max_transaction_id = 0x7fff;
+	constexpr int initial_transaction_slots = 64;
+
+	constexpr int short_timeout = 1;
+	constexpr int timeout = 15;
+}
+
 using observer_storage = aux::aligned_union<1
 	, find_data_observer
 	, announce_observer
@@ -153,6 +164,7 @@ rpc_manager::rpc_manager(node_id const& our_id
 	, socket_manager* sock_man
 	, dht_logger* log)
 	: m_pool_allocator(sizeof(observer_storage), 10)
+	, m_short_timeout_cursor(0)
 	, m_sock(sock)
 	, m_sock_man(sock_man)
 #ifndef TORRENT_DISABLE_LOGGING
@@ -176,7 +188,7 @@ rpc_manager::~rpc_manager()
 
 	for (auto const& t : m_transactions)
 	{
-		t.second->abort();
+		if (t) t->abort();
 	}
 }
 
@@ -196,6 +208,61 @@ void rpc_manager::free_observer(void* ptr)
 	m_pool_allocator.free(ptr);
 }
 
+int rpc_manager::allocate_transaction_id()
+{
+	if (m_free_slots.empty())
+	{
+		int const size = int(m_transactions.size());
+		if (size > max_transaction_id) return -1;
+		int const new_size = size == 0 ? initial_transaction_slots : size * 2;
+
+		// move every transaction into its slot in the larger table. Since
+		// the slot is the low bits of the transaction ID, this can't collide
+		std::vector<observer_ptr> table(static_cast<std::size_t>(new_size));
+		for (auto& t : m_transactions)
+		{
+			TORRENT_ASSERT(t);
+			table[t->transaction_id() & (new_size - 1)] = std::move(t);
+		}
+		m_transactions.swap(table);
+
+		for (int i = 0; i < new_size; ++i)
+		{
+			if (m_transactions[std::size_t(i)]) continue;
+			m_free_slots.push_back(std::uint16_t(i));
+		}
+	}
+
+	// pick a random free slot, to keep the transaction IDs unpredictable
+	// even when the table is (nearly) full
+	auto const pick = random(std::uint32_t(m_free_slots.size() - 1));
+	std::swap(m_free_slots[pick], m_free_slots.back());
+	int const slot = m_free_slots.back();
+	m_free_slots.pop_back();
+
+	int const mask = int(m_transactions.size()) - 1;
+	int const high_bits = int(random(std::uint32_t(max_transaction_id))) & ~mask;
+	return (high_bits | slot) & max_transaction_id;
+}
+
+observer* rpc_manager::find_transaction(std::uint16_t const tid) const
+{
+	if (m_transactions.empty()) return nullptr;
+	observer* o = m_transactions[tid & (m_transactions.size() - 1)].get();
+	if (o == nullptr || o->transaction_id() != tid) return nullptr;
+	return o;
+}
+
+observer_ptr rpc_manager::remove_transaction(std::uint16_t const tid)
+{
+	TORRENT_ASSERT(find_transaction(tid) != nullptr);
+	std::size_t const slot = tid & (m_transactions.size() - 1);
+	observer_ptr ret = std::move(m_transactions[slot]);
+	m_transactions[slot].reset();
+	m_free_slots.push_back(std::uint16_t(slot));
+	return ret;
+}
+
 #if TORRENT_USE_ASSERTS
 size_t rpc_manager::allocation_size() const
 {
@@ -205,10 +272,17 @@ size_t rpc_manager::allocation_size() const
 #if TORRENT_USE_INVARIANT_CHECKS
 void rpc_manager::check_invariant() const
 {
-	for (auto const& t : m_transactions)
+	int num_used = 0;
+	std::size_t const mask = m_transactions.size() - 1;
+	for (std::size_t i = 0; i < m_transactions.size(); ++i)
 	{
-		TORRENT_ASSERT(t.second);
+		if (!m_transactions[i]) continue;
+		TORRENT_ASSERT((m_transactions[i]->transaction_id() & mask) == i);
+		++num_used;
 	}
+	TORRENT_ASSERT(num_used + int(m_free_slots.size()) == int(m_transactions.size()));
+	TORRENT_ASSERT(m_short_timeout_cursor >= 0);
+	TORRENT_ASSERT(m_short_timeout_cursor <= int(m_timeout_queue.size()));
 }
 #endif
 
@@ -222,12 +296,10 @@ void rpc_manager::unreachable(udp::endpoint const& ep)
 	}
 #endif
 
-	for (auto i = m_transactions.begin(); i != m_transactions.end();)
+	for (auto const& t : m_transactions)
 	{
-		TORRENT_ASSERT(i->second);
-		if (i->second->target_ep() != ep) { ++i; continue; }
-		observer_ptr o = i->second;
-		i = m_transactions.erase(i);
+		if (!t || t->target_ep() != ep) continue;
+		observer_ptr o = remove_transaction(t->transaction_id());
 #ifndef TORRENT_DISABLE_LOGGING
 		m_log->log(dht_logger::rpc_manager, "[%u] found transaction [ tid: %d ]"
 			, o->algorithm()->id(), int(o->transaction_id()));
@@ -253,17 +325,14 @@ bool rpc_manager::incoming(msg const& m, node_id* id)
 	auto transaction_id = m.message.dict_find_string_value("t");
 	if (transaction_id.empty()) return false;
 
-	auto ptr = transaction_id.begin();
-	int tid = transaction_id.size() != 2 ? -1 : detail::read_uint16(ptr);
-
 	observer_ptr o;
-	auto range = m_transactions.equal_range(tid);
-	for (auto i = range.first; i != range.second; ++i)
+	if (transaction_id.size() == 2)
 	{
-		if (m.addr.address() != i->second->target_addr()) continue;
-		o = i->second;
-		i = m_transactions.erase(i);
-		break;
+		auto ptr = transaction_id.begin();
+		std::uint16_t const tid = detail::read_uint16(ptr);
+		observer const* t = find_transaction(tid);
+		if (t != nullptr && m.addr.address() == t->target_addr())
+			o = remove_transaction(tid);
 	}
 
 	if (!o)
@@ -377,61 +446,69 @@ time_duration rpc_manager::tick()
 {
 	INVARIANT_CHECK;
 
-	constexpr int short_timeout = 1;
-	constexpr int timeout = 15;
-
 	// look for observers that have timed out
 
-	if (m_transactions.empty()) return seconds(short_timeout);
+	if (m_timeout_queue.empty()) return seconds(short_timeout);
 
 	std::vector<observer_ptr> timeouts;
 	std::vector<observer_ptr> short_timeouts;
 
-	time_duration ret = seconds(short_timeout);
 	time_point now = aux::time_now();
 
-	for (auto i = m_transactions.begin(); i != m_transactions.end();)
+	// an entry is stale if its transaction has already completed, in which
+	// case its slot may have been reused by a different transaction
+	auto const live = [this](timeout_entry const& e)
 	{
-		observer_ptr o = i->second;
+		observer const* o = find_transaction(e.tid);
+		return o == e.o && o->sent() == e.sent;
+	};
 
-		time_duration diff = now - o->sent();
-		if (diff >= seconds(timeout))
-		{
+	while (!m_timeout_queue.empty()
+		&& now - m_timeout_queue.front().sent >= seconds(timeout))
+	{
+		timeout_entry const e = m_timeout_queue.front();
+		m_timeout_queue.pop_front();
+		if (m_short_timeout_cursor > 0) --m_short_timeout_cursor;
+		if (!live(e)) continue;
+
+		observer_ptr o = remove_transaction(e.tid);
 #ifndef TORRENT_DISABLE_LOGGING
-			if (m_log->should_log(dht_logger::rpc_manager))
-			{
-				m_log->log(dht_logger::rpc_manager, "[%u] timing out transaction id: %d from: %s"
-					, o->algorithm()->id(), o->transaction_id()
-					, print_endpoint(o->target_ep()).c_str());
-			}
-#endif
-			i = m_transactions.erase(i);
-			timeouts.push_back(o);
-			continue;
+		if (m_log->should_log(dht_logger::rpc_manager))
+		{
+			m_log->log(dht_logger::rpc_manager, "[%u] timing out transaction id: %d from: %s"
+				, o->algorithm()->id(), o->transaction_id()
+				, print_endpoint(o->target_ep()).c_str());
 		}
+#endif
+		timeouts.push_back(std::move(o));
+	}
+
+	while (m_short_timeout_cursor < int(m_timeout_queue.size()))
+	{
+		timeout_entry const& e = m_timeout_queue[std::size_t(m_short_timeout_cursor)];
+		if (now - e.sent < seconds(short_timeout)) break;
+		++m_short_timeout_cursor;
 
 		// don't call short_timeout() again if we've
 		// already called it once
-		if (diff >= seconds(short_timeout) && !o->has_short_timeout())
-		{
-#ifndef TORRENT_DISABLE_LOGGING
-			if (m_log->should_log(dht_logger::rpc_manager))
-			{
-				m_log->log(dht_logger::rpc_manager, "[%u] short-timing out transaction id: %d from: %s"
-					, o->algorithm()->id(), o->transaction_id()
-					, print_endpoint(o->target_ep()).c_str());
-			}
-#endif
-			++i;
+		if (!live(e) || e.o->has_short_timeout()) continue;
 
-			short_timeouts.push_back(o);
-			continue;
+		observer_ptr o = m_transactions[e.tid & (m_transactions.size() - 1)];
+#ifndef TORRENT_DISABLE_LOGGING
+		if (m_log->should_log(dht_logger::rpc_manager))
+		{
+			m_log->log(dht_logger::rpc_manager, "[%u] short-timing out transaction id: %d from: %s"
+				, o->algorithm()->id(), o->transaction_id()
+				, print_endpoint(o->target_ep()).c_str());
 		}
-
-		ret = std::min(seconds(timeout) - diff, ret);
-		++i;
+#endif
+		short_timeouts.push_back(std::move(o));
 	}
 
+	time_duration ret = seconds(short_timeout);
+	if (!m_timeout_queue.empty())
+		ret = std::min(seconds(timeout) - (now - m_timeout_queue.front().sent), ret);
+
 	std::for_each(timeouts.begin(), timeouts.end(), std::bind(&observer::timeout, _1));
 	std::for_each(short_timeouts.begin(), short_timeouts.end(), std::bind(&observer::short_timeout, _1));
 
@@ -454,10 +531,24 @@ bool rpc_manager::invoke(entry& e, udp::endpoint const& target_addr
 	entry& a = e["a"];
 	add_our_id(a);
 
+	int const slot_tid = allocate_transaction_id();
+	if (slot_tid < 0)
+	{
+#ifndef TORRENT_DISABLE_LOGGING
+		if (m_log != nullptr && m_log->should_log(dht_logger::rpc_manager))
+		{
+			m_log->log(dht_logger::rpc_manager, "[%u] transaction table full, dropping %s -> %s"
+				, o->algorithm()->id(), e["q"].string().c_str()
+				, print_endpoint(target_addr).c_str());
+		}
+#endif
+		return false;
+	}
+
 	std::string transaction_id;
 	transaction_id.resize(2);
 	char* out = &transaction_id[0];
-	std::uint16_t const tid = std::uint16_t(random(0x7fff));
+	std::uint16_t const tid = std::uint16_t(slot_tid);
 	detail::write_uint16(tid, out);
 	e["t"] = transaction_id;
 
@@ -483,14 +574,17 @@ bool rpc_manager::invoke(entry& e, udp::endpoint const& target_addr
 	}
 #endif
 
+	std::size_t const slot = tid & (m_transactions.size() - 1);
 	if (m_sock_man->send_packet(m_sock, e, target_addr))
 	{
-		m_transactions.insert(std::make_pair(tid, o));
 #if TORRENT_USE_ASSERTS
 		o->m_was_sent = true;
 #endif
+		m_timeout_queue.push_back(timeout_entry{o->sent(), o.get(), tid});
+		m_transactions[slot] = std::move(o);
 		return true;
 	}
+	m_free_slots.push_back(std::uint16_t(slot));
 	return false;
 }
 
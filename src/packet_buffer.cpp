@@ -33,6 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/packet_buffer.hpp"
 #include "libtorrent/assert.hpp"
 #include "libtorrent/invariant_check.hpp"
+#include "libtorrent/aux_/ffs.hpp"
+
+#include <algorithm>
 
 namespace libtorrent {
 
@@ -43,14 +46,27 @@ namespace libtorrent {
 	void packet_buffer::check_invariant() const
 	{
 		int count = 0;
+		int marked = 0;
 		for (index_type i = 0; i < m_capacity; ++i)
 		{
 			count += m_storage[i] ? 1 : 0;
+			if (!slot_marked(i)) continue;
+			// only occupied slots can be marked
+			TORRENT_ASSERT(m_storage[i]);
+			++marked;
 		}
 		TORRENT_ASSERT(count == m_size);
+		TORRENT_ASSERT(marked == m_num_marked);
 	}
 #endif
 
+	void packet_buffer::clear_slot_mark(std::uint32_t const slot)
+	{
+		if (!slot_marked(slot)) return;
+		m_marked[slot / 32] &= ~(std::uint32_t(1) << (slot % 32));
+		--m_num_marked;
+	}
+
 	packet_ptr packet_buffer::insert(index_type idx, packet_ptr value)
 	{
 		INVARIANT_CHECK;
@@ -106,6 +122,7 @@ namespace libtorrent {
 
 		if (m_capacity == 0) reserve(16);
 
+		clear_slot_mark(idx & (m_capacity - 1));
 		packet_ptr old_value = std::move(m_storage[idx & (m_capacity - 1)]);
 		m_storage[idx & (m_capacity - 1)] = std::move(value);
 
@@ -131,6 +148,66 @@ namespace libtorrent {
 		return m_storage[idx & mask].get();
 	}
 
+	void packet_buffer::mark(index_type const idx)
+	{
+		INVARIANT_CHECK;
+		if (at(idx) == nullptr) return;
+
+		std::uint32_t const slot = idx & (m_capacity - 1);
+		if (slot_marked(slot)) return;
+		m_marked[slot / 32] |= std::uint32_t(1) << (slot % 32);
+		++m_num_marked;
+	}
+
+	void packet_buffer::unmark(index_type const idx)
+	{
+		INVARIANT_CHECK;
+		if (at(idx) == nullptr) return;
+		clear_slot_mark(idx & (m_capacity - 1));
+	}
+
+	bool packet_buffer::marked(index_type const idx) const
+	{
+		if (at(idx) == nullptr) return false;
+		return slot_marked(idx & (m_capacity - 1));
+	}
+
+	packet_buffer::index_type packet_buffer::next_marked(index_type idx
+		, index_type const end) const
+	{
+		if (m_num_marked == 0) return end;
+
+		// there are no elements before m_first
+		if (compare_less_wrap(idx, m_first, 0xffff))
+		{
+			if (!compare_less_wrap(m_first, end, 0xffff)) return end;
+			idx = m_first;
+		}
+
+		// nor past the end of the storage
+		std::uint32_t const offset = (idx - m_first) & 0xffff;
+		if (offset >= m_capacity) return end;
+		std::uint32_t const len = std::min((end - idx) & 0xffff
+			, m_capacity - offset);
+
+		std::uint32_t const mask = m_capacity - 1;
+		std::uint32_t i = 0;
+		while (i < len)
+		{
+			std::uint32_t const slot = (idx + i) & mask;
+			std::uint32_t const word = m_marked[slot / 32] >> (slot % 32);
+			if (word != 0)
+			{
+				i += std::uint32_t(aux::count_trailing_zeros(word));
+				if (i >= len) break;
+				return (idx + i) & 0xffff;
+			}
+			// skip to the next word, or wrap around to the first slot
+			i += std::min(32 - slot % 32, m_capacity - slot);
+		}
+		return end;
+	}
+
 	void packet_buffer::reserve(std::uint32_t size)
 	{
 		INVARIANT_CHECK;
@@ -141,11 +218,20 @@ namespace libtorrent {
 			new_size <<= 1;
 
 		aux::unique_ptr<packet_ptr[], index_type> new_storage(new packet_ptr[new_size]);
+		aux::unique_ptr<std::uint32_t[], index_type> new_marked(
+			new std::uint32_t[(new_size + 31) / 32]());
 
 		for (index_type i = m_first; i < (m_first + m_capacity); ++i)
-			new_storage[i & (new_size - 1)] = std::move(m_storage[i & (m_capacity - 1)]);
+		{
+			std::uint32_t const old_slot = i & (m_capacity - 1);
+			std::uint32_t const new_slot = i & (new_size - 1);
+			new_storage[new_slot] = std::move(m_storage[old_slot]);
+			if (slot_marked(old_slot))
+				new_marked[new_slot / 32] |= std::uint32_t(1) << (new_slot % 32);
+		}
 
 		m_storage = std::move(new_storage);
+		m_marked = std::move(new_marked);
 		m_capacity = new_size;
 	}
 
@@ -160,6 +246,7 @@ namespace libtorrent {
 			return packet_ptr();
 
 		std::size_t const mask = m_capacity - 1;
+		clear_slot_mark(std::uint32_t(idx & mask));
 		packet_ptr old_value = std::move(m_storage[idx & mask]);
 		m_storage[idx & mask].reset();
 
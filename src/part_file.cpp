@@ -59,22 +59,51 @@ POSSIBILITY OF SUCH DAMAGE.
   // header to an even multiple of 1024 bytes.
   uint8_t padding[n];
 
+  The header is kept in memory and written back in 4 kiB blocks, only the
+  blocks with slot entries that changed since the last flush. The slot of a
+  freed piece is reused by the next piece written to the part file. Slots
+  that are still unused when the header is flushed are deallocated from the
+  file (a hole is punched), where the filesystem supports it.
+
 */
 
 #include "libtorrent/part_file.hpp"
 #include "libtorrent/io.hpp"
 #include "libtorrent/assert.hpp"
-#include "libtorrent/aux_/vector.hpp"
 #include "libtorrent/aux_/path.hpp"
 
 #include <functional> // for std::function
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 namespace {
 
 	// round up to even kilobyte
 	int round_up(int n)
 	{ return (n + 1023) & ~0x3ff; }
+
+	// the header is flushed in blocks of this size
+	constexpr int header_block_size = 4096;
+
+	// holes are only punched in whole blocks of this size. Some filesystems
+	// (APFS, via F_PUNCHHOLE) fail with EINVAL when the range isn't aligned
+	// to their block size. Since the header is only aligned to 1 kiB, slots
+	// typically aren't
+	constexpr std::int64_t punch_block_size = 4096;
+
+	// returns true if the error means hole punching isn't supported at all,
+	// as opposed to this particular range failing
+	bool punch_not_supported(lt::error_code const& ec)
+	{
+		return ec == boost::system::errc::operation_not_supported
+			|| ec == boost::system::errc::not_supported
+			|| ec == boost::system::errc::function_not_supported;
+	}
+
+	// the offset of the slot entry for the specified piece, in the header
+	int entry_offset(lt::piece_index_t const piece)
+	{ return 8 + static_cast<int>(piece) * 4; }
 }
 
 namespace libtorrent {
@@ -90,15 +119,21 @@ namespace libtorrent {
 		TORRENT_ASSERT(num_pieces > 0);
 		TORRENT_ASSERT(m_piece_size > 0);
 
+		m_piece_map.resize(num_pieces, slot_index_t(-1));
+
+		// unless we find a valid header, the whole header needs to be written
+		m_dirty_blocks.resize(std::size_t((m_header_size + header_block_size - 1)
+			/ header_block_size), true);
+
 		error_code ec;
 		std::string fn = combine_path(m_path, m_name);
-		m_file.open(fn, file::read_only, ec);
+		file f(fn, file::read_only, ec);
 		if (ec) return;
 
 		// parse header
 		std::unique_ptr<std::uint32_t[]> header(new std::uint32_t[m_header_size]);
 		iovec_t b = {header.get(), std::size_t(m_header_size)};
-		int n = int(m_file.readv(0, b, ec));
+		int n = int(f.readv(0, b, ec));
 		if (ec) return;
 
 		// we don't have a full header. consider the file empty
@@ -128,48 +163,101 @@ namespace libtorrent {
 			TORRENT_ASSERT(slot < slot_index_t(num_pieces));
 			if (slot >= slot_index_t(num_pieces)) continue;
 
+			// two pieces claiming the same slot. This is also an invalid
+			// part-file. The header is rewritten if we drop any entries
+			if (!free_slots[slot])
+			{
+				m_dirty_metadata = true;
+				continue;
+			}
+
 			if (slot >= m_num_allocated)
 				m_num_allocated = next(slot);
 
 			free_slots[slot] = false;
 			m_piece_map[i] = slot;
+			++m_num_pieces;
 		}
 
-		// now, populate the free_list with the "holes"
-		for (slot_index_t i(0); i < m_num_allocated; ++i)
+		if (!m_dirty_metadata)
+			std::fill(m_dirty_blocks.begin(), m_dirty_blocks.end(), false);
+
+		m_slots.resize(static_cast<int>(m_num_allocated));
+
+		// now, populate the free_list with the "holes". Slots are allocated
+		// from the back of the list, lowest index first
+		for (slot_index_t i = prev(m_num_allocated); i >= slot_index_t(0); --i)
 		{
 			if (free_slots[i]) m_free_slots.push_back(i);
 		}
-
-		m_file.close();
 	}
 
 	part_file::~part_file()
 	{
 		error_code ec;
-		flush_metadata_impl(ec);
+		std::unique_lock<std::mutex> l(m_mutex);
+		flush_metadata_impl(l, ec);
 	}
 
 	slot_index_t part_file::allocate_slot(piece_index_t const piece)
 	{
 		// the mutex is assumed to be held here, since this is a private function
 
-		TORRENT_ASSERT(m_piece_map.find(piece) == m_piece_map.end());
+		TORRENT_ASSERT(m_piece_map[piece] == slot_index_t(-1));
 		slot_index_t slot(-1);
 		if (!m_free_slots.empty())
 		{
-			slot = m_free_slots.front();
-			m_free_slots.erase(m_free_slots.begin());
+			slot = m_free_slots.back();
+			m_free_slots.pop_back();
 		}
 		else
 		{
 			slot = m_num_allocated;
 			++m_num_allocated;
+			m_slots.emplace_back();
 		}
 
+		TORRENT_ASSERT(m_slots[slot].refs == 0);
+		TORRENT_ASSERT(!m_slots[slot].free_pending);
+		m_slots[slot].needs_punch = false;
+		set_slot(piece, slot);
+		++m_num_pieces;
+		return slot;
+	}
+
+	void part_file::set_slot(piece_index_t const piece, slot_index_t const slot)
+	{
 		m_piece_map[piece] = slot;
+		m_dirty_blocks[std::size_t(entry_offset(piece) / header_block_size)] = true;
 		m_dirty_metadata = true;
-		return slot;
+	}
+
+	void part_file::release_slot(slot_index_t const slot)
+	{
+		slot_state& st = m_slots[slot];
+		TORRENT_ASSERT(st.refs > 0);
+		--st.refs;
+		if (st.refs > 0 || !st.free_pending) return;
+		st.free_pending = false;
+		free_slot(slot);
+	}
+
+	void part_file::free_slot(slot_index_t const slot)
+	{
+		slot_state& st = m_slots[slot];
+		if (st.refs > 0)
+		{
+			// someone is still reading or writing this slot. Whoever finishes
+			// last will free it
+			st.free_pending = true;
+			return;
+		}
+
+		// the space in the file is deallocated the next time the header is
+		// flushed, unless the slot has been reused by then. Punching holes is
+		// expensive on some filesystems
+		st.needs_punch = m_punch_holes;
+		m_free_slots.push_back(slot);
 	}
 
 	int part_file::writev(span<iovec_t const> bufs, piece_index_t const piece
@@ -181,14 +269,18 @@ namespace libtorrent {
 		open_file(file::read_write, ec);
 		if (ec) return -1;
 
-		auto const i = m_piece_map.find(piece);
-		slot_index_t const slot = (i == m_piece_map.end())
-			? allocate_slot(piece) : i->second;
+		slot_index_t slot = m_piece_map[piece];
+		if (slot == slot_index_t(-1)) slot = allocate_slot(piece);
 
+		++m_slots[slot].refs;
+		std::shared_ptr<file> f = m_file;
 		l.unlock();
 
-		std::int64_t slot_offset = std::int64_t(m_header_size) + std::int64_t(static_cast<int>(slot)) * m_piece_size;
-		return int(m_file.writev(slot_offset + offset, bufs, ec));
+		int const ret = int(f->writev(slot_offset(slot) + offset, bufs, ec));
+
+		l.lock();
+		release_slot(slot);
+		return ret;
 	}
 
 	int part_file::readv(span<iovec_t const> bufs
@@ -197,32 +289,44 @@ namespace libtorrent {
 		TORRENT_ASSERT(offset >= 0);
 		std::unique_lock<std::mutex> l(m_mutex);
 
-		auto const i = m_piece_map.find(piece);
-		if (i == m_piece_map.end())
+		slot_index_t const slot = m_piece_map[piece];
+		if (slot == slot_index_t(-1))
 		{
 			ec = error_code(boost::system::errc::no_such_file_or_directory
 				, boost::system::generic_category());
 			return -1;
 		}
 
-		slot_index_t const slot = i->second;
 		open_file(file::read_write, ec);
 		if (ec) return -1;
 
+		++m_slots[slot].refs;
+		std::shared_ptr<file> f = m_file;
 		l.unlock();
 
-		std::int64_t slot_offset = std::int64_t(m_header_size) + std::int64_t(static_cast<int>(slot)) * m_piece_size;
-		return int(m_file.readv(slot_offset + offset, bufs, ec));
+		int const ret = int(f->readv(slot_offset(slot) + offset, bufs, ec));
+
+		l.lock();
+		release_slot(slot);
+		return ret;
 	}
 
 	void part_file::open_file(std::uint32_t const mode, error_code& ec)
 	{
-		if (m_file.is_open()
-			&& ((m_file.open_mode() & file::rw_mask) == mode
+		if (m_file && m_file->is_open()
+			&& ((m_file->open_mode() & file::rw_mask) == mode
 				|| mode == file::read_only)) return;
 
+		// the part file is opened sparse, to be able to deallocate freed
+		// slots on windows
+		std::uint32_t const open_mode = mode == file::read_only
+			? mode : (mode | file::sparse);
+
+		// reads and writes in progress hold on to the current file object,
+		// it is closed once they complete
 		std::string fn = combine_path(m_path, m_name);
-		m_file.open(fn, mode, ec);
+		auto f = std::make_shared<file>();
+		f->open(fn, open_mode, ec);
 		if (((mode & file::rw_mask) != file::read_only)
 			&& ec == boost::system::errc::no_such_file_or_directory)
 		{
@@ -232,37 +336,37 @@ namespace libtorrent {
 			create_directories(m_path, ec);
 
 			if (ec) return;
-			m_file.open(fn, mode, ec);
+			f->open(fn, open_mode, ec);
 		}
+		if (ec) return;
+		m_file = std::move(f);
 	}
 
 	void part_file::free_piece(piece_index_t piece)
 	{
-		std::lock_guard<std::mutex> l(m_mutex);
-
-		auto const i = m_piece_map.find(piece);
-		if (i == m_piece_map.end()) return;
+		std::unique_lock<std::mutex> l(m_mutex);
 
-		// TODO: what do we do if someone is currently reading from the disk
-		// from this piece? does it matter? Since we won't actively erase the
-		// data from disk, but it may be overwritten soon, it's probably not that
-		// big of a deal
+		slot_index_t const slot = m_piece_map[piece];
+		if (slot == slot_index_t(-1)) return;
 
-		m_free_slots.push_back(i->second);
-		m_piece_map.erase(i);
-		m_dirty_metadata = true;
+		// if someone is currently reading from or writing to this piece, the
+		// slot won't be reused until they are done
+		set_slot(piece, slot_index_t(-1));
+		--m_num_pieces;
+		free_slot(slot);
 	}
 
 	void part_file::move_partfile(std::string const& path, error_code& ec)
 	{
-		std::lock_guard<std::mutex> l(m_mutex);
+		std::lock_guard<std::mutex> fl(m_flush_mutex);
+		std::unique_lock<std::mutex> l(m_mutex);
 
-		flush_metadata_impl(ec);
+		flush_metadata_impl(l, ec);
 		if (ec) return;
 
-		m_file.close();
+		m_file.reset();
 
-		if (!m_piece_map.empty())
+		if (m_num_pieces > 0)
 		{
 			std::string old_path = combine_path(m_path, m_name);
 			std::string new_path = combine_path(path, m_name);
@@ -296,49 +400,44 @@ namespace libtorrent {
 		std::int64_t file_offset = 0;
 		for (; piece < end; ++piece)
 		{
-			auto const i = m_piece_map.find(piece);
+			slot_index_t const slot = m_piece_map[piece];
 			int const block_to_copy = int(std::min(m_piece_size - piece_offset, size));
-			if (i != m_piece_map.end())
+			if (slot != slot_index_t(-1))
 			{
-				slot_index_t const slot = i->second;
 				open_file(file::read_only, ec);
 				if (ec) return;
 
 				if (!buf) buf.reset(new char[m_piece_size]);
 
-				std::int64_t const slot_offset = std::int64_t(m_header_size)
-					+ std::int64_t(static_cast<int>(slot)) * m_piece_size;
+				// hold on to the slot, so it isn't reused while we read from it
+				++m_slots[slot].refs;
+				std::shared_ptr<file> pf = m_file;
 
 				// don't hold the lock during disk I/O
 				l.unlock();
 
 				iovec_t v = {buf.get(), std::size_t(block_to_copy)};
-				v.iov_len = std::size_t(m_file.readv(slot_offset + piece_offset, v, ec));
+				v.iov_len = std::size_t(pf->readv(slot_offset(slot) + piece_offset, v, ec));
 				TORRENT_ASSERT(!ec);
-				if (ec || v.iov_len == 0) return;
-
-				f(file_offset, {buf.get(), std::size_t(block_to_copy)});
+				if (!ec && v.iov_len > 0)
+					f(file_offset, {buf.get(), std::size_t(block_to_copy)});
 
 				// we're done with the disk I/O, grab the lock again to update
 				// the slot map
 				l.lock();
 
-				if (block_to_copy == m_piece_size)
+				if (!ec && v.iov_len > 0 && block_to_copy == m_piece_size
+					&& m_piece_map[piece] == slot)
 				{
 					// since we released the lock, it's technically possible that
-					// another thread removed this slot map entry, and invalidated
-					// our iterator. Now that we hold the lock again, perform
-					// another lookup to be sure.
-					auto const j = m_piece_map.find(piece);
-					if (j != m_piece_map.end())
-					{
-						// if the slot moved, that's really suspicious
-						TORRENT_ASSERT(j->second == slot);
-						m_free_slots.push_back(j->second);
-						m_piece_map.erase(j);
-						m_dirty_metadata = true;
-					}
+					// another thread freed the piece. Only free it if it's still
+					// in the slot we read it from
+					set_slot(piece, slot_index_t(-1));
+					--m_num_pieces;
+					free_slot(slot);
 				}
+				release_slot(slot);
+				if (ec || v.iov_len == 0) return;
 			}
 			file_offset += block_to_copy;
 			piece_offset = 0;
@@ -348,21 +447,26 @@ namespace libtorrent {
 
 	void part_file::flush_metadata(error_code& ec)
 	{
-		std::lock_guard<std::mutex> l(m_mutex);
+		std::lock_guard<std::mutex> fl(m_flush_mutex);
+		std::unique_lock<std::mutex> l(m_mutex);
 
-		flush_metadata_impl(ec);
+		flush_metadata_impl(l, ec);
 	}
 
-	// TODO: instead of rebuilding the whole file header
-	// and flushing it, update the slot entries as we go
-	void part_file::flush_metadata_impl(error_code& ec)
+	// m_flush_mutex is expected to be held by the caller (except in the
+	// destructor), as well as m_mutex, via l. The mutex is released while
+	// writing to the file
+	void part_file::flush_metadata_impl(std::unique_lock<std::mutex>& l
+		, error_code& ec)
 	{
+		TORRENT_ASSERT(l.owns_lock());
+
 		// do we need to flush the metadata?
 		if (m_dirty_metadata == false) return;
 
-		if (m_piece_map.empty())
+		if (m_num_pieces == 0)
 		{
-			m_file.close();
+			m_file.reset();
 
 			// if we don't have any pieces left in the
 			// part file, remove it
@@ -371,31 +475,131 @@ namespace libtorrent {
 
 			if (ec == boost::system::errc::no_such_file_or_directory)
 				ec.clear();
+
+			// if the part file is created again, it needs a complete header
+			std::fill(m_dirty_blocks.begin(), m_dirty_blocks.end(), true);
+			for (slot_index_t const& slot : m_free_slots)
+				m_slots[slot].needs_punch = false;
 			return;
 		}
 
 		open_file(file::read_write, ec);
 		if (ec) return;
 
-		std::unique_ptr<std::uint32_t[]> header(new std::uint32_t[m_header_size]);
-
 		using namespace libtorrent::detail;
 
-		char* ptr = reinterpret_cast<char*>(header.get());
+		// copy the blocks that changed into a buffer, and note which ranges of
+		// the header they belong to. Adjacent blocks are merged
+		std::vector<char> buffer;
+		std::vector<std::pair<int, int>> ranges;
+		int const num_blocks = int(m_dirty_blocks.size());
+		for (int block = 0; block < num_blocks; ++block)
+		{
+			if (!m_dirty_blocks[std::size_t(block)]) continue;
+			m_dirty_blocks[std::size_t(block)] = false;
+
+			int const start = block * header_block_size;
+			int const block_end = std::min(start + header_block_size, m_header_size);
+			if (!ranges.empty() && ranges.back().first + ranges.back().second == start)
+				ranges.back().second += block_end - start;
+			else
+				ranges.emplace_back(start, block_end - start);
+
+			std::size_t const buf_start = buffer.size();
+			buffer.resize(buf_start + std::size_t(block_end - start), 0);
+			char* ptr = buffer.data() + buf_start;
+			int pos = start;
+			if (pos == 0)
+			{
+				write_uint32(m_max_pieces, ptr);
+				write_uint32(m_piece_size, ptr);
+				pos = 8;
+			}
+			// the slot entries in this block
+			piece_index_t piece((pos - 8) / 4);
+			for (; pos + 4 <= block_end && piece < m_piece_map.end_index(); pos += 4, ++piece)
+				write_int32(static_cast<int>(m_piece_map[piece]), ptr);
+		}
+		m_dirty_metadata = false;
+		std::shared_ptr<file> f = m_file;
+
+		// take the free slots that haven't been deallocated yet off the free
+		// list while we punch holes in their place. Nobody else can touch them
+		// without holding the mutex
+		std::vector<slot_index_t> punch;
+		if (m_punch_holes)
+		{
+			auto const it = std::stable_partition(m_free_slots.begin(), m_free_slots.end()
+				, [this](slot_index_t const s) { return !m_slots[s].needs_punch; });
+			punch.assign(it, m_free_slots.end());
+			m_free_slots.erase(it, m_free_slots.end());
+		}
+
+		// don't hold the lock while writing to disk. Another flush can't
+		// overwrite these blocks with stale data, since we hold m_flush_mutex
+		l.unlock();
+
+		char* ptr = buffer.data();
+		std::size_t failed = ranges.size();
+		for (std::size_t i = 0; i < ranges.size(); ++i)
+		{
+			iovec_t b = {ptr, std::size_t(ranges[i].second)};
+			f->writev(ranges[i].first, b, ec);
+			if (ec)
+			{
+				failed = i;
+				break;
+			}
+			ptr += ranges[i].second;
+		}
+
+		// only deallocate the slots once the header no longer refers to them.
+		// The range is rounded inwards to whole blocks. A slot that fails for
+		// any other reason than the filesystem not supporting it is left as
+		// it is, it will be overwritten by the next piece using it anyway
+		bool punch_supported = true;
+		std::size_t punched = 0;
+		if (!ec)
+		{
+			for (; punched < punch.size(); ++punched)
+			{
+				std::int64_t const slot_start = slot_offset(punch[punched]);
+				std::int64_t const start = (slot_start + punch_block_size - 1)
+					/ punch_block_size * punch_block_size;
+				std::int64_t const end = (slot_start + m_piece_size)
+					/ punch_block_size * punch_block_size;
+				if (end <= start) continue;
+
+				error_code punch_ec;
+				f->punch_hole(start, end - start, punch_ec);
+				if (punch_ec && punch_not_supported(punch_ec))
+				{
+					punch_supported = false;
+					break;
+				}
+			}
+		}
 
-		write_uint32(m_max_pieces, ptr);
-		write_uint32(m_piece_size, ptr);
+		l.lock();
 
-		for (piece_index_t piece(0); piece < piece_index_t(m_max_pieces); ++piece)
+		for (std::size_t i = 0; i < punch.size(); ++i)
 		{
-			auto const i = m_piece_map.find(piece);
-			slot_index_t const slot(i == m_piece_map.end()
-				? slot_index_t(-1) : i->second);
-			write_int32(static_cast<int>(slot), ptr);
+			m_slots[punch[i]].needs_punch = i >= punched;
+			m_free_slots.push_back(punch[i]);
 		}
-		std::memset(ptr, 0, std::size_t(m_header_size - (ptr - reinterpret_cast<char*>(header.get()))));
 
-		iovec_t b = {header.get(), std::size_t(m_header_size)};
-		m_file.writev(0, b, ec);
+		// this is an optimization. If the filesystem doesn't support it, stop
+		// trying
+		if (!punch_supported) m_punch_holes = false;
+
+		// the blocks we didn't manage to write are still dirty
+		for (std::size_t i = failed; i < ranges.size(); ++i)
+		{
+			int const first = ranges[i].first / header_block_size;
+			int const last = (ranges[i].first + ranges[i].second - 1) / header_block_size;
+			for (int block = first; block <= last; ++block)
+				m_dirty_blocks[std::size_t(block)] = true;
+			m_dirty_metadata = true;
+		}
 	}
 }
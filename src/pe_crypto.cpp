@@ -54,6 +54,17 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/pe_crypto.hpp"
 #include "libtorrent/hasher.hpp"
 
+// without CryptoAPI, /dev/random or libcrypto, random_bytes() falls back to
+// the unsynchronized shared PRNG. The dh_key_pool thread can't use it then, and
+// reads /dev/urandom instead
+#if !defined TORRENT_BUILD_SIMULATOR && !defined TORRENT_WINDOWS \
+	&& !TORRENT_USE_DEV_RANDOM && !defined TORRENT_USE_LIBCRYPTO
+#define TORRENT_DH_POOL_URANDOM 1
+#include "libtorrent/aux_/dev_random.hpp"
+#else
+#define TORRENT_DH_POOL_URANDOM 0
+#endif
+
 namespace libtorrent {
 
 	namespace mp = boost::multiprecision;
@@ -62,6 +73,189 @@ namespace libtorrent {
 		// TODO: it would be nice to get the literal working
 		key_t const dh_prime
 			("0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563");
+
+		// the dh_key_pool thread needs a thread safe source of randomness,
+		// and the simulator has to be deterministic
+#if defined TORRENT_BUILD_SIMULATOR \
+	|| (defined TORRENT_WINDOWS && !TORRENT_USE_CRYPTOAPI && !defined TORRENT_USE_LIBCRYPTO)
+		bool const dh_pool_thread_supported = false;
+#else
+		bool const dh_pool_thread_supported = true;
+#endif
+
+		// the source of randomness for keypairs generated by the dh_key_pool
+		// thread
+		void pool_random_bytes(span<char> buffer)
+		{
+#if TORRENT_DH_POOL_URANDOM
+			static aux::dev_random dev("/dev/urandom");
+			dev.read(buffer);
+#else
+			aux::random_bytes(buffer);
+#endif
+		}
+
+#if defined __SIZEOF_INT128__
+		// Montgomery arithmetic modulo dh_prime, on 64 bit limbs. The modulus
+		// is fixed, so the constants are computed once. This avoids the
+		// division in every step of the generic powm()
+		using limb_t = std::uint64_t;
+		using dlimb_t = unsigned __int128;
+		int const limb_bits = 64;
+		int const num_limbs = 768 / limb_bits;
+		using limbs_t = std::array<limb_t, num_limbs>;
+
+		// least significant limb first
+		limbs_t to_limbs(key_t const& k)
+		{
+			limbs_t ret{};
+			mp::export_bits(k, ret.begin(), limb_bits, false);
+			return ret;
+		}
+
+		key_t from_limbs(limbs_t const& l)
+		{
+			key_t ret;
+			mp::import_bits(ret, l.begin(), l.end(), limb_bits, false);
+			return ret;
+		}
+
+		struct montgomery_ctx
+		{
+			montgomery_ctx()
+			{
+				prime = to_limbs(dh_prime);
+
+				// -prime^-1 mod 2^64, by Newton's iteration. Each step doubles
+				// the number of correct bits
+				limb_t inv = 1;
+				for (int i = 0; i < 6; ++i) inv *= 2 - prime[0] * inv;
+				n0 = limb_t(0) - inv;
+
+				using wide_t = mp::number<mp::cpp_int_backend<1600, 1600
+					, mp::unsigned_magnitude, mp::unchecked, void>>;
+				wide_t const r = wide_t(1) << 768;
+				wide_t const p(dh_prime);
+				one = to_limbs(key_t(r % p));
+				r2 = to_limbs(key_t((r * r) % p));
+			}
+
+			limbs_t prime;
+			limb_t n0;
+			// R mod prime and R^2 mod prime, where R = 2^768
+			limbs_t one;
+			limbs_t r2;
+		};
+
+		montgomery_ctx const& mont()
+		{
+			static montgomery_ctx const ctx;
+			return ctx;
+		}
+
+		// out = a * b * R^-1 mod prime. out may alias a or b
+		void mont_mul(limbs_t& out, limbs_t const& a, limbs_t const& b
+			, montgomery_ctx const& ctx)
+		{
+			limb_t t[num_limbs + 2] = {};
+			for (int i = 0; i < num_limbs; ++i)
+			{
+				limb_t carry = 0;
+				for (int j = 0; j < num_limbs; ++j)
+				{
+					dlimb_t const s = dlimb_t(a[j]) * b[i] + t[j] + carry;
+					t[j] = limb_t(s);
+					carry = limb_t(s >> limb_bits);
+				}
+				dlimb_t s = dlimb_t(t[num_limbs]) + carry;
+				t[num_limbs] = limb_t(s);
+				t[num_limbs + 1] = limb_t(s >> limb_bits);
+
+				// add a multiple of the prime to make the lowest limb zero, and
+				// shift down by one limb
+				limb_t const m = t[0] * ctx.n0;
+				s = dlimb_t(m) * ctx.prime[0] + t[0];
+				carry = limb_t(s >> limb_bits);
+				for (int j = 1; j < num_limbs; ++j)
+				{
+					s = dlimb_t(m) * ctx.prime[j] + t[j] + carry;
+					t[j - 1] = limb_t(s);
+					carry = limb_t(s >> limb_bits);
+				}
+				s = dlimb_t(t[num_limbs]) + carry;
+				t[num_limbs - 1] = limb_t(s);
+				t[num_limbs] = t[num_limbs + 1] + limb_t(s >> limb_bits);
+			}
+
+			// t < 2 * prime, subtract the prime once if t >= prime
+			limbs_t r;
+			limb_t borrow = 0;
+			for (int j = 0; j < num_limbs; ++j)
+			{
+				dlimb_t const d = dlimb_t(t[j]) - ctx.prime[j] - borrow;
+				r[j] = limb_t(d);
+				borrow = limb_t(d >> limb_bits) & 1;
+			}
+			bool const use_r = t[num_limbs] != 0 || borrow == 0;
+			for (int j = 0; j < num_limbs; ++j)
+				out[j] = use_r ? r[j] : t[j];
+		}
+#endif
+	}
+
+	key_t dh_powm(key_t const& base, key_t const& exponent)
+	{
+#if defined __SIZEOF_INT128__
+		montgomery_ctx const& ctx = mont();
+
+		// fixed 4 bit window. table[i] = base^i in Montgomery form
+		std::array<limbs_t, 16> table;
+		table[0] = ctx.one;
+		mont_mul(table[1], to_limbs(base % dh_prime), ctx.r2, ctx);
+		for (int i = 2; i < 16; ++i)
+			mont_mul(table[i], table[i - 1], table[1], ctx);
+
+		limbs_t const e = to_limbs(exponent);
+		limbs_t acc = ctx.one;
+		int const digits_per_limb = limb_bits / 4;
+		for (int i = num_limbs * digits_per_limb - 1; i >= 0; --i)
+		{
+			for (int k = 0; k < 4; ++k) mont_mul(acc, acc, acc, ctx);
+			int const digit = int((e[std::size_t(i / digits_per_limb)]
+				>> ((i % digits_per_limb) * 4)) & 0xf);
+			if (digit != 0) mont_mul(acc, acc, table[std::size_t(digit)], ctx);
+		}
+
+		// convert back out of Montgomery form
+		limbs_t unit{};
+		unit[0] = 1;
+		mont_mul(acc, acc, unit, ctx);
+		return from_limbs(acc);
+#else
+		return mp::powm(base, exponent, dh_prime);
+#endif
+	}
+
+	namespace {
+
+		dh_keypair generate_dh_keypair(void (*rand)(span<char>))
+		{
+			std::array<std::uint8_t, 96> random_key;
+			rand({reinterpret_cast<char*>(random_key.data()), random_key.size()});
+
+			dh_keypair ret;
+			// create local key (random)
+			mp::import_bits(ret.secret, random_key.begin(), random_key.end());
+
+			// key = (2 ^ secret) % prime
+			ret.public_key = dh_powm(key_t(2), ret.secret);
+			return ret;
+		}
+	}
+
+	dh_keypair generate_dh_keypair()
+	{
+		return generate_dh_keypair(&aux::random_bytes);
 	}
 
 	std::array<char, 96> export_key(key_t const& k)
@@ -82,20 +276,17 @@ namespace libtorrent {
 	}
 
 	void rc4_init(const unsigned char* in, std::size_t len, rc4 *state);
-	std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state);
+	int rc4_encrypt(span<span<char>> bufs, rc4 *state);
 
 	// Set the prime P and the generator, generate local public key
 	dh_key_exchange::dh_key_exchange()
-	{
-		std::array<std::uint8_t, 96> random_key;
-		aux::random_bytes({reinterpret_cast<char*>(random_key.data()), random_key.size()});
-
-		// create local key (random)
-		mp::import_bits(m_dh_local_secret, random_key.begin(), random_key.end());
+		: dh_key_exchange(generate_dh_keypair())
+	{}
 
-		// key = (2 ^ secret) % prime
-		m_dh_local_key = mp::powm(key_t(2), m_dh_local_secret, dh_prime);
-	}
+	dh_key_exchange::dh_key_exchange(dh_keypair const& kp)
+		: m_dh_local_key(kp.public_key)
+		, m_dh_local_secret(kp.secret)
+	{}
 
 	// compute shared secret given remote public key
 	void dh_key_exchange::compute_secret(std::uint8_t const* remote_pubkey)
@@ -109,7 +300,7 @@ namespace libtorrent {
 	void dh_key_exchange::compute_secret(key_t const& remote_pubkey)
 	{
 		// shared_secret = (remote_pubkey ^ local_secret) % prime
-		m_dh_shared_secret = mp::powm(remote_pubkey, m_dh_local_secret, dh_prime);
+		m_dh_shared_secret = dh_powm(remote_pubkey, m_dh_local_secret);
 
 		std::array<char, 96> buffer;
 		mp::export_bits(m_dh_shared_secret, reinterpret_cast<std::uint8_t*>(buffer.data()), 8);
@@ -119,6 +310,92 @@ namespace libtorrent {
 		m_xor_mask = hasher(req3).update(buffer).final();
 	}
 
+	dh_key_pool::dh_key_pool(int const size)
+		: m_max_keys(std::max(size, 0))
+	{}
+
+	dh_key_pool::~dh_key_pool()
+	{
+		stop();
+	}
+
+	bool dh_key_pool::get(dh_keypair& kp)
+	{
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			if (dh_pool_thread_supported
+				&& !m_abort && m_max_keys > 0 && !m_thread.joinable())
+				m_thread = std::thread(&dh_key_pool::thread_fun, this);
+
+			if (!m_keys.empty())
+			{
+				kp = m_keys.back();
+				m_keys.pop_back();
+				l.unlock();
+				m_cond.notify_all();
+				return true;
+			}
+		}
+		kp = generate_dh_keypair();
+		return false;
+	}
+
+	void dh_key_pool::set_size(int const size)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_max_keys = std::max(size, 0);
+		if (int(m_keys.size()) > m_max_keys)
+			m_keys.resize(std::size_t(m_max_keys));
+		l.unlock();
+		m_cond.notify_all();
+	}
+
+	int dh_key_pool::num_keys() const
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		return int(m_keys.size());
+	}
+
+	void dh_key_pool::stop()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_abort = true;
+		m_keys.clear();
+		l.unlock();
+		m_cond.notify_all();
+		if (m_thread.joinable()) m_thread.join();
+	}
+
+	void dh_key_pool::thread_fun()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		for (;;)
+		{
+			m_cond.wait(l, [this] { return m_abort || int(m_keys.size()) < m_max_keys; });
+			if (m_abort) break;
+
+			// generating a keypair takes about a millisecond, don't hold the
+			// mutex while doing it
+			l.unlock();
+			dh_keypair kp;
+			TORRENT_TRY
+			{
+				kp = generate_dh_keypair(&pool_random_bytes);
+			}
+			TORRENT_CATCH(std::exception const&)
+			{
+				// we failed to get entropy. Leave it to get() to generate keys
+				// inline, and report the error on the network thread
+				l.lock();
+				m_abort = true;
+				break;
+			}
+			l.lock();
+			if (int(m_keys.size()) < m_max_keys)
+				m_keys.push_back(std::move(kp));
+		}
+	}
+
 	std::tuple<int, span<span<char const>>>
 	encryption_handler::encrypt(
 		span<span<char>> iovec)
@@ -311,37 +588,15 @@ namespace libtorrent {
 		if (!m_encrypt) return std::make_tuple(0, empty);
 		if (bufs.size() == 0) return std::make_tuple(0, empty);
 
-		int bytes_processed = 0;
-		for (auto& buf : bufs)
-		{
-			unsigned char* const pos = reinterpret_cast<unsigned char*>(buf.data());
-			int const len = int(buf.size());
-
-			TORRENT_ASSERT(len >= 0);
-			TORRENT_ASSERT(pos);
-
-			bytes_processed += len;
-			rc4_encrypt(pos, std::uint32_t(len), &m_rc4_outgoing);
-		}
+		int const bytes_processed = rc4_encrypt(bufs, &m_rc4_outgoing);
 		return std::make_tuple(bytes_processed, empty);
 	}
 
 	std::tuple<int, int, int> rc4_handler::decrypt(span<span<char>> bufs)
 	{
-		if (!m_decrypt) std::make_tuple(0, 0, 0);
-
-		int bytes_processed = 0;
-		for (auto& buf : bufs)
-		{
-			unsigned char* const pos = reinterpret_cast<unsigned char*>(buf.data());
-			int const len = int(buf.size());
+		if (!m_decrypt) return std::make_tuple(0, 0, 0);
 
-			TORRENT_ASSERT(len >= 0);
-			TORRENT_ASSERT(pos);
-
-			bytes_processed += len;
-			rc4_encrypt(pos, std::uint32_t(len), &m_rc4_incoming);
-		}
+		int const bytes_processed = rc4_encrypt(bufs, &m_rc4_incoming);
 		return std::make_tuple(0, bytes_processed, 0);
 	}
 
@@ -386,28 +641,77 @@ void rc4_init(const unsigned char* in, std::size_t len, rc4 *state)
 	state->y = 0;
 }
 
-std::size_t rc4_encrypt(unsigned char *out, std::size_t outlen, rc4 *state)
+// encrypts (or decrypts) all buffers in place, returns the number of bytes
+int rc4_encrypt(span<span<char>> bufs, rc4 *state)
 {
-	std::uint8_t x, y, *s, tmp;
-	std::size_t n;
-
-	TORRENT_ASSERT(out != nullptr);
 	TORRENT_ASSERT(state != nullptr);
 
-	n = outlen;
-	x = state->x & 0xff;
-	y = state->y & 0xff;
-	s = state->buf.data();
-	while (outlen--) {
-		x = (x + 1) & 255;
-		y = (y + s[x]) & 255;
-		tmp = s[x]; s[x] = s[y]; s[y] = tmp;
-		tmp = (s[x] + s[y]) & 255;
-		*out++ ^= s[tmp];
+	std::uint32_t x = std::uint32_t(state->x) & 0xff;
+	std::uint32_t y = std::uint32_t(state->y) & 0xff;
+
+	std::size_t total = 0;
+	for (auto const& buf : bufs) total += buf.size();
+
+	int bytes_processed = 0;
+	if (total < 128)
+	{
+		// most peer wire messages are only a few bytes. For those, copying
+		// the permutation (below) costs more than it saves, so it's updated
+		// in place
+		std::uint8_t* const s = state->buf.data();
+		for (auto& buf : bufs)
+		{
+			unsigned char* const out = reinterpret_cast<unsigned char*>(buf.data());
+			std::size_t const len = buf.size();
+			TORRENT_ASSERT(out != nullptr || len == 0);
+
+			for (std::size_t i = 0; i < len; ++i)
+			{
+				x = (x + 1) & 0xff;
+				std::uint8_t const sx = s[x];
+				y = (y + sx) & 0xff;
+				std::uint8_t const sy = s[y];
+				s[x] = sy;
+				s[y] = sx;
+				out[i] ^= s[(sx + sy) & 0xff];
+			}
+			bytes_processed += int(len);
+		}
+	}
+	else
+	{
+		// for larger buffers, the permutation is copied into a local array of
+		// 32 bit words for the duration of the call. Since it's local, the
+		// compiler knows it can't alias the output buffer, and working on full
+		// words avoids partial register updates. See tools/bench_rc4.cpp
+		std::uint32_t s[256];
+		for (int i = 0; i < 256; ++i) s[i] = state->buf[i];
+
+		for (auto& buf : bufs)
+		{
+			unsigned char* const out = reinterpret_cast<unsigned char*>(buf.data());
+			std::size_t const len = buf.size();
+			TORRENT_ASSERT(out != nullptr || len == 0);
+
+			for (std::size_t i = 0; i < len; ++i)
+			{
+				x = (x + 1) & 0xff;
+				std::uint32_t const sx = s[x];
+				y = (y + sx) & 0xff;
+				std::uint32_t const sy = s[y];
+				s[x] = sy;
+				s[y] = sx;
+				out[i] ^= std::uint8_t(s[(sx + sy) & 0xff]);
+			}
+			bytes_processed += int(len);
+		}
+
+		for (int i = 0; i < 256; ++i) state->buf[i] = std::uint8_t(s[i]);
 	}
-	state->x = x;
-	state->y = y;
-	return n;
+
+	state->x = int(x);
+	state->y = int(y);
+	return bytes_processed;
 }
 
 } // namespace libtorrent
@@ -139,6 +139,10 @@ namespace libtorrent {
 		, m_has_metadata(true)
 		, m_exceeded_limit(false)
 		, m_slow_start(true)
+		, m_send_deferred(false)
+		, m_in_receive_batch(false)
+		, m_batch_pick_pending(false)
+		, m_batch_pick_useful(false)
 	{
 		m_counters.inc_stats_counter(counters::num_tcp_peers + m_socket->type() - 1);
 
@@ -2587,7 +2591,24 @@ namespace libtorrent {
 	// ----------- PIECE -----------
 	// -----------------------------
 
+	disk_buffer_holder peer_connection::allocate_receive_buffer()
+	{
+		return m_disk_thread.allocate_receive_buffer(self());
+	}
+
 	void peer_connection::incoming_piece(peer_request const& p, char const* data)
+	{
+		incoming_piece_impl(p, data, disk_buffer_holder());
+	}
+
+	void peer_connection::incoming_piece(peer_request const& p, disk_buffer_holder data)
+	{
+		char const* const buf = data.get();
+		incoming_piece_impl(p, buf, std::move(data));
+	}
+
+	void peer_connection::incoming_piece_impl(peer_request const& p
+		, char const* data, disk_buffer_holder buffer)
 	{
 		TORRENT_ASSERT(is_single_thread());
 		INVARIANT_CHECK;
@@ -2759,9 +2780,7 @@ namespace libtorrent {
 			if (!m_download_queue.empty())
 				m_requested = now;
 
-			if (request_a_block(*t, *this))
-				m_counters.inc_stats_counter(counters::incoming_redundant_piece_picks);
-			send_block_requests();
+			pick_after_incoming_piece(*t, true);
 			return;
 		}
 
@@ -2795,9 +2814,20 @@ namespace libtorrent {
 
 		if (t->is_deleted()) return;
 
-		bool const exceeded = m_disk_thread.async_write(t->storage(), p, data, self()
-			, std::bind(&peer_connection::on_disk_write_complete
-			, self(), _1, p, t));
+		bool exceeded = false;
+		if (buffer)
+		{
+			m_counters.inc_stats_counter(counters::recv_payload_zero_copy_bytes, p.length);
+			queue_write(*t, p, std::move(buffer));
+		}
+		else
+		{
+			flush_pending_writes();
+			m_counters.inc_stats_counter(counters::recv_payload_copied_bytes, p.length);
+			exceeded = m_disk_thread.async_write(t->storage(), p, data, self()
+				, std::bind(&peer_connection::on_disk_write_complete
+				, self(), _1, p, t));
+		}
 
 		// every peer is entitled to have two disk blocks allocated at any given
 		// time, regardless of whether the cache size is exceeded or not. If this
@@ -2915,6 +2945,8 @@ namespace libtorrent {
 #if TORRENT_USE_INVARIANT_CHECKS
 			check_postcondition post_checker2_(t, false);
 #endif
+			// the hash job must be issued after the writes of this piece
+			flush_pending_writes();
 			t->verify_piece(p.piece);
 		}
 
@@ -2922,8 +2954,83 @@ namespace libtorrent {
 
 		if (is_disconnecting()) return;
 
-		if (request_a_block(*t, *this))
-			m_counters.inc_stats_counter(counters::incoming_piece_picks);
+		pick_after_incoming_piece(*t, false);
+	}
+
+	void peer_connection::queue_write(torrent& t, peer_request const& p
+		, disk_buffer_holder buffer)
+	{
+		std::function<void(storage_error const&)> handler = std::bind(
+			&peer_connection::on_disk_write_complete, self(), _1, p, t.shared_from_this());
+
+		if (!m_in_receive_batch)
+		{
+			m_disk_thread.async_write(t.storage(), p, std::move(buffer), std::move(handler));
+			return;
+		}
+
+		// only a contiguous run of blocks of the same piece can be submitted
+		// as one job
+		if (!m_pending_writes.empty())
+		{
+			peer_request const& last = m_pending_writes.back().r;
+			if (m_pending_writes_torrent.get() != &t
+				|| last.piece != p.piece
+				|| last.start + last.length != p.start)
+			{
+				flush_pending_writes();
+			}
+		}
+
+		if (m_pending_writes.empty()) m_pending_writes_torrent = t.shared_from_this();
+		m_pending_writes.push_back(disk_write_block{p, std::move(buffer), std::move(handler)});
+	}
+
+	void peer_connection::flush_pending_writes()
+	{
+		if (m_pending_writes.empty()) return;
+
+		std::shared_ptr<torrent> t = std::move(m_pending_writes_torrent);
+		m_pending_writes_torrent.reset();
+		if (!t->has_storage())
+		{
+			// the torrent lost its storage while we were handling the batch.
+			// Fail the writes the same way the disk thread fails jobs for a
+			// removed storage
+			for (auto& b : m_pending_writes)
+			{
+				m_ios.post(std::bind(std::move(b.handler)
+					, storage_error(boost::asio::error::operation_aborted)));
+			}
+		}
+		else if (m_pending_writes.size() == 1)
+		{
+			disk_write_block& b = m_pending_writes.front();
+			m_disk_thread.async_write(t->storage(), b.r, std::move(b.buffer)
+				, std::move(b.handler));
+		}
+		else
+		{
+			m_disk_thread.async_write_blocks(t->storage(), m_pending_writes);
+		}
+		m_pending_writes.clear();
+	}
+
+	void peer_connection::pick_after_incoming_piece(torrent& t, bool const redundant)
+	{
+		if (m_in_receive_batch)
+		{
+			m_batch_pick_pending = true;
+			if (!redundant) m_batch_pick_useful = true;
+			return;
+		}
+
+		if (request_a_block(t, *this))
+		{
+			m_counters.inc_stats_counter(redundant
+				? counters::incoming_redundant_piece_picks
+				: counters::incoming_piece_picks);
+		}
 		send_block_requests();
 	}
 
@@ -5559,6 +5666,7 @@ namespace libtorrent {
 
 		m_socket->async_write_some(vec, make_write_handler(std::bind(
 			&peer_connection::on_send_data, self(), _1, _2)));
+		m_counters.inc_stats_counter(counters::peer_socket_writes);
 
 		m_channel_state[upload_channel] |= peer_info::bw_network;
 		m_last_sent = aux::time_now();
@@ -5685,6 +5793,34 @@ namespace libtorrent {
 			m_send_buffer.append_buffer(std::move(session_buf)
 				, alloc_buf_size, buf_size);
 		}
+		defer_send();
+	}
+
+	void peer_connection::defer_send()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (m_send_deferred) return;
+
+		// if there's an outstanding write, the buffer will be flushed once it
+		// completes anyway. A cork sets the same bw_network flag (see the cork
+		// struct), so this also covers sends made while we're corked, which
+		// are flushed when the cork is released
+		if (m_channel_state[upload_channel] & peer_info::bw_network)
+		{
+			setup_send();
+			return;
+		}
+
+		m_send_deferred = true;
+		m_counters.inc_stats_counter(counters::peer_sends_deferred);
+		m_ses.deferred_send(self());
+	}
+
+	void peer_connection::flush_deferred_send()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		TORRENT_ASSERT(m_send_deferred);
+		m_send_deferred = false;
 		setup_send();
 	}
 
@@ -5797,6 +5933,11 @@ namespace libtorrent {
 				return;
 			}
 
+			// when receiving into a disk buffer, we can't read past the end
+			// of the current message
+			if (m_recv_buffer.has_disk_buffer())
+				buffer_size = std::min(buffer_size, m_recv_buffer.max_receive());
+
 #ifndef TORRENT_DISABLE_LOGGING
 			peer_log(peer_log_alert::incoming, "AVAILABLE"
 				, "%d bytes", buffer_size);
@@ -5846,19 +5987,42 @@ namespace libtorrent {
 		bool const prev_choked = m_peer_choked;
 		int bytes = int(bytes_transferred);
 		int sub_transferred = 0;
+		TORRENT_ASSERT(!m_in_receive_batch);
+		m_in_receive_batch = true;
 		do {
 			sub_transferred = m_recv_buffer.advance_pos(bytes);
 			TORRENT_ASSERT(sub_transferred > 0);
 			on_receive(error, std::size_t(sub_transferred));
 			bytes -= sub_transferred;
-			if (m_disconnecting) return;
+			if (m_disconnecting) break;
 		} while (bytes > 0 && sub_transferred > 0);
+		m_in_receive_batch = false;
+		flush_pending_writes();
+
+		bool const pick = m_batch_pick_pending;
+		bool const useful = m_batch_pick_useful;
+		m_batch_pick_pending = false;
+		m_batch_pick_useful = false;
+		if (m_disconnecting) return;
+
+		if (pick)
+		{
+			std::shared_ptr<torrent> t = m_torrent.lock();
+			if (t) pick_after_incoming_piece(*t, !useful);
+			if (m_disconnecting) return;
+		}
 
 		// if the peer went from unchoked to choked, suggest to the receive
 		// buffer that it shrinks to 100 bytes
 		int const force_shrink = (m_peer_choked && !prev_choked)
 			? 100 : 0;
-		m_recv_buffer.normalize(force_shrink);
+		int bytes_moved;
+		int bytes_not_moved;
+		std::tie(bytes_moved, bytes_not_moved) = m_recv_buffer.normalize(force_shrink);
+		if (bytes_moved > 0)
+			m_counters.inc_stats_counter(counters::recv_buffer_bytes_moved, bytes_moved);
+		if (bytes_not_moved > 0)
+			m_counters.inc_stats_counter(counters::recv_buffer_move_bytes_saved, bytes_not_moved);
 
 		if (m_recv_buffer.max_receive() == 0)
 		{
@@ -0,0 +1,121 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/aux_/read_ahead.hpp"
+#include "libtorrent/assert.hpp"
+
+#include <algorithm>
+
+namespace libtorrent { namespace aux {
+
+	constexpr int read_ahead_predictor::min_run;
+	constexpr int read_ahead_predictor::max_streams;
+
+	read_ahead_predictor::decision read_ahead_predictor::on_read(
+		piece_index_t const piece, bool const hit, bool const sequential
+		, int const max_pieces, piece_index_t const end_piece)
+	{
+		TORRENT_ASSERT(piece >= piece_index_t(0));
+		TORRENT_ASSERT(piece < end_piece);
+
+		decision ret;
+		++m_clock;
+
+		// a read continues a stream if it's from the same piece as the
+		// stream's last read, or from the next one
+		auto s = std::find_if(m_streams.begin(), m_streams.end()
+			, [piece](stream const& st)
+			{
+				return st.piece >= piece_index_t(0)
+					&& (st.piece == piece || next(st.piece) == piece);
+			});
+
+		if (s == m_streams.end())
+		{
+			s = std::min_element(m_streams.begin(), m_streams.end()
+				, [](stream const& lhs, stream const& rhs)
+				{ return lhs.last_use < rhs.last_use; });
+			*s = stream();
+			s->piece = piece;
+			s->run = 1;
+		}
+		else if (s->piece == piece)
+		{
+			// just another block from the same piece
+			s->last_use = m_clock;
+			return ret;
+		}
+		else
+		{
+			s->piece = piece;
+			++s->run;
+		}
+		s->last_use = m_clock;
+
+		if (piece >= s->ahead_start && piece < s->ahead_end)
+		{
+			ret.read_ahead = true;
+			if (hit)
+			{
+				s->window = std::min(s->window * 2, max_pieces);
+			}
+			else
+			{
+				// the piece was evicted before it was needed. We're reading
+				// further ahead than the cache can hold
+				s->window /= 2;
+				if (s->window == 0)
+				{
+					s->run = 0;
+					s->ahead_end = piece;
+				}
+			}
+		}
+
+		if (s->ahead_end <= piece) s->ahead_end = next(piece);
+		s->ahead_start = next(piece);
+
+		if (max_pieces <= 0) return ret;
+		if (s->run < min_run && !sequential) return ret;
+
+		s->window = std::max(1, std::min(s->window, max_pieces));
+
+		piece_index_t const target(std::min(static_cast<int>(piece) + 1 + s->window
+			, static_cast<int>(end_piece)));
+		if (s->ahead_end >= target) return ret;
+
+		ret.first = s->ahead_end;
+		ret.end = target;
+		s->ahead_end = target;
+		return ret;
+	}
+}}
@@ -39,6 +39,8 @@ namespace libtorrent {
 
 int receive_buffer::max_receive() const
 {
+	if (m_disk_recv_buffer_size > 0)
+		return m_disk_recv_buffer_size - m_disk_recv_end;
 	return int(m_recv_buffer.size()) - m_recv_end;
 }
 
@@ -48,15 +50,27 @@ span<char> receive_buffer::reserve(int const size)
 	TORRENT_ASSERT(size > 0);
 	TORRENT_ASSERT(m_recv_pos >= 0);
 
-	// normalize() must be called before receiving more data
-	TORRENT_ASSERT(m_recv_start == 0);
+	// the rest of the current packet goes into the disk buffer. Don't
+	// receive past the end of it
+	if (m_disk_recv_buffer_size > 0)
+	{
+		TORRENT_ASSERT(m_disk_recv_end < m_disk_recv_buffer_size);
+		return span<char>(m_disk_recv_buffer.get() + m_disk_recv_end
+			, aux::numeric_cast<std::size_t>(std::min(size, m_disk_recv_buffer_size - m_disk_recv_end)));
+	}
 
 	if (int(m_recv_buffer.size()) < m_recv_end + size)
 	{
-		int const new_size = std::max(m_recv_end + size, m_packet_size);
+		// normalize() may have left the current packet where it was, in
+		// which case only the bytes from m_recv_start need to be copied
+		account_deferred(m_recv_start);
+		int const used = m_recv_end - m_recv_start;
+		int const new_size = std::max(used + size, m_packet_size);
 		buffer new_buffer(aux::numeric_cast<std::size_t>(new_size)
-			, {m_recv_buffer.data(), aux::numeric_cast<std::size_t>(m_recv_end)});
+			, {m_recv_buffer.data() + m_recv_start, aux::numeric_cast<std::size_t>(used)});
 		m_recv_buffer = std::move(new_buffer);
+		m_recv_end = used;
+		m_recv_start = 0;
 
 		// since we just increased the size of the buffer, reset the watermark to
 		// start at our new size (avoid flapping the buffer size)
@@ -77,9 +91,13 @@ void receive_buffer::grow(int const limit)
 		? m_packet_size : std::min(current_size * 3 / 2, limit);
 
 	// re-allocate the buffer and copy over the part of it that's used
+	account_deferred(m_recv_start);
+	int const used = m_recv_end - m_recv_start;
 	buffer new_buffer(aux::numeric_cast<std::size_t>(new_size)
-		, {m_recv_buffer.data(), aux::numeric_cast<std::size_t>(m_recv_end)});
+		, {m_recv_buffer.data() + m_recv_start, aux::numeric_cast<std::size_t>(used)});
 	m_recv_buffer = std::move(new_buffer);
+	m_recv_end = used;
+	m_recv_start = 0;
 
 	// since we just increased the size of the buffer, reset the watermark to
 	// start at our new size (avoid flapping the buffer size)
@@ -98,10 +116,60 @@ int receive_buffer::advance_pos(int const bytes)
 // size = the packet size to remove from the receive buffer
 // packet_size = the next packet size to receive in the buffer
 // offset = the offset into the receive buffer where to remove `size` bytes
-void receive_buffer::cut(int const size, int const packet_size, int const offset)
+bool receive_buffer::can_assign_disk_buffer() const
+{
+	return m_disk_recv_buffer_size == 0
+		&& m_recv_start + m_recv_pos == m_recv_end
+		&& !packet_finished();
+}
+
+void receive_buffer::assign_disk_buffer(disk_buffer_holder buffer, int const size)
+{
+	INVARIANT_CHECK;
+	TORRENT_ASSERT(buffer);
+	TORRENT_ASSERT(size > 0);
+	TORRENT_ASSERT(can_assign_disk_buffer());
+
+	int const offset = m_packet_size - size;
+	TORRENT_ASSERT(offset >= 0);
+	TORRENT_ASSERT(m_recv_pos >= offset);
+
+	// move the part of the payload we've already received
+	int const received = m_recv_pos - offset;
+	std::memcpy(buffer.get(), m_recv_buffer.data() + m_recv_start + offset
+		, aux::numeric_cast<std::size_t>(received));
+	m_recv_end -= received;
+	m_disk_recv_end = received;
+	m_disk_recv_buffer_size = size;
+	m_disk_recv_buffer = std::move(buffer);
+}
+
+disk_buffer_holder receive_buffer::release_disk_buffer()
+{
+	TORRENT_ASSERT(m_disk_recv_buffer_size > 0);
+	TORRENT_ASSERT(packet_finished());
+	return std::move(m_disk_recv_buffer);
+}
+
+void receive_buffer::cut(int size, int const packet_size, int const offset)
 {
 	INVARIANT_CHECK;
 	TORRENT_ASSERT(packet_size > 0);
+
+	if (m_disk_recv_buffer_size > 0)
+	{
+		// the end of the packet was received into the disk buffer, only the
+		// beginning of it is in m_recv_buffer
+		TORRENT_ASSERT(offset == 0);
+		TORRENT_ASSERT(size == m_packet_size);
+		TORRENT_ASSERT(m_disk_recv_end == m_disk_recv_buffer_size);
+		size -= m_disk_recv_buffer_size;
+		m_recv_pos -= m_disk_recv_buffer_size;
+		m_disk_recv_buffer.reset();
+		m_disk_recv_buffer_size = 0;
+		m_disk_recv_end = 0;
+	}
+
 	TORRENT_ASSERT(int(m_recv_buffer.size()) >= size);
 	TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_pos);
 	TORRENT_ASSERT(m_recv_pos >= size + offset);
@@ -146,8 +214,10 @@ span<char const> receive_buffer::get() const
 		return span<char const>();
 	}
 
-	TORRENT_ASSERT(m_recv_start + m_recv_pos <= int(m_recv_buffer.size()));
-	return aux::typed_span<char const>(m_recv_buffer).subspan(m_recv_start, m_recv_pos);
+	int const size = (m_disk_recv_buffer_size > 0)
+		? std::min(m_recv_pos, m_packet_size - m_disk_recv_buffer_size) : m_recv_pos;
+	TORRENT_ASSERT(m_recv_start + size <= int(m_recv_buffer.size()));
+	return aux::typed_span<char const>(m_recv_buffer).subspan(m_recv_start, size);
 }
 
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
@@ -171,12 +241,22 @@ span<char> receive_buffer::mutable_buffer(int const bytes)
 // in the receive buffer that have been parsed and processed.
 // it may also shrink the size of the buffer allocation if we haven't been using
 // enough of it lately.
-void receive_buffer::normalize(int const force_shrink)
+// returns (bytes moved, bytes consumed without being moved)
+std::pair<int, int> receive_buffer::normalize(int const force_shrink)
 {
 	INVARIANT_CHECK;
 	TORRENT_ASSERT(m_recv_end >= m_recv_start);
 
-	m_watermark.add_sample(std::max(m_recv_end, m_packet_size));
+	// the bytes a previous call left in place that have been consumed since
+	// never had to be moved
+	account_deferred(m_recv_start);
+	int const not_moved = m_bytes_not_moved;
+	m_bytes_not_moved = 0;
+
+	// the part of the packet received into a disk buffer doesn't need space
+	// in the receive buffer
+	int const packet_size = m_packet_size - m_disk_recv_buffer_size;
+	m_watermark.add_sample(std::max(m_recv_end, packet_size));
 
 	// if the running average drops below half of the current buffer size,
 	// reallocate a smaller one.
@@ -185,24 +265,41 @@ void receive_buffer::normalize(int const force_shrink)
 
 	span<char const> bytes_to_shift(m_recv_buffer.data() + m_recv_start
 		, aux::numeric_cast<std::size_t>(m_recv_end - m_recv_start));
+	int const used = int(bytes_to_shift.size());
+	int moved = 0;
 
 	if (force_shrink)
 	{
 		int const target_size = std::max(std::max(force_shrink
-			, int(bytes_to_shift.size())), m_packet_size);
+			, used), packet_size);
 		buffer new_buffer(aux::numeric_cast<std::size_t>(target_size), bytes_to_shift);
 		m_recv_buffer = std::move(new_buffer);
+		moved = used;
 	}
 	else if (shrink_buffer)
 	{
 		buffer new_buffer(aux::numeric_cast<std::size_t>(m_watermark.mean()), bytes_to_shift);
 		m_recv_buffer = std::move(new_buffer);
+		moved = used;
 	}
-	else if (m_recv_end > m_recv_start
-		&& m_recv_start > 0)
+	else if (used > 0 && m_recv_start > 0)
 	{
+		// if there's room after the partially received packet to receive the
+		// rest of it, and the next read isn't limited to less than a quarter
+		// of the buffer, leave it where it is. It will be moved once it's
+		// closer to the end of the buffer, or not at all if it's consumed
+		// before then
+		int const free_space = int(m_recv_buffer.size()) - m_recv_end;
+		if (free_space >= std::max(packet_size - used, int(m_recv_buffer.size()) / 4))
+		{
+			m_deferred_start = m_recv_start;
+			m_deferred_end = m_recv_end;
+			return { 0, not_moved };
+		}
+
 		std::memmove(m_recv_buffer.data(), bytes_to_shift.data()
 			, bytes_to_shift.size());
+		moved = used;
 	}
 
 	m_recv_end -= m_recv_start;
@@ -211,6 +308,15 @@ void receive_buffer::normalize(int const force_shrink)
 #if TORRENT_USE_ASSERTS
 	std::fill(m_recv_buffer.begin() + m_recv_end, m_recv_buffer.end(), std::uint8_t{0xcc});
 #endif
+	return { moved, not_moved };
+}
+
+void receive_buffer::account_deferred(int const consumed_end)
+{
+	m_bytes_not_moved += std::max(0
+		, std::min(consumed_end, m_deferred_end) - m_deferred_start);
+	m_deferred_start = 0;
+	m_deferred_end = 0;
 }
 
 void receive_buffer::reset(int const packet_size)
@@ -218,12 +324,14 @@ void receive_buffer::reset(int const packet_size)
 	INVARIANT_CHECK;
 	TORRENT_ASSERT(int(m_recv_buffer.size()) >= m_recv_end);
 	TORRENT_ASSERT(packet_size > 0);
-	if (m_recv_end > m_packet_size)
+	if (m_recv_end > m_packet_size || m_disk_recv_buffer_size > 0)
 	{
 		cut(m_packet_size, packet_size);
 		return;
 	}
 
+	// everything received so far has been consumed
+	account_deferred(m_recv_end);
 	m_recv_pos = 0;
 	m_recv_start = 0;
 	m_recv_end = 0;
@@ -34,38 +34,80 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/debug.hpp"
 #include "libtorrent/aux_/time.hpp"
 
+#include <algorithm>
+
 namespace libtorrent {
 
+namespace {
+
+	// failed lookups are cached for this long (or the cache timeout, if
+	// it's shorter)
+	time_duration const negative_cache_timeout = seconds(60);
+
+	// once a cache entry that's being used reaches this fraction of its
+	// lifetime, the hostname is looked up again in the background so that
+	// frequently used names (like trackers) never expire from the cache
+	constexpr int refresh_percentage = 75;
+}
+
 	resolver::resolver(io_service& ios)
 		: m_ios(ios)
 		, m_resolver(ios)
 		, m_critical_resolver(ios)
 		, m_max_size(700)
 		, m_timeout(seconds(1200))
+		, m_num_lookups(0)
 	{}
 
 	void resolver::on_lookup(error_code const& ec, tcp::resolver::iterator i
-		, resolver_interface::callback_t h, std::string hostname)
+		, std::string hostname, bool const abortable)
 	{
 		COMPLETE_ASYNC("resolver::on_lookup");
-		if (ec)
+
+		std::vector<callback_t> handlers;
+		auto& pending = m_pending[abortable ? 0 : 1];
+		auto const p = pending.find(hostname);
+		if (p != pending.end())
 		{
-			std::vector<address> empty;
-			h(ec, empty);
-			return;
+			handlers.swap(p->second);
+			pending.erase(p);
 		}
 
-		dns_cache_entry& ce = m_cache[hostname];
-		time_point now = aux::time_now();
-		ce.last_seen = now;
-		ce.addresses.clear();
-		while (i != tcp::resolver::iterator())
+		time_point const now = aux::time_now();
+		std::vector<address> addresses;
+		if (ec)
+		{
+			// remember the failure, unless the lookup was cancelled. Any
+			// addresses from an earlier successful lookup are kept, they may
+			// still be used by prefer_cache lookups, or be within their
+			// timeout if this was a background refresh
+			if (ec != boost::asio::error::operation_aborted)
+			{
+				dns_cache_entry& ce = m_cache[hostname];
+				ce.last_failure = now;
+				ce.error = ec;
+			}
+		}
+		else
 		{
-			ce.addresses.push_back(i->endpoint().address());
-			++i;
+			dns_cache_entry& ce = m_cache[hostname];
+			ce.last_seen = now;
+			ce.error.clear();
+			ce.addresses.clear();
+			while (i != tcp::resolver::iterator())
+			{
+				ce.addresses.push_back(i->endpoint().address());
+				++i;
+			}
+			addresses = ce.addresses;
 		}
 
-		h(ec, ce.addresses);
+		// the handlers may issue new lookups, so don't hold on to
+		// references into our containers while calling them
+		for (auto const& h : handlers)
+		{
+			if (h) h(ec, addresses);
+		}
 
 		// if m_cache grows too big, weed out the
 		// oldest entries
@@ -74,7 +116,7 @@ namespace libtorrent {
 			auto oldest = m_cache.begin();
 			for (auto k = m_cache.begin(); k != m_cache.end(); ++k)
 			{
-				if (k->second.last_seen < oldest->second.last_seen)
+				if (k->second.last_used() < oldest->second.last_used())
 					oldest = k;
 			}
 
@@ -86,15 +128,36 @@ namespace libtorrent {
 	void resolver::async_resolve(std::string const& host, int const flags
 		, resolver_interface::callback_t const& h)
 	{
+		bool const abortable = (flags & resolver_interface::abort_on_shutdown) != 0;
 		auto const i = m_cache.find(host);
 		if (i != m_cache.end())
 		{
-			// keep cache entries valid for m_timeout seconds
-			if ((flags & resolver_interface::prefer_cache)
-				|| i->second.last_seen + m_timeout >= aux::time_now())
+			time_point const now = aux::time_now();
+			dns_cache_entry const& ce = i->second;
+			bool const failed = ce.error
+				&& ce.last_failure + std::min(m_timeout, negative_cache_timeout) >= now;
+
+			// keep cache entries valid for m_timeout seconds, even if a
+			// background refresh failed. prefer_cache lookups are also served
+			// stale addresses, even if the name has failed to resolve since
+			if (!ce.addresses.empty()
+				&& ((flags & resolver_interface::prefer_cache)
+					|| ce.last_seen + m_timeout >= now))
 			{
 				error_code ec;
-				m_ios.post(std::bind(h, ec, i->second.addresses));
+				m_ios.post(std::bind(h, ec, ce.addresses));
+
+				// if the entry is about to expire (or already has), refresh
+				// it in the background. Unless the last attempt failed, in
+				// which case we wait for the failure to expire first
+				if (!failed && ce.last_seen + m_timeout * refresh_percentage / 100 < now)
+					start_lookup(host, abortable, callback_t());
+				return;
+			}
+
+			if (failed)
+			{
+				m_ios.post(std::bind(h, ce.error, std::vector<address>()));
 				return;
 			}
 		}
@@ -111,20 +174,33 @@ namespace libtorrent {
 			return;
 		}
 
+		start_lookup(host, abortable, h);
+	}
+
+	void resolver::start_lookup(std::string const& host, bool const abortable
+		, resolver_interface::callback_t const& h)
+	{
+		// if there already is a lookup for this name in flight, just wait
+		// for it to complete
+		auto& handlers = m_pending[abortable ? 0 : 1][host];
+		handlers.push_back(h);
+		if (handlers.size() > 1) return;
+
 		// the port is ignored
 		tcp::resolver::query const q(host, "80");
+		++m_num_lookups;
 
 		using namespace std::placeholders;
 		ADD_OUTSTANDING_ASYNC("resolver::on_lookup");
-		if (flags & resolver_interface::abort_on_shutdown)
+		if (abortable)
 		{
 			m_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
-				, h, host));
+				, host, true));
 		}
 		else
 		{
 			m_critical_resolver.async_resolve(q, std::bind(&resolver::on_lookup, this, _1, _2
-				, h, host));
+				, host, false));
 		}
 	}
 
@@ -0,0 +1,903 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+
+  The resume store is a file header followed by an array of slots, each of
+  which either holds the record of one torrent or is free. All values are
+  stored big endian.
+
+  // the file header, 64 bytes
+  char magic[8]; // "LTRESUME"
+  uint32_t version; // 1
+  uint8_t reserved[52];
+
+  // every slot is an even multiple of 64 bytes, and starts with the 32
+  // byte record header. Since slots are aligned, the record header always
+  // fits in a single disk sector, and is written atomically.
+  uint32_t magic; // 'LTRR'
+
+  // the size of the slot, including this header. This never changes once
+  // the slot has been written, which makes it possible to find every slot
+  // even if the content of some of them is corrupt.
+  uint32_t slot_size;
+
+  // 0 if the slot is free, 1 if it holds a record
+  uint32_t state;
+
+  uint32_t body_size;
+
+  // crc32c of the sequence number followed by the body
+  uint32_t body_crc;
+
+  // the number of entries in the piece log
+  uint32_t log_capacity;
+
+  // every record written to the store gets a new, higher, sequence number.
+  // If there is more than one record for a torrent (because the store was
+  // not flushed after it was replaced), the highest one is current.
+  uint64_t sequence;
+
+  // the body, written once when the record is saved
+  uint8_t info_hash[20];
+  uint32_t num_pieces;
+  uint64_t flags;
+  int32_t max_uploads;
+  int32_t max_connections;
+  int32_t upload_limit;
+  int32_t download_limit;
+  int64_t added_time;
+  int32_t num_downloaded;
+  uint32_t save_path_size;
+  uint32_t name_size;
+  uint32_t num_file_priorities;
+  uint32_t num_piece_priorities;
+  stats_t stats;
+  char save_path[save_path_size];
+  char name[name_size];
+  uint8_t file_priorities[num_file_priorities];
+  uint8_t piece_priorities[num_piece_priorities];
+
+  // one bit per piece, the most significant bit of the first byte is
+  // piece 0
+  uint8_t have_pieces[(num_pieces + 7) / 8];
+
+  // to align the stats updates to 8 bytes
+  uint8_t padding[n];
+
+  // two slots for updated statistics, written alternately. The valid one
+  // with the highest sequence number supersedes the stats in the body.
+  struct
+  {
+    // crc32c of the record's sequence number followed by the remaining 60
+    // bytes of the update
+    uint32_t crc;
+    uint32_t sequence;
+    stats_t stats;
+    uint32_t reserved;
+  } stats_update[2];
+
+  // pieces completed since the record was saved, appended in place. Entries
+  // that don't match their check are unused (or left over from a previous
+  // record in this slot).
+  struct
+  {
+    uint32_t piece;
+
+    // crc32c of the record's sequence number followed by the piece index
+    uint32_t check;
+  } piece_log[log_capacity];
+
+  // to make the slot an even multiple of 64 bytes
+  uint8_t padding[n];
+
+  // 52 bytes
+  struct stats_t
+  {
+    int64_t total_uploaded;
+    int64_t total_downloaded;
+    int64_t last_seen_complete;
+    int64_t completed_time;
+    int32_t active_time;
+    int32_t finished_time;
+    int32_t seeding_time;
+    int32_t num_complete;
+    int32_t num_incomplete;
+  };
+
+*/
+
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/io.hpp"
+#include "libtorrent/assert.hpp"
+
+#include "libtorrent/aux_/disable_warnings_push.hpp"
+#include <boost/crc.hpp>
+
+#if TORRENT_HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#ifndef TORRENT_WINDOWS
+#include <unistd.h> // for fsync
+#include <cerrno>
+#endif
+#include "libtorrent/aux_/disable_warnings_pop.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace libtorrent {
+
+namespace {
+
+	char const file_magic[8] = {'L', 'T', 'R', 'E', 'S', 'U', 'M', 'E'};
+	std::uint32_t const file_version = 1;
+	int const file_header_size = 64;
+
+	std::uint32_t const record_magic = 0x4c545252; // 'LTRR'
+	std::uint32_t const slot_free = 0;
+	std::uint32_t const slot_in_use = 1;
+
+	int const record_header_size = 32;
+	int const body_header_size = 128;
+	int const stats_update_size = 64;
+	int const log_entry_size = 8;
+
+	struct stats_t
+	{
+		std::int64_t total_uploaded = 0;
+		std::int64_t total_downloaded = 0;
+		std::int64_t last_seen_complete = 0;
+		std::int64_t completed_time = 0;
+		std::int32_t active_time = 0;
+		std::int32_t finished_time = 0;
+		std::int32_t seeding_time = 0;
+		std::int32_t num_complete = -1;
+		std::int32_t num_incomplete = -1;
+	};
+
+	void write_stats(stats_t const& s, char*& ptr)
+	{
+		detail::write_int64(s.total_uploaded, ptr);
+		detail::write_int64(s.total_downloaded, ptr);
+		detail::write_int64(s.last_seen_complete, ptr);
+		detail::write_int64(s.completed_time, ptr);
+		detail::write_int32(s.active_time, ptr);
+		detail::write_int32(s.finished_time, ptr);
+		detail::write_int32(s.seeding_time, ptr);
+		detail::write_int32(s.num_complete, ptr);
+		detail::write_int32(s.num_incomplete, ptr);
+	}
+
+	stats_t read_stats(char const*& ptr)
+	{
+		stats_t s;
+		s.total_uploaded = detail::read_int64(ptr);
+		s.total_downloaded = detail::read_int64(ptr);
+		s.last_seen_complete = detail::read_int64(ptr);
+		s.completed_time = detail::read_int64(ptr);
+		s.active_time = detail::read_int32(ptr);
+		s.finished_time = detail::read_int32(ptr);
+		s.seeding_time = detail::read_int32(ptr);
+		s.num_complete = detail::read_int32(ptr);
+		s.num_incomplete = detail::read_int32(ptr);
+		return s;
+	}
+
+	// round up to an even multiple of n, which must be a power of 2
+	std::uint64_t round_up(std::uint64_t const v, std::uint64_t const n)
+	{ return (v + n - 1) & ~(n - 1); }
+
+	std::uint64_t bitfield_size(std::uint64_t const num_pieces)
+	{ return (num_pieces + 7) / 8; }
+
+	// the offsets of the stats updates and the piece log, within a slot
+	std::uint64_t stats_offset(std::uint32_t const body_size)
+	{ return record_header_size + round_up(body_size, 8); }
+
+	std::uint64_t log_offset(std::uint32_t const body_size)
+	{ return stats_offset(body_size) + 2 * stats_update_size; }
+
+	// the number of completed pieces that can be logged before the record
+	// has to be saved again. The log takes up about as much space as the
+	// piece bitfield, which bounds the amortized cost of saving it per piece
+	int log_capacity(int const num_pieces)
+	{ return std::max(16, std::min(num_pieces / 64, 1024)); }
+
+	std::uint32_t checksum(std::uint64_t const sequence
+		, char const* buf, std::size_t const size)
+	{
+		char seq[8];
+		char* ptr = seq;
+		detail::write_uint64(sequence, ptr);
+		boost::crc_optimal<32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, true> crc;
+		crc.process_bytes(seq, sizeof(seq));
+		crc.process_bytes(buf, size);
+		return crc.checksum();
+	}
+
+	// returns the index of the piece in the log entry, or -1 if the entry is
+	// not valid for a record with the specified sequence number
+	int parse_log_entry(std::uint64_t const sequence, char const* entry)
+	{
+		char const* ptr = entry;
+		std::uint32_t const piece = detail::read_uint32(ptr);
+		std::uint32_t const check = detail::read_uint32(ptr);
+		if (check != checksum(sequence, entry, 4)) return -1;
+		if (piece > std::uint32_t(std::numeric_limits<int>::max())) return -1;
+		return int(piece);
+	}
+
+	// returns the sequence number of the stats update, or 0 if it's not valid
+	// for a record with the specified sequence number
+	std::uint32_t parse_stats_update(std::uint64_t const sequence
+		, char const* update, stats_t& stats)
+	{
+		char const* ptr = update;
+		std::uint32_t const crc = detail::read_uint32(ptr);
+		if (crc != checksum(sequence, update + 4, stats_update_size - 4))
+			return 0;
+		std::uint32_t const update_sequence = detail::read_uint32(ptr);
+		stats = read_stats(ptr);
+		return update_sequence;
+	}
+
+	void sync_file(file& f, error_code& ec)
+	{
+#ifdef TORRENT_WINDOWS
+		if (FlushFileBuffers(f.native_handle()) == 0)
+			ec.assign(GetLastError(), system_category());
+#elif TORRENT_USE_FDATASYNC
+		if (fdatasync(f.native_handle()) != 0)
+			ec.assign(errno, system_category());
+#else
+		if (fsync(f.native_handle()) != 0)
+			ec.assign(errno, system_category());
+#endif
+	}
+
+#if TORRENT_HAVE_MMAP
+	char const* map_file(file& f, std::size_t const size, error_code& ec)
+	{
+		void* const ret = ::mmap(nullptr, size, PROT_READ, MAP_SHARED
+			, f.native_handle(), 0);
+		if (ret == MAP_FAILED)
+		{
+			ec.assign(errno, system_category());
+			return nullptr;
+		}
+		return static_cast<char const*>(ret);
+	}
+
+	void unmap_file(char const* const p, std::size_t const size)
+	{
+		::munmap(const_cast<char*>(p), size);
+	}
+#endif
+
+} // anonymous namespace
+
+	resume_store::resume_store(std::string const& path, error_code& ec)
+		: m_path(path)
+	{
+		ec.clear();
+		m_file.open(m_path, file::read_write, ec);
+		if (ec) return;
+
+		std::int64_t const size = m_file.get_size(ec);
+		if (ec)
+		{
+			m_file.close();
+			return;
+		}
+
+		if (size < file_header_size)
+		{
+			// this is a new store (or we crashed while creating it)
+			char header[file_header_size] = {};
+			std::memcpy(header, file_magic, sizeof(file_magic));
+			char* ptr = header + sizeof(file_magic);
+			detail::write_uint32(file_version, ptr);
+			iovec_t const b = {header, sizeof(header)};
+			m_file.writev(0, b, ec);
+			if (ec)
+			{
+				m_file.close();
+				return;
+			}
+			m_file_size = file_header_size;
+			return;
+		}
+
+		std::vector<char> buffer;
+		char const* data = nullptr;
+#if TORRENT_HAVE_MMAP
+		if (std::uint64_t(size) <= std::numeric_limits<std::size_t>::max())
+		{
+			error_code map_ec;
+			data = map_file(m_file, std::size_t(size), map_ec);
+			if (data != nullptr)
+			{
+				m_map = data;
+				m_map_size = std::size_t(size);
+			}
+		}
+#endif
+		if (data == nullptr)
+		{
+			// if the file can't be mapped, read all of it instead
+			buffer.resize(std::size_t(size));
+			iovec_t const b = {buffer.data(), buffer.size()};
+			std::int64_t const read = m_file.readv(0, b, ec);
+			if (ec)
+			{
+				m_file.close();
+				return;
+			}
+			if (read < size)
+			{
+				ec = errors::file_too_short;
+				m_file.close();
+				return;
+			}
+			data = buffer.data();
+		}
+
+		{
+			char const* ptr = data + sizeof(file_magic);
+			if (std::memcmp(data, file_magic, sizeof(file_magic)) != 0
+				|| detail::read_uint32(ptr) != file_version)
+			{
+				ec = errors::invalid_file_tag;
+				m_file.close();
+				return;
+			}
+		}
+
+		std::int64_t offset = file_header_size;
+		while (size - offset >= record_header_size)
+		{
+			char const* const rec = data + offset;
+			char const* ptr = rec;
+			std::uint32_t const magic = detail::read_uint32(ptr);
+			std::uint32_t const slot_size = detail::read_uint32(ptr);
+
+			// this is where we crashed while appending a record. Nothing
+			// beyond this point can be trusted
+			if (magic != record_magic
+				|| slot_size == 0
+				|| slot_size % 64 != 0
+				|| slot_size > size - offset)
+				break;
+
+			std::uint32_t const state = detail::read_uint32(ptr);
+			std::uint32_t const body_size = detail::read_uint32(ptr);
+			std::uint32_t const body_crc = detail::read_uint32(ptr);
+			std::uint32_t const capacity = detail::read_uint32(ptr);
+			std::uint64_t const sequence = detail::read_uint64(ptr);
+
+			std::int64_t const slot_offset = offset;
+			offset += slot_size;
+
+			// free slots may still have stale stats updates and log entries
+			// tied to their sequence number. Never hand it out again
+			m_sequence = std::max(m_sequence, sequence);
+
+			if (state != slot_in_use
+				|| body_size < body_header_size
+				|| body_size > slot_size
+				|| log_offset(body_size) + std::uint64_t(capacity) * log_entry_size > slot_size
+				|| checksum(sequence, rec + record_header_size, body_size) != body_crc)
+			{
+				m_free_slots.emplace(slot_size, slot_offset);
+				continue;
+			}
+
+			char const* const body = rec + record_header_size;
+			sha1_hash const info_hash(body);
+			ptr = body + 20;
+			std::uint32_t const num_pieces = detail::read_uint32(ptr);
+			// skip flags, limits, added_time and num_downloaded
+			ptr += 8 + 16 + 8 + 4;
+			std::uint64_t const save_path_size = detail::read_uint32(ptr);
+			std::uint64_t const name_size = detail::read_uint32(ptr);
+			std::uint64_t const num_file_prios = detail::read_uint32(ptr);
+			std::uint64_t const num_piece_prios = detail::read_uint32(ptr);
+
+			if (num_pieces > std::uint32_t(std::numeric_limits<int>::max())
+				|| body_header_size + save_path_size + name_size + num_file_prios
+					+ num_piece_prios + bitfield_size(num_pieces) != body_size)
+			{
+				m_free_slots.emplace(slot_size, slot_offset);
+				continue;
+			}
+
+			record r;
+			r.offset = slot_offset;
+			r.slot_size = slot_size;
+			r.body_size = body_size;
+			r.sequence = sequence;
+			r.num_pieces = int(num_pieces);
+			r.log_capacity = int(capacity);
+			r.log_used = 0;
+			r.stats_sequence = 0;
+
+			char const* const updates = rec + stats_offset(body_size);
+			for (int i = 0; i < 2; ++i)
+			{
+				stats_t stats;
+				r.stats_sequence = std::max(r.stats_sequence, parse_stats_update(
+					sequence, updates + i * stats_update_size, stats));
+			}
+
+			// entries are appended in order, but if the system crashed, the
+			// later ones may have made it to the disk without the earlier ones
+			char const* const log = rec + log_offset(body_size);
+			for (int i = 0; i < r.log_capacity; ++i)
+			{
+				if (parse_log_entry(sequence, log + i * log_entry_size) >= 0)
+					r.log_used = i + 1;
+			}
+
+			auto const ins = m_records.emplace(info_hash, r);
+			if (!ins.second)
+			{
+				// this torrent has more than one record, because we didn't get
+				// to flush() after replacing it. The highest sequence number
+				// is the current one
+				record& current = ins.first->second;
+				if (current.sequence < r.sequence) std::swap(current, r);
+				m_replaced.emplace_back(info_hash, slot{r.offset, r.slot_size});
+			}
+		}
+
+		if (offset < size)
+		{
+			// discard whatever is left of the record we were appending
+			m_file.set_size(offset, ec);
+			if (ec)
+			{
+				m_file.close();
+				return;
+			}
+		}
+		m_file_size = offset;
+	}
+
+	resume_store::~resume_store()
+	{
+		if (m_file.is_open())
+		{
+			error_code ec;
+			flush(ec);
+		}
+#if TORRENT_HAVE_MMAP
+		if (m_map != nullptr) unmap_file(m_map, m_map_size);
+#endif
+	}
+
+	std::vector<sha1_hash> resume_store::torrents() const
+	{
+		std::vector<sha1_hash> ret;
+		ret.reserve(m_records.size());
+		for (auto const& r : m_records) ret.push_back(r.first);
+		return ret;
+	}
+
+	span<char const> resume_store::read_record(record const& r
+		, std::vector<char>& buf, error_code& ec) const
+	{
+		if (m_map != nullptr
+			&& r.offset + std::int64_t(r.slot_size) <= std::int64_t(m_map_size))
+			return {m_map + r.offset, r.slot_size};
+
+		buf.resize(r.slot_size);
+		iovec_t const b = {buf.data(), buf.size()};
+		std::int64_t const read = m_file.readv(r.offset, b, ec);
+		if (ec) return {};
+		if (read < std::int64_t(r.slot_size))
+		{
+			ec = errors::file_too_short;
+			return {};
+		}
+		return buf;
+	}
+
+	add_torrent_params resume_store::load(sha1_hash const& info_hash
+		, error_code& ec) const
+	{
+		ec.clear();
+		add_torrent_params ret;
+
+		auto const i = m_records.find(info_hash);
+		if (i == m_records.end())
+		{
+			ec = errors::invalid_torrent_handle;
+			return ret;
+		}
+		record const& r = i->second;
+
+		std::vector<char> buf;
+		span<char const> const rec = read_record(r, buf, ec);
+		if (ec) return ret;
+
+		using namespace libtorrent::detail;
+
+		char const* ptr = rec.data() + record_header_size;
+		ret.info_hash.assign(ptr);
+		ptr += 20;
+		int const num_pieces = int(read_uint32(ptr));
+		ret.flags = read_uint64(ptr);
+		ret.max_uploads = read_int32(ptr);
+		ret.max_connections = read_int32(ptr);
+		ret.upload_limit = read_int32(ptr);
+		ret.download_limit = read_int32(ptr);
+		ret.added_time = std::time_t(read_int64(ptr));
+		ret.num_downloaded = read_int32(ptr);
+		std::size_t const save_path_size = read_uint32(ptr);
+		std::size_t const name_size = read_uint32(ptr);
+		std::size_t const num_file_prios = read_uint32(ptr);
+		std::size_t const num_piece_prios = read_uint32(ptr);
+		stats_t stats = read_stats(ptr);
+		TORRENT_ASSERT(ptr == rec.data() + record_header_size + body_header_size);
+
+		ret.save_path.assign(ptr, save_path_size);
+		ptr += save_path_size;
+		ret.name.assign(ptr, name_size);
+		ptr += name_size;
+		ret.file_priorities.assign(ptr, ptr + num_file_prios);
+		ptr += num_file_prios;
+		ret.piece_priorities.assign(ptr, ptr + num_piece_prios);
+		ptr += num_piece_prios;
+
+		// the bitfield is stored in the same bit order as it's kept in memory
+		ret.have_pieces.assign(ptr, num_pieces);
+
+		// the latest stats update supersedes the stats the record was saved
+		// with
+		char const* const updates = rec.data() + stats_offset(r.body_size);
+		std::uint32_t latest = 0;
+		for (int u = 0; u < 2; ++u)
+		{
+			stats_t update;
+			std::uint32_t const seq = parse_stats_update(r.sequence
+				, updates + u * stats_update_size, update);
+			if (seq <= latest) continue;
+			latest = seq;
+			stats = update;
+		}
+
+		ret.total_uploaded = stats.total_uploaded;
+		ret.total_downloaded = stats.total_downloaded;
+		ret.last_seen_complete = std::time_t(stats.last_seen_complete);
+		ret.completed_time = std::time_t(stats.completed_time);
+		ret.active_time = stats.active_time;
+		ret.finished_time = stats.finished_time;
+		ret.seeding_time = stats.seeding_time;
+		ret.num_complete = stats.num_complete;
+		ret.num_incomplete = stats.num_incomplete;
+
+		// and the pieces completed since then
+		char const* const log = rec.data() + log_offset(r.body_size);
+		for (int e = 0; e < r.log_used; ++e)
+		{
+			int const piece = parse_log_entry(r.sequence, log + e * log_entry_size);
+			if (piece < 0 || piece >= num_pieces) continue;
+			ret.have_pieces.set_bit(piece_index_t(piece));
+		}
+
+		return ret;
+	}
+
+	void resume_store::save(add_torrent_params const& atp, error_code& ec)
+	{
+		ec.clear();
+		if (!m_file.is_open())
+		{
+			ec = error_code(boost::system::errc::bad_file_descriptor, generic_category());
+			return;
+		}
+
+		sha1_hash const info_hash = atp.ti ? atp.ti->info_hash() : atp.info_hash;
+		int const num_pieces = std::max(atp.have_pieces.size()
+			, atp.ti && atp.ti->is_valid() ? atp.ti->num_pieces() : 0);
+
+		std::uint64_t const body_size = body_header_size
+			+ atp.save_path.size() + atp.name.size()
+			+ atp.file_priorities.size() + atp.piece_priorities.size()
+			+ bitfield_size(std::uint64_t(num_pieces));
+		int const capacity = log_capacity(num_pieces);
+		std::uint64_t const size = round_up(log_offset(std::uint32_t(body_size))
+			+ std::uint64_t(capacity) * log_entry_size, 64);
+		if (size > std::numeric_limits<std::uint32_t>::max())
+		{
+			ec = errors::too_many_pieces_in_torrent;
+			return;
+		}
+
+		slot const s = allocate_slot(std::uint32_t(size));
+		std::uint64_t const sequence = ++m_sequence;
+
+		using namespace libtorrent::detail;
+
+		// this also clears the stats updates and the piece log
+		std::vector<char> buf(s.size, 0);
+		char* ptr = buf.data() + record_header_size;
+		std::memcpy(ptr, info_hash.data(), info_hash.size());
+		ptr += info_hash.size();
+		write_uint32(num_pieces, ptr);
+		write_uint64(atp.flags, ptr);
+		write_int32(atp.max_uploads, ptr);
+		write_int32(atp.max_connections, ptr);
+		write_int32(atp.upload_limit, ptr);
+		write_int32(atp.download_limit, ptr);
+		write_int64(atp.added_time, ptr);
+		write_int32(atp.num_downloaded, ptr);
+		write_uint32(atp.save_path.size(), ptr);
+		write_uint32(atp.name.size(), ptr);
+		write_uint32(atp.file_priorities.size(), ptr);
+		write_uint32(atp.piece_priorities.size(), ptr);
+
+		stats_t stats;
+		stats.total_uploaded = atp.total_uploaded;
+		stats.total_downloaded = atp.total_downloaded;
+		stats.last_seen_complete = atp.last_seen_complete;
+		stats.completed_time = atp.completed_time;
+		stats.active_time = atp.active_time;
+		stats.finished_time = atp.finished_time;
+		stats.seeding_time = atp.seeding_time;
+		stats.num_complete = atp.num_complete;
+		stats.num_incomplete = atp.num_incomplete;
+		write_stats(stats, ptr);
+		TORRENT_ASSERT(ptr == buf.data() + record_header_size + body_header_size);
+
+		ptr = std::copy(atp.save_path.begin(), atp.save_path.end(), ptr);
+		ptr = std::copy(atp.name.begin(), atp.name.end(), ptr);
+		ptr = std::copy(atp.file_priorities.begin(), atp.file_priorities.end(), ptr);
+		ptr = std::copy(atp.piece_priorities.begin(), atp.piece_priorities.end(), ptr);
+		if (atp.have_pieces.size() > 0)
+		{
+			std::memcpy(ptr, atp.have_pieces.data()
+				, std::size_t(bitfield_size(std::uint64_t(atp.have_pieces.size()))));
+		}
+
+		ptr = buf.data();
+		write_uint32(record_magic, ptr);
+		write_uint32(s.size, ptr);
+		write_uint32(slot_in_use, ptr);
+		write_uint32(body_size, ptr);
+		write_uint32(checksum(sequence, buf.data() + record_header_size
+			, std::size_t(body_size)), ptr);
+		write_uint32(capacity, ptr);
+		write_uint64(sequence, ptr);
+
+		iovec_t const b = {buf.data(), buf.size()};
+		m_file.writev(s.offset, b, ec);
+		if (ec)
+		{
+			if (s.offset + s.size == m_file_size)
+			{
+				// don't leave a partial record at the end of the file, it would
+				// hide any record appended after it the next time the store is
+				// opened
+				error_code ignore;
+				m_file.set_size(s.offset, ignore);
+				m_file_size = s.offset;
+			}
+			else
+			{
+				m_free_slots.emplace(s.size, s.offset);
+			}
+			return;
+		}
+
+		record r;
+		r.offset = s.offset;
+		r.slot_size = s.size;
+		r.body_size = std::uint32_t(body_size);
+		r.sequence = sequence;
+		r.num_pieces = num_pieces;
+		r.log_capacity = capacity;
+		r.log_used = 0;
+		r.stats_sequence = 0;
+
+		auto const ins = m_records.emplace(info_hash, r);
+		if (!ins.second)
+		{
+			// the previous record must stay in place until the new one is
+			// known to be on disk
+			record& prev = ins.first->second;
+			m_replaced.emplace_back(info_hash, slot{prev.offset, prev.slot_size});
+			prev = r;
+		}
+	}
+
+	void resume_store::piece_finished(sha1_hash const& info_hash
+		, piece_index_t const piece, error_code& ec)
+	{
+		ec.clear();
+		auto const i = m_records.find(info_hash);
+		if (i == m_records.end())
+		{
+			ec = errors::invalid_torrent_handle;
+			return;
+		}
+		if (piece < piece_index_t(0))
+		{
+			ec = errors::invalid_piece_index;
+			return;
+		}
+		record& r = i->second;
+
+		if (static_cast<int>(piece) >= r.num_pieces || r.log_used >= r.log_capacity)
+		{
+			// the log is full (or the piece is outside the bitfield). Save the
+			// record again, with the log merged into the bitfield
+			add_torrent_params atp = load(info_hash, ec);
+			if (ec) return;
+			if (piece >= atp.have_pieces.end_index())
+				atp.have_pieces.resize(static_cast<int>(piece) + 1, false);
+			atp.have_pieces.set_bit(piece);
+			save(atp, ec);
+			return;
+		}
+
+		char entry[log_entry_size];
+		char* ptr = entry;
+		detail::write_uint32(static_cast<int>(piece), ptr);
+		detail::write_uint32(checksum(r.sequence, entry, 4), ptr);
+
+		iovec_t const b = {entry, sizeof(entry)};
+		m_file.writev(r.offset + std::int64_t(log_offset(r.body_size))
+			+ r.log_used * log_entry_size, b, ec);
+		if (ec) return;
+		++r.log_used;
+	}
+
+	void resume_store::update_stats(torrent_status const& st, error_code& ec)
+	{
+		ec.clear();
+		auto const i = m_records.find(st.info_hash);
+		if (i == m_records.end())
+		{
+			ec = errors::invalid_torrent_handle;
+			return;
+		}
+		record& r = i->second;
+
+		stats_t stats;
+		stats.total_uploaded = st.all_time_upload;
+		stats.total_downloaded = st.all_time_download;
+		stats.last_seen_complete = st.last_seen_complete;
+		stats.completed_time = st.completed_time;
+		stats.active_time = int(st.active_duration.count());
+		stats.finished_time = int(st.finished_duration.count());
+		stats.seeding_time = int(st.seeding_duration.count());
+		stats.num_complete = st.num_complete;
+		stats.num_incomplete = st.num_incomplete;
+
+		// write to the slot not holding the current update, so that we still
+		// have it if this write doesn't make it to the disk
+		std::uint32_t const seq = r.stats_sequence + 1;
+		char update[stats_update_size] = {};
+		char* ptr = update + 4;
+		detail::write_uint32(seq, ptr);
+		write_stats(stats, ptr);
+		ptr = update;
+		detail::write_uint32(checksum(r.sequence, update + 4
+			, stats_update_size - 4), ptr);
+
+		iovec_t const b = {update, sizeof(update)};
+		m_file.writev(r.offset + std::int64_t(stats_offset(r.body_size))
+			+ (seq & 1) * stats_update_size, b, ec);
+		if (ec) return;
+		r.stats_sequence = seq;
+	}
+
+	void resume_store::remove(sha1_hash const& info_hash, error_code& ec)
+	{
+		ec.clear();
+		auto const i = m_records.find(info_hash);
+		if (i == m_records.end())
+		{
+			ec = errors::invalid_torrent_handle;
+			return;
+		}
+
+		// free the previous records first, if we crash half-way, this
+		// torrent must not revert to one of them
+		for (auto r = m_replaced.begin(); r != m_replaced.end();)
+		{
+			if (r->first != info_hash)
+			{
+				++r;
+				continue;
+			}
+			free_slot(r->second, ec);
+			if (ec) return;
+			r = m_replaced.erase(r);
+		}
+
+		free_slot(slot{i->second.offset, i->second.slot_size}, ec);
+		if (ec) return;
+		m_records.erase(i);
+	}
+
+	void resume_store::flush(error_code& ec)
+	{
+		ec.clear();
+		if (!m_file.is_open()) return;
+
+		sync_file(m_file, ec);
+		if (ec) return;
+
+		// now that the records that replaced these are on disk, they can be
+		// released
+		while (!m_replaced.empty())
+		{
+			free_slot(m_replaced.back().second, ec);
+			if (ec) return;
+			m_replaced.pop_back();
+		}
+	}
+
+	resume_store::slot resume_store::allocate_slot(std::uint32_t const size)
+	{
+		// use the smallest free slot that's large enough, if there is one
+		auto const i = m_free_slots.lower_bound(size);
+		if (i != m_free_slots.end())
+		{
+			slot const ret{i->second, i->first};
+			m_free_slots.erase(i);
+			return ret;
+		}
+
+		slot const ret{m_file_size, size};
+		m_file_size += size;
+		return ret;
+	}
+
+	void resume_store::free_slot(slot const s, error_code& ec)
+	{
+		char state[4];
+		char* ptr = state;
+		detail::write_uint32(slot_free, ptr);
+		iovec_t const b = {state, sizeof(state)};
+		m_file.writev(s.offset + 8, b, ec);
+		if (ec) return;
+		m_free_slots.emplace(s.size, s.offset);
+	}
+}
@@ -726,6 +726,9 @@ namespace {
 	void session_handle::set_ip_filter(ip_filter const& f)
 	{
 		std::shared_ptr<ip_filter> copy = std::make_shared<ip_filter>(f);
+		// do the work of compacting the filter on the calling thread,
+		// rather than the network thread
+		copy->compact();
 		async_call(&session_impl::set_ip_filter, copy);
 	}
 
@@ -777,7 +780,9 @@ namespace {
 
 	void session_handle::set_peer_class_filter(ip_filter const& f)
 	{
-		async_call(&session_impl::set_peer_class_filter, f);
+		ip_filter copy = f;
+		copy.compact();
+		async_call(&session_impl::set_peer_class_filter, copy);
 	}
 
 	void session_handle::set_peer_class_type_filter(peer_class_type_filter const& f)
@@ -919,6 +919,10 @@ namespace aux {
 #endif
 		m_lsd_announce_timer.cancel(ec);
 
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+		if (m_dh_key_pool) m_dh_key_pool->stop();
+#endif
+
 		for (auto const& s : m_incoming_sockets)
 		{
 			s->close(ec);
@@ -1260,6 +1264,22 @@ namespace {
 		m_disk_thread.submit_jobs();
 	}
 
+	void session_impl::deferred_send(std::shared_ptr<peer_connection> p)
+	{
+		m_deferred_sends.push_back(std::move(p));
+		if (m_deferred_sends.size() > 1) return;
+		m_io_service.post([this] { this->wrap(&session_impl::flush_deferred_sends); } );
+	}
+
+	void session_impl::flush_deferred_sends()
+	{
+		// flushing may cause peers to be deferred again (for the next turn), so
+		// swap the list out first
+		std::vector<std::shared_ptr<peer_connection>> peers;
+		peers.swap(m_deferred_sends);
+		for (auto const& p : peers) p->flush_deferred_send();
+	}
+
 	// copies pointers to bandwidth channels from the peer classes
 	// into the array. Only bandwidth channels with a bandwidth limit
 	// is considered pertinent and copied
@@ -4459,6 +4479,17 @@ namespace {
 		if (i == m_obfuscated_torrents.end()) return nullptr;
 		return i->second.get();
 	}
+
+	dh_key_pool& session_impl::dh_keys()
+	{
+		TORRENT_ASSERT(is_single_thread());
+		if (!m_dh_key_pool)
+		{
+			m_dh_key_pool.reset(new dh_key_pool(m_abort ? 0
+				: m_settings.get_int(settings_pack::dh_key_pool_size)));
+		}
+		return *m_dh_key_pool;
+	}
 #endif
 
 #ifndef TORRENT_NO_DEPRECATE
@@ -4633,13 +4664,15 @@ namespace {
 	{
 		std::vector<dht_lookup> requests;
 		std::vector<dht_routing_bucket> table;
+		time_duration bootstrap_time = seconds(0);
 
 #ifndef TORRENT_DISABLE_DHT
 		if (m_dht)
-			m_dht->dht_status(table, requests);
+			m_dht->dht_status(table, requests, bootstrap_time);
 #endif
 
-		m_alerts.emplace_alert<dht_stats_alert>(std::move(table), std::move(requests));
+		m_alerts.emplace_alert<dht_stats_alert>(std::move(table), std::move(requests)
+			, bootstrap_time);
 	}
 
 	std::vector<torrent_handle> session_impl::get_torrents() const
@@ -5260,6 +5293,14 @@ namespace {
 		m_host_resolver.set_cache_timeout(seconds(timeout));
 	}
 
+	void session_impl::update_dh_key_pool_size()
+	{
+#if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
+		if (m_dh_key_pool)
+			m_dh_key_pool->set_size(m_settings.get_int(settings_pack::dh_key_pool_size));
+#endif
+	}
+
 	void session_impl::update_proxy()
 	{
 		for (auto& i : m_listen_sockets)
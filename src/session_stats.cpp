@@ -198,6 +198,45 @@ namespace {
 		// were downloaded multiple times (from different peers)
 		METRIC(net, recv_redundant_bytes)
 
+		// the number of UDP tracker announces and scrapes that did not send a
+		// connect message of their own, because they could use the connection
+		// ID obtained by a concurrent request to the same tracker
+		METRIC(net, udp_tracker_connects_saved)
+
+		// the number of UDP tracker scrapes whose info-hash was sent in the
+		// scrape message of another request to the same tracker, instead of
+		// a message of their own
+		METRIC(net, udp_tracker_scrapes_batched)
+
+		// the number of bytes of piece payload that were copied from the peer
+		// receive buffer into a disk buffer, and the number of bytes received
+		// directly into a disk buffer (from plain-text bittorrent connections)
+		METRIC(net, recv_payload_copied_bytes)
+		METRIC(net, recv_payload_zero_copy_bytes)
+
+		// the number of bytes of partially received messages that were moved
+		// to the front of peer receive buffers, and the number of bytes that
+		// were left where they were (since there was enough room after them
+		// to receive the rest of the message) and consumed without ever
+		// being moved
+		METRIC(net, recv_buffer_bytes_moved)
+		METRIC(net, recv_buffer_move_bytes_saved)
+
+		// the number of write operations issued on peer sockets (each one is
+		// typically a single writev() system call), and the number of times a
+		// peer's messages were held back until the end of the current network
+		// thread turn, to be sent together. ``peer_socket_writes`` divided by
+		// ``sent_bytes`` (in MB) is the number of writes per MB sent
+		METRIC(net, peer_socket_writes)
+		METRIC(net, peer_sends_deferred)
+
+		// the number of Diffie-Hellman keypairs for encrypted handshakes that
+		// were taken from the pool precomputed by a background thread, and the
+		// number that had to be generated on the network thread because the
+		// pool was empty or disabled (see settings_pack::dh_key_pool_size)
+		METRIC(net, dh_keys_precomputed)
+		METRIC(net, dh_keys_generated)
+
 		// is false by default and set to true when
 		// the first incoming connection is established
 		// this is used to know if the client is behind
@@ -308,7 +347,12 @@ namespace {
 		METRIC(picker, piece_picker_busy_loops)
 
 		// This breaks down the piece picks into the event that
-		// triggered it
+		// triggered it. PIECE messages that arrive in the same read from
+		// the socket are followed by a single pick, so
+		// ``incoming_piece_picks`` and ``incoming_redundant_piece_picks``
+		// count picks per batch of received blocks, not per block. The
+		// pick is counted as redundant only if every block in the batch
+		// was redundant
 		METRIC(picker, reject_piece_picks)
 		METRIC(picker, unchoke_piece_picks)
 		METRIC(picker, incoming_redundant_piece_picks)
@@ -387,6 +431,21 @@ namespace {
 		// hash a piece (when verifying against the piece hash)
 		METRIC(disk, num_read_back)
 
+		// the number of pieces read into the cache ahead of sequential
+		// readers, and the number of times a sequential reader reached a piece
+		// that was read ahead while it was still in the cache (hit) or after
+		// it had been evicted (miss)
+		METRIC(disk, num_read_ahead_pieces)
+		METRIC(disk, num_read_ahead_hits)
+		METRIC(disk, num_read_ahead_misses)
+
+		// the number of write submissions from the network thread to the disk
+		// thread, and the number of blocks they carried. Blocks received back
+		// to back for the same piece are submitted together, the ratio is the
+		// average number of blocks per submission
+		METRIC(disk, num_write_batches)
+		METRIC(disk, num_write_batch_blocks)
+
 		// cumulative time spent in various disk jobs, as well
 		// as total for all disk jobs. Measured in microseconds
 		METRIC(disk, disk_read_time)
@@ -495,6 +554,11 @@ namespace {
 		METRIC(utp, utp_invalid_pkts_in)
 		METRIC(utp, utp_redundant_pkts_in)
 
+		// the number of payload bytes uTP sockets had to copy into their own
+		// buffers, because they were received out of order or before the
+		// socket had a read buffer to copy them into
+		METRIC(utp, utp_payload_bytes_buffered)
+
 		// the number of uTP sockets in each respective state
 		METRIC(utp, num_utp_idle)
 		METRIC(utp, num_utp_syn_sent)
@@ -336,6 +336,10 @@ constexpr int CLOSE_FILE_INTERVAL = 0;
 		SET(close_file_interval, CLOSE_FILE_INTERVAL, nullptr),
 		SET(max_web_seed_connections, 3, nullptr),
 		SET(resolver_cache_timeout, 1200, &session_impl::update_resolver_cache_timeout),
+		SET(utp_congestion_control, settings_pack::ledbat, nullptr),
+		SET(dh_key_pool_size, 16, &session_impl::update_dh_key_pool_size),
+		SET(stat_threads, 4, nullptr),
+		SET(read_ahead_pieces, 4, nullptr),
 	}});
 
 #undef SET
@@ -35,8 +35,26 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/error_code.hpp"
 #include "libtorrent/aux_/path.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <system_error>
+
 namespace libtorrent {
 
+namespace {
+
+	// don't bother spawning a thread unless it has at least this many files
+	// to stat
+	int const min_files_per_thread = 16;
+
+	struct stat_result
+	{
+		std::int64_t file_size = 0;
+		error_code ec;
+	};
+}
+
 	stat_cache::stat_cache() {}
 	stat_cache::~stat_cache() = default;
 
@@ -93,6 +111,66 @@ namespace libtorrent {
 		return sz;
 	}
 
+	void stat_cache::prefetch(file_storage const& fs, std::string const& save_path
+		, std::vector<file_index_t> const& files, int const num_threads)
+	{
+		std::vector<file_index_t> to_stat;
+		to_stat.reserve(files.size());
+		for (file_index_t const& i : files)
+		{
+			TORRENT_ASSERT(i < fs.end_file());
+			if (i < m_stat_cache.end_index()
+				&& m_stat_cache[i].file_size != not_in_cache)
+				continue;
+			to_stat.push_back(i);
+		}
+		if (to_stat.empty()) return;
+
+		std::vector<stat_result> results(to_stat.size());
+		std::atomic<int> next_file(0);
+
+		// every thread picks the next file to stat off of the shared counter.
+		// The results are recorded in the cache by the calling thread once
+		// all threads are done, the cache itself is not thread safe
+		auto const stat_files = [&]()
+		{
+			for (;;)
+			{
+				int const idx = next_file.fetch_add(1, std::memory_order_relaxed);
+				if (idx >= int(to_stat.size())) break;
+				file_status s;
+				stat_file(fs.file_path(to_stat[std::size_t(idx)], save_path), &s
+					, results[std::size_t(idx)].ec);
+				results[std::size_t(idx)].file_size = s.file_size;
+			}
+		};
+
+		int const extra_threads = std::min(num_threads
+			, int(to_stat.size()) / min_files_per_thread) - 1;
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < extra_threads; ++i)
+		{
+			try
+			{
+				threads.emplace_back(stat_files);
+			}
+			catch (std::system_error const&)
+			{
+				// if we can't start more threads, make do with the ones we have
+				break;
+			}
+		}
+		stat_files();
+		for (auto& t : threads) t.join();
+
+		for (std::size_t i = 0; i < to_stat.size(); ++i)
+		{
+			if (results[i].ec) set_error(to_stat[i], results[i].ec);
+			else set_cache(to_stat[i], results[i].file_size);
+		}
+	}
+
 	void stat_cache::reserve(int num_files)
 	{
 		m_stat_cache.resize(num_files, not_in_cache);
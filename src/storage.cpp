@@ -378,9 +378,26 @@ namespace libtorrent {
 
 		m_file_created.resize(files().num_files(), false);
 
+		file_storage const& fs = files();
+
+		// stat all the files we're about to look at up-front, in parallel.
+		// Typically they're already in the cache from checking the resume data
+		{
+			std::vector<file_index_t> to_stat;
+			for (file_index_t file_index(0); file_index < fs.end_file(); ++file_index)
+			{
+				if (m_file_priority.end_index() > file_index
+					&& m_file_priority[file_index] == 0)
+					continue;
+				if (fs.pad_file_at(file_index)) continue;
+				to_stat.push_back(file_index);
+			}
+			m_stat_cache.prefetch(fs, m_save_path, to_stat, m_settings
+				? settings().get_int(settings_pack::stat_threads) : 1);
+		}
+
 		// first, create all missing directories
 		std::string last_path;
-		file_storage const& fs = files();
 		for (file_index_t file_index(0); file_index < fs.end_file(); ++file_index)
 		{
 			// ignore files that have priority 0
@@ -601,8 +618,10 @@ namespace libtorrent {
 		, aux::vector<std::string, file_index_t> const& links
 		, storage_error& ec)
 	{
+		int const stat_threads = m_settings
+			? settings().get_int(settings_pack::stat_threads) : 1;
 		return aux::verify_resume_data(rd, links, files()
-			, m_file_priority, m_stat_cache, m_save_path, ec);
+			, m_file_priority, m_stat_cache, m_save_path, stat_threads, ec);
 	}
 
 	status_t default_storage::move_storage(std::string const& sp, int const flags
@@ -723,6 +742,15 @@ namespace libtorrent {
 			mode |= file::no_cache;
 		}
 
+		// with direct I/O, our cache is the only one
+		if (m_settings
+			&& settings().get_int((mode & file::rw_mask) == file::read_only
+				? settings_pack::disk_io_read_mode : settings_pack::disk_io_write_mode)
+			== settings_pack::direct_io)
+		{
+			mode |= file::direct_io;
+		}
+
 		file_handle ret = m_pool.open_file(storage_index(), m_save_path, file
 			, files(), mode, ec);
 		if (ec && (mode & file::lock_file))
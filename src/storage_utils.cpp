@@ -41,6 +41,7 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <set>
 #include <string>
+#include <vector>
 
 namespace libtorrent { namespace aux {
 
@@ -456,6 +457,7 @@ namespace libtorrent { namespace aux {
 		, aux::vector<std::uint8_t, file_index_t> const& file_priority
 		, stat_cache& stat
 		, std::string const& save_path
+		, int const stat_threads
 		, storage_error& ec)
 	{
 #ifdef TORRENT_DISABLE_MUTABLE_TORRENTS
@@ -497,16 +499,15 @@ namespace libtorrent { namespace aux {
 
 		bool const seed = rd.have_pieces.all_set();
 
-		// parse have bitmask. Verify that the files we expect to have
-		// actually do exist
+		// parse have bitmask. Collect the files we expect to have, to verify
+		// that they actually do exist
+		std::vector<file_index_t> files;
 		for (piece_index_t i(0); i < piece_index_t(rd.have_pieces.size()); ++i)
 		{
 			if (rd.have_pieces.get_bit(i) == false) continue;
 
-			std::vector<file_slice> f = fs.map_block(i, 0, 1);
-			TORRENT_ASSERT(!f.empty());
-
-			file_index_t const file_index = f[0].file_index;
+			file_index_t const file_index = fs.file_index_at_offset(
+				std::int64_t(static_cast<int>(i)) * fs.piece_length());
 
 			// files with priority zero may not have been saved to disk at their
 			// expected location, but is likely to be in a partfile. Just exempt it
@@ -515,8 +516,22 @@ namespace libtorrent { namespace aux {
 				&& file_priority[file_index] == 0)
 				continue;
 
+			files.push_back(file_index);
+
+			// skip all remaining pieces in this file. We're just
+			// sanity-checking whether the files exist or not.
+			peer_request const pr = fs.map_file(file_index
+				, fs.file_size(file_index) + 1, 0);
+			i = std::max(next(i), pr.piece);
+		}
+
+		// stat all files up-front, in parallel
+		stat.prefetch(fs, save_path, files, stat_threads);
+
+		for (file_index_t const& file_index : files)
+		{
 			error_code error;
-			std::int64_t const size = stat.get_filesize(f[0].file_index
+			std::int64_t const size = stat.get_filesize(file_index
 				, fs, save_path, error);
 
 			if (size < 0)
@@ -546,13 +561,6 @@ namespace libtorrent { namespace aux {
 				ec.operation = storage_error::check_resume;
 				return false;
 			}
-
-			// OK, this file existed, good. Now, skip all remaining pieces in
-			// this file. We're just sanity-checking whether the files exist
-			// or not.
-			peer_request const pr = fs.map_file(file_index
-				, fs.file_size(file_index) + 1, 0);
-			i = std::max(next(i), pr.piece);
 		}
 		return true;
 	}
@@ -819,6 +819,12 @@ namespace libtorrent {
 	}
 
 	void torrent::read_piece(piece_index_t const piece)
+	{
+		read_piece_impl(piece, is_sequential_download()
+			? std::uint8_t(disk_interface::sequential_access) : std::uint8_t(0));
+	}
+
+	void torrent::read_piece_impl(piece_index_t const piece, std::uint8_t const disk_flags)
 	{
 		if (m_abort || m_deleted)
 		{
@@ -857,7 +863,8 @@ namespace libtorrent {
 			r.length = (std::min)(piece_size - r.start, block_size());
 			m_ses.disk_thread().async_read(m_storage, r
 				, std::bind(&torrent::on_disk_read_complete
-				, shared_from_this(), _1, _2, _3, r, rp), reinterpret_cast<void*>(1));
+				, shared_from_this(), _1, _2, _3, r, rp), reinterpret_cast<void*>(1)
+				, disk_flags);
 		}
 	}
 
@@ -4526,7 +4533,7 @@ namespace libtorrent {
 		if (is_seed() || (has_picker() && m_picker->has_piece_passed(piece)))
 		{
 			if (flags & torrent_handle::alert_when_available)
-				read_piece(piece);
+				read_piece_impl(piece, disk_interface::sequential_access);
 			return;
 		}
 
@@ -4620,7 +4627,7 @@ namespace libtorrent {
 			{
 				if (i->flags & torrent_handle::alert_when_available)
 				{
-					read_piece(i->piece);
+					read_piece_impl(i->piece, disk_interface::sequential_access);
 				}
 
 				// if first_requested is min_time(), it wasn't requested as a critical piece
@@ -243,6 +243,70 @@ namespace libtorrent {
 		m_udp_conns[tid] = c;
 	}
 
+	bool tracker_manager::wait_for_udp_connect(address const& tracker
+		, std::shared_ptr<udp_tracker_connection> const& c)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const i = m_udp_connecting.find(tracker);
+		if (i == m_udp_connecting.end())
+		{
+			m_udp_connecting[tracker];
+			return false;
+		}
+		i->second.push_back(c);
+		return true;
+	}
+
+	void tracker_manager::udp_connect_done(
+		std::shared_ptr<udp_tracker_connection> const& c, bool const success)
+	{
+		TORRENT_ASSERT(is_single_thread());
+		auto const i = m_udp_connecting.find(c->m_target.address());
+		TORRENT_ASSERT(i != m_udp_connecting.end());
+		if (i == m_udp_connecting.end()) return;
+
+		std::vector<std::weak_ptr<udp_tracker_connection>> waiting;
+		waiting.swap(i->second);
+		m_udp_connecting.erase(i);
+
+		// the scrape requests that will send a scrape message. Other scrapes
+		// to the same tracker add their info-hashes to those messages
+		std::vector<std::shared_ptr<udp_tracker_connection>> scrapes;
+		if (success && c->is_scrape()) scrapes.push_back(c);
+
+		// if the connect succeeded, the waiting requests will find the
+		// connection ID in the cache. If it failed, one of them will send a new
+		// connect message
+		for (auto const& w : waiting)
+		{
+			std::shared_ptr<udp_tracker_connection> r = w.lock();
+			if (!r) continue;
+			if (success)
+			{
+				m_stats_counters.inc_stats_counter(counters::udp_tracker_connects_saved);
+
+				if (r->is_scrape() && r->m_scrape_batch.empty())
+				{
+					auto const s = std::find_if(scrapes.begin(), scrapes.end()
+						, [&r](std::shared_ptr<udp_tracker_connection> const& l)
+						{
+							return l->m_target == r->m_target
+								&& int(l->m_scrape_batch.size()) + 1
+									< udp_tracker_connection::max_scrape_batch;
+						});
+					if (s != scrapes.end())
+					{
+						(*s)->add_to_scrape_batch(r);
+						m_stats_counters.inc_stats_counter(counters::udp_tracker_scrapes_batched);
+						continue;
+					}
+				}
+				if (r->is_scrape()) scrapes.push_back(r);
+			}
+			c->get_io_service().post(std::bind(&udp_tracker_connection::start_announce, r));
+		}
+	}
+
 	void tracker_manager::queue_request(
 		io_service& ios
 		, tracker_request req
@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cctype>
+#include <algorithm>
 #include <functional>
 #include <tuple>
 
@@ -129,6 +130,10 @@ namespace libtorrent {
 	void udp_tracker_connection::fail(error_code const& ec, int code
 		, char const* msg, seconds32 const interval, seconds32 const min_interval)
 	{
+		release_connect(false);
+		release_scrape_batch();
+		m_batched = false;
+
 		// m_target failed. remove it from the endpoint list
 		auto const i = std::find(m_endpoints.begin()
 			, m_endpoints.end(), tcp::endpoint(m_target.address(), m_target.port()));
@@ -275,6 +280,15 @@ namespace libtorrent {
 
 	void udp_tracker_connection::start_announce()
 	{
+		// this may have been posted while waiting for another request's
+		// connect message
+		if (cancelled())
+		{
+			release_scrape_batch();
+			return;
+		}
+		m_batched = false;
+
 		std::unique_lock<std::mutex> l(m_cache_mutex);
 		auto const cc = m_connection_cache.find(m_target.address());
 		if (cc != m_connection_cache.end())
@@ -294,9 +308,52 @@ namespace libtorrent {
 		}
 		l.unlock();
 
+		// when many torrents announce to the same tracker at the same time,
+		// only one of them needs to obtain a connection ID. The others wait
+		// for it (unless we only know the tracker's hostname, because we're
+		// going through a proxy)
+		if (!m_connecting && m_hostname.empty())
+		{
+			if (m_man.wait_for_udp_connect(m_target.address(), shared_from_this()))
+				return;
+			m_connecting = true;
+		}
+
 		send_udp_connect();
 	}
 
+	void udp_tracker_connection::release_connect(bool const success)
+	{
+		if (!m_connecting) return;
+		m_connecting = false;
+		m_man.udp_connect_done(shared_from_this(), success);
+	}
+
+	void udp_tracker_connection::add_to_scrape_batch(
+		std::shared_ptr<udp_tracker_connection> c)
+	{
+		TORRENT_ASSERT(is_scrape());
+		TORRENT_ASSERT(c->is_scrape());
+		TORRENT_ASSERT(c->m_target == m_target);
+		TORRENT_ASSERT(int(m_scrape_batch.size()) + 1 < max_scrape_batch);
+		c->m_batched = true;
+		m_scrape_batch.push_back(std::move(c));
+	}
+
+	void udp_tracker_connection::release_scrape_batch()
+	{
+		std::vector<std::shared_ptr<udp_tracker_connection>> batch;
+		batch.swap(m_scrape_batch);
+		for (auto const& c : batch)
+		{
+			// the request may have timed out or been aborted since
+			if (!c->m_batched) continue;
+			c->m_batched = false;
+			get_io_service().post(std::bind(
+				&udp_tracker_connection::start_announce, c));
+		}
+	}
+
 	void udp_tracker_connection::on_timeout(error_code const& ec)
 	{
 		if (ec)
@@ -315,6 +372,9 @@ namespace libtorrent {
 	void udp_tracker_connection::close()
 	{
 		cancel();
+		release_connect(false);
+		release_scrape_batch();
+		m_batched = false;
 		m_man.remove_request(this);
 	}
 
@@ -461,10 +521,13 @@ namespace libtorrent {
 		update_transaction_id();
 		std::int64_t const connection_id = aux::read_int64(buf);
 
-		std::lock_guard<std::mutex> l(m_cache_mutex);
+		std::unique_lock<std::mutex> l(m_cache_mutex);
 		connection_cache_entry& cce = m_connection_cache[m_target.address()];
 		cce.connection_id = connection_id;
 		cce.expires = aux::time_now() + seconds(m_man.settings().get_int(settings_pack::udp_tracker_token_expiry));
+		l.unlock();
+
+		release_connect(true);
 
 		if (0 == (tracker_req().kind & tracker_request::scrape_request))
 			send_udp_announce();
@@ -549,32 +612,42 @@ namespace libtorrent {
 		TORRENT_ASSERT(i != m_connection_cache.end());
 		if (i == m_connection_cache.end()) return;
 
-		char buf[8 + 4 + 4 + 20];
+		// drop batched requests that have timed out or been aborted
+		m_scrape_batch.erase(std::remove_if(m_scrape_batch.begin(), m_scrape_batch.end()
+			, [](std::shared_ptr<udp_tracker_connection> const& c)
+			{ return !c->m_batched; }), m_scrape_batch.end());
+
+		char buf[8 + 4 + 4 + 20 * max_scrape_batch];
 		span<char> view = buf;
 
 		aux::write_int64(i->second.connection_id, view); // connection_id
 		aux::write_int32(action_t::scrape, view); // action (scrape)
 		aux::write_int32(m_transaction_id, view); // transaction_id
-		// info_hash
+		// info_hash, followed by the info-hashes of the batched requests
 		std::copy(tracker_req().info_hash.begin(), tracker_req().info_hash.end()
 			, view.data());
-#if TORRENT_USE_ASSERTS
-		TORRENT_ASSERT(view.size() == 20);
-#endif
+		view = view.subspan(20);
+		for (auto const& c : m_scrape_batch)
+		{
+			std::copy(c->tracker_req().info_hash.begin(), c->tracker_req().info_hash.end()
+				, view.data());
+			view = view.subspan(20);
+		}
+		span<char const> const msg(buf, std::size_t(sizeof(buf) - view.size()));
 
 		error_code ec;
 		if (!m_hostname.empty())
 		{
 			m_man.send_hostname(m_hostname.c_str(), m_target.port()
-				, buf, ec, udp_socket::tracker_connection);
+				, msg, ec, udp_socket::tracker_connection);
 		}
 		else
 		{
-			m_man.send(m_target, buf, ec
+			m_man.send(m_target, msg, ec
 				, udp_socket::tracker_connection);
 		}
 		m_state = action_t::scrape;
-		sent_bytes(sizeof(buf) + 28); // assuming UDP/IP header
+		sent_bytes(int(msg.size()) + 28); // assuming UDP/IP header
 		++m_attempts;
 		if (ec)
 		{
@@ -699,6 +772,36 @@ namespace libtorrent {
 		int const downloaded = aux::read_int32(buf);
 		int const incomplete = aux::read_int32(buf);
 
+		// the responses for the batched info-hashes follow ours, in the order
+		// they were sent. If the tracker left any of them out, those requests
+		// are sent again on their own
+		std::vector<std::shared_ptr<udp_tracker_connection>> batch;
+		batch.swap(m_scrape_batch);
+		for (auto const& c : batch)
+		{
+			bool const has_entry = buf.size() >= 12;
+			int const c_complete = has_entry ? aux::read_int32(buf) : -1;
+			int const c_downloaded = has_entry ? aux::read_int32(buf) : -1;
+			int const c_incomplete = has_entry ? aux::read_int32(buf) : -1;
+
+			if (!c->m_batched) continue;
+			if (!has_entry)
+			{
+				c->m_batched = false;
+				get_io_service().post(std::bind(
+					&udp_tracker_connection::start_announce, c));
+				continue;
+			}
+
+			std::shared_ptr<request_callback> ccb = c->requester();
+			if (ccb)
+			{
+				ccb->tracker_scrape_response(c->tracker_req()
+					, c_complete, c_incomplete, c_downloaded, -1);
+			}
+			c->close();
+		}
+
 		std::shared_ptr<request_callback> cb = requester();
 		if (!cb)
 		{
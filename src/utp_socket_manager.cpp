@@ -329,7 +329,7 @@ namespace libtorrent {
 	void utp_socket_manager::inc_stats_counter(int counter, int delta)
 	{
 		TORRENT_ASSERT((counter >= counters::utp_packet_loss
-				&& counter <= counters::utp_redundant_pkts_in)
+				&& counter <= counters::utp_payload_bytes_buffered)
 			|| (counter >= counters::num_utp_idle
 				&& counter <= counters::num_utp_deleted));
 		m_counters.inc_stats_counter(counter, delta);
@@ -41,8 +41,10 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/invariant_check.hpp"
 #include "libtorrent/performance_counters.hpp"
 #include "libtorrent/io_service.hpp"
+#include "libtorrent/aux_/ffs.hpp"
 #include <cstdint>
 #include <limits>
+#include <array>
 
 // the behavior of the sequence numbers as implemented by uTorrent is not
 // particularly regular. This switch indicates the odd parts.
@@ -172,6 +174,42 @@ bool compare_less_wrap(std::uint32_t lhs
 	return dist_up < dist_down;
 }
 
+int sack_bit_offsets(span<std::uint8_t const> const bitmask
+	, int const num_bits, span<std::uint16_t> const offsets)
+{
+	TORRENT_ASSERT(num_bits >= 0);
+	TORRENT_ASSERT(num_bits <= int(bitmask.size()) * 8);
+	TORRENT_ASSERT(num_bits <= int(offsets.size()));
+
+	std::uint8_t const* ptr = bitmask.data();
+	std::uint16_t* out = offsets.data();
+	int const num_bytes = (num_bits + 7) / 8;
+	int ret = 0;
+
+	// the bitmask is processed 32 bits at a time. Bit 0 of the first byte
+	// becomes bit 0 of the word, so the offset of a set bit is its
+	// position in the word. Runs of zeros (i.e. packets still in flight)
+	// are skipped without looking at the individual bits
+	for (int i = 0; i < num_bytes; i += 4)
+	{
+		std::uint32_t word = 0;
+		int const n = std::min(4, num_bytes - i);
+		for (int k = 0; k < n; ++k)
+			word |= std::uint32_t(ptr[i + k]) << (k * 8);
+
+		int const bits_left = num_bits - i * 8;
+		if (bits_left < 32) word &= (std::uint32_t(1) << bits_left) - 1;
+
+		while (word != 0)
+		{
+			out[ret++] = std::uint16_t(i * 8 + aux::count_trailing_zeros(word));
+			// clear the lowest set bit
+			word &= word - 1;
+		}
+	}
+	return ret;
+}
+
 // since the uTP socket state may be needed after the
 // utp_stream is closed, it's kept in a separate struct
 // whose lifetime is not tied to the lifetime of utp_stream
@@ -290,7 +328,10 @@ struct utp_socket_impl
 		, std::uint16_t seq_nr);
 	void write_sack(std::uint8_t* buf, int size) const;
 	void incoming(std::uint8_t const* buf, int size, packet_ptr p, time_point now);
+	void do_congestion_control(int acked_bytes, int delay, int in_flight
+		, time_point now);
 	void do_ledbat(int acked_bytes, int delay, int in_flight);
+	void do_ledbat_plus_plus(int acked_bytes, int delay, time_point now);
 	int packet_timeout() const;
 	bool test_socket_state();
 	void maybe_trigger_receive_callback();
@@ -422,6 +463,14 @@ public:
 	// threshold to leave slow-start earlier next time, to avoid packet-loss
 	std::int32_t m_ssthres = 0;
 
+	// the state of the periodic slowdowns of LEDBAT++. m_slowdown_start is
+	// when the last slowdown started, m_slowdown_end is when the current one
+	// ends (min_time() when we're not slowing down) and m_next_slowdown is when
+	// the next one is due (min_time() if it hasn't been scheduled yet)
+	time_point m_slowdown_start = min_time();
+	time_point m_slowdown_end = min_time();
+	time_point m_next_slowdown = min_time();
+
 	// the number of bytes we have buffered in m_inbuf
 	std::int32_t m_buffered_incoming_bytes = 0;
 
@@ -1495,48 +1544,39 @@ std::pair<std::uint32_t, int> utp_socket_impl::parse_sack(std::uint16_t const pa
 	int acked_bytes = 0;
 	std::uint32_t min_rtt = std::numeric_limits<std::uint32_t>::max();
 
-	// for each byte
-	for (std::uint8_t const* end = ptr + size; ptr != end; ++ptr)
-	{
-		std::uint8_t bitfield = *ptr;
-		unsigned char mask = 1;
-		// for each bit
-		for (int i = 0; i < 8; ++i)
-		{
-			if (mask & bitfield)
-			{
-				last_ack = ack_nr;
-				if (m_fast_resend_seq_nr == ack_nr)
-					m_fast_resend_seq_nr = (m_fast_resend_seq_nr + 1) & ACK_MASK;
-
-				if (compare_less_wrap(m_fast_resend_seq_nr, ack_nr, ACK_MASK)) ++dups;
-				// this bit was set, ack_nr was received
-				packet_ptr p = m_outbuf.remove(aux::numeric_cast<packet_buffer::index_type>(ack_nr));
-				if (p)
-				{
-					acked_bytes += p->size - p->header_size;
-					// each ACKed packet counts as a duplicate ack
-					UTP_LOGV("%8p: duplicate_acks:%u fast_resend_seq_nr:%u\n"
-						, static_cast<void*>(this), m_duplicate_acks, m_fast_resend_seq_nr);
-					min_rtt = std::min(min_rtt, ack_packet(std::move(p), now, std::uint16_t(ack_nr)));
-				}
-				else
-				{
-					// this packet might have been acked by a previous
-					// selective ack
-					maybe_inc_acked_seq_nr();
-				}
-			}
+	// we haven't sent packets past m_seq_nr. If there are any bits set
+	// past that point, we have to ignore them anyway
+	int const num_bits = std::min(size * 8, int((m_seq_nr - ack_nr) & ACK_MASK));
 
-			mask <<= 1;
-			ack_nr = (ack_nr + 1) & ACK_MASK;
+	// the SACK extension length is a single byte, so this covers the
+	// largest possible bitmask
+	std::array<std::uint16_t, 255 * 8> offsets;
+	int const num_acked = sack_bit_offsets({ptr, std::size_t(size)}, num_bits, offsets);
+
+	for (int i = 0; i < num_acked; ++i)
+	{
+		std::uint32_t const seq = (ack_nr + offsets[std::size_t(i)]) & ACK_MASK;
+		last_ack = seq;
+		if (m_fast_resend_seq_nr == seq)
+			m_fast_resend_seq_nr = (m_fast_resend_seq_nr + 1) & ACK_MASK;
 
-			// we haven't sent packets past this point.
-			// if there are any more bits set, we have to
-			// ignore them anyway
-			if (ack_nr == m_seq_nr) break;
+		if (compare_less_wrap(m_fast_resend_seq_nr, seq, ACK_MASK)) ++dups;
+		// this bit was set, seq was received
+		packet_ptr p = m_outbuf.remove(aux::numeric_cast<packet_buffer::index_type>(seq));
+		if (p)
+		{
+			acked_bytes += p->size - p->header_size;
+			// each ACKed packet counts as a duplicate ack
+			UTP_LOGV("%8p: duplicate_acks:%u fast_resend_seq_nr:%u\n"
+				, static_cast<void*>(this), m_duplicate_acks, m_fast_resend_seq_nr);
+			min_rtt = std::min(min_rtt, ack_packet(std::move(p), now, std::uint16_t(seq)));
+		}
+		else
+		{
+			// this packet might have been acked by a previous
+			// selective ack
+			maybe_inc_acked_seq_nr();
 		}
-		if (ack_nr == m_seq_nr) break;
 	}
 
 	TORRENT_ASSERT(m_outbuf.at((m_acked_seq_nr + 1) & ACK_MASK) || ((m_seq_nr - m_acked_seq_nr) & ACK_MASK) <= 1);
@@ -1680,15 +1720,13 @@ bool utp_socket_impl::send_pkt(int const flags)
 
 //	TORRENT_ASSERT(m_state != UTP_STATE_FIN_SENT || (flags & pkt_ack));
 
-	// first see if we need to resend any packets
-
-	// TODO: this loop is not very efficient. It could be fixed by having
-	// a separate list of sequence numbers that need resending
-	for (int i = (m_acked_seq_nr + 1) & ACK_MASK; i != m_seq_nr; i = (i + 1) & ACK_MASK)
+	// first see if we need to resend any packets. Packets that need
+	// resending are marked in m_outbuf, so this only visits those
+	for (packet_buffer::index_type i = m_outbuf.next_marked((m_acked_seq_nr + 1) & ACK_MASK, m_seq_nr);
+		i != m_seq_nr; i = m_outbuf.next_marked((i + 1) & ACK_MASK, m_seq_nr))
 	{
-		packet* p = m_outbuf.at(aux::numeric_cast<packet_buffer::index_type>(i));
-		if (!p) continue;
-		if (!p->need_resend) continue;
+		packet* p = m_outbuf.at(i);
+		TORRENT_ASSERT(p != nullptr && p->need_resend);
 		if (!resend_packet(p))
 		{
 			// we couldn't resend the packet. It probably doesn't
@@ -2126,7 +2164,11 @@ bool utp_socket_impl::resend_packet(packet* p, bool fast_resend)
 	TORRENT_ASSERT(p->num_transmissions < m_sm.num_resends() + 1);
 
 	TORRENT_ASSERT(p->size - p->header_size >= 0);
-	if (p->need_resend) m_bytes_in_flight += p->size - p->header_size;
+	if (p->need_resend)
+	{
+		m_bytes_in_flight += p->size - p->header_size;
+		m_outbuf.unmark(reinterpret_cast<utp_header*>(p->buf)->seq_nr);
+	}
 
 	m_sm.inc_stats_counter(counters::utp_packet_resend);
 	if (fast_resend) m_sm.inc_stats_counter(counters::utp_fast_retransmit);
@@ -2386,6 +2428,7 @@ void utp_socket_impl::incoming(std::uint8_t const* buf, int size, packet_ptr p
 		p->size = std::uint16_t(size);
 		p->header_size = 0;
 		std::memcpy(p->buf, buf, aux::numeric_cast<std::size_t>(size));
+		m_sm.inc_stats_counter(counters::utp_payload_bytes_buffered, size);
 	}
 	// save this packet until the client issues another read
 	m_receive_buffer_size += p->size - p->header_size;
@@ -2529,6 +2572,7 @@ bool utp_socket_impl::consume_incoming_data(
 #endif
 		p->need_resend = false;
 		std::memcpy(p->buf, ptr, aux::numeric_cast<std::size_t>(payload_size));
+		m_sm.inc_stats_counter(counters::utp_payload_bytes_buffered, payload_size);
 		m_buffered_incoming_bytes += p->size;
 		m_inbuf.insert(ph->seq_nr, std::move(p));
 
@@ -3066,7 +3110,8 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 				// sure to clamp it as a sanity check
 				if (delay > min_rtt) delay = min_rtt;
 
-				do_ledbat(acked_bytes, int(delay), prev_bytes_in_flight);
+				do_congestion_control(acked_bytes, int(delay), prev_bytes_in_flight
+					, receive_time);
 				m_send_delay = std::int32_t(delay);
 			}
 
@@ -3304,11 +3349,42 @@ bool utp_socket_impl::incoming_packet(span<std::uint8_t const> buf
 	return true;
 }
 
-void utp_socket_impl::do_ledbat(const int acked_bytes, const int delay
-	, const int in_flight)
+void utp_socket_impl::do_congestion_control(int const acked_bytes
+	, int const delay, int const in_flight, time_point const now)
 {
 	INVARIANT_CHECK;
 
+	switch (m_sm.congestion_control())
+	{
+		case settings_pack::ledbat_plus_plus:
+			do_ledbat_plus_plus(acked_bytes, delay, now);
+			break;
+		default:
+			do_ledbat(acked_bytes, delay, in_flight);
+			break;
+	}
+
+	TORRENT_ASSERT(m_cwnd >= 0);
+
+	int window_size_left = std::min(int(m_cwnd >> 16), int(m_adv_wnd)) - in_flight + acked_bytes;
+	if (window_size_left >= m_mtu)
+	{
+		UTP_LOGV("%8p: mtu:%d in_flight:%d adv_wnd:%d cwnd:%d acked_bytes:%d cwnd_full -> 0\n"
+			, static_cast<void*>(this), m_mtu, in_flight, int(m_adv_wnd), int(m_cwnd >> 16), acked_bytes);
+		m_cwnd_full = false;
+	}
+
+	if ((m_cwnd >> 16) >= m_adv_wnd)
+	{
+		m_slow_start = false;
+		UTP_LOGV("%8p: cwnd > advertized wnd (%d) slow_start -> 0\n"
+			, static_cast<void*>(this), m_adv_wnd);
+	}
+}
+
+void utp_socket_impl::do_ledbat(const int acked_bytes, const int delay
+	, const int in_flight)
+{
 	// the portion of the in-flight bytes that were acked. This is used to make
 	// the gain factor be scaled by the rtt. The formula is applied once per
 	// rtt, or on every ACK scaled by the number of ACKs per rtt
@@ -3402,23 +3478,160 @@ void utp_socket_impl::do_ledbat(const int acked_bytes, const int delay
 		m_cwnd += scaled_gain;
 		TORRENT_ASSERT(m_cwnd > 0);
 	}
+}
 
-	TORRENT_ASSERT(m_cwnd >= 0);
+// this implements LEDBAT++ as described in draft-irtf-iccrg-ledbat-plus-plus.
+// Compared to LEDBAT it has a smaller gain on long RTT links, decreases the
+// window multiplicatively when above the target delay and periodically
+// drains its own queue to keep the base delay measurement accurate (which
+// fixes the latecomer advantage of LEDBAT)
+void ledbat_plus_plus(ledbat_state& s, int const acked_bytes
+	, int const delay, int target_delay, int const rtt_ms, int const mtu
+	, int const bytes_in_flight, time_point const now)
+{
+	TORRENT_ASSERT(acked_bytes > 0);
+	TORRENT_ASSERT(mtu > 0);
 
-	int window_size_left = std::min(int(m_cwnd >> 16), int(m_adv_wnd)) - in_flight + acked_bytes;
-	if (window_size_left >= m_mtu)
+	target_delay = std::max(1, target_delay);
+	std::int64_t const rtt = std::max(1, rtt_ms);
+	std::int64_t const min_cwnd = std::int64_t(mtu) * (1 << 16);
+
+	if (s.slowdown_end != min_time())
 	{
-		UTP_LOGV("%8p: mtu:%d in_flight:%d adv_wnd:%d cwnd:%d acked_bytes:%d cwnd_full -> 0\n"
-			, static_cast<void*>(this), m_mtu, in_flight, int(m_adv_wnd), int(m_cwnd >> 16), acked_bytes);
-		m_cwnd_full = false;
+		// while slowing down, the cwnd is held at two packets for two RTTs, to
+		// let the queue drain
+		if (now < s.slowdown_end)
+		{
+			s.cwnd = 2 * min_cwnd;
+			return;
+		}
+
+		// then slow-start back to the cwnd we had before the slowdown (which
+		// is stored in s.ssthres)
+		s.slowdown_end = min_time();
+		s.slow_start = true;
 	}
 
-	if ((m_cwnd >> 16) >= m_adv_wnd)
+	if (!s.slow_start && s.next_slowdown == min_time())
 	{
-		m_slow_start = false;
-		UTP_LOGV("%8p: cwnd > advertized wnd (%d) slow_start -> 0\n"
-			, static_cast<void*>(this), m_adv_wnd);
+		// we just left slow-start. The first slowdown is two RTTs later,
+		// subsequent ones are scheduled to keep the time spent slowing down
+		// (and recovering) to about 10%
+		s.next_slowdown = (s.slowdown_start == min_time())
+			? now + milliseconds(2 * rtt)
+			: now + (now - s.slowdown_start) * 9;
+	}
+	else if (!s.slow_start && now >= s.next_slowdown)
+	{
+		s.ssthres = std::int32_t(s.cwnd >> 16);
+		s.cwnd = 2 * min_cwnd;
+		s.slowdown_start = now;
+		s.slowdown_end = now + milliseconds(2 * rtt);
+		s.next_slowdown = min_time();
+		return;
+	}
+
+	// the gain is reduced on long RTT links, to not make up for the longer
+	// feedback loop by queuing more. It's 1 / min(16, ceil(2 * target / rtt))
+	// as a fixed point value with 16 bits fraction
+	std::int64_t const gain_divisor = std::min(std::int64_t(16)
+		, (2 * std::int64_t(target_delay) + rtt * 1000 - 1) / (rtt * 1000));
+	std::int64_t const gain = (std::int64_t(1) << 16) / std::max(std::int64_t(1), gain_divisor);
+
+	// true if the upper layer is pushing enough data down the socket to be
+	// limited by the cwnd. If this is not the case, we should not grow cwnd.
+	bool const cwnd_saturated = (bytes_in_flight + acked_bytes + mtu > (s.cwnd >> 16));
+
+	std::int64_t const cwnd_bytes = std::max(std::int64_t(mtu), s.cwnd >> 16);
+	std::int64_t scaled_gain = 0;
+
+	if (delay >= target_delay)
+	{
+		// multiplicative decrease, proportional to how far above the target
+		// we are, but never more than half the window per RTT. This is scaled
+		// by the portion of the window that was acked
+		std::int64_t const off_target = std::min(std::int64_t(1) << 15
+			, (std::int64_t(delay - target_delay) * (1 << 16)) / target_delay);
+		scaled_gain = gain * acked_bytes * mtu / cwnd_bytes
+			- off_target * acked_bytes;
+	}
+	else
+	{
+		if (!cwnd_saturated)
+		{
+			scaled_gain = 0;
+		}
+		else if (s.slow_start)
+		{
+			scaled_gain = gain * acked_bytes;
+			if (s.ssthres != 0 && ((s.cwnd + scaled_gain) >> 16) > s.ssthres)
+				s.slow_start = false;
+		}
+		else
+		{
+			scaled_gain = gain * acked_bytes * mtu / cwnd_bytes;
+		}
+	}
+
+	// leave slow-start early, when the queuing delay reaches 3/4 of the
+	// target, to not overshoot
+	if (s.slow_start && delay * 4 >= target_delay * 3)
+	{
+		s.ssthres = std::int32_t(s.cwnd >> 16);
+		s.slow_start = false;
+	}
+
+	// make sure we don't wrap the cwnd
+	if (scaled_gain >= (std::numeric_limits<std::int64_t>::max)() - s.cwnd)
+		scaled_gain = (std::numeric_limits<std::int64_t>::max)() - s.cwnd - 1;
+
+	s.cwnd = std::max(s.cwnd + scaled_gain, min_cwnd);
+}
+
+void utp_socket_impl::do_ledbat_plus_plus(int const acked_bytes
+	, int const delay, time_point const now)
+{
+	TORRENT_ASSERT(acked_bytes > 0);
+
+	int const target_delay = std::max(1, m_sm.target_delay());
+	m_sm.inc_stats_counter(delay >= target_delay
+		? counters::utp_samples_above_target
+		: counters::utp_samples_below_target);
+
+	ledbat_state s;
+	s.cwnd = m_cwnd;
+	s.ssthres = m_ssthres;
+	s.slow_start = m_slow_start;
+	s.slowdown_start = m_slowdown_start;
+	s.slowdown_end = m_slowdown_end;
+	s.next_slowdown = m_next_slowdown;
+
+	ledbat_plus_plus(s, acked_bytes, delay, target_delay, m_rtt.mean(), m_mtu
+		, m_bytes_in_flight, now);
+
+	if (s.slow_start != bool(m_slow_start))
+	{
+		UTP_LOGV("%8p: off_target: %d cwnd:%d ssthres:%d slow_start -> %d\n"
+			, static_cast<void*>(this), target_delay - delay, int(s.cwnd >> 16)
+			, s.ssthres, int(s.slow_start));
 	}
+	if (s.slowdown_end != m_slowdown_end && s.slowdown_end != min_time())
+	{
+		UTP_LOGV("%8p: slowdown, cwnd:%d ssthres:%d\n"
+			, static_cast<void*>(this), int(s.cwnd >> 16), s.ssthres);
+	}
+
+	UTP_LOGV("%8p: do_ledbat_plus_plus delay:%d off_target: %d cwnd:%d -> %d "
+		"slow_start:%d\n"
+		, static_cast<void*>(this), delay, target_delay - delay
+		, int(m_cwnd >> 16), int(s.cwnd >> 16), int(s.slow_start));
+
+	m_cwnd = s.cwnd;
+	m_ssthres = s.ssthres;
+	m_slow_start = s.slow_start;
+	m_slowdown_start = s.slowdown_start;
+	m_slowdown_end = s.slowdown_end;
+	m_next_slowdown = s.next_slowdown;
 }
 
 void utp_stream::bind(endpoint_type const&, error_code&) { }
@@ -3563,6 +3776,7 @@ void utp_socket_impl::tick(time_point now)
 			if (!p) continue;
 			if (p->need_resend) continue;
 			p->need_resend = true;
+			m_outbuf.mark(aux::numeric_cast<packet_buffer::index_type>(i));
 			TORRENT_ASSERT(m_bytes_in_flight >= p->size - p->header_size);
 			m_bytes_in_flight -= p->size - p->header_size;
 			UTP_LOGV("%8p: Packet %d lost (timeout).\n", static_cast<void*>(this), i);
@@ -3659,6 +3873,7 @@ void utp_socket_impl::check_invariant() const
 			TORRENT_ASSERT(p->mtu_probe);
 		}
 		TORRENT_ASSERT(reinterpret_cast<utp_header*>(p->buf)->seq_nr == i);
+		TORRENT_ASSERT(m_outbuf.marked(i) == p->need_resend);
 	}
 
 	if (m_nagle_packet)
@@ -33,6 +33,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <cstdint>
 
 #include "libtorrent/bdecode.hpp"
+#include "libtorrent/bencode_writer.hpp"
 #include "libtorrent/write_resume_data.hpp"
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/socket_io.hpp" // for write_*_endpoint()
@@ -246,12 +247,277 @@ namespace libtorrent {
 		return ret;
 	}
 
+	void write_resume_data_buf(add_torrent_params const& atp, std::vector<char>& buf)
+	{
+		// this produces the same encoding as bencoding the entry returned by
+		// write_resume_data(), but without building the entry tree first. The
+		// keys must be written in sorted order
+		using namespace libtorrent::detail; // for write_*_endpoint()
+		auto w = make_bencode_writer(std::back_inserter(buf));
+		w.open_dict();
+
+		// peers are saved as one string of compact IPv4 endpoints and one of
+		// IPv6 endpoints
+		auto const write_endpoints = [&w](string_view const key, string_view const key6
+			, std::vector<tcp::endpoint> const& eps)
+		{
+			std::size_t num_v6 = 0;
+#if TORRENT_USE_IPV6
+			for (auto const& p : eps)
+				if (p.address().is_v6()) ++num_v6;
+#else
+			TORRENT_UNUSED(key6);
+#endif
+
+			w.key(key);
+			w.string_header((eps.size() - num_v6) * 6);
+			for (auto const& p : eps)
+			{
+#if TORRENT_USE_IPV6
+				if (p.address().is_v6()) continue;
+#endif
+				write_endpoint(p, w.out());
+			}
+#if TORRENT_USE_IPV6
+			w.key(key6);
+			w.string_header(num_v6 * 18);
+			for (auto const& p : eps)
+			{
+				if (!p.address().is_v6()) continue;
+				write_endpoint(p, w.out());
+			}
+#endif
+		};
+
+		w.add("active_time", atp.active_time);
+		w.add("added_time", atp.added_time);
+		w.add("allocation", atp.storage_mode == storage_mode_allocate
+			? "allocate" : "sparse");
+		w.add("auto_managed", std::int64_t(atp.flags & add_torrent_params::flag_auto_managed));
+
+		if (!atp.banned_peers.empty())
+			write_endpoints("banned_peers", "banned_peers6", atp.banned_peers);
+
+		w.add("completed_time", atp.completed_time);
+		w.add("download_rate_limit", atp.download_limit);
+		w.add("file-format", "libtorrent resume file");
+		w.add("file-version", 1);
+
+		if (!atp.file_priorities.empty())
+		{
+			// write file priorities
+			w.key("file_priority");
+			w.open_list();
+			for (auto const p : atp.file_priorities)
+				w.integer(p);
+			w.close();
+		}
+
+		w.add("finished_time", atp.finished_time);
+
+		if (!atp.http_seeds.empty())
+		{
+			w.key("httpseeds");
+			w.open_list();
+			for (auto const& s : atp.http_seeds) w.string(s);
+			w.close();
+		}
+
+		if (atp.ti)
+		{
+			boost::shared_array<char> const info = atp.ti->metadata();
+			int const size = atp.ti->metadata_size();
+			w.key("info");
+			w.preformatted({info.get(), std::size_t(size)});
+		}
+
+		w.key("info-hash");
+		w.string(string_view(atp.info_hash.data(), atp.info_hash.size()));
+		w.add("last_seen_complete", atp.last_seen_complete);
+		w.add("libtorrent-version", LIBTORRENT_VERSION);
+
+		// write renamed files
+		if (!atp.renamed_files.empty())
+		{
+			// files that aren't renamed are represented by empty strings
+			w.key("mapped_files");
+			w.open_list();
+			file_index_t idx(0);
+			for (auto const& ent : atp.renamed_files)
+			{
+				for (; idx < ent.first; ++idx) w.string(string_view());
+				w.string(ent.second);
+				++idx;
+			}
+			w.close();
+		}
+
+		w.add("max_connections", atp.max_connections);
+		w.add("max_uploads", atp.upload_limit);
+
+		if (!atp.merkle_tree.empty())
+		{
+			// we need to save the whole merkle hash tree
+			// in order to resume
+			w.key("merkle tree");
+			w.string_header(atp.merkle_tree.size() * 20);
+			for (auto const& h : atp.merkle_tree)
+				w.out() = std::copy(h.data(), h.data() + h.size(), w.out());
+		}
+
+		w.add("num_complete", atp.num_complete);
+		w.add("num_downloaded", atp.num_downloaded);
+		w.add("num_incomplete", atp.num_incomplete);
+		w.add("paused", std::int64_t(atp.flags & add_torrent_params::flag_paused));
+
+		// write local peers
+		if (!atp.peers.empty())
+			write_endpoints("peers", "peers6", atp.peers);
+
+		if (!atp.piece_priorities.empty())
+		{
+			// write piece priorities
+			w.key("piece_priority");
+			w.string_header(atp.piece_priorities.size());
+			for (auto const p : atp.piece_priorities)
+				write_char(w.out(), static_cast<char>(p));
+		}
+
+		// write have bitmask. It's by far the largest field, so it's filled in
+		// place in the buffer rather than one byte at a time through the
+		// output iterator
+		{
+			std::size_t const num_pieces = aux::numeric_cast<std::size_t>(std::max(
+				atp.have_pieces.size(), atp.verified_pieces.size()));
+			w.key("pieces");
+			w.string_header(num_pieces);
+			std::size_t const offset = buf.size();
+			buf.resize(offset + num_pieces, 0);
+			char* pieces = buf.data() + offset;
+
+			std::size_t piece = 0;
+			for (auto const bit : atp.have_pieces)
+			{
+				pieces[piece] = bit ? 1 : 0;
+				++piece;
+			}
+
+			piece = 0;
+			for (auto const bit : atp.verified_pieces)
+			{
+				pieces[piece] |= bit ? 2 : 0;
+				++piece;
+			}
+		}
+
+		w.add("save_path", atp.save_path);
+		w.add("seed_mode", std::int64_t(atp.flags & add_torrent_params::flag_seed_mode));
+		w.add("seeding_time", atp.seeding_time);
+		w.add("sequential_download"
+			, std::int64_t(atp.flags & add_torrent_params::flag_sequential_download));
+		w.add("super_seeding", std::int64_t(atp.flags & add_torrent_params::flag_super_seeding));
+		w.add("total_downloaded", atp.total_downloaded);
+		w.add("total_uploaded", atp.total_uploaded);
+
+		// save trackers
+		if (!atp.trackers.empty())
+		{
+			// trackers without an explicit tier end up in the tier of the
+			// previous one
+			auto const tier_of = [&atp](std::size_t const i, std::size_t const prev)
+			{
+				return i < atp.tracker_tiers.size()
+					? aux::clamp(std::size_t(atp.tracker_tiers[i]), std::size_t{0}, std::size_t{1024})
+					: prev;
+			};
+
+			std::size_t num_tiers = 1;
+			std::size_t tier = 0;
+			for (std::size_t i = 0; i < atp.trackers.size(); ++i)
+			{
+				tier = tier_of(i, tier);
+				num_tiers = std::max(num_tiers, tier + 1);
+			}
+
+			w.key("trackers");
+			w.open_list();
+			for (std::size_t t = 0; t < num_tiers; ++t)
+			{
+				bool empty = true;
+				tier = 0;
+				for (std::size_t i = 0; i < atp.trackers.size(); ++i)
+				{
+					tier = tier_of(i, tier);
+					if (tier != t) continue;
+					if (empty) w.open_list();
+					empty = false;
+					w.string(atp.trackers[i]);
+				}
+				if (!empty)
+				{
+					w.close();
+				}
+				else if (t == 0)
+				{
+					w.open_list();
+					w.close();
+				}
+				else
+				{
+					// write_resume_data() leaves empty tiers past the first one
+					// undefined, which encodes as an empty string
+					w.string(string_view());
+				}
+			}
+			w.close();
+		}
+
+		if (!atp.unfinished_pieces.empty())
+		{
+			// info for each unfinished piece
+			w.key("unfinished");
+			w.open_list();
+			for (auto const& p : atp.unfinished_pieces)
+			{
+				w.open_dict();
+				w.key("bitmask");
+				w.string_header(std::size_t(p.second.size()));
+				for (auto bit : p.second)
+					write_char(w.out(), bit ? '1' : '0');
+				// the unfinished piece's index
+				w.add("piece", static_cast<int>(p.first));
+				w.close();
+			}
+			w.close();
+		}
+
+		w.add("upload_rate_limit", atp.upload_limit);
+
+#ifndef TORRENT_NO_DEPRECATE
+		// deprecated in 1.2
+		if (!atp.url.empty()) w.add("url", atp.url);
+#endif
+
+		// save web seeds
+		if (!atp.url_seeds.empty())
+		{
+			w.key("url-list");
+			w.open_list();
+			for (auto const& s : atp.url_seeds) w.string(s);
+			w.close();
+		}
+
+#ifndef TORRENT_NO_DEPRECATE
+		if (!atp.uuid.empty()) w.add("uuid", atp.uuid);
+#endif
+
+		w.close();
+	}
+
 	std::vector<char> write_resume_data_buf(add_torrent_params const& atp)
 	{
 		std::vector<char> ret;
-		entry rd = write_resume_data(atp);
-		bencode(std::back_inserter(ret), rd);
+		write_resume_data_buf(atp, ret);
 		return ret;
 	}
 }
-
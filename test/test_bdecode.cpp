@@ -34,6 +34,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/entry.hpp"
 
+#include <random>
+
 using namespace lt;
 
 // test integer
@@ -1302,3 +1304,193 @@ TORRENT_TEST(switch_buffer)
 	TEST_EQUAL(string1, string2);
 }
 
+
+TORRENT_TEST(count_leading_digits8)
+{
+	// bytes that are close to digits, in one way or another
+	char const non_digits[] = { '/', ':', 'e', '-', '\0', char(0x80)
+		, char('0' | 0x80), char('9' | 0x80), char(0xff), char(0x10), char(0x20) };
+
+	for (int pos = 0; pos < 8; ++pos)
+	{
+		for (char const c : non_digits)
+		{
+			char buf[8];
+			for (int i = 0; i < 8; ++i) buf[i] = char('0' + (i * 7 + pos) % 10);
+			buf[pos] = c;
+			TEST_EQUAL(aux::count_leading_digits8(buf), pos);
+
+			// anything after the first non-digit doesn't matter
+			for (int i = pos + 1; i < 8; ++i) buf[i] = c;
+			TEST_EQUAL(aux::count_leading_digits8(buf), pos);
+		}
+	}
+
+	TEST_EQUAL(aux::count_leading_digits8("01234567"), 8);
+	TEST_EQUAL(aux::count_leading_digits8("99999999"), 8);
+	TEST_EQUAL(aux::count_leading_digits8("123:abcd"), 3);
+	TEST_EQUAL(aux::count_leading_digits8("-1234567"), 0);
+
+	std::mt19937 rng(0x1234);
+	for (int i = 0; i < 100000; ++i)
+	{
+		char buf[8];
+		for (char& c : buf)
+		{
+			// mostly digits, to exercise the longer runs
+			int const r = int(rng() % 16);
+			c = r < 10 ? char('0' + r) : char(rng());
+		}
+		int expected = 0;
+		while (expected < 8 && buf[expected] >= '0' && buf[expected] <= '9')
+			++expected;
+		TEST_EQUAL(aux::count_leading_digits8(buf), expected);
+	}
+}
+
+namespace {
+
+// prints the structure of the tree, including where in the buffer each node
+// is, to detect any difference in the tokens
+void dump_tree(bdecode_node const& e, char const* base, std::string& out)
+{
+	span<char const> const section = e.data_section();
+	out += std::to_string(int(e.type()));
+	out += '@';
+	out += std::to_string(section.data() - base);
+	out += '+';
+	out += std::to_string(section.size());
+	switch (e.type())
+	{
+		case bdecode_node::string_t:
+			out += ' ';
+			out += std::to_string(e.string_ptr() - base);
+			out += '+';
+			out += std::to_string(e.string_length());
+			break;
+		case bdecode_node::list_t:
+			out += " [";
+			for (int i = 0; i < e.list_size(); ++i)
+			{
+				dump_tree(e.list_at(i), base, out);
+				out += ',';
+			}
+			out += ']';
+			break;
+		case bdecode_node::dict_t:
+			out += " {";
+			for (int i = 0; i < e.dict_size(); ++i)
+			{
+				auto const item = e.dict_at(i);
+				out.append(item.first.data(), item.first.size());
+				out += ':';
+				dump_tree(item.second, base, out);
+				out += ',';
+			}
+			out += '}';
+			break;
+		default: break;
+	}
+}
+
+void compare_scan_words(std::string const& buf)
+{
+	error_code ec1;
+	error_code ec2;
+	int pos1 = -1;
+	int pos2 = -1;
+	bdecode_node e1;
+	bdecode_node e2;
+	span<char const> const input(buf.data(), buf.size());
+	aux::bdecode_impl(input, e1, ec1, &pos1, 100, 1000000, true);
+	aux::bdecode_impl(input, e2, ec2, &pos2, 100, 1000000, false);
+
+	TEST_EQUAL(ec1, ec2);
+	if (ec1) TEST_EQUAL(pos1, pos2);
+
+	std::string tree1;
+	std::string tree2;
+	dump_tree(e1, buf.data(), tree1);
+	dump_tree(e2, buf.data(), tree2);
+	TEST_EQUAL(tree1, tree2);
+}
+
+} // anonymous namespace
+
+// the word-at-a-time scanning of integers and string lengths must produce
+// exactly the same tokens and errors as scanning a byte at a time
+TORRENT_TEST(scan_words_differential)
+{
+	std::vector<std::string> const corpus = {
+		"d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e1:q9:find_node1:t2:aa1:y1:qe",
+		"d1:rd2:id20:0123456789abcdefghij5:token8:aoeusnth6:valuesl6:axje.u6:idhtnme1:t2:aa1:y1:re",
+		"d4:infod6:lengthi1234567890123e4:name8:test.bin12:piece lengthi16384e6:pieces20:aaaaaaaaaaaaaaaaaaaaee",
+		"li0ei-1ei12345678ei-1234567ei123456789012345678901ei9999999ei-99999999ee",
+		"l00000001:a0000000:10000000:aaaaaaaaaa7:abcdefgi00000001ei-0ee",
+		"d1:ai1e1:b3:foo1:cli1e-i2ee1:dd1:xi1eee",
+		"i12345678901234567890e",
+		"d1:xi1e1:yl1:a1:b1:ce1:zd1:al1:bi12ee1:ci-7eee",
+	};
+
+	for (auto const& s : corpus)
+	{
+		compare_scan_words(s);
+		// every prefix
+		for (std::size_t i = 0; i < s.size(); ++i)
+			compare_scan_words(s.substr(0, i));
+	}
+
+	char const interesting[] = { '0', '1', '9', ':', 'e', 'i', '-', 'd', 'l'
+		, '/', 'x', '\0', char(0xb0) };
+
+	std::mt19937 rng(0x4321);
+	for (int i = 0; i < 50000; ++i)
+	{
+		std::string s = corpus[rng() % corpus.size()];
+		int const mutations = 1 + int(rng() % 4);
+		for (int m = 0; m < mutations && !s.empty(); ++m)
+		{
+			std::size_t const pos = rng() % s.size();
+			char const c = interesting[rng() % sizeof(interesting)];
+			switch (rng() % 4)
+			{
+				case 0: s[pos] = c; break;
+				case 1: s.insert(s.begin() + std::ptrdiff_t(pos), c); break;
+				case 2: s.erase(pos, 1); break;
+				case 3: s.resize(pos); break;
+			}
+		}
+		compare_scan_words(s);
+	}
+}
+
+// decoding into a node that already holds a tree replaces it entirely
+TORRENT_TEST(reuse_node)
+{
+	char const b1[] = "d1:ad2:id20:abcdefghij01234567896:target20:mnopqrstuvwxyz123456e1:q9:find_node1:t2:aa1:y1:qe";
+	char const b2[] = "li1ei2ee";
+	char const b3[] = "d1:ai1e1:b";
+
+	bdecode_node e;
+	error_code ec;
+	int pos = -1;
+	int ret = bdecode(b1, b1 + sizeof(b1) - 1, e, ec, &pos);
+	TEST_EQUAL(ret, 0);
+	TEST_EQUAL(e.dict_find_string_value("q"), "find_node");
+
+	ret = bdecode(b2, b2 + sizeof(b2) - 1, e, ec, &pos);
+	TEST_EQUAL(ret, 0);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(print_entry(e), "[ 1, 2 ]");
+
+	ret = bdecode(b3, b3 + sizeof(b3) - 1, e, ec, &pos);
+	TEST_EQUAL(ret, -1);
+	TEST_EQUAL(ec, error_code(bdecode_errors::unexpected_eof));
+	TEST_EQUAL(pos, 10);
+	TEST_EQUAL(print_entry(e), "{ 'a': 1, 'b': {} }");
+
+	ret = bdecode(b2, b2 + sizeof(b2) - 1, e, ec, &pos);
+	TEST_EQUAL(ret, 0);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(print_entry(e), "[ 1, 2 ]");
+}
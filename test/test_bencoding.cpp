@@ -31,6 +31,7 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "libtorrent/bencode.hpp"
+#include "libtorrent/bencode_writer.hpp"
 
 #include <iostream>
 #include <cstring>
@@ -141,6 +142,81 @@ TORRENT_TEST(implicit_construct)
 	TEST_EQUAL(e.list().back().type(), entry::list_t);
 }
 
+TORRENT_TEST(bencode_writer)
+{
+	std::string buf;
+	auto w = make_bencode_writer(std::back_inserter(buf));
+	w.open_dict();
+	w.add("a", -3);
+	w.key("b");
+	w.open_list();
+	w.string("spam");
+	w.integer(0);
+	w.open_dict();
+	w.close();
+	w.open_list();
+	w.close();
+	w.close();
+	w.add("c", "eggs");
+	w.key("d");
+	w.string_header(3);
+	*w.out()++ = 'f';
+	*w.out()++ = 'o';
+	*w.out()++ = 'o';
+	w.key("e");
+	w.preformatted(span<char const>("i1e", 3));
+	w.key("f");
+	w.value(entry("bar"));
+	w.close();
+
+	TEST_EQUAL(buf, "d1:ai-3e1:bl4:spami0edelee1:c4:eggs1:d3:foo1:ei1e1:f3:bare");
+}
+
+TORRENT_TEST(bencode_writer_entry)
+{
+	// the writer produces the same encoding as bencoding an entry
+	entry e;
+	e["announce"] = "http://example.com/announce";
+	e["creation date"] = 1234567890;
+	e["info"]["length"] = std::int64_t(1) << 40;
+	e["info"]["name"] = "test";
+	e["info"]["piece length"] = 0x4000;
+	e["url-list"].list().push_back(entry("http://a.com"));
+	e["url-list"].list().push_back(entry("http://b.com"));
+
+	std::vector<char> buf;
+	auto w = make_bencode_writer(std::back_inserter(buf));
+	w.open_dict();
+	w.add("announce", "http://example.com/announce");
+	w.add("creation date", 1234567890);
+	w.key("info");
+	w.open_dict();
+	w.add("length", std::int64_t(1) << 40);
+	w.add("name", "test");
+	w.add("piece length", 0x4000);
+	w.close();
+	w.key("url-list");
+	w.open_list();
+	w.string("http://a.com");
+	w.string("http://b.com");
+	w.close();
+	w.close();
+
+	TEST_EQUAL(std::string(buf.begin(), buf.end()), encode(e));
+}
+
+TORRENT_TEST(bencode_writer_raw_buffer)
+{
+	char buf[20];
+	auto w = make_bencode_writer(&buf[0]);
+	w.open_list();
+	w.integer(42);
+	w.string("x");
+	w.close();
+	TEST_EQUAL(w.out() - buf, 9);
+	TEST_EQUAL(std::string(buf, 9), "li42e1:xe");
+}
+
 #ifndef TORRENT_NO_DEPRECATE
 TORRENT_TEST(lazy_entry)
 {
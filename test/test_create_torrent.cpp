@@ -37,8 +37,12 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/aux_/escape_string.hpp" // for convert_path_to_posix
 #include "libtorrent/announce_entry.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/aux_/path.hpp"
 
 #include <cstring>
+#include <fstream>
+#include <thread>
 
 
 // make sure creating a torrent from an existing handle preserves the
@@ -70,3 +74,135 @@ TORRENT_TEST(create_verbatim_torrent)
 	TEST_CHECK(memcmp(dest_info, test_torrent + 1, sizeof(test_torrent)-3) == 0);
 }
 
+
+namespace {
+
+// creates the files of fs under path, with pseudo random content, and
+// returns the content of the whole torrent, including pad files
+std::vector<char> create_files(lt::file_storage const& fs, std::string const& path)
+{
+	std::vector<char> ret;
+	for (lt::file_index_t i(0); i < fs.end_file(); ++i)
+	{
+		std::vector<char> data(std::size_t(fs.file_size(i)));
+		if (!fs.pad_file_at(i))
+		{
+			for (std::size_t k = 0; k < data.size(); ++k)
+				data[k] = char((k * 7 + std::size_t(static_cast<int>(i)) * 13) & 0xff);
+			std::string const file_path = fs.file_path(i, path);
+			lt::error_code ec;
+			lt::create_directories(lt::parent_path(file_path), ec);
+			std::ofstream f(file_path, std::ios::binary);
+			f.write(data.data(), std::streamsize(data.size()));
+		}
+		ret.insert(ret.end(), data.begin(), data.end());
+	}
+	return ret;
+}
+
+lt::file_storage test_files(std::string const& name)
+{
+	lt::file_storage fs;
+	std::int64_t const sizes[] = {100000, 0x4000, 1, 0, 300000, 77777};
+	int idx = 0;
+	for (auto const size : sizes)
+	{
+		char filename[100];
+		std::snprintf(filename, sizeof(filename), "%s/file-%d", name.c_str(), idx++);
+		fs.add_file(filename, size);
+	}
+	return fs;
+}
+
+void check_hashes(lt::create_torrent const& t, std::vector<char> const& data)
+{
+	std::vector<char> buffer;
+	lt::bencode(std::back_inserter(buffer), t.generate());
+	lt::torrent_info const ti(buffer.data(), int(buffer.size()));
+	lt::file_storage const& fs = ti.files();
+	TEST_EQUAL(fs.num_pieces(), t.num_pieces());
+	for (lt::piece_index_t i(0); i < fs.end_piece(); ++i)
+	{
+		std::int64_t const offset = std::int64_t(static_cast<int>(i)) * fs.piece_length();
+		TEST_CHECK(ti.hash_for_piece(i) == lt::hasher(data.data() + offset
+			, fs.piece_size(i)).final());
+	}
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(set_piece_hashes_threads)
+{
+	std::string const path = lt::current_working_directory();
+	lt::error_code ec;
+	lt::remove_all(lt::combine_path(path, "hash_test"), ec);
+
+	lt::file_storage fs = test_files("hash_test");
+	// the pad files are hashed as zeros
+	lt::create_torrent t(fs, 0x4000, -1, lt::create_torrent::optimize_alignment);
+	std::vector<char> const data = create_files(t.files(), path);
+	TEST_EQUAL(std::int64_t(data.size()), t.files().total_size());
+
+	for (int readers = 1; readers < 4; ++readers)
+	{
+		for (int read_size : {1, 0x10000, 4 * 1024 * 1024})
+		{
+			lt::piece_hash_settings sett;
+			sett.reader_threads = readers;
+			sett.hasher_threads = 3;
+			sett.read_size = read_size;
+
+			int progress = 0;
+			lt::set_piece_hashes(t, path, sett, [&](lt::piece_index_t p)
+			{
+				TEST_EQUAL(static_cast<int>(p), progress);
+				++progress;
+			}, ec);
+			TEST_CHECK(!ec);
+			TEST_EQUAL(progress, t.num_pieces());
+			check_hashes(t, data);
+		}
+	}
+}
+
+TORRENT_TEST(set_piece_hashes_concurrent)
+{
+	std::string const path = lt::current_working_directory();
+	lt::error_code ec;
+	lt::remove_all(lt::combine_path(path, "hash_test1"), ec);
+	lt::remove_all(lt::combine_path(path, "hash_test2"), ec);
+
+	lt::file_storage fs1 = test_files("hash_test1");
+	lt::file_storage fs2 = test_files("hash_test2");
+	lt::create_torrent t1(fs1, 0x4000);
+	lt::create_torrent t2(fs2, 0x8000);
+	std::vector<char> const data1 = create_files(t1.files(), path);
+	std::vector<char> const data2 = create_files(t2.files(), path);
+
+	lt::error_code ec1;
+	lt::error_code ec2;
+	std::thread th([&] { lt::set_piece_hashes(t1, path, ec1); });
+	lt::set_piece_hashes(t2, path, ec2);
+	th.join();
+
+	TEST_CHECK(!ec1);
+	TEST_CHECK(!ec2);
+	check_hashes(t1, data1);
+	check_hashes(t2, data2);
+}
+
+TORRENT_TEST(set_piece_hashes_missing_file)
+{
+	std::string const path = lt::current_working_directory();
+	lt::error_code ec;
+	lt::remove_all(lt::combine_path(path, "hash_test3"), ec);
+
+	lt::file_storage fs = test_files("hash_test3");
+	lt::create_torrent t(fs, 0x4000);
+	create_files(t.files(), path);
+	lt::remove(t.files().file_path(lt::file_index_t(4), path), ec);
+	TEST_CHECK(!ec);
+
+	lt::set_piece_hashes(t, path, ec);
+	TEST_CHECK(ec);
+}
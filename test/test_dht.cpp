@@ -38,6 +38,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/session.hpp"
 #include "libtorrent/kademlia/msg.hpp" // for verify_message
 #include "libtorrent/kademlia/node.hpp"
+#include "libtorrent/kademlia/dht_tracker.hpp"
+#include "libtorrent/alert_types.hpp" // for dht_lookup, dht_routing_bucket
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/bdecode.hpp"
 #include "libtorrent/socket_io.hpp" // for hash_address
@@ -57,6 +59,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/kademlia/dht_observer.hpp"
 
 #include <numeric>
+#include <algorithm>
+#include <thread>
+#include <set>
 #include <cstdarg>
 #include <tuple>
 #include <iostream>
@@ -3351,6 +3356,85 @@ TORRENT_TEST(rpc_invalid_error_msg)
 }
 #endif
 
+TORRENT_TEST(rpc_many_transactions)
+{
+	dht_settings sett = test_settings();
+	mock_socket s;
+	mock_dht_socket ds;
+	obs observer;
+	counters cnt;
+
+	dht::routing_table table(node_id(), udp::v4(), 8, sett, &observer);
+	dht::rpc_manager rpc(node_id(), sett, table, &ds, &s, &observer);
+	std::unique_ptr<dht_storage_interface> dht_storage(dht_default_storage_constructor(sett));
+	dht_storage->update_node_ids({node_id(nullptr)});
+	dht::node node(&ds, &s, sett, node_id(nullptr), &observer, cnt, get_foreign_node_stub, *dht_storage);
+
+	auto algo = std::make_shared<dht::traversal_algorithm>(node, node_id());
+
+	// enough outstanding requests to make the transaction table grow a few
+	// times. Every request must be given a unique transaction ID
+	int const num_requests = 3000;
+	std::vector<observer_ptr> observers;
+	std::set<std::string> tids;
+	g_sent_packets.clear();
+	for (int i = 0; i < num_requests; ++i)
+	{
+		udp::endpoint const ep = rand_udp_ep(rand_v4);
+		auto o = rpc.allocate_observer<null_observer>(algo, ep, node_id());
+#if TORRENT_USE_ASSERTS
+		o->m_in_constructor = false;
+#endif
+		entry req;
+		req["q"] = "ping";
+		TEST_CHECK(rpc.invoke(req, ep, o));
+		observers.push_back(o);
+		TEST_CHECK(tids.insert(g_sent_packets.back().second["t"].string()).second);
+	}
+	TEST_EQUAL(rpc.num_transactions(), num_requests);
+
+	// a response from the wrong address must not match a transaction
+	{
+		entry err;
+		err["y"] = "e";
+		err["e"].list().push_back(entry(201));
+		err["e"].list().push_back(entry("generic error"));
+		err["t"] = g_sent_packets.front().second["t"].string();
+		char msg_buf[1500];
+		int const size = bencode(msg_buf, err);
+		bdecode_node decoded;
+		error_code ec;
+		bdecode(msg_buf, msg_buf + size, decoded, ec);
+		dht::msg m(decoded, rand_udp_ep(rand_v4));
+		node_id nid;
+		rpc.incoming(m, &nid);
+		TEST_EQUAL(rpc.num_transactions(), num_requests);
+	}
+
+	// respond to every request (with an error, to not involve the routing
+	// table) and make sure each one is matched up with its observer
+	int idx = 0;
+	for (auto const& p : g_sent_packets)
+	{
+		entry err;
+		err["y"] = "e";
+		err["e"].list().push_back(entry(201));
+		err["e"].list().push_back(entry("generic error"));
+		err["t"] = p.second["t"].string();
+		char msg_buf[1500];
+		int const size = bencode(msg_buf, err);
+		bdecode_node decoded;
+		error_code ec;
+		bdecode(msg_buf, msg_buf + size, decoded, ec);
+		dht::msg m(decoded, p.first);
+		node_id nid;
+		rpc.incoming(m, &nid);
+		TEST_CHECK(observers[std::size_t(idx)]->flags & observer::flag_done);
+		++idx;
+	}
+	TEST_EQUAL(rpc.num_transactions(), 0);
+}
+
 // test bucket distribution
 TORRENT_TEST(node_id_bucket_distribution)
 {
@@ -3591,6 +3675,168 @@ TORRENT_TEST(dht_state)
 	TEST_CHECK(s2.nodes.empty());
 }
 
+namespace {
+
+struct tracker_packet
+{
+	aux::session_listen_socket* sock;
+	udp::endpoint ep;
+	std::string query;
+	std::string tid;
+};
+
+struct dht_tracker_setup
+{
+	dht_tracker_setup()
+		: sett(test_settings())
+		, storage(dht_default_storage_constructor(sett))
+		, tracker(std::make_shared<dht_tracker>(&observer, ios
+			, [this](aux::session_listen_socket* s, udp::endpoint const& ep
+				, span<char const> buf, error_code&, int) { record(s, ep, buf); }
+			, sett, cnt, *storage, dht_state()))
+	{}
+
+	void record(aux::session_listen_socket* s, udp::endpoint const& ep
+		, span<char const> buf)
+	{
+		bdecode_node msg;
+		error_code ec;
+		bdecode(buf.data(), buf.data() + buf.size(), msg, ec);
+		TEST_CHECK(!ec);
+		if (ec || msg.dict_find_string_value("y") != "q") return;
+		sent.push_back({s, ep, msg.dict_find_string_value("q").to_string()
+			, msg.dict_find_string_value("t").to_string()});
+	}
+
+	int count(string_view const query) const
+	{
+		return int(std::count_if(sent.begin(), sent.end()
+			, [&](tracker_packet const& p) { return p.query == query; }));
+	}
+
+	// respond to a query sent to the router node
+	void reply(tracker_packet const& p, entry r)
+	{
+		entry e;
+		e["y"] = "r";
+		e["t"] = p.tid;
+		r["id"] = std::string(20, '\x42');
+		e["r"] = std::move(r);
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), e);
+		tracker->incoming_packet(p.ep, buf);
+	}
+
+	io_service ios;
+	dht_settings sett;
+	obs observer;
+	counters cnt;
+	std::unique_ptr<dht_storage_interface> storage;
+	std::shared_ptr<dht_tracker> tracker;
+	std::vector<tracker_packet> sent;
+};
+
+udp::endpoint const router_ep(addr4("4.4.4.4"), 6881);
+
+} // anonymous namespace
+
+TORRENT_TEST(dht_tracker_shared_lookups)
+{
+	dht_tracker_setup t;
+	mock_dht_socket sock1(addr4("192.168.4.1"));
+	mock_dht_socket sock2(addr4("192.168.4.2"));
+	t.tracker->new_socket(&sock1);
+	t.tracker->new_socket(&sock2);
+	t.tracker->add_router_node(router_ep);
+
+	sha1_hash const ih = to_hash("1111111111111111111111111111111111111111");
+	std::vector<tcp::endpoint> peers1, peers2, peers3;
+	auto collect = [](std::vector<tcp::endpoint>& dst)
+	{
+		return [&dst](std::vector<tcp::endpoint> const& p)
+		{ dst.insert(dst.end(), p.begin(), p.end()); };
+	};
+
+	// the lookup runs on the node of every listen socket
+	t.tracker->get_peers(ih, collect(peers1));
+	TEST_EQUAL(t.count("get_peers"), 2);
+	TEST_CHECK(t.sent[0].sock != t.sent[1].sock);
+
+	// an identical lookup while the first is in flight doesn't send anything
+	t.tracker->get_peers(ih, collect(peers2));
+	TEST_EQUAL(t.count("get_peers"), 2);
+
+	// the results are passed to both requesters
+	tcp::endpoint const peer(addr4("10.0.0.1"), 1234);
+	entry r;
+	std::string compact_peer;
+	detail::write_endpoint(peer, std::back_inserter(compact_peer));
+	r["values"].list().push_back(compact_peer);
+	r["token"] = "tok";
+	t.reply(t.sent[0], r);
+	TEST_EQUAL(peers1.size(), 1);
+	TEST_EQUAL(peers2.size(), 1);
+
+	// a requester joining late gets what was found so far
+	t.tracker->get_peers(ih, collect(peers3));
+	TEST_EQUAL(t.count("get_peers"), 2);
+	TEST_EQUAL(peers3.size(), 1);
+	TEST_CHECK(peers3.front() == peer);
+
+	t.reply(t.sent[1], r);
+	TEST_EQUAL(peers1.size(), 2);
+	TEST_EQUAL(peers2.size(), 2);
+	TEST_EQUAL(peers3.size(), 2);
+
+	// both traversals are done now. A new request starts new ones
+	t.tracker->get_peers(ih, collect(peers1));
+	TEST_EQUAL(t.count("get_peers"), 4);
+
+	// a different target is a different lookup
+	t.tracker->get_peers(to_hash("2222222222222222222222222222222222222222")
+		, collect(peers1));
+	TEST_EQUAL(t.count("get_peers"), 6);
+
+	// immutable items are shared the same way
+	sha1_hash const target = to_hash("3333333333333333333333333333333333333333");
+	int items = 0;
+	t.tracker->get_item(target, [&](item const&) { ++items; });
+	t.tracker->get_item(target, [&](item const&) { ++items; });
+	TEST_EQUAL(t.count("get"), 2);
+	TEST_EQUAL(items, 0);
+}
+
+TORRENT_TEST(dht_tracker_bootstrap_time)
+{
+	dht_tracker_setup t;
+	mock_dht_socket sock(addr4("192.168.4.1"));
+	t.tracker->new_socket(&sock);
+	t.tracker->add_router_node(router_ep);
+
+	std::vector<dht_routing_bucket> table;
+	std::vector<dht_lookup> requests;
+	time_duration bootstrap_time = seconds(10);
+
+	int bootstrapped = 0;
+	t.tracker->start([&](std::vector<std::pair<node_entry, std::string>> const&)
+		{ ++bootstrapped; });
+	TEST_CHECK(!t.sent.empty());
+	TEST_EQUAL(bootstrapped, 0);
+
+	// still bootstrapping
+	t.tracker->dht_status(table, requests, bootstrap_time);
+	TEST_CHECK(bootstrap_time == seconds(0));
+
+	std::this_thread::sleep_for(lt::milliseconds(50));
+	t.reply(t.sent.back(), entry(entry::dictionary_t));
+	TEST_EQUAL(bootstrapped, 1);
+
+	t.tracker->dht_status(table, requests, bootstrap_time);
+	TEST_CHECK(bootstrap_time >= milliseconds(50));
+	TEST_CHECK(bootstrap_time < seconds(10));
+	t.tracker->stop();
+}
+
 // TODO: test obfuscated_get_peers
 
 #else
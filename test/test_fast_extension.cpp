@@ -883,6 +883,151 @@ TORRENT_TEST(dont_have)
 	print_session_log(*ses);
 }
 
+// messages produced outside of the receive handler are sent at the end of the
+// network thread's turn, all in a single write
+TORRENT_TEST(deferred_sends_coalesce)
+{
+	std::cout << "\n === test deferred sends ===\n" << std::endl;
+
+	sha1_hash ih;
+	torrent_handle th;
+	std::shared_ptr<lt::session> ses;
+	io_service ios;
+	tcp::socket s(ios);
+	std::shared_ptr<torrent_info> ti = setup_peer(s, ih, ses, true, 0, &th);
+
+	// we won't be interested in the peer to begin with. Don't disconnect it
+	// because of that
+	settings_pack pack;
+	pack.set_bool(settings_pack::close_redundant_connections, false);
+	ses->apply_settings(pack);
+
+	std::vector<int> prio(std::size_t(ti->num_pieces()), 0);
+	th.prioritize_pieces(prio);
+	TEST_CHECK(th.piece_priorities() == prio);
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+	send_have_all(s);
+	send_unchoke(s);
+
+	std::this_thread::sleep_for(lt::milliseconds(500));
+	print_session_log(*ses);
+
+	std::map<std::string, std::int64_t> cnt = get_counters(*ses);
+	std::int64_t const writes = cnt["net.peer_socket_writes"];
+	std::int64_t const deferred = cnt["net.peer_sends_deferred"];
+
+	// wanting the pieces makes the peer send INTERESTED and its first
+	// REQUESTs from a posted interest update, outside of the receive handler
+	std::fill(prio.begin(), prio.end(), 4);
+	th.prioritize_pieces(prio);
+
+	int messages = 0;
+	for (;;)
+	{
+		int const len = read_message(s, recv_buffer, sizeof(recv_buffer));
+		if (len == -1) break;
+		print_message(recv_buffer, len);
+		if (len == 0) continue;
+		int const msg = recv_buffer[0];
+		// interested
+		if (msg == 2) messages = 1;
+		else if (messages > 0) ++messages;
+		// request
+		if (msg == 6 && messages > 0) break;
+	}
+	print_session_log(*ses);
+
+	TEST_CHECK(messages >= 2);
+	cnt = get_counters(*ses);
+	TEST_CHECK(cnt["net.peer_socket_writes"] - writes < messages);
+	TEST_CHECK(cnt["net.peer_sends_deferred"] > deferred);
+}
+
+// PIECE messages arriving in the same read from the socket are followed by a
+// single pick of new blocks to request, not one pick per message
+TORRENT_TEST(incoming_pieces_single_pick)
+{
+	using namespace lt::detail;
+
+	std::cout << "\n === test batched incoming piece picks ===\n" << std::endl;
+
+	sha1_hash ih;
+	std::shared_ptr<lt::session> ses;
+	io_service ios;
+	tcp::socket s(ios);
+	setup_peer(s, ih, ses);
+
+	char recv_buffer[1000];
+	do_handshake(s, ih, recv_buffer);
+	send_have_all(s);
+	send_unchoke(s);
+
+	// the first REQUESTs are all sent from a single pick, in one write
+	std::vector<peer_request> requests;
+	for (;;)
+	{
+		int const len = read_message(s, recv_buffer, sizeof(recv_buffer));
+		if (len == -1) break;
+		print_message(recv_buffer, len);
+		if (len == 0) continue;
+		if (recv_buffer[0] == 6 && len == 13)
+		{
+			char const* ptr = recv_buffer + 1;
+			peer_request r;
+			r.piece = piece_index_t(read_int32(ptr));
+			r.start = read_int32(ptr);
+			r.length = read_int32(ptr);
+			requests.push_back(r);
+		}
+		if (!requests.empty() && s.available() < 4) break;
+	}
+	print_session_log(*ses);
+
+	TEST_CHECK(requests.size() >= 2);
+	if (requests.size() < 2) return;
+
+	std::int64_t const picks = get_counters(*ses)["picker.incoming_piece_picks"];
+
+	// every piece of the test torrent holds the same data, (offset % 26) + 'A'
+	std::vector<char> msg;
+	for (peer_request const& r : requests)
+	{
+		log("==> piece %d (%d,%d)", static_cast<int>(r.piece), r.start, r.length);
+		std::size_t const pos = msg.size();
+		msg.resize(pos + 13 + std::size_t(r.length));
+		char* ptr = msg.data() + pos;
+		write_uint32(9 + r.length, ptr);
+		write_uint8(7, ptr);
+		write_uint32(static_cast<int>(r.piece), ptr);
+		write_uint32(r.start, ptr);
+		for (int i = 0; i < r.length; ++i)
+			write_uint8(((r.start + i) % 26) + 'A', ptr);
+	}
+	error_code ec;
+	boost::asio::write(s, boost::asio::buffer(msg)
+		, boost::asio::transfer_all(), ec);
+	if (ec) TEST_ERROR(ec.message());
+
+	// wait for the REQUESTs that follow the pieces
+	for (;;)
+	{
+		int const len = read_message(s, recv_buffer, sizeof(recv_buffer));
+		if (len == -1) break;
+		print_message(recv_buffer, len);
+		if (len > 0 && recv_buffer[0] == 6) break;
+	}
+	std::this_thread::sleep_for(lt::milliseconds(500));
+	print_session_log(*ses);
+
+	std::int64_t const batched = get_counters(*ses)["picker.incoming_piece_picks"] - picks;
+	std::printf("%d pieces received, %d incoming piece picks\n"
+		, int(requests.size()), int(batched));
+	TEST_CHECK(batched >= 1);
+	TEST_CHECK(batched < std::int64_t(requests.size()));
+}
+
 // TEST metadata extension messages and edge cases
 
 // this tests sending a request for a metadata piece that's too high. This is
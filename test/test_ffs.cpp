@@ -120,3 +120,15 @@ TORRENT_TEST(count_trailing_ones_u32)
 	TEST_EQUAL(aux::count_trailing_ones_hw(arr), 44);
 	TEST_EQUAL(aux::count_trailing_ones(arr), 44);
 }
+
+TORRENT_TEST(count_trailing_zeros_u32)
+{
+	TEST_EQUAL(aux::count_trailing_zeros(1), 0);
+	TEST_EQUAL(aux::count_trailing_zeros(0xffffffff), 0);
+	TEST_EQUAL(aux::count_trailing_zeros(0x80000000), 31);
+	TEST_EQUAL(aux::count_trailing_zeros(0xff00ff00), 8);
+	TEST_EQUAL(aux::count_trailing_zeros(0x00f00000), 20);
+
+	for (int i = 0; i < 32; ++i)
+		TEST_EQUAL(aux::count_trailing_zeros(std::uint32_t(1) << i), i);
+}
@@ -34,6 +34,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/string_util.hpp" // for split_string
 #include "libtorrent/string_view.hpp"
+#include "libtorrent/allocator.hpp"
 #include "test.hpp"
 #include <vector>
 #include <set>
@@ -391,6 +392,59 @@ TORRENT_TEST(coalesce_buffer)
 	f.close();
 }
 
+TORRENT_TEST(direct_io)
+{
+	// the aligned parts of reads and writes bypass the page cache, the
+	// unaligned parts don't. If the filesystem doesn't support direct I/O,
+	// everything goes through the page cache. Either way, the data must be
+	// consistent
+	int const align = file::direct_io_alignment;
+	int const size = 3 * align + 100;
+	char* buf = page_aligned_allocator::malloc(4 * align);
+	for (int i = 0; i < size; ++i) buf[i] = char(i * 7);
+
+	error_code ec;
+	file f;
+	TEST_CHECK(f.open("test_direct_io", file::read_write | file::direct_io, ec));
+	if (ec)
+		std::printf("open failed: [%s] %s\n", ec.category().name(), ec.message().c_str());
+	TEST_EQUAL(ec, error_code());
+
+	// an aligned write with an unaligned tail
+	iovec_t b = {buf, std::size_t(size)};
+	TEST_EQUAL(f.writev(0, b, ec), size);
+	TEST_EQUAL(ec, error_code());
+
+	// an unaligned write, overlapping the first aligned block
+	iovec_t u = {const_cast<char*>("foobar"), 6};
+	TEST_EQUAL(f.writev(10, u, ec), 6);
+	TEST_EQUAL(ec, error_code());
+	std::memcpy(buf + 10, "foobar", 6);
+
+	// read it back, with an aligned buffer followed by an unaligned one.
+	// Reading past the end of the file is a short read
+	std::vector<char> expected(buf, buf + size);
+	char* out = page_aligned_allocator::malloc(4 * align);
+	std::vector<char> unaligned(std::size_t(2 * align));
+	iovec_t r[2] = {{out, std::size_t(2 * align)}, {unaligned.data() + 1, std::size_t(2 * align - 1)}};
+	TEST_EQUAL(f.readv(0, r, ec), size);
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(std::equal(expected.begin(), expected.begin() + 2 * align, out));
+	TEST_CHECK(std::equal(expected.begin() + 2 * align, expected.end(), unaligned.data() + 1));
+
+	// an unaligned read
+	char small[8] = {0};
+	iovec_t s = {small, 8};
+	TEST_EQUAL(f.readv(8, s, ec), 8);
+	TEST_EQUAL(ec, error_code());
+	TEST_CHECK(std::equal(small, small + 8, expected.begin() + 8));
+
+	f.close();
+	page_aligned_allocator::free(out);
+	page_aligned_allocator::free(buf);
+	remove("test_direct_io", ec);
+}
+
 TORRENT_TEST(stat_file)
 {
 	file_status st;
@@ -36,6 +36,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/file_storage.hpp"
 #include "libtorrent/aux_/path.hpp"
 
+#include <memory>
+
 using namespace lt;
 
 void setup_test_storage(file_storage& st)
@@ -368,10 +370,116 @@ TORRENT_TEST(piece_range)
 	TEST_CHECK(aux::file_piece_range_exclusive(fs, file_index_t(1)) == std::make_tuple(piece_index_t(3), piece_index_t(7)));
 }
 
+namespace {
+
+// the reference implementation, a linear scan for the last file starting at
+// or before offset
+file_index_t file_at_offset_ref(file_storage const& fs, std::int64_t const offset)
+{
+	file_index_t ret(0);
+	for (file_index_t i(0); i < fs.end_file(); ++i)
+		if (fs.file_offset(i) <= offset) ret = i;
+	return ret;
+}
+
+void check_file_index_at_offset(file_storage const& fs)
+{
+	for (file_index_t i(0); i < fs.end_file(); ++i)
+	{
+		std::int64_t const start = fs.file_offset(i);
+		std::int64_t const end = start + fs.file_size(i);
+		for (std::int64_t const o : {start, start + 1, end - 1, end})
+		{
+			if (o < 0 || o >= fs.total_size()) continue;
+			TEST_EQUAL(fs.file_index_at_offset(o), file_at_offset_ref(fs, o));
+		}
+	}
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(file_index_at_offset)
+{
+	file_storage fs;
+	std::int64_t const sizes[] = {1, 0, 0x4000, 0, 0, 3, 0x100000, 1
+		, 0x3fff, 0, 0x12345, 0x800000, 7, 0};
+	int i = 0;
+	for (auto const size : sizes)
+		fs.add_file(combine_path("test", std::to_string(i++)), size);
+	fs.set_piece_length(0x4000);
+	fs.set_num_pieces(int((fs.total_size() + 0x3fff) / 0x4000));
+	check_file_index_at_offset(fs);
+
+	// map_block() uses the same lookup
+	for (piece_index_t p(0); p < fs.end_piece(); ++p)
+	{
+		std::vector<file_slice> const slices = fs.map_block(p, 0, fs.piece_size(p));
+		TEST_CHECK(!slices.empty());
+		std::int64_t const offset = std::int64_t(static_cast<int>(p)) * 0x4000;
+		TEST_EQUAL(slices.front().file_index, file_at_offset_ref(fs, offset));
+		std::int64_t total = 0;
+		for (auto const& s : slices) total += s.size;
+		TEST_EQUAL(total, fs.piece_size(p));
+	}
+
+	// the index is rebuilt when files are moved around and padded
+	fs.optimize(0, 0x4000);
+	check_file_index_at_offset(fs);
+
+	file_storage const copy = fs;
+	check_file_index_at_offset(copy);
+}
+
+TORRENT_TEST(file_index_at_offset_many_files)
+{
+	file_storage fs;
+	for (int i = 0; i < 5000; ++i)
+	{
+		fs.add_file(combine_path("test", "f" + std::to_string(i))
+			, (i * 7919) % 3 == 0 ? 0 : (i * 7919) % 70000);
+	}
+	fs.set_piece_length(0x4000);
+	fs.set_num_pieces(int((fs.total_size() + 0x3fff) / 0x4000));
+	check_file_index_at_offset(fs);
+}
+
+TORRENT_TEST(copy_file_names)
+{
+	// the file names are stored in a buffer owned by the file_storage.
+	// make sure copies don't refer to the original
+	std::unique_ptr<file_storage> fs(new file_storage);
+	for (int i = 0; i < 1000; ++i)
+	{
+		fs->add_file(combine_path("test", combine_path("d" + std::to_string(i % 10)
+			, "file-" + std::to_string(i))), 10);
+	}
+	fs->rename_file(file_index_t(3), combine_path("test", combine_path("d5", "renamed")));
+
+	file_storage copy1(*fs);
+	file_storage copy2;
+	copy2 = *fs;
+	file_storage moved(std::move(*fs));
+	fs.reset();
+
+	for (file_storage const* f : {&copy1, &copy2, &moved})
+	{
+		TEST_EQUAL(f->num_files(), 1000);
+		TEST_EQUAL(f->file_name(file_index_t(3)), "renamed");
+		TEST_EQUAL(f->file_path(file_index_t(3)), combine_path("test", combine_path("d5", "renamed")));
+		for (int i = 0; i < 1000; ++i)
+		{
+			if (i == 3) continue;
+			TEST_EQUAL(f->file_name(file_index_t(i)), "file-" + std::to_string(i));
+			TEST_EQUAL(f->file_path(file_index_t(i)), combine_path("test"
+				, combine_path("d" + std::to_string(i % 10), "file-" + std::to_string(i))));
+		}
+		// each directory is only stored once
+		TEST_EQUAL(f->paths().size(), 10);
+	}
+}
+
 // TODO: test file_storage::optimize
-// TODO: test map_block
 // TODO: test piece_size(int piece)
-// TODO: test file_index_at_offset
 // TODO: test file attributes
 // TODO: test symlinks
 // TODO: test pad_files
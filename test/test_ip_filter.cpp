@@ -33,6 +33,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/ip_filter.hpp"
 #include "setup_transfer.hpp" // for addr()
 #include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
 
 #include "test.hpp"
 #include "settings.hpp"
@@ -297,3 +300,122 @@ TORRENT_TEST(ip_filter)
 	TEST_CHECK(pf.access(6881) == 0);
 	TEST_CHECK(pf.access(65535) == 0);
 }
+
+TORRENT_TEST(ip_filter_compact)
+{
+	using namespace lt;
+
+	ip_range<address_v4> expected[] =
+	{
+		{addr4("0.0.0.0"), addr4("0.255.255.255"), 0}
+		, {addr4("1.0.0.0"), addr4("2.0.0.0"), ip_filter::blocked}
+		, {addr4("2.0.0.1"), addr4("9.255.255.255"), 0}
+		, {addr4("10.0.0.0"), addr4("10.0.0.255"), ip_filter::blocked}
+		, {addr4("10.0.1.0"), addr4("255.255.255.255"), 0}
+	};
+
+	ip_filter f;
+	f.add_rule(addr("10.0.0.0"), addr("10.0.0.255"), ip_filter::blocked);
+	f.add_rule(addr("1.0.0.0"), addr("3.0.0.0"), ip_filter::blocked);
+	f.compact();
+
+	TEST_EQUAL(f.access(addr("1.0.0.0")), ip_filter::blocked);
+	TEST_EQUAL(f.access(addr("3.0.0.1")), 0);
+	TEST_EQUAL(f.access(addr("10.0.0.128")), ip_filter::blocked);
+
+	// adding rules to a compacted filter still works
+	f.add_rule(addr("2.0.0.1"), addr("3.0.0.0"), 0);
+	TEST_EQUAL(f.access(addr("2.0.0.0")), ip_filter::blocked);
+	TEST_EQUAL(f.access(addr("2.0.0.1")), 0);
+	f.compact();
+
+	std::vector<ip_range<address_v4>> range;
+#if TORRENT_USE_IPV6
+	range = std::get<0>(f.export_filter());
+#else
+	range = f.export_filter();
+#endif
+	test_rules_invariant(range, f);
+
+	TEST_EQUAL(range.size(), 5);
+	TEST_CHECK(std::equal(range.begin(), range.end(), expected, &compare<address_v4>));
+	TEST_EQUAL(f.access(addr("0.0.0.0")), 0);
+	TEST_EQUAL(f.access(addr("255.255.255.255")), 0);
+}
+
+namespace {
+
+	template <class Addr>
+	bool equal_ranges(std::vector<ip_range<Addr>> const& lhs
+		, std::vector<ip_range<Addr>> const& rhs)
+	{
+		return lhs.size() == rhs.size()
+			&& std::equal(lhs.begin(), lhs.end(), rhs.begin(), &compare<Addr>);
+	}
+
+	address_v4 random_v4(std::uint32_t const mask)
+	{
+		// narrow the addresses down to a small part of the address space, to
+		// make the rules overlap
+		return address_v4(std::uint32_t(std::rand()) & mask);
+	}
+}
+
+TORRENT_TEST(ip_filter_add_rules)
+{
+	using namespace lt;
+
+	for (int round = 0; round < 20; ++round)
+	{
+		std::vector<ip_range<address>> rules;
+		for (int i = 0; i < 200; ++i)
+		{
+			address_v4 a = random_v4(0xfff);
+			address_v4 b = random_v4(0xfff);
+			if (b < a) std::swap(a, b);
+			rules.push_back({a, b, std::uint32_t(std::rand() % 3)});
+		}
+		// rules touching the ends of the address space
+		rules.push_back({addr4("0.0.0.0"), random_v4(0xfff), ip_filter::blocked});
+		rules.push_back({random_v4(0xfff), addr4("255.255.255.255"), 2});
+#if TORRENT_USE_IPV6
+		rules.push_back({addr6("::1"), addr6("::ffff"), ip_filter::blocked});
+		rules.push_back({addr6("::100"), addr6("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"), 0});
+#endif
+		std::shuffle(rules.begin(), rules.end(), std::mt19937(std::uint32_t(round)));
+
+		// the bulk load applies on top of the existing rules, whether the
+		// filter is compacted or not
+		ip_filter f1;
+		ip_filter f2;
+		f1.add_rule(addr("0.0.8.0"), addr("0.0.10.0"), 4);
+		f2.add_rule(addr("0.0.8.0"), addr("0.0.10.0"), 4);
+		if (round & 1) f2.compact();
+
+		for (auto const& r : rules) f1.add_rule(r.first, r.last, r.flags);
+		f2.add_rules(rules);
+
+#if TORRENT_USE_IPV6
+		auto const r1 = f1.export_filter();
+		auto const r2 = f2.export_filter();
+		TEST_CHECK(equal_ranges(std::get<0>(r1), std::get<0>(r2)));
+		TEST_CHECK(equal_ranges(std::get<1>(r1), std::get<1>(r2)));
+		test_rules_invariant(std::get<0>(r2), f2);
+		test_rules_invariant(std::get<1>(r2), f2);
+#else
+		TEST_CHECK(equal_ranges(f1.export_filter(), f2.export_filter()));
+		test_rules_invariant(f2.export_filter(), f2);
+#endif
+
+		for (int i = 0; i < 1000; ++i)
+		{
+			address const a = random_v4(0x1fff);
+			TEST_EQUAL(f1.access(a), f2.access(a));
+		}
+	}
+
+	// an empty list doesn't change anything
+	ip_filter f;
+	f.add_rules({});
+	TEST_EQUAL(f.access(addr("1.2.3.4")), 0);
+}
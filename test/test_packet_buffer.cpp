@@ -180,3 +180,68 @@ TORRENT_TEST(reverse_wrap)
 	pb.insert(0xffff, make_pkt(pool, 3));
 }
 
+
+TORRENT_TEST(mark)
+{
+	packet_pool pool;
+	packet_buffer pb;
+
+	TEST_EQUAL(pb.num_marked(), 0);
+	TEST_EQUAL(pb.next_marked(0, 100), 100);
+
+	for (int i = 10; i < 60; ++i)
+		pb.insert(i, make_pkt(pool, i));
+
+	// marking an empty slot is a no-op
+	pb.mark(5);
+	pb.mark(60);
+	TEST_EQUAL(pb.num_marked(), 0);
+
+	pb.mark(12);
+	pb.mark(40);
+	pb.mark(41);
+	pb.mark(41);
+	TEST_EQUAL(pb.num_marked(), 3);
+	TEST_CHECK(pb.marked(12));
+	TEST_CHECK(!pb.marked(13));
+
+	TEST_EQUAL(pb.next_marked(0, 100), 12);
+	TEST_EQUAL(pb.next_marked(13, 100), 40);
+	TEST_EQUAL(pb.next_marked(41, 100), 41);
+	TEST_EQUAL(pb.next_marked(42, 100), 100);
+	TEST_EQUAL(pb.next_marked(13, 40), 40);
+
+	// growing the buffer preserves the marks
+	pb.insert(300, make_pkt(pool, 1));
+	TEST_EQUAL(pb.num_marked(), 3);
+	TEST_EQUAL(pb.next_marked(13, 301), 40);
+
+	// removing or replacing an element clears its mark
+	pb.remove(40);
+	pb.insert(41, make_pkt(pool, 2));
+	TEST_EQUAL(pb.num_marked(), 1);
+	TEST_EQUAL(pb.next_marked(13, 301), 301);
+
+	pb.unmark(12);
+	TEST_EQUAL(pb.num_marked(), 0);
+	TEST_EQUAL(pb.next_marked(0, 301), 301);
+}
+
+TORRENT_TEST(mark_wrap)
+{
+	packet_pool pool;
+	packet_buffer pb;
+
+	for (int i = 0; i < 40; ++i)
+		pb.insert((0xfff0 + i) & 0xffff, make_pkt(pool, i));
+
+	pb.mark(0xfff2);
+	pb.mark(0x10);
+	TEST_EQUAL(pb.next_marked(0xfff0, 0x18), 0xfff2);
+	TEST_EQUAL(pb.next_marked(0xfff3, 0x18), 0x10);
+	TEST_EQUAL(pb.next_marked(0xfff3, 0x10), 0x10);
+	TEST_EQUAL(pb.next_marked(0x11, 0x18), 0x18);
+
+	// indices before the first element are skipped
+	TEST_EQUAL(pb.next_marked(0xffe0, 0x18), 0xfff2);
+}
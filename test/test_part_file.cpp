@@ -31,10 +31,15 @@ POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cstring>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
 #include "test.hpp"
 #include "libtorrent/part_file.hpp"
 #include "libtorrent/aux_/path.hpp"
 #include "libtorrent/error_code.hpp"
+#include "libtorrent/file.hpp"
 
 using namespace lt;
 
@@ -137,3 +142,241 @@ TORRENT_TEST(part_file)
 	}
 }
 
+
+namespace {
+
+	void fill_piece(std::vector<char>& buf, int const piece, int const generation)
+	{
+		for (std::size_t i = 0; i < buf.size(); ++i)
+			buf[i] = char((piece * 7 + generation * 13 + int(i)) & 0xff);
+	}
+
+	bool check_piece(part_file& pf, int const piece, int const generation
+		, int const piece_size)
+	{
+		std::vector<char> expected(std::size_t(piece_size), 0);
+		fill_piece(expected, piece, generation);
+		std::vector<char> buf(std::size_t(piece_size), 0);
+		iovec_t v = {buf.data(), buf.size()};
+		error_code ec;
+		int const ret = pf.readv(v, piece_index_t(piece), 0, ec);
+		if (ec) std::printf("part_file::readv: %s\n", ec.message().c_str());
+		return ret == piece_size && buf == expected;
+	}
+
+	void write_piece(part_file& pf, int const piece, int const generation
+		, int const piece_size)
+	{
+		std::vector<char> buf(std::size_t(piece_size), 0);
+		fill_piece(buf, piece, generation);
+		iovec_t v = {buf.data(), buf.size()};
+		error_code ec;
+		pf.writev(v, piece_index_t(piece), 0, ec);
+		if (ec) std::printf("part_file::writev: %s\n", ec.message().c_str());
+	}
+}
+
+TORRENT_TEST(part_file_reuse_slots)
+{
+	error_code ec;
+	std::string const dir = combine_path(complete("."), "partfile_test_dir3");
+	remove_all(dir, ec);
+	ec.clear();
+	std::string const fn = combine_path(dir, "partfile.parts");
+
+	// large enough for the header to span several blocks
+	int const num_pieces = 3000;
+	int const piece_size = 0x4000;
+	int const header_size = 12 * 1024;
+
+	{
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+		write_piece(pf, 0, 0, piece_size);
+		write_piece(pf, 1500, 0, piece_size);
+		write_piece(pf, 2999, 0, piece_size);
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+
+		TEST_EQUAL(file_size(fn), header_size + 3 * piece_size);
+
+		// the slot is reused by the next piece written, and the file doesn't
+		// grow
+		pf.free_piece(piece_index_t(1500));
+		write_piece(pf, 10, 1, piece_size);
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+		TEST_EQUAL(file_size(fn), header_size + 3 * piece_size);
+
+		// only the block of the header holding piece 2999 has changed
+		pf.free_piece(piece_index_t(2999));
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+
+		TEST_CHECK(check_piece(pf, 0, 0, piece_size));
+		TEST_CHECK(check_piece(pf, 10, 1, piece_size));
+	}
+
+	{
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+		TEST_CHECK(check_piece(pf, 0, 0, piece_size));
+		TEST_CHECK(check_piece(pf, 10, 1, piece_size));
+
+		char buf[16];
+		iovec_t v = {buf, sizeof(buf)};
+		for (int const p : {1500, 2999})
+		{
+			pf.readv(v, piece_index_t(p), 0, ec);
+			TEST_EQUAL(ec, error_code(boost::system::errc::no_such_file_or_directory
+				, boost::system::generic_category()));
+			ec.clear();
+		}
+
+		// the freed slot is the next one to be used
+		write_piece(pf, 20, 2, piece_size);
+		TEST_EQUAL(file_size(fn), header_size + 3 * piece_size);
+		TEST_CHECK(check_piece(pf, 20, 2, piece_size));
+	}
+	remove_all(dir, ec);
+}
+
+TORRENT_TEST(part_file_concurrent)
+{
+	error_code ec;
+	std::string const dir = combine_path(complete("."), "partfile_test_dir4");
+	remove_all(dir, ec);
+	ec.clear();
+
+	int const num_threads = 4;
+	int const pieces_per_thread = 64;
+	int const num_pieces = num_threads * pieces_per_thread;
+	int const piece_size = 0x4000;
+	int const iterations = 8;
+
+	// the generation of the last write to each piece, -1 if it was freed
+	std::vector<int> generation(std::size_t(num_pieces), -1);
+	std::atomic<int> errors{0};
+	std::atomic<bool> done{false};
+
+	{
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+
+		// each thread reads and writes its own set of pieces, interleaved with
+		// the others, and frees every third piece. One more thread flushes the
+		// header continuously
+		std::vector<std::thread> threads;
+		for (int t = 0; t < num_threads; ++t)
+		{
+			threads.emplace_back([&, t]
+			{
+				for (int gen = 0; gen < iterations; ++gen)
+				{
+					for (int i = 0; i < pieces_per_thread; ++i)
+					{
+						int const piece = i * num_threads + t;
+						write_piece(pf, piece, gen, piece_size);
+						if (!check_piece(pf, piece, gen, piece_size)) ++errors;
+						generation[std::size_t(piece)] = gen;
+						if ((piece + gen) % 3 == 0)
+						{
+							pf.free_piece(piece_index_t(piece));
+							generation[std::size_t(piece)] = -1;
+						}
+					}
+				}
+			});
+		}
+
+		std::thread flusher([&]
+		{
+			while (!done)
+			{
+				error_code err;
+				pf.flush_metadata(err);
+				if (err) ++errors;
+				std::this_thread::yield();
+			}
+		});
+
+		for (auto& t : threads) t.join();
+		done = true;
+		flusher.join();
+
+		TEST_EQUAL(errors, 0);
+	}
+
+	// all pieces that were not freed last can be read back
+	part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+	for (int p = 0; p < num_pieces; ++p)
+	{
+		int const gen = generation[std::size_t(p)];
+		if (gen < 0) continue;
+		TEST_CHECK(check_piece(pf, p, gen, piece_size));
+	}
+	remove_all(dir, ec);
+}
+
+TORRENT_TEST(part_file_punch_hole_alignment)
+{
+	error_code ec;
+	std::string const dir = combine_path(complete("."), "partfile_test_dir5");
+	remove_all(dir, ec);
+	ec.clear();
+	std::string const fn = combine_path(dir, "partfile.parts");
+
+	// the header is 1 kiB, so the slots aren't aligned to 4 kiB blocks
+	int const num_pieces = 10;
+	int const piece_size = 0x4000;
+	int const header_size = 1024;
+
+	{
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+		for (int p = 0; p < 3; ++p) write_piece(pf, p, 0, piece_size);
+		pf.free_piece(piece_index_t(1));
+		pf.flush_metadata(ec);
+		TEST_CHECK(!ec);
+
+		TEST_CHECK(check_piece(pf, 0, 0, piece_size));
+		TEST_CHECK(check_piece(pf, 2, 0, piece_size));
+	}
+
+	std::vector<char> expected(static_cast<std::size_t>(piece_size));
+	fill_piece(expected, 1, 0);
+	std::vector<char> slot(static_cast<std::size_t>(piece_size));
+	bool punch_supported = false;
+	{
+		file f(fn, file::read_write, ec);
+		TEST_CHECK(!ec);
+		iovec_t v = {slot.data(), slot.size()};
+		TEST_EQUAL(f.readv(header_size + piece_size, v, ec), piece_size);
+		TEST_CHECK(!ec);
+
+		// find out whether the filesystem supports punching holes at all, in
+		// an aligned block of the last slot
+		error_code punch_ec;
+		f.punch_hole(0xc000, 0x1000, punch_ec);
+		punch_supported = !punch_ec;
+	}
+
+	// the first 3 kiB of the freed slot share a block with the slot before
+	// it, and must not have been touched
+	int const head = 0x1000 - header_size;
+	TEST_CHECK(std::equal(slot.begin(), slot.begin() + head, expected.begin()));
+
+	// the whole blocks in the slot were deallocated, and read back as zeroes
+	if (punch_supported)
+	{
+		int const tail = (header_size + 2 * piece_size) % 0x1000;
+		TEST_CHECK(std::all_of(slot.begin() + head, slot.end() - tail
+			, [](char const c) { return c == 0; }));
+		TEST_CHECK(std::equal(slot.end() - tail, slot.end(), expected.end() - tail));
+	}
+
+	{
+		// the slot is reused
+		part_file pf(dir, "partfile.parts", num_pieces, piece_size);
+		write_piece(pf, 5, 1, piece_size);
+		TEST_CHECK(check_piece(pf, 5, 1, piece_size));
+		TEST_EQUAL(file_size(fn), header_size + 3 * piece_size);
+	}
+	remove_all(dir, ec);
+}
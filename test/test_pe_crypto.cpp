@@ -32,6 +32,10 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <iostream>
+#include <array>
+#include <string>
+#include <thread>
+#include <chrono>
 
 #include "libtorrent/hasher.hpp"
 #include "libtorrent/pe_crypto.hpp"
@@ -39,6 +43,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/random.hpp"
 #include "libtorrent/span.hpp"
 #include "libtorrent/buffer.hpp"
+#include "libtorrent/hex.hpp"
 
 #include "setup_transfer.hpp"
 #include "test.hpp"
@@ -135,6 +140,62 @@ TORRENT_TEST(diffie_hellman)
 	}
 }
 
+TORRENT_TEST(dh_powm)
+{
+	using namespace lt;
+
+	lt::key_t const prime("0xFFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F14374FE1356D6D51C245E485B576625E7EC6F44C42E9A63A36210000000000090563");
+
+	TEST_CHECK(dh_powm(lt::key_t(2), lt::key_t(0)) == 1);
+	TEST_CHECK(dh_powm(lt::key_t(0), lt::key_t(5)) == 0);
+	TEST_CHECK(dh_powm(lt::key_t(2), lt::key_t(10)) == 1024);
+	TEST_CHECK(dh_powm(prime - 1, lt::key_t(2)) == 1);
+	TEST_CHECK(dh_powm(prime + 3, lt::key_t(3)) == 27);
+
+	for (int i = 0; i < 32; ++i)
+	{
+		dh_keypair const a = generate_dh_keypair();
+		dh_keypair const b = generate_dh_keypair();
+		TEST_CHECK(a.public_key == mp::powm(lt::key_t(2), a.secret, prime));
+		TEST_CHECK(dh_powm(b.public_key, a.secret)
+			== mp::powm(b.public_key, a.secret, prime));
+	}
+}
+
+TORRENT_TEST(dh_key_pool)
+{
+	using namespace lt;
+
+	dh_key_pool pool(4);
+	dh_keypair kp;
+	// the first call starts the background thread, the pool is still empty
+	TEST_CHECK(!pool.get(kp));
+	TEST_CHECK(kp.public_key == dh_powm(lt::key_t(2), kp.secret));
+
+	for (int i = 0; i < 500 && pool.num_keys() < 4; ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	TEST_EQUAL(pool.num_keys(), 4);
+
+	dh_keypair kp2;
+	TEST_CHECK(pool.get(kp2));
+	TEST_CHECK(kp2.public_key == dh_powm(lt::key_t(2), kp2.secret));
+	TEST_CHECK(kp2.secret != kp.secret);
+
+	dh_key_exchange DH1(kp);
+	dh_key_exchange DH2(kp2);
+	DH1.compute_secret(DH2.get_local_key());
+	DH2.compute_secret(DH1.get_local_key());
+	TEST_CHECK(DH1.get_secret() == DH2.get_secret());
+
+	pool.set_size(1);
+	TEST_CHECK(pool.num_keys() <= 1);
+
+	pool.stop();
+	TEST_EQUAL(pool.num_keys(), 0);
+	TEST_CHECK(!pool.get(kp));
+	TEST_CHECK(kp.public_key == dh_powm(lt::key_t(2), kp.secret));
+}
+
 TORRENT_TEST(rc4)
 {
 	using namespace lt;
@@ -152,6 +213,84 @@ TORRENT_TEST(rc4)
 	test_enc_handler(rc41, rc42);
 }
 
+namespace {
+
+// plain, byte-at-a-time RC4, used as the reference for rc4_handler
+struct rc4_ref
+{
+	explicit rc4_ref(std::string const& key)
+	{
+		for (int i = 0; i < 256; ++i) s[std::size_t(i)] = std::uint8_t(i);
+		std::uint8_t j = 0;
+		for (std::size_t i = 0; i < 256; ++i)
+		{
+			j = std::uint8_t(j + s[i] + std::uint8_t(key[i % key.size()]));
+			std::swap(s[i], s[j]);
+		}
+	}
+
+	void crypt(char* buf, std::size_t const len)
+	{
+		for (std::size_t k = 0; k < len; ++k)
+		{
+			x = std::uint8_t(x + 1);
+			y = std::uint8_t(y + s[x]);
+			std::swap(s[x], s[y]);
+			buf[k] = char(buf[k] ^ s[std::uint8_t(s[x] + s[y])]);
+		}
+	}
+
+	std::array<std::uint8_t, 256> s;
+	std::uint8_t x = 0;
+	std::uint8_t y = 0;
+};
+
+std::string rc4_ref_crypt(std::string const& key, std::string buf)
+{
+	rc4_ref r(key);
+	r.crypt(&buf[0], buf.size());
+	return lt::aux::to_hex(buf);
+}
+
+}
+
+TORRENT_TEST(rc4_reference)
+{
+	// make sure the reference implementation is right
+	TEST_EQUAL(rc4_ref_crypt("Key", "Plaintext"), "bbf316e8d940af0ad3");
+	TEST_EQUAL(rc4_ref_crypt("Wiki", "pedia"), "1021bf0420");
+	TEST_EQUAL(rc4_ref_crypt("Secret", "Attack at dawn"), "45a01f645fc35b383552544b9bf5");
+
+	using namespace lt;
+
+	sha1_hash const key = hasher("test1_key", 8).final();
+	rc4_handler rc4;
+	rc4.set_outgoing_key(key);
+
+	rc4_ref ref(key.to_string());
+	// rc4_handler discards the first 1024 bytes of the keystream
+	std::vector<char> discard(1024);
+	ref.crypt(discard.data(), discard.size());
+
+	// encrypt buffers of all kinds of sizes. Short ones are encrypted with the
+	// permutation in place, longer ones with a copy of it, so this covers both
+	// and the switch between them
+	for (int len : { 0, 1, 5, 17, 68, 127, 128, 129, 1024, 1031, 16384, 65537 })
+	{
+		std::vector<char> buf(static_cast<std::size_t>(len));
+		std::generate(buf.begin(), buf.end(), &std::rand);
+		std::vector<char> expected = buf;
+		ref.crypt(expected.data(), expected.size());
+
+		// split the buffer in two, to cover multiple iovecs
+		int const split = len / 3;
+		span<char> iovec[2] = { span<char>(buf.data(), std::size_t(split))
+			, span<char>(buf.data() + split, std::size_t(len - split)) };
+		rc4.encrypt(iovec);
+		TEST_CHECK(buf == expected);
+	}
+}
+
 #else
 TORRENT_TEST(disabled)
 {
@@ -0,0 +1,190 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/aux_/read_ahead.hpp"
+
+using namespace lt;
+
+namespace {
+
+	piece_index_t const end_piece(1000);
+
+	aux::read_ahead_predictor::decision read(aux::read_ahead_predictor& p
+		, int const piece, bool const hit = true, bool const sequential = false
+		, int const max_pieces = 8)
+	{
+		return p.on_read(piece_index_t(piece), hit, sequential, max_pieces, end_piece);
+	}
+
+	bool no_read_ahead(aux::read_ahead_predictor::decision const& d)
+	{
+		return d.first >= d.end;
+	}
+
+	bool read_ahead(aux::read_ahead_predictor::decision const& d, int const first, int const end)
+	{
+		return d.first == piece_index_t(first) && d.end == piece_index_t(end);
+	}
+}
+
+TORRENT_TEST(read_ahead_sequential)
+{
+	aux::read_ahead_predictor p;
+
+	// it takes a few pieces to detect a sequential reader
+	TEST_CHECK(no_read_ahead(read(p, 0)));
+	TEST_CHECK(no_read_ahead(read(p, 1)));
+	TEST_CHECK(read_ahead(read(p, 2), 3, 4));
+
+	// the window doubles every time a piece that was read ahead is still
+	// in the cache
+	auto d = read(p, 3);
+	TEST_CHECK(d.read_ahead);
+	TEST_CHECK(read_ahead(d, 4, 6));
+	TEST_CHECK(read_ahead(read(p, 4), 6, 9));
+	TEST_CHECK(read_ahead(read(p, 5), 9, 14));
+
+	// up to the limit
+	TEST_CHECK(read_ahead(read(p, 6), 14, 15));
+	TEST_CHECK(read_ahead(read(p, 7), 15, 16));
+}
+
+TORRENT_TEST(read_ahead_same_piece)
+{
+	aux::read_ahead_predictor p;
+	read(p, 0);
+	read(p, 1);
+	TEST_CHECK(read_ahead(read(p, 2), 3, 4));
+
+	// more blocks from the same piece don't move the stream
+	for (int i = 0; i < 10; ++i)
+	{
+		auto const d = read(p, 2);
+		TEST_CHECK(no_read_ahead(d));
+		TEST_CHECK(!d.read_ahead);
+	}
+	TEST_CHECK(read_ahead(read(p, 3), 4, 6));
+}
+
+TORRENT_TEST(read_ahead_hint)
+{
+	aux::read_ahead_predictor p;
+
+	// readers known to be sequential start reading ahead right away
+	TEST_CHECK(read_ahead(read(p, 10, false, true), 11, 12));
+	TEST_CHECK(read_ahead(read(p, 11, true, true), 12, 14));
+}
+
+TORRENT_TEST(read_ahead_random)
+{
+	aux::read_ahead_predictor p;
+	for (int const piece : {10, 50, 3, 80, 20, 11, 51, 700, 4, 999, 0, 12})
+	{
+		auto const d = read(p, piece);
+		TEST_CHECK(no_read_ahead(d));
+		TEST_CHECK(!d.read_ahead);
+	}
+}
+
+TORRENT_TEST(read_ahead_interleaved)
+{
+	aux::read_ahead_predictor p;
+
+	// two sequential readers at different places in the torrent are
+	// tracked separately
+	TEST_CHECK(no_read_ahead(read(p, 0)));
+	TEST_CHECK(no_read_ahead(read(p, 100)));
+	TEST_CHECK(no_read_ahead(read(p, 1)));
+	TEST_CHECK(no_read_ahead(read(p, 101)));
+	TEST_CHECK(read_ahead(read(p, 2), 3, 4));
+	TEST_CHECK(read_ahead(read(p, 102), 103, 104));
+	TEST_CHECK(read_ahead(read(p, 3), 4, 6));
+	TEST_CHECK(read_ahead(read(p, 103), 104, 106));
+
+	// random reads in between replace the least recently used streams, not
+	// the active ones
+	read(p, 500);
+	read(p, 600);
+	TEST_CHECK(read_ahead(read(p, 4), 6, 9));
+	TEST_CHECK(read_ahead(read(p, 104), 106, 109));
+}
+
+TORRENT_TEST(read_ahead_backoff)
+{
+	aux::read_ahead_predictor p;
+	read(p, 0);
+	read(p, 1);
+	read(p, 2);
+	read(p, 3);
+	read(p, 4);
+	TEST_CHECK(read_ahead(read(p, 5), 9, 14));
+
+	// the read-ahead pieces are evicted before they're used. Shrink the
+	// window
+	auto d = read(p, 6, false);
+	TEST_CHECK(d.read_ahead);
+	TEST_CHECK(no_read_ahead(d));
+	d = read(p, 7, false);
+	TEST_CHECK(d.read_ahead);
+	TEST_CHECK(no_read_ahead(d));
+	d = read(p, 8, false);
+	TEST_CHECK(d.read_ahead);
+	TEST_CHECK(no_read_ahead(d));
+
+	// the window is down to zero. The stream has to be detected again
+	d = read(p, 9, false);
+	TEST_CHECK(d.read_ahead);
+	TEST_CHECK(no_read_ahead(d));
+	TEST_CHECK(no_read_ahead(read(p, 10, false)));
+	TEST_CHECK(no_read_ahead(read(p, 11, false)));
+	TEST_CHECK(read_ahead(read(p, 12, false), 13, 14));
+}
+
+TORRENT_TEST(read_ahead_limits)
+{
+	aux::read_ahead_predictor p;
+
+	// never past the end of the torrent
+	piece_index_t const last(5);
+	p.on_read(piece_index_t(2), true, true, 8, last);
+	auto d = p.on_read(piece_index_t(3), true, true, 8, last);
+	TEST_CHECK(d.first == piece_index_t(4));
+	TEST_CHECK(d.end == piece_index_t(5));
+	d = p.on_read(piece_index_t(4), true, true, 8, last);
+	TEST_CHECK(d.first >= d.end);
+
+	// read-ahead disabled
+	aux::read_ahead_predictor p2;
+	for (int i = 0; i < 10; ++i)
+		TEST_CHECK(no_read_ahead(read(p2, i, true, true, 0)));
+}
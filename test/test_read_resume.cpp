@@ -41,6 +41,9 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/bencode.hpp"
 #include "libtorrent/add_torrent_params.hpp"
 #include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/socket.hpp"
 
 using namespace lt;
 
@@ -213,3 +216,61 @@ TORRENT_TEST(read_resume_torrent)
 	TEST_EQUAL(atp.ti->info_hash(), ti->info_hash());
 	TEST_EQUAL(atp.ti->name(), ti->name());
 }
+
+TORRENT_TEST(write_resume_data_buf)
+{
+	add_torrent_params atp;
+	atp.ti = generate_torrent();
+	atp.info_hash = atp.ti->info_hash();
+	atp.save_path = "/foo/bar";
+	atp.total_uploaded = 1337;
+	atp.added_time = 1500000000;
+	atp.flags |= add_torrent_params::flag_seed_mode
+		| add_torrent_params::flag_sequential_download;
+	atp.trackers = {"http://a.com/announce", "http://b.com/announce"
+		, "http://c.com/announce", "http://d.com/announce"};
+	atp.tracker_tiers = {0, 3, 1};
+	atp.url_seeds = {"http://url_seed.com/"};
+	atp.http_seeds = {"http://http_seed.com/"};
+	atp.peers.push_back(tcp::endpoint(address_v4::from_string("1.2.3.4"), 6881));
+#if TORRENT_USE_IPV6
+	atp.peers.push_back(tcp::endpoint(address_v6::from_string("::1"), 6881));
+#endif
+	atp.peers.push_back(tcp::endpoint(address_v4::from_string("4.3.2.1"), 6882));
+	atp.banned_peers.push_back(tcp::endpoint(address_v4::from_string("5.6.7.8"), 1));
+	atp.have_pieces.resize(10, false);
+	atp.have_pieces.set_bit(piece_index_t(3));
+	atp.verified_pieces.resize(12, false);
+	atp.verified_pieces.set_bit(piece_index_t(3));
+	atp.verified_pieces.set_bit(piece_index_t(11));
+	atp.unfinished_pieces[piece_index_t(4)].resize(8, true);
+	atp.unfinished_pieces[piece_index_t(2)].resize(8, false);
+	atp.renamed_files[file_index_t(2)] = "renamed";
+	atp.file_priorities = {1, 0, 4};
+	atp.piece_priorities = {4, 4, 0, 7};
+	atp.merkle_tree.resize(3);
+	atp.merkle_tree[1][0] = 0x42;
+
+	// encoding directly must give the same result as bencoding the entry
+	std::vector<char> expected;
+	bencode(std::back_inserter(expected), write_resume_data(atp));
+	std::vector<char> const buf = write_resume_data_buf(atp);
+	TEST_CHECK(buf == expected);
+
+	// the buffer is appended to
+	std::vector<char> buf2(3, 'x');
+	write_resume_data_buf(atp, buf2);
+	TEST_EQUAL(buf2.size(), buf.size() + 3);
+	TEST_CHECK(std::equal(buf.begin(), buf.end(), buf2.begin() + 3));
+
+	error_code ec;
+	add_torrent_params const atp2 = read_resume_data(buf, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(atp2.save_path, "/foo/bar");
+	TEST_EQUAL(atp2.total_uploaded, 1337);
+	TEST_EQUAL(atp2.peers.size(), atp.peers.size());
+	TEST_EQUAL(atp2.banned_peers.size(), 1);
+	TEST_EQUAL(atp2.trackers.size(), 4);
+	TEST_CHECK(atp2.have_pieces.get_bit(piece_index_t(3)));
+	TEST_CHECK(atp2.verified_pieces.get_bit(piece_index_t(11)));
+}
@@ -211,6 +211,194 @@ TORRENT_TEST(receive_buffer_max_receive)
 	TEST_EQUAL(b.max_receive(), max_receive - 20);
 }
 
+TORRENT_TEST(receive_buffer_normalize_in_place)
+{
+	receive_buffer b;
+	b.reset(10);
+	span<char> vec = b.reserve(1000);
+	int const capacity = b.capacity();
+	for (int i = 0; i < capacity; ++i) vec[i] = char(i);
+
+	// one complete packet of half the buffer and the first 50 bytes of a 100
+	// byte one
+	int const first = capacity / 2;
+	b.cut(0, first);
+	b.received(first + 50);
+	TEST_EQUAL(b.advance_pos(first + 50), first);
+	b.cut(first, 100);
+	TEST_EQUAL(b.advance_pos(50), 50);
+
+	// there's plenty of room to receive the rest of the packet, so it's left
+	// where it is. Nothing has been saved yet, it may still have to be moved
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+	TEST_CHECK(!b.normalized());
+	TEST_CHECK(b.get().data() == vec.data() + first);
+	TEST_EQUAL(b.max_receive(), capacity - first - 50);
+	TEST_CHECK(b.pos_at_end());
+
+	// the rest of the packet is received right after it
+	span<char> const vec2 = b.reserve(50);
+	TEST_CHECK(vec2.data() == vec.data() + first + 50);
+	b.received(50);
+	TEST_EQUAL(b.advance_pos(50), 50);
+	TEST_CHECK(b.packet_finished());
+	span<char const> const packet = b.get();
+	TEST_EQUAL(packet.size(), 100);
+	for (int i = 0; i < 100; ++i) TEST_EQUAL(packet[i], char(first + i));
+
+	// once the packet is consumed, the 50 bytes that were left in place
+	// were never moved
+	b.cut(100, 10);
+	TEST_CHECK(b.normalize() == std::make_pair(0, 50));
+
+	// and they're only counted once
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+}
+
+TORRENT_TEST(receive_buffer_normalize_saved_once)
+{
+	receive_buffer b;
+	b.reset(10);
+	b.reserve(1000);
+	int const first = b.capacity() / 2;
+	b.cut(0, first);
+	b.received(first + 20);
+	TEST_EQUAL(b.advance_pos(first + 20), first);
+	b.cut(first, 100);
+	TEST_EQUAL(b.advance_pos(20), 20);
+
+	// the partial packet is left in place by several calls, without being
+	// consumed
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+	b.reserve(10);
+	b.received(10);
+	TEST_EQUAL(b.advance_pos(10), 10);
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+
+	// then it's moved after all, when the buffer grows. None of it was saved
+	b.reserve(b.capacity());
+	TEST_CHECK(b.normalized());
+	b.received(70);
+	TEST_EQUAL(b.advance_pos(70), 70);
+	TEST_CHECK(b.packet_finished());
+	b.cut(100, 10);
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+}
+
+TORRENT_TEST(receive_buffer_normalize_move)
+{
+	receive_buffer b;
+	b.reset(100);
+	b.reserve(100);
+	int const capacity = b.capacity();
+
+	// receive a packet almost filling the buffer, and the first few bytes of
+	// the next one
+	b.cut(0, capacity - 5);
+	b.received(capacity);
+	TEST_EQUAL(b.advance_pos(capacity), capacity - 5);
+	b.cut(capacity - 5, 100);
+	TEST_EQUAL(b.advance_pos(5), 5);
+
+	// there's no room for the rest of the packet, so it's moved to the front
+	TEST_CHECK(b.normalize() == std::make_pair(5, 0));
+	TEST_CHECK(b.normalized());
+	TEST_EQUAL(b.get().size(), 5);
+	TEST_EQUAL(b.max_receive(), capacity - 5);
+}
+
+TORRENT_TEST(receive_buffer_reserve_in_place)
+{
+	receive_buffer b;
+	b.reset(10);
+	b.reserve(1000);
+	int const first = b.capacity() / 2;
+	b.cut(0, first);
+	b.received(first + 30);
+	TEST_EQUAL(b.advance_pos(first + 30), first);
+	b.cut(first, 50);
+	TEST_EQUAL(b.advance_pos(30), 30);
+	TEST_CHECK(b.normalize() == std::make_pair(0, 0));
+
+	// growing the buffer moves the current packet to the front
+	span<char> const vec = b.reserve(b.capacity());
+	TEST_CHECK(b.normalized());
+	TEST_EQUAL(b.get().size(), 30);
+	TEST_CHECK(vec.data() == b.get().data() + 30);
+}
+
+namespace {
+
+struct test_allocator : buffer_allocator_interface
+{
+	void free_disk_buffer(char* b) override { delete[] b; }
+	void reclaim_blocks(span<aux::block_cache_reference>) override {}
+};
+
+}
+
+TORRENT_TEST(recv_buffer_disk_buffer)
+{
+	test_allocator alloc;
+	receive_buffer b;
+
+	// a 9 byte header followed by 100 bytes of payload
+	b.cut(0, 109);
+	span<char> vec = b.reserve(50);
+	for (int i = 0; i < 50; ++i) vec[i] = char(i);
+	b.received(50);
+	TEST_EQUAL(b.advance_pos(50), 50);
+
+	TEST_CHECK(b.can_assign_disk_buffer());
+	b.assign_disk_buffer(disk_buffer_holder(alloc, new char[100]), 100);
+	TEST_CHECK(b.has_disk_buffer());
+	TEST_CHECK(!b.can_assign_disk_buffer());
+
+	// only the header is left in the receive buffer
+	TEST_EQUAL(b.get().size(), 9);
+	TEST_EQUAL(b.pos(), 50);
+	TEST_EQUAL(b.max_receive(), 59);
+	TEST_CHECK(b.pos_at_end());
+	b.normalize();
+
+	// we can't receive past the end of the packet
+	vec = b.reserve(1000);
+	TEST_EQUAL(vec.size(), 59);
+	for (int i = 0; i < 59; ++i) vec[i] = char(50 + i);
+	b.received(59);
+	TEST_EQUAL(b.advance_pos(59), 59);
+	TEST_CHECK(b.packet_finished());
+	TEST_CHECK(b.pos_at_end());
+
+	disk_buffer_holder payload = b.release_disk_buffer();
+	for (int i = 0; i < 100; ++i) TEST_EQUAL(int(payload.get()[i]), 9 + i);
+	span<char const> const header = b.get();
+	TEST_EQUAL(header.size(), 9);
+	for (int i = 0; i < 9; ++i) TEST_EQUAL(int(header[i]), i);
+
+	b.reset(5);
+	TEST_CHECK(!b.has_disk_buffer());
+	TEST_EQUAL(b.pos(), 0);
+	TEST_EQUAL(b.packet_size(), 5);
+	b.normalize();
+	TEST_CHECK(b.pos_at_end());
+	TEST_EQUAL(b.max_receive(), b.capacity());
+}
+
+TORRENT_TEST(recv_buffer_disk_buffer_next_packet)
+{
+	receive_buffer b;
+
+	// if we've received bytes past the current packet, the payload is
+	// already in the receive buffer and there's no point in a disk buffer
+	b.cut(0, 109);
+	b.reserve(200);
+	b.received(200);
+	b.advance_pos(50);
+	TEST_CHECK(!b.can_assign_disk_buffer());
+}
+
 #if !defined(TORRENT_DISABLE_ENCRYPTION) && !defined(TORRENT_DISABLE_EXTENSIONS)
 
 TORRENT_TEST(recv_buffer_mutable_buffers)
@@ -0,0 +1,255 @@
+/*
+
+Copyright (c) 2026, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/resolver.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/aux_/time.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+// this fails in getaddrinfo() without asking a DNS server, since it has an
+// empty label
+char const* const invalid_name = "invalid..name";
+
+struct lookup_result
+{
+	int calls = 0;
+	error_code ec;
+	std::vector<address> addresses;
+};
+
+resolver_interface::callback_t record(lookup_result& r)
+{
+	return [&r](error_code const& ec, std::vector<address> const& addresses)
+	{
+		++r.calls;
+		r.ec = ec;
+		r.addresses = addresses;
+	};
+}
+
+void wait(io_service& ios, seconds const s)
+{
+	std::this_thread::sleep_for(s);
+	aux::update_time_now();
+	ios.reset();
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(coalesce_lookups)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+
+	lookup_result r[5];
+	for (auto& l : r)
+		res.async_resolve("localhost", 0, record(l));
+
+	// all requests for the same name are served by a single lookup
+	TEST_EQUAL(res.num_lookups(), 1);
+	ios.run();
+
+	for (auto const& l : r)
+	{
+		TEST_EQUAL(l.calls, 1);
+		TEST_CHECK(!l.ec);
+		TEST_CHECK(!l.addresses.empty());
+		TEST_CHECK(l.addresses == r[0].addresses);
+	}
+
+	// lookups on the abortable and the critical resolver don't share
+	// results with each other
+	ios.reset();
+	lookup_result a;
+	lookup_result b;
+	res.async_resolve(invalid_name, resolver_interface::abort_on_shutdown, record(a));
+	res.async_resolve(invalid_name, 0, record(b));
+	TEST_EQUAL(res.num_lookups(), 3);
+	ios.run();
+	TEST_EQUAL(a.calls, 1);
+	TEST_EQUAL(b.calls, 1);
+	TEST_CHECK(a.ec);
+	TEST_CHECK(b.ec);
+}
+
+TORRENT_TEST(cache_hit)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+
+	lookup_result r1;
+	res.async_resolve("localhost", 0, record(r1));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+
+	ios.reset();
+	lookup_result r2;
+	res.async_resolve("localhost", 0, record(r2));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_EQUAL(r2.calls, 1);
+	TEST_CHECK(r2.addresses == r1.addresses);
+
+	// IP addresses never hit the resolver
+	ios.reset();
+	lookup_result r3;
+	res.async_resolve("10.0.0.1", 0, record(r3));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_EQUAL(r3.addresses.size(), 1);
+}
+
+TORRENT_TEST(negative_cache)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+
+	lookup_result r1;
+	res.async_resolve(invalid_name, 0, record(r1));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_EQUAL(r1.calls, 1);
+	TEST_CHECK(r1.ec);
+
+	// the failure is remembered
+	ios.reset();
+	lookup_result r2;
+	res.async_resolve(invalid_name, 0, record(r2));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_EQUAL(r2.calls, 1);
+	TEST_CHECK(r2.ec == r1.ec);
+	TEST_CHECK(r2.addresses.empty());
+}
+
+TORRENT_TEST(negative_cache_expiry)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+
+	// failures are cached for 60 seconds, or the cache timeout if that's
+	// shorter
+	res.set_cache_timeout(seconds(1));
+
+	lookup_result r1;
+	res.async_resolve(invalid_name, 0, record(r1));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_CHECK(r1.ec);
+
+	wait(ios, seconds(2));
+
+	lookup_result r2;
+	res.async_resolve(invalid_name, 0, record(r2));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 2);
+	TEST_EQUAL(r2.calls, 1);
+	TEST_CHECK(r2.ec);
+}
+
+TORRENT_TEST(refresh_ahead)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+
+	// entries are refreshed once they're past 75% of their lifetime
+	res.set_cache_timeout(seconds(4));
+
+	lookup_result r1;
+	res.async_resolve("localhost", 0, record(r1));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+
+	// 50% of the lifetime, no refresh yet
+	wait(ios, seconds(2));
+	lookup_result r2;
+	res.async_resolve("localhost", 0, record(r2));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+	TEST_EQUAL(r2.calls, 1);
+
+	// 75% of the lifetime has passed. The cached entry is returned right
+	// away, and refreshed in the background
+	wait(ios, seconds(1));
+	lookup_result r3;
+	res.async_resolve("localhost", 0, record(r3));
+	TEST_EQUAL(res.num_lookups(), 2);
+	ios.run();
+	TEST_EQUAL(r3.calls, 1);
+	TEST_CHECK(r3.addresses == r1.addresses);
+
+	// the original entry would have expired by now, but it was refreshed
+	wait(ios, seconds(2));
+	lookup_result r4;
+	res.async_resolve("localhost", 0, record(r4));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 2);
+	TEST_EQUAL(r4.calls, 1);
+}
+
+TORRENT_TEST(prefer_cache_stale)
+{
+	io_service ios;
+	resolver res(ios);
+	aux::update_time_now();
+	res.set_cache_timeout(seconds(1));
+
+	lookup_result r1;
+	res.async_resolve("localhost", 0, record(r1));
+	ios.run();
+	TEST_EQUAL(res.num_lookups(), 1);
+
+	wait(ios, seconds(2));
+
+	// the entry has expired, but prefer_cache lookups still get the
+	// addresses right away, while the entry is refreshed
+	lookup_result r2;
+	res.async_resolve("localhost", resolver_interface::prefer_cache, record(r2));
+	TEST_EQUAL(res.num_lookups(), 2);
+	ios.run();
+	TEST_EQUAL(r2.calls, 1);
+	TEST_CHECK(!r2.ec);
+	TEST_CHECK(r2.addresses == r1.addresses);
+}
+
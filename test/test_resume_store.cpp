@@ -0,0 +1,530 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "test.hpp"
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/hex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+
+using namespace lt;
+
+namespace {
+
+std::string const store_path = "resume_store_test.dat";
+std::string const crash_path = "resume_store_crash.dat";
+
+sha1_hash info_hash(char const c)
+{
+	sha1_hash ret;
+	for (int i = 0; i < 20; ++i) ret[i] = std::uint8_t(c + i);
+	return ret;
+}
+
+add_torrent_params make_params(char const c, int const num_pieces)
+{
+	add_torrent_params atp;
+	atp.info_hash = info_hash(c);
+	atp.save_path = std::string("/downloads/") + c;
+	atp.name = std::string("torrent ") + c;
+	atp.flags = 0x1234;
+	atp.max_uploads = 4;
+	atp.max_connections = 50;
+	atp.upload_limit = 1000;
+	atp.download_limit = 2000;
+	atp.added_time = 1500000000;
+	atp.completed_time = 1500001000;
+	atp.last_seen_complete = 1500002000;
+	atp.total_uploaded = 1234567890123;
+	atp.total_downloaded = 9876543210;
+	atp.active_time = 100;
+	atp.finished_time = 50;
+	atp.seeding_time = 25;
+	atp.num_complete = 10;
+	atp.num_incomplete = 20;
+	atp.num_downloaded = 30;
+	atp.file_priorities = {1, 4, 7, 0};
+	atp.piece_priorities.resize(std::size_t(num_pieces), 4);
+	atp.piece_priorities[3] = 7;
+	atp.have_pieces.resize(num_pieces, false);
+	for (int i = 0; i < num_pieces; i += 3)
+		atp.have_pieces.set_bit(piece_index_t(i));
+	return atp;
+}
+
+// the state a resume_store is expected to restore, as a string to make
+// comparisons and failure messages simple
+std::string describe(add_torrent_params const& atp)
+{
+	std::string ret = aux::to_hex(atp.info_hash) + " " + atp.save_path
+		+ " " + atp.name
+		+ " flags: " + std::to_string(atp.flags)
+		+ " limits: " + std::to_string(atp.max_uploads)
+		+ "," + std::to_string(atp.max_connections)
+		+ "," + std::to_string(atp.upload_limit)
+		+ "," + std::to_string(atp.download_limit)
+		+ " times: " + std::to_string(atp.added_time)
+		+ "," + std::to_string(atp.completed_time)
+		+ "," + std::to_string(atp.last_seen_complete)
+		+ "," + std::to_string(atp.active_time)
+		+ "," + std::to_string(atp.finished_time)
+		+ "," + std::to_string(atp.seeding_time)
+		+ " transfer: " + std::to_string(atp.total_uploaded)
+		+ "," + std::to_string(atp.total_downloaded)
+		+ " scrape: " + std::to_string(atp.num_complete)
+		+ "," + std::to_string(atp.num_incomplete)
+		+ "," + std::to_string(atp.num_downloaded)
+		+ " file-prio: ";
+	for (auto const p : atp.file_priorities) ret += char('0' + p);
+	ret += " piece-prio: ";
+	for (auto const p : atp.piece_priorities) ret += char('0' + p);
+	ret += " pieces: ";
+	for (piece_index_t i(0); i < atp.have_pieces.end_index(); ++i)
+		ret += atp.have_pieces[i] ? '1' : '0';
+	return ret;
+}
+
+std::string load(resume_store const& store, sha1_hash const& ih)
+{
+	error_code ec;
+	add_torrent_params const atp = store.load(ih, ec);
+	if (ec) return "error: " + ec.message();
+	return describe(atp);
+}
+
+std::vector<char> read_file(std::string const& path)
+{
+	std::ifstream in(path, std::ios_base::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(in)
+		, std::istreambuf_iterator<char>());
+}
+
+void write_file(std::string const& path, std::vector<char> const& buf)
+{
+	std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+	out.write(buf.data(), std::streamsize(buf.size()));
+}
+
+torrent_status make_status(sha1_hash const& ih, int const n)
+{
+	torrent_status st;
+	st.info_hash = ih;
+	st.all_time_upload = 1000 * n;
+	st.all_time_download = 2000 * n;
+	st.last_seen_complete = 1600000000 + n;
+	st.completed_time = 1600000100 + n;
+	st.active_duration = seconds(10 * n);
+	st.finished_duration = seconds(5 * n);
+	st.seeding_duration = seconds(2 * n);
+	st.num_complete = n;
+	st.num_incomplete = 2 * n;
+	return st;
+}
+
+void apply_stats(add_torrent_params& atp, torrent_status const& st)
+{
+	atp.total_uploaded = st.all_time_upload;
+	atp.total_downloaded = st.all_time_download;
+	atp.last_seen_complete = st.last_seen_complete;
+	atp.completed_time = st.completed_time;
+	atp.active_time = int(st.active_duration.count());
+	atp.finished_time = int(st.finished_duration.count());
+	atp.seeding_time = int(st.seeding_duration.count());
+	atp.num_complete = st.num_complete;
+	atp.num_incomplete = st.num_incomplete;
+}
+
+// simulates the system crashing while the store file was changed from
+// ``before`` to ``after``: any subset of the 64 byte blocks that changed
+// may have made it to the disk (and the file may have been extended by any
+// number of them). For every such state of the file, ``check`` is called with
+// the store opened from it
+template <typename Fun>
+void simulate_crash(std::vector<char> const& before, std::vector<char> const& after
+	, Fun const& check)
+{
+	int const block = 64;
+	std::size_t const size = std::max(before.size(), after.size());
+	std::vector<std::size_t> changed;
+	for (std::size_t i = 0; i < size; i += block)
+	{
+		std::size_t const len = std::min(std::size_t(block), size - i);
+		if (i + len > before.size() || i + len > after.size()
+			|| std::memcmp(before.data() + i, after.data() + i, len) != 0)
+			changed.push_back(i);
+	}
+
+	auto const test_subset = [&](std::function<bool(std::size_t)> const& written
+		, std::size_t const file_size)
+	{
+		std::vector<char> buf = before;
+		buf.resize(file_size, 0);
+		for (std::size_t i = 0; i < changed.size(); ++i)
+		{
+			if (!written(i)) continue;
+			std::size_t const off = changed[i];
+			if (off >= file_size) continue;
+			std::size_t const len = std::min(std::size_t(block)
+				, std::min(after.size(), file_size) - std::min(off, after.size()));
+			if (off < after.size())
+				std::memcpy(buf.data() + off, after.data() + off, len);
+		}
+		write_file(crash_path, buf);
+
+		error_code ec;
+		resume_store store(crash_path, ec);
+		TEST_CHECK(!ec);
+		if (ec) std::printf("open: %s\n", ec.message().c_str());
+		check(store);
+	};
+
+	// the process terminating between (or in the middle of) writes,
+	// leaving a prefix of them
+	for (std::size_t n = 0; n <= changed.size(); ++n)
+		test_subset([&](std::size_t i) { return i < n; }, after.size());
+
+	// the system crashing, with the blocks written in any order
+	std::mt19937 rng(0x5eed);
+	int const rounds = changed.size() <= 10 ? (1 << changed.size()) : 1024;
+	for (int r = 0; r < rounds; ++r)
+	{
+		std::uint32_t const mask = changed.size() <= 10 ? std::uint32_t(r) : std::uint32_t(rng());
+		std::vector<bool> written(changed.size());
+		for (std::size_t i = 0; i < changed.size(); ++i)
+			written[i] = changed.size() <= 10 ? ((mask >> i) & 1) != 0 : (rng() & 1) != 0;
+		std::size_t const file_size = after.size() > before.size()
+			? before.size() + (rng() % (after.size() - before.size() + 1)) / block * block
+			: after.size();
+		test_subset([&](std::size_t i) { return bool(written[i]); }, file_size);
+	}
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(resume_store_round_trip)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params const a = make_params('a', 1000);
+	add_torrent_params const b = make_params('b', 10);
+
+	{
+		resume_store store(store_path, ec);
+		TEST_CHECK(!ec);
+		TEST_CHECK(store.torrents().empty());
+		store.save(a, ec);
+		TEST_CHECK(!ec);
+		store.save(b, ec);
+		TEST_CHECK(!ec);
+
+		TEST_EQUAL(load(store, a.info_hash), describe(a));
+		TEST_EQUAL(load(store, b.info_hash), describe(b));
+	}
+
+	resume_store store(store_path, ec);
+	TEST_CHECK(!ec);
+	std::vector<sha1_hash> torrents = store.torrents();
+	std::sort(torrents.begin(), torrents.end());
+	TEST_EQUAL(torrents.size(), 2);
+	TEST_CHECK(torrents[0] == a.info_hash);
+	TEST_CHECK(torrents[1] == b.info_hash);
+
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+	TEST_EQUAL(load(store, b.info_hash), describe(b));
+
+	store.load(info_hash('c'), ec);
+	TEST_EQUAL(ec, error_code(errors::invalid_torrent_handle));
+}
+
+TORRENT_TEST(resume_store_piece_finished)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params a = make_params('a', 1000);
+	a.have_pieces.clear_all();
+
+	{
+		resume_store store(store_path, ec);
+		store.save(a, ec);
+		TEST_CHECK(!ec);
+
+		// this is more than fits in the log, so the record has to be saved
+		// again along the way
+		for (int i = 0; i < 100; ++i)
+		{
+			store.piece_finished(a.info_hash, piece_index_t(i * 7), ec);
+			TEST_CHECK(!ec);
+			a.have_pieces.set_bit(piece_index_t(i * 7));
+		}
+		TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+		store.piece_finished(a.info_hash, piece_index_t(-1), ec);
+		TEST_EQUAL(ec, error_code(errors::invalid_piece_index));
+		store.piece_finished(info_hash('x'), piece_index_t(1), ec);
+		TEST_EQUAL(ec, error_code(errors::invalid_torrent_handle));
+	}
+
+	resume_store store(store_path, ec);
+	TEST_CHECK(!ec);
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+	// keep going after re-opening the store
+	store.piece_finished(a.info_hash, piece_index_t(999), ec);
+	a.have_pieces.set_bit(piece_index_t(999));
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+	// a piece beyond the end of the bitfield grows it
+	store.piece_finished(a.info_hash, piece_index_t(1001), ec);
+	TEST_CHECK(!ec);
+	a.have_pieces.resize(1002, false);
+	a.have_pieces.set_bit(piece_index_t(1001));
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+}
+
+TORRENT_TEST(resume_store_update_stats)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params a = make_params('a', 100);
+
+	{
+		resume_store store(store_path, ec);
+		store.save(a, ec);
+		for (int i = 1; i <= 3; ++i)
+		{
+			store.update_stats(make_status(a.info_hash, i), ec);
+			TEST_CHECK(!ec);
+		}
+		apply_stats(a, make_status(a.info_hash, 3));
+		TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+		store.update_stats(make_status(info_hash('x'), 1), ec);
+		TEST_EQUAL(ec, error_code(errors::invalid_torrent_handle));
+	}
+
+	resume_store store(store_path, ec);
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+	store.update_stats(make_status(a.info_hash, 4), ec);
+	apply_stats(a, make_status(a.info_hash, 4));
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+
+	// saving the torrent again replaces the stats
+	a.total_uploaded = 1;
+	store.save(a, ec);
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+}
+
+TORRENT_TEST(resume_store_replace_and_remove)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params a = make_params('a', 100);
+	add_torrent_params const b = make_params('b', 100);
+
+	std::int64_t size = 0;
+	{
+		resume_store store(store_path, ec);
+		store.save(a, ec);
+		store.save(b, ec);
+		a.save_path = "/somewhere/else";
+		store.save(a, ec);
+		TEST_EQUAL(load(store, a.info_hash), describe(a));
+		store.flush(ec);
+		TEST_CHECK(!ec);
+		size = std::int64_t(read_file(store_path).size());
+
+		// the slot freed by the flush is reused
+		a.name = "renamed";
+		store.save(a, ec);
+		TEST_EQUAL(std::int64_t(read_file(store_path).size()), size);
+	}
+
+	{
+		// the store was flushed when closed, and the previous record of "a"
+		// was freed. Saving it again reuses it
+		resume_store store(store_path, ec);
+		TEST_EQUAL(store.torrents().size(), 2);
+		TEST_EQUAL(load(store, a.info_hash), describe(a));
+		TEST_EQUAL(load(store, b.info_hash), describe(b));
+		store.save(a, ec);
+		TEST_EQUAL(std::int64_t(read_file(store_path).size()), size);
+
+		store.remove(b.info_hash, ec);
+		TEST_CHECK(!ec);
+		store.remove(b.info_hash, ec);
+		TEST_EQUAL(ec, error_code(errors::invalid_torrent_handle));
+		TEST_EQUAL(store.torrents().size(), 1);
+	}
+
+	resume_store store(store_path, ec);
+	TEST_EQUAL(store.torrents().size(), 1);
+	TEST_EQUAL(load(store, a.info_hash), describe(a));
+	store.load(b.info_hash, ec);
+	TEST_EQUAL(ec, error_code(errors::invalid_torrent_handle));
+}
+
+TORRENT_TEST(resume_store_invalid_file)
+{
+	error_code ec;
+	write_file(store_path, std::vector<char>(100, 'x'));
+	resume_store store(store_path, ec);
+	TEST_EQUAL(ec, error_code(errors::invalid_file_tag));
+
+	store.save(make_params('a', 10), ec);
+	TEST_CHECK(ec);
+
+	// the file was not touched
+	TEST_CHECK(read_file(store_path) == std::vector<char>(100, 'x'));
+}
+
+TORRENT_TEST(resume_store_truncated)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params const a = make_params('a', 100);
+	add_torrent_params const b = make_params('b', 2000);
+	{
+		resume_store store(store_path, ec);
+		store.save(a, ec);
+		store.save(b, ec);
+	}
+	std::vector<char> const full = read_file(store_path);
+
+	// cutting the file short anywhere loses the records that don't fit,
+	// but never corrupts any
+	for (std::size_t size = 0; size <= full.size(); size += 16)
+	{
+		write_file(crash_path, std::vector<char>(full.begin()
+			, full.begin() + std::ptrdiff_t(size)));
+		resume_store store(crash_path, ec);
+		TEST_CHECK(!ec);
+		for (auto const& ih : store.torrents())
+		{
+			TEST_CHECK(ih == a.info_hash || ih == b.info_hash);
+			TEST_EQUAL(load(store, ih), describe(ih == a.info_hash ? a : b));
+		}
+	}
+}
+
+TORRENT_TEST(resume_store_crash_consistency)
+{
+	error_code ec;
+	remove(store_path, ec);
+
+	add_torrent_params a1 = make_params('a', 500);
+	add_torrent_params const b = make_params('b', 100);
+	add_torrent_params a2 = a1;
+	a2.save_path = "/new/path";
+	a2.have_pieces.set_all();
+
+	resume_store store(store_path, ec);
+	store.save(a1, ec);
+	store.save(b, ec);
+	store.flush(ec);
+
+	auto const b_intact = [&](resume_store const& s)
+	{ TEST_EQUAL(load(s, b.info_hash), describe(b)); };
+
+	// replacing a record: either the old or the new one survives
+	std::vector<char> before = read_file(store_path);
+	store.save(a2, ec);
+	std::vector<char> after = read_file(store_path);
+	simulate_crash(before, after, [&](resume_store const& s)
+	{
+		std::string const state = load(s, a1.info_hash);
+		TEST_CHECK(state == describe(a1) || state == describe(a2));
+		b_intact(s);
+	});
+
+	// releasing the old record once the new one is on disk
+	before = after;
+	store.flush(ec);
+	after = read_file(store_path);
+	simulate_crash(before, after, [&](resume_store const& s)
+	{
+		TEST_EQUAL(load(s, a1.info_hash), describe(a2));
+		b_intact(s);
+	});
+
+	// updating the stats in place
+	add_torrent_params a3 = a2;
+	apply_stats(a3, make_status(a1.info_hash, 7));
+	before = after;
+	store.update_stats(make_status(a1.info_hash, 7), ec);
+	after = read_file(store_path);
+	simulate_crash(before, after, [&](resume_store const& s)
+	{
+		std::string const state = load(s, a1.info_hash);
+		TEST_CHECK(state == describe(a2) || state == describe(a3));
+		b_intact(s);
+	});
+
+	// logging a completed piece in place
+	add_torrent_params b2 = b;
+	b2.have_pieces.set_bit(piece_index_t(1));
+	before = after;
+	store.piece_finished(b.info_hash, piece_index_t(1), ec);
+	after = read_file(store_path);
+	simulate_crash(before, after, [&](resume_store const& s)
+	{
+		TEST_EQUAL(load(s, a1.info_hash), describe(a3));
+		std::string const state = load(s, b.info_hash);
+		TEST_CHECK(state == describe(b) || state == describe(b2));
+	});
+
+	// removing a torrent
+	before = after;
+	store.remove(b.info_hash, ec);
+	after = read_file(store_path);
+	simulate_crash(before, after, [&](resume_store const& s)
+	{
+		TEST_EQUAL(load(s, a1.info_hash), describe(a3));
+		std::string const state = load(s, b.info_hash);
+		TEST_CHECK(state == describe(b2)
+			|| state == "error: " + error_code(errors::invalid_torrent_handle).message());
+	});
+}
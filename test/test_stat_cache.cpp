@@ -32,8 +32,11 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "libtorrent/stat_cache.hpp"
 #include "libtorrent/error_code.hpp"
+#include "libtorrent/aux_/path.hpp"
 #include "test.hpp"
 
+#include <fstream>
+
 using namespace lt;
 
 TORRENT_TEST(stat_cache)
@@ -85,3 +88,57 @@ TORRENT_TEST(stat_cache)
 	TEST_CHECK(!ec);
 }
 
+
+TORRENT_TEST(stat_cache_prefetch)
+{
+	error_code ec;
+	std::string const save_path = current_working_directory();
+	remove_all("test_prefetch", ec);
+	create_directory("test_prefetch", ec);
+	TEST_CHECK(!ec);
+
+	file_storage fs;
+	std::vector<file_index_t> files;
+	for (int i = 0; i < 200; ++i)
+	{
+		std::string const name = combine_path("test_prefetch"
+			, "test-" + std::to_string(i));
+		fs.add_file(name, i + 1);
+		files.push_back(file_index_t(i));
+
+		// every third file is missing
+		if ((i % 3) == 0) continue;
+		std::ofstream f(combine_path(save_path, name));
+		f << std::string(std::size_t(i), 'a');
+	}
+
+	stat_cache sc;
+	sc.set_cache(file_index_t(1), 1337);
+	sc.prefetch(fs, save_path, files, 4);
+
+	// the results must come from the cache now, not the filesystem
+	remove_all("test_prefetch", ec);
+	TEST_CHECK(!ec);
+
+	for (int i = 0; i < 200; ++i)
+	{
+		ec.clear();
+		std::int64_t const size = sc.get_filesize(file_index_t(i), fs, save_path, ec);
+		if (i == 1)
+		{
+			// prefetch doesn't touch files already in the cache
+			TEST_EQUAL(size, 1337);
+			TEST_CHECK(!ec);
+		}
+		else if ((i % 3) == 0)
+		{
+			TEST_EQUAL(size, stat_cache::file_error);
+			TEST_CHECK(ec == boost::system::errc::no_such_file_or_directory);
+		}
+		else
+		{
+			TEST_EQUAL(size, i);
+			TEST_CHECK(!ec);
+		}
+	}
+}
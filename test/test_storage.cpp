@@ -1480,3 +1480,278 @@ TORRENT_TEST(dont_move_intermingled_files)
 	TEST_CHECK(!exists(combine_path(test_path, combine_path("temp_storage"
 		, combine_path("_folder3", "alien_folder1")))));
 }
+
+TORRENT_TEST(async_write_blocks)
+{
+	std::string const test_path = current_working_directory();
+	delete_dirs(combine_path(test_path, "temp_storage"));
+
+	int const block_size = 16 * 1024;
+	int const num_blocks = 4;
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", block_size * num_blocks);
+	fs.set_piece_length(block_size * num_blocks);
+	fs.set_num_pieces(1);
+
+	io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	io.set_settings(&sett);
+
+	storage_params p;
+	p.files = &fs;
+	p.path = test_path;
+	p.mode = storage_mode_sparse;
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<char> const piece = new_piece(block_size * num_blocks);
+	std::vector<disk_write_block> blocks;
+	int num_written = 0;
+	for (int i = 0; i < num_blocks; ++i)
+	{
+		disk_buffer_holder buf = io.allocate_receive_buffer(
+			std::shared_ptr<disk_observer>());
+		TEST_CHECK(buf);
+		std::memcpy(buf.get(), piece.data() + i * block_size, block_size);
+		peer_request r;
+		r.piece = piece_index_t(0);
+		r.start = i * block_size;
+		r.length = block_size;
+		blocks.push_back(disk_write_block{r, std::move(buf)
+			, [&num_written](storage_error const& e)
+			{
+				TEST_CHECK(!e);
+				++num_written;
+			}});
+	}
+
+	// all four blocks are submitted as a single batch
+	io.async_write_blocks(st, blocks);
+	TEST_EQUAL(cnt[counters::num_write_batches], 1);
+	TEST_EQUAL(cnt[counters::num_write_batch_blocks], num_blocks);
+
+	bool done = false;
+	sha1_hash hash;
+	io.async_hash(st, piece_index_t(0), 0
+		, [&](piece_index_t, sha1_hash const& h, storage_error const& e)
+		{
+			TEST_CHECK(!e);
+			hash = h;
+			done = true;
+		}, nullptr);
+	io.submit_jobs();
+	run_until(ios, done);
+	TEST_CHECK(hash == hasher(piece).final());
+
+	// releasing the files flushes the write cache
+	done = false;
+	io.async_release_files(st, [&done] { done = true; });
+	io.submit_jobs();
+	run_until(ios, done);
+	TEST_EQUAL(num_written, num_blocks);
+	TEST_EQUAL(file_size(combine_path(test_path, combine_path("temp_storage", "test1.tmp")))
+		, block_size * num_blocks);
+
+	io.abort(true);
+}
+
+TORRENT_TEST(coalesced_flush)
+{
+	std::string const test_path = current_working_directory();
+	delete_dirs(combine_path(test_path, "temp_storage"));
+
+	int const block_size = 16 * 1024;
+	int const blocks_per_piece = 4;
+	int const piece_size = block_size * blocks_per_piece;
+	int const num_pieces = 64;
+	file_storage fs;
+	fs.add_file("temp_storage/test1.tmp", piece_size * num_pieces);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(num_pieces);
+
+	io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	sett.set_int(settings_pack::cache_size, 2048);
+	// hold off flushing until the cache line (the whole torrent) is complete.
+	// Piece 0 is never written, so nothing is flushed until the files are
+	// released
+	sett.set_int(settings_pack::write_cache_line_size, blocks_per_piece * num_pieces);
+	io.set_settings(&sett);
+
+	storage_params p;
+	p.files = &fs;
+	p.path = test_path;
+	p.mode = storage_mode_sparse;
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<char> const data = new_piece(piece_size * num_pieces);
+	int num_written = 0;
+	// write pieces 1..63 out of order
+	for (int i = 0; i < num_pieces - 1; ++i)
+	{
+		int const piece = 1 + (i * 37) % (num_pieces - 1);
+		std::vector<disk_write_block> blocks;
+		for (int b = 0; b < blocks_per_piece; ++b)
+		{
+			disk_buffer_holder buf = io.allocate_receive_buffer(
+				std::shared_ptr<disk_observer>());
+			TEST_CHECK(buf);
+			std::memcpy(buf.get(), data.data() + piece * piece_size + b * block_size
+				, block_size);
+			peer_request r;
+			r.piece = piece_index_t(piece);
+			r.start = b * block_size;
+			r.length = block_size;
+			blocks.push_back(disk_write_block{r, std::move(buf)
+				, [&num_written](storage_error const& e)
+				{
+					TEST_CHECK(!e);
+					++num_written;
+				}});
+		}
+		io.async_write_blocks(st, blocks);
+	}
+
+	bool done = false;
+	io.async_release_files(st, [&done] { done = true; });
+	io.submit_jobs();
+	run_until(ios, done);
+
+	int const total_blocks = (num_pieces - 1) * blocks_per_piece;
+	TEST_EQUAL(num_written, total_blocks);
+	TEST_EQUAL(cnt[counters::num_blocks_written], total_blocks);
+
+	// the adjacent pieces are written in offset order, many pieces per
+	// write operation, rather than one (or more) operation per piece
+	std::int64_t const write_ops = cnt[counters::num_write_ops];
+	TEST_CHECK(write_ops > 0);
+	TEST_CHECK(write_ops < num_pieces / 4);
+
+	std::vector<char> file_data(std::size_t(piece_size * num_pieces));
+	std::ifstream f(combine_path(test_path, combine_path("temp_storage", "test1.tmp"))
+		, std::ios::binary);
+	f.read(file_data.data(), std::streamsize(file_data.size()));
+	TEST_CHECK(std::equal(file_data.begin() + piece_size, file_data.end()
+		, data.begin() + piece_size));
+
+	io.abort(true);
+}
+
+// pieces after a sequential reader are read into the cache ahead of it
+TORRENT_TEST(read_ahead)
+{
+	std::string const test_path = current_working_directory();
+	delete_dirs(combine_path(test_path, "temp_storage"));
+
+	int const block_size = 16 * 1024;
+	int const blocks_per_piece = 4;
+	int const piece_size = block_size * blocks_per_piece;
+	int const num_pieces = 16;
+	file_storage fs;
+	fs.add_file("temp_storage/read_ahead.tmp", piece_size * num_pieces);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(num_pieces);
+
+	std::vector<char> const data = new_piece(piece_size * num_pieces);
+	error_code ec;
+	create_directory(combine_path(test_path, "temp_storage"), ec);
+	if (ec) std::cout << "create_directory: " << ec.message() << std::endl;
+	{
+		std::ofstream f(combine_path(test_path, combine_path("temp_storage", "read_ahead.tmp"))
+			, std::ios::binary);
+		f.write(data.data(), std::streamsize(data.size()));
+	}
+
+	io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	sett.set_int(settings_pack::cache_size, 2048);
+	sett.set_int(settings_pack::read_ahead_pieces, 4);
+	// reads by the peer only pull in the requested block
+	sett.set_int(settings_pack::read_cache_line_size, 1);
+	io.set_settings(&sett);
+
+	storage_params p;
+	p.files = &fs;
+	p.path = test_path;
+	p.mode = storage_mode_sparse;
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	// stands in for the peer reading the pieces
+	int requester = 0;
+	auto read_block = [&](int const piece)
+	{
+		bool done = false;
+		peer_request r;
+		r.piece = piece_index_t(piece);
+		r.start = 0;
+		r.length = block_size;
+		io.async_read(st, r, [&](disk_buffer_holder block, std::uint32_t
+			, storage_error const& se)
+		{
+			TEST_CHECK(!se.ec);
+			TEST_CHECK(block && std::memcmp(block.get()
+				, data.data() + piece * piece_size, block_size) == 0);
+			done = true;
+		}, &requester);
+		io.submit_jobs();
+		run_until(ios, done);
+	};
+
+	// read-ahead jobs don't have a handler. Wait for them with a fence
+	auto wait_for_jobs = [&]
+	{
+		bool done = false;
+		io.async_release_files(st, [&done] { done = true; });
+		io.submit_jobs();
+		run_until(ios, done);
+	};
+
+	// it takes three consecutive pieces to detect a sequential reader. Then
+	// the piece after it is read ahead
+	for (int i = 0; i < 3; ++i) read_block(i);
+	wait_for_jobs();
+	TEST_EQUAL(cnt[counters::num_read_ahead_pieces], 1);
+	TEST_EQUAL(cnt[counters::num_read_ahead_hits], 0);
+
+	// reaching that piece is a hit, and doubles the window
+	read_block(3);
+	wait_for_jobs();
+	TEST_EQUAL(cnt[counters::num_read_ahead_hits], 1);
+	TEST_EQUAL(cnt[counters::num_read_ahead_misses], 0);
+	TEST_EQUAL(cnt[counters::num_read_ahead_pieces], 3);
+
+	// read-ahead reads whole pieces, regardless of the read cache line size
+	cache_status cs;
+	io.get_cache_info(&cs, st, false, false);
+	for (int const piece : { 4, 5 })
+	{
+		auto const i = std::find_if(cs.pieces.begin(), cs.pieces.end()
+			, [piece](cached_piece_info const& pi) { return pi.piece == piece_index_t(piece); });
+		TEST_CHECK(i != cs.pieces.end());
+		if (i == cs.pieces.end()) continue;
+		TEST_EQUAL(int(i->blocks.size()), blocks_per_piece);
+		TEST_CHECK(std::count(i->blocks.begin(), i->blocks.end(), true) == blocks_per_piece);
+	}
+	TEST_CHECK(std::none_of(cs.pieces.begin(), cs.pieces.end()
+		, [](cached_piece_info const& pi) { return pi.piece >= piece_index_t(6); }));
+
+	// every piece was read once by the same peer. The first read of a piece
+	// that was read ahead (without a requester) doesn't make it frequently
+	// used
+	io.update_stats_counters(cnt);
+	TEST_EQUAL(cnt[counters::arc_mfu_size], 0);
+	TEST_CHECK(cnt[counters::arc_mru_size] > 0);
+
+	io.abort(true);
+}
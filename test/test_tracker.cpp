@@ -320,6 +320,97 @@ TORRENT_TEST(extract_peer_missing_port)
 		, errors::invalid_tracker_response, false);
 }
 
+// this needs to run before the other UDP tracker tests, since UDP connection
+// IDs are cached per tracker IP, for the life of the process
+TORRENT_TEST(udp_tracker_shared_connect)
+{
+	int const num_torrents = 5;
+
+	// hold back the connect response, to make sure all requests are waiting
+	// for it
+	int const udp_port = start_udp_tracker(address_v4::any(), lt::milliseconds(500));
+
+	settings_pack pack = settings();
+	pack.set_bool(settings_pack::announce_to_all_trackers, true);
+	pack.set_bool(settings_pack::announce_to_all_tiers, true);
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:48876");
+	pack.set_int(settings_pack::alert_mask, alert::all_categories);
+
+	std::unique_ptr<lt::session> s(new lt::session(pack));
+
+	char tracker_url[200];
+	std::snprintf(tracker_url, sizeof(tracker_url), "udp://127.0.0.1:%d/announce", udp_port);
+
+	error_code ec;
+	remove_all("tmp3_tracker", ec);
+	create_directory("tmp3_tracker", ec);
+
+	std::vector<torrent_handle> handles;
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		char name[50];
+		std::snprintf(name, sizeof(name), "temporary_%d", i);
+		std::shared_ptr<torrent_info> t = ::create_torrent(nullptr, name, 16 * 1024, 13, false);
+		t->add_tracker(tracker_url, 0);
+
+		add_torrent_params addp;
+		addp.flags |= add_torrent_params::flag_paused;
+		addp.flags &= ~add_torrent_params::flag_auto_managed;
+		addp.flags |= add_torrent_params::flag_seed_mode;
+		addp.ti = t;
+		addp.save_path = "tmp3_tracker";
+		handles.push_back(s->add_torrent(addp));
+	}
+
+	// all scrapes wait for the same connect, and are then sent as a single
+	// scrape message
+	for (auto const& h : handles) h.scrape_tracker();
+
+	int replies = 0;
+	time_point const end = clock_type::now() + seconds(10);
+	while (replies < num_torrents && clock_type::now() < end)
+	{
+		s->wait_for_alert(seconds(1));
+		std::vector<alert*> alerts;
+		s->pop_alerts(&alerts);
+		for (auto const a : alerts)
+		{
+			auto const* sr = alert_cast<scrape_reply_alert>(a);
+			if (!sr) continue;
+			++replies;
+
+			// the tracker reports the first two bytes of the info-hash
+			sha1_hash const ih = sr->handle.info_hash();
+			TEST_EQUAL(sr->complete, int(std::uint8_t(ih[0])));
+			TEST_EQUAL(sr->incomplete, int(std::uint8_t(ih[1])));
+		}
+	}
+
+	TEST_EQUAL(replies, num_torrents);
+	TEST_EQUAL(num_udp_connects(), 1);
+	TEST_EQUAL(num_udp_scrapes(), 1);
+
+	std::map<std::string, std::int64_t> cnt = get_counters(*s);
+	TEST_EQUAL(cnt["net.udp_tracker_connects_saved"], num_torrents - 1);
+	TEST_EQUAL(cnt["net.udp_tracker_scrapes_batched"], num_torrents - 1);
+
+	// the announces reuse the connection ID
+	for (auto const& h : handles) h.resume();
+
+	for (int i = 0; i < 50; ++i)
+	{
+		print_alerts(*s, "s");
+		if (num_udp_announces() == num_torrents) break;
+		std::this_thread::sleep_for(lt::milliseconds(100));
+	}
+
+	TEST_EQUAL(num_udp_announces(), num_torrents);
+	TEST_EQUAL(num_udp_connects(), 1);
+
+	s.reset();
+	stop_udp_tracker();
+}
+
 bool connect_alert(lt::alert const* a, tcp::endpoint& ep)
 {
 	if (peer_connect_alert const* pc = alert_cast<peer_connect_alert>(a))
@@ -40,6 +40,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "libtorrent/utp_stream.hpp"
 #include <tuple>
 #include <functional>
+#include <array>
+#include <vector>
 
 #include "test.hpp"
 #include "setup_transfer.hpp"
@@ -150,3 +152,223 @@ TORRENT_TEST(compare_less_wrap)
 	TEST_CHECK(compare_less_wrap(0xfff0, 0x000f, 0xffff)); // wrap
 	TEST_CHECK(!compare_less_wrap(0xfff0, 0xff00, 0xffff));
 }
+
+namespace {
+
+// the straight-forward, bit-by-bit, decoding of a SACK bitmask. Used as
+// the reference for sack_bit_offsets()
+int sack_bit_offsets_ref(std::vector<std::uint8_t> const& bitmask
+	, int const num_bits, std::uint16_t* offsets)
+{
+	int ret = 0;
+	for (int i = 0; i < num_bits; ++i)
+	{
+		if (bitmask[std::size_t(i / 8)] & (1 << (i % 8)))
+			offsets[ret++] = std::uint16_t(i);
+	}
+	return ret;
+}
+
+std::vector<std::uint8_t> make_sack(int const size, std::uint32_t seed)
+{
+	std::vector<std::uint8_t> ret(std::size_t(size), 0);
+	for (auto& b : ret)
+	{
+		seed = seed * 1664525 + 1013904223;
+		b = std::uint8_t(seed >> 24);
+	}
+	return ret;
+}
+
+}
+
+TORRENT_TEST(sack_bit_offsets)
+{
+	std::array<std::uint16_t, 255 * 8> offsets;
+	std::array<std::uint16_t, 255 * 8> expected;
+
+	std::vector<std::uint8_t> const empty(4, 0);
+	TEST_EQUAL(sack_bit_offsets(empty, 32, offsets), 0);
+
+	std::vector<std::uint8_t> const sack = { 0x01, 0x80, 0x00, 0x00, 0x10, 0xff };
+	TEST_EQUAL(sack_bit_offsets(sack, 48, offsets), 11);
+	TEST_EQUAL(offsets[0], 0);
+	TEST_EQUAL(offsets[1], 15);
+	TEST_EQUAL(offsets[2], 36);
+	TEST_EQUAL(offsets[3], 40);
+	TEST_EQUAL(offsets[10], 47);
+
+	// bits past num_bits are ignored
+	TEST_EQUAL(sack_bit_offsets(sack, 37, offsets), 3);
+	TEST_EQUAL(sack_bit_offsets(sack, 36, offsets), 2);
+	TEST_EQUAL(sack_bit_offsets(sack, 0, offsets), 0);
+
+	for (int size = 1; size <= 255; size += 7)
+	{
+		std::vector<std::uint8_t> const bits = make_sack(size, std::uint32_t(size));
+		for (int num_bits : { size * 8, size * 8 - 3, size * 4 + 1 })
+		{
+			int const n = sack_bit_offsets(bits, num_bits, offsets);
+			TEST_EQUAL(n, sack_bit_offsets_ref(bits, num_bits, expected.data()));
+			TEST_CHECK(std::equal(offsets.begin(), offsets.begin() + n, expected.begin()));
+		}
+	}
+}
+
+namespace {
+
+int const mtu = 1400;
+// 100 ms target delay (in microseconds) and RTT (in milliseconds)
+int const target = 100000;
+int const rtt = 100;
+
+std::int64_t packets(int const n) { return std::int64_t(n) * mtu * (1 << 16); }
+
+// acks one window worth of packets, one at a time, all with the same delay
+void ack_window(ledbat_state& s, int const delay, time_point const now)
+{
+	int const n = int((s.cwnd >> 16) / mtu);
+	for (int i = 0; i < n; ++i)
+		ledbat_plus_plus(s, mtu, delay, target, rtt, mtu, int(s.cwnd >> 16), now);
+}
+
+// a state past slow-start, with the next slowdown far in the future
+ledbat_state steady_state(int const num_packets, time_point const now)
+{
+	ledbat_state s;
+	s.cwnd = packets(num_packets);
+	s.ssthres = num_packets * mtu;
+	s.slow_start = false;
+	s.slowdown_start = now;
+	s.next_slowdown = now + hours(1);
+	return s;
+}
+
+} // anonymous namespace
+
+TORRENT_TEST(ledbat_plus_plus_decrease)
+{
+	time_point const now = clock_type::now();
+
+	// when the delay is above the target, the window shrinks in proportion
+	// to how far above it we are, regardless of its size. At twice the
+	// target, a window's worth of ACKs halves it (plus the additive gain of
+	// half a packet, since the gain is 1/2 with this RTT)
+	for (int const size : { 20, 100, 400 })
+	{
+		ledbat_state s = steady_state(size, now);
+		ack_window(s, 2 * target, now);
+		TEST_CHECK(s.cwnd >= packets(size) / 2);
+		TEST_CHECK(s.cwnd <= packets(size) / 2 + packets(1));
+		TEST_CHECK(!s.slow_start);
+
+		// at 25% above the target, it shrinks by about a quarter
+		s = steady_state(size, now);
+		ack_window(s, target + target / 4, now);
+		TEST_CHECK(s.cwnd >= packets(size) * 3 / 4);
+		TEST_CHECK(s.cwnd <= packets(size) * 3 / 4 + packets(1));
+	}
+
+	// the decrease is capped at half the window per RTT
+	ledbat_state s = steady_state(100, now);
+	ack_window(s, 10 * target, now);
+	TEST_CHECK(s.cwnd >= packets(50));
+
+	// it never goes below one packet. With a short RTT the gain is small
+	// (1/16), so the decrease would take it lower
+	s = steady_state(4, now);
+	for (int i = 0; i < 20; ++i)
+		ledbat_plus_plus(s, mtu, 2 * target, target, 10, mtu, mtu, now);
+	TEST_EQUAL(s.cwnd, packets(1));
+
+	// below the target, the window grows by at most one packet per RTT
+	s = steady_state(100, now);
+	ack_window(s, target / 2, now);
+	TEST_CHECK(s.cwnd > packets(100));
+	TEST_CHECK(s.cwnd <= packets(101));
+}
+
+TORRENT_TEST(ledbat_plus_plus_slow_start_exit)
+{
+	time_point const now = clock_type::now();
+
+	ledbat_state s;
+	s.cwnd = packets(10);
+
+	// below 3/4 of the target we stay in slow-start, growing the window by
+	// the acked bytes times the gain (1/2 with this RTT)
+	ledbat_plus_plus(s, mtu, target * 3 / 4 - 1, target, rtt, mtu, 10 * mtu, now);
+	TEST_CHECK(s.slow_start);
+	TEST_EQUAL(s.cwnd, packets(10) + packets(1) / 2);
+	TEST_EQUAL(s.ssthres, 0);
+
+	// at 3/4 of the target we leave it, remembering the window as the
+	// slow-start threshold
+	s.cwnd = packets(10);
+	ledbat_plus_plus(s, mtu, target * 3 / 4, target, rtt, mtu, 10 * mtu, now);
+	TEST_CHECK(!s.slow_start);
+	TEST_EQUAL(s.ssthres, 10 * mtu);
+	TEST_CHECK(s.next_slowdown == min_time());
+
+	// growing past the slow-start threshold ends it too
+	s = ledbat_state();
+	s.cwnd = packets(10);
+	s.ssthres = 10 * mtu + mtu / 4;
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, 10 * mtu, now);
+	TEST_CHECK(!s.slow_start);
+	TEST_EQUAL(s.ssthres, 10 * mtu + mtu / 4);
+}
+
+TORRENT_TEST(ledbat_plus_plus_slowdown)
+{
+	time_point now = clock_type::now();
+
+	// we just left slow-start
+	ledbat_state s;
+	s.cwnd = packets(50);
+	s.ssthres = 50 * mtu;
+	s.slow_start = false;
+
+	// the first slowdown is scheduled two RTTs later
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, 50 * mtu, now);
+	TEST_CHECK(s.next_slowdown == now + milliseconds(2 * rtt));
+	TEST_CHECK(s.slowdown_end == min_time());
+
+	now += milliseconds(2 * rtt);
+	std::int64_t const cwnd = s.cwnd;
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, 50 * mtu, now);
+
+	// the slowdown holds the window at two packets for two RTTs
+	time_point const slowdown_start = now;
+	TEST_EQUAL(s.cwnd, packets(2));
+	TEST_EQUAL(s.ssthres, int(cwnd >> 16));
+	TEST_CHECK(s.slowdown_start == slowdown_start);
+	TEST_CHECK(s.slowdown_end == now + milliseconds(2 * rtt));
+	TEST_CHECK(!s.slow_start);
+
+	now += milliseconds(rtt);
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, 2 * mtu, now);
+	TEST_EQUAL(s.cwnd, packets(2));
+
+	// then slow-starts back up to the window it had before
+	now += milliseconds(rtt);
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, 2 * mtu, now);
+	TEST_CHECK(s.slow_start);
+	TEST_CHECK(s.slowdown_end == min_time());
+	TEST_CHECK(s.cwnd > packets(2));
+
+	int acks = 0;
+	while (s.slow_start && acks < 1000)
+	{
+		now += milliseconds(1);
+		ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, int(s.cwnd >> 16), now);
+		++acks;
+	}
+	TEST_CHECK(!s.slow_start);
+	TEST_CHECK(s.cwnd >= cwnd);
+
+	// the next slowdown is scheduled so that slowing down and recovering
+	// takes about 10% of the time
+	ledbat_plus_plus(s, mtu, 0, target, rtt, mtu, int(s.cwnd >> 16), now);
+	TEST_CHECK(s.next_slowdown == now + (now - slowdown_start) * 9);
+}
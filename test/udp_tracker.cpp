@@ -55,10 +55,16 @@ struct udp_tracker
 
 	lt::io_service m_ios;
 	std::atomic<int> m_udp_announces{0};
+	std::atomic<int> m_udp_connects{0};
+	std::atomic<int> m_udp_scrapes{0};
 	udp::socket m_socket{m_ios};
 	int m_port = 0;
 	bool m_abort = false;
 
+	// connect responses are held back this long, to let requests pile up
+	// behind the connect
+	lt::milliseconds m_connect_delay;
+
 	std::shared_ptr<std::thread> m_thread;
 
 	void on_udp_receive(error_code const& ec, size_t const bytes_transferred
@@ -100,8 +106,11 @@ struct udp_tracker
 						, int(bytes_transferred));
 					return;
 				}
+				++m_udp_connects;
 				std::printf("%s: UDP connect from %s\n", time_now_string()
 					, print_endpoint(*from).c_str());
+				if (m_connect_delay > lt::milliseconds(0))
+					std::this_thread::sleep_for(m_connect_delay);
 				ptr = buffer;
 				detail::write_uint32(0, ptr); // action = connect
 				detail::write_uint32(transaction_id, ptr); // transaction_id
@@ -160,10 +169,39 @@ struct udp_tracker
 				else std::printf("%s: UDP sent response to: %s\n"
 					, time_now_string(), print_endpoint(*from).c_str());
 				break;
-			case 2:
-				// ignore scrapes
-				std::printf("%s: UDP scrape (ignored)\n", time_now_string());
+			case 2: // scrape
+			{
+				if (bytes_transferred < 36 || (bytes_transferred - 16) % 20 != 0)
+				{
+					std::printf("invalid scrape message: %d Bytes\n"
+						, int(bytes_transferred));
+					return;
+				}
+
+				++m_udp_scrapes;
+				int const num_hashes = int((bytes_transferred - 16) / 20);
+				std::printf("%s: UDP scrape [%d] %d info-hashes\n", time_now_string()
+					, int(m_udp_scrapes), num_hashes);
+
+				// the stats for each info-hash are taken from its first two
+				// bytes, to let the client tell the responses apart
+				char response[8 + 12 * 74];
+				char* out = response;
+				detail::write_uint32(2, out); // action = scrape
+				detail::write_uint32(transaction_id, out); // transaction_id
+				for (int i = 0; i < num_hashes && i < 74; ++i)
+				{
+					char const* ih = buffer + 16 + i * 20;
+					detail::write_uint32(std::uint8_t(ih[0]), out); // complete
+					detail::write_uint32(0, out); // downloaded
+					detail::write_uint32(std::uint8_t(ih[1]), out); // incomplete
+				}
+				m_socket.send_to(boost::asio::buffer(response
+					, static_cast<std::size_t>(out - response)), *from, 0, e);
+				if (e) std::printf("%s: UDP send_to failed. ERROR: %s\n"
+					, time_now_string(), e.message().c_str());
 				break;
+			}
 			default:
 				std::printf("%s: UDP unknown message: %d\n", time_now_string()
 					, action);
@@ -175,7 +213,8 @@ struct udp_tracker
 			, std::bind(&udp_tracker::on_udp_receive, this, _1, _2, from, buffer, size));
 	}
 
-	explicit udp_tracker(address iface)
+	udp_tracker(address iface, lt::milliseconds const connect_delay)
+		: m_connect_delay(connect_delay)
 	{
 		error_code ec;
 		m_socket.open(iface.is_v4() ? udp::v4() : udp::v6(), ec);
@@ -224,6 +263,8 @@ struct udp_tracker
 	int port() const { return m_port; }
 
 	int num_hits() const { return m_udp_announces; }
+	int num_connects() const { return m_udp_connects; }
+	int num_scrapes() const { return m_udp_scrapes; }
 
 	void thread_fun()
 	{
@@ -251,10 +292,10 @@ namespace {
 std::shared_ptr<udp_tracker> g_udp_tracker;
 }
 
-int start_udp_tracker(address iface)
+int start_udp_tracker(address iface, lt::milliseconds const connect_delay)
 {
 	TORRENT_ASSERT(!g_udp_tracker);
-	g_udp_tracker.reset(new udp_tracker(iface));
+	g_udp_tracker.reset(new udp_tracker(iface, connect_delay));
 	return g_udp_tracker->port();
 }
 
@@ -265,6 +306,18 @@ int num_udp_announces()
 	return 0;
 }
 
+int num_udp_connects()
+{
+	if (g_udp_tracker) return g_udp_tracker->num_connects();
+	return 0;
+}
+
+int num_udp_scrapes()
+{
+	if (g_udp_tracker) return g_udp_tracker->num_scrapes();
+	return 0;
+}
+
 void stop_udp_tracker()
 {
 	g_udp_tracker.reset();
@@ -32,13 +32,23 @@ POSSIBILITY OF SUCH DAMAGE.
 
 #include "test.hpp" // for EXPORT
 #include "libtorrent/address.hpp"
+#include "libtorrent/time.hpp"
 
-// returns the port the udp tracker is running on
+// returns the port the udp tracker is running on. Responses to connect
+// messages are delayed by connect_delay
 int EXPORT start_udp_tracker(lt::address iface
-	= lt::address_v4::any());
+	= lt::address_v4::any()
+	, lt::milliseconds connect_delay = lt::milliseconds(0));
 
 // the number of udp tracker announces received
 int EXPORT num_udp_announces();
 
+// the number of udp tracker connect messages received
+int EXPORT num_udp_connects();
+
+// the number of udp tracker scrape messages received (each may carry
+// several info-hashes)
+int EXPORT num_udp_scrapes();
+
 void EXPORT stop_udp_tracker();
 
@@ -0,0 +1,257 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/bdecode.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/entry.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_bdecode [options] [file...]\n\n"
+		"measures bdecode() throughput on a corpus of synthetic DHT messages\n"
+		"and a large synthetic .torrent file, or on the files given on the\n"
+		"command line\n\n"
+		"OPTIONS:\n"
+		"-n <iterations>  the number of times to decode the corpus (default 200)\n"
+		"-f <files>       the number of files in the synthetic torrent (default 50000)\n");
+}
+
+std::string random_bytes(std::mt19937& rng, int const len)
+{
+	std::string ret(std::size_t(len), '\0');
+	for (char& c : ret) c = char(rng());
+	return ret;
+}
+
+std::vector<char> encode(entry const& e)
+{
+	std::vector<char> ret;
+	bencode(std::back_inserter(ret), e);
+	return ret;
+}
+
+// a mix of queries and responses, roughly like what a DHT node sees
+std::vector<std::vector<char>> dht_messages(int const count)
+{
+	std::mt19937 rng(0x1337);
+	std::vector<std::vector<char>> ret;
+	char const* queries[] = { "ping", "find_node", "get_peers", "announce_peer" };
+	for (int i = 0; i < count; ++i)
+	{
+		entry e;
+		e["t"] = random_bytes(rng, 2);
+		e["v"] = "LT\x01\x02";
+		if (i % 2 == 0)
+		{
+			char const* q = queries[rng() % 4];
+			e["y"] = "q";
+			e["q"] = q;
+			entry& a = e["a"];
+			a["id"] = random_bytes(rng, 20);
+			if (q != queries[0]) a["info_hash"] = random_bytes(rng, 20);
+			if (q == queries[3])
+			{
+				a["port"] = int(rng() % 65536);
+				a["token"] = random_bytes(rng, 8);
+				a["implied_port"] = 1;
+			}
+		}
+		else
+		{
+			e["y"] = "r";
+			entry& r = e["r"];
+			r["id"] = random_bytes(rng, 20);
+			r["nodes"] = random_bytes(rng, 26 * 8);
+			if (rng() % 2)
+			{
+				r["token"] = random_bytes(rng, 8);
+				entry::list_type& values = r["values"].list();
+				int const num_values = int(rng() % 50);
+				for (int v = 0; v < num_values; ++v)
+					values.push_back(random_bytes(rng, 6));
+			}
+		}
+		ret.push_back(encode(e));
+	}
+	return ret;
+}
+
+std::vector<char> large_torrent(int const num_files)
+{
+	std::mt19937 rng(0x4242);
+	entry e;
+	e["announce"] = "http://tracker.example.com/announce";
+	e["creation date"] = 1500000000;
+	entry& info = e["info"];
+	info["name"] = "synthetic torrent";
+	info["piece length"] = 4 * 1024 * 1024;
+	std::int64_t total_size = 0;
+	entry::list_type& files = info["files"].list();
+	for (int i = 0; i < num_files; ++i)
+	{
+		entry f;
+		std::int64_t const size = std::int64_t(rng() % 100000000);
+		f["length"] = size;
+		total_size += size;
+		entry::list_type& path = f["path"].list();
+		path.push_back("directory-" + std::to_string(i / 100));
+		path.push_back("file-" + std::to_string(i) + ".dat");
+		files.push_back(std::move(f));
+	}
+	int const num_pieces = int((total_size + 4 * 1024 * 1024 - 1) / (4 * 1024 * 1024));
+	info["pieces"] = random_bytes(rng, num_pieces * 20);
+	return encode(e);
+}
+
+bool load_file(char const* filename, std::vector<char>& buf)
+{
+	std::ifstream in(filename, std::ios_base::binary);
+	if (!in) return false;
+	buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// decodes every buffer in the corpus ``iterations`` times, into a new node
+// every time or into the same node, depending on ``reuse``. Returns the sum of
+// the types of the root nodes, to keep the decoding from being optimized away
+int run(char const* name, std::vector<std::vector<char>> const& corpus
+	, int const iterations, bool const reuse)
+{
+	std::size_t bytes = 0;
+	std::size_t messages = 0;
+	int types = 0;
+	bdecode_node reused;
+	error_code ec;
+	auto const start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+	{
+		for (auto const& buf : corpus)
+		{
+			if (reuse)
+			{
+				bdecode(buf.data(), buf.data() + buf.size(), reused, ec
+					, nullptr, 100, 10000000);
+				types += int(reused.type());
+			}
+			else
+			{
+				bdecode_node const e = bdecode(buf, ec, nullptr, 100, 10000000);
+				types += int(e.type());
+			}
+			if (ec)
+			{
+				std::fprintf(stderr, "failed to decode: %s\n", ec.message().c_str());
+				return 0;
+			}
+			bytes += buf.size();
+			++messages;
+		}
+	}
+	double const elapsed = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	std::printf("%-28s %8.1f MB/s %10.1f ns/message\n", name
+		, double(bytes) / elapsed / 1000000.0
+		, elapsed * 1000000000.0 / double(messages));
+	return types;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int iterations = 200;
+	int num_files = 50000;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': iterations = value; break;
+			case 'f': num_files = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (iterations <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	if (argc > 0)
+	{
+		std::vector<std::vector<char>> corpus;
+		for (int i = 0; i < argc; ++i)
+		{
+			std::vector<char> buf;
+			if (!load_file(argv[i], buf))
+			{
+				std::fprintf(stderr, "failed to load \"%s\"\n", argv[i]);
+				return 1;
+			}
+			corpus.push_back(std::move(buf));
+		}
+		return run("files", corpus, iterations, false) == 0 ? 1 : 0;
+	}
+
+	int total = 0;
+	std::vector<std::vector<char>> const dht = dht_messages(10000);
+	total += run("DHT messages (new node)", dht, iterations, false);
+	total += run("DHT messages (reused node)", dht, iterations, true);
+
+	std::vector<std::vector<char>> const torrent = { large_torrent(num_files) };
+	std::printf("synthetic torrent: %d files, %d bytes\n", num_files
+		, int(torrent.front().size()));
+	total += run("torrent", torrent, iterations / 10 + 1, false);
+	return total == 0 ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/session.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/alert_types.hpp"
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/torrent_info.hpp"
+#include "libtorrent/bencode.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace lt;
+
+namespace {
+
+// every file is exactly one piece, which makes the resume data check look at
+// every single file
+int const file_size = 16 * 1024;
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_check_resume [options] <directory>\n\n"
+		"adds torrents with resume data claiming all pieces to a session and\n"
+		"reports the time until all of them have been checked. Run with a cold\n"
+		"disk cache (or on a network filesystem) to see the effect of stat()\n"
+		"latency.\n\n"
+		"OPTIONS:\n"
+		"-c             create the (sparse) files in <directory> first\n"
+		"-n <torrents>  the number of torrents (default 1000)\n"
+		"-f <files>     the number of files per torrent (default 1000)\n"
+		"-s <threads>   the number of stat threads per check (default 4)\n"
+		"-a <threads>   the number of disk threads (default 4)\n");
+}
+
+void make_directory(std::string const& p)
+{
+#ifdef _WIN32
+	_mkdir(p.c_str());
+#else
+	mkdir(p.c_str(), 0777);
+#endif
+}
+
+std::string torrent_name(int const t) { return "t" + std::to_string(t); }
+std::string file_name(int const f) { return "file-" + std::to_string(f); }
+
+bool create_files(std::string const& dir, int const num_torrents, int const num_files)
+{
+	make_directory(dir);
+	for (int t = 0; t < num_torrents; ++t)
+	{
+		std::string const torrent_dir = dir + "/" + torrent_name(t);
+		make_directory(torrent_dir);
+		for (int f = 0; f < num_files; ++f)
+		{
+			// only write the last byte, to leave the file sparse
+			std::ofstream out(torrent_dir + "/" + file_name(f), std::ios::binary);
+			out.seekp(file_size - 1);
+			out.put('\0');
+			if (!out)
+			{
+				std::fprintf(stderr, "failed to create file in \"%s\"\n", torrent_dir.c_str());
+				return false;
+			}
+		}
+		std::fprintf(stderr, "\rcreating files: %d/%d", t + 1, num_torrents);
+	}
+	std::fprintf(stderr, "\n");
+	return true;
+}
+
+std::shared_ptr<torrent_info> make_torrent(int const t, int const num_files)
+{
+	file_storage fs;
+	for (int f = 0; f < num_files; ++f)
+		fs.add_file(torrent_name(t) + "/" + file_name(f), file_size);
+
+	// the piece hashes are never checked, only the file sizes are. The
+	// comment makes the info-hash of every torrent unique
+	create_torrent ct(fs, file_size);
+	ct.set_comment(torrent_name(t).c_str());
+	for (piece_index_t p(0); p < fs.end_piece(); ++p)
+		ct.set_hash(p, sha1_hash());
+
+	std::vector<char> buf;
+	bencode(std::back_inserter(buf), ct.generate());
+	error_code ec;
+	auto ti = std::make_shared<torrent_info>(buf.data(), int(buf.size()), ec);
+	if (ec) return nullptr;
+	return ti;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_torrents = 1000;
+	int num_files = 1000;
+	int stat_threads = 4;
+	int aio_threads = 4;
+	bool create = false;
+
+	--argc;
+	++argv;
+	while (argc > 0 && argv[0][0] == '-')
+	{
+		if (argv[0][1] == 'c')
+		{
+			create = true;
+			--argc;
+			++argv;
+			continue;
+		}
+		if (argc < 2)
+		{
+			print_usage();
+			return 1;
+		}
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': num_torrents = value; break;
+			case 'f': num_files = value; break;
+			case 's': stat_threads = value; break;
+			case 'a': aio_threads = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || num_torrents <= 0 || num_files <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const save_path = argv[0];
+	if (create && !create_files(save_path, num_torrents, num_files))
+		return 1;
+
+	std::vector<add_torrent_params> torrents;
+	for (int t = 0; t < num_torrents; ++t)
+	{
+		add_torrent_params atp;
+		atp.ti = make_torrent(t, num_files);
+		if (!atp.ti)
+		{
+			std::fprintf(stderr, "failed to create torrent\n");
+			return 1;
+		}
+		atp.save_path = save_path;
+		atp.flags &= ~(add_torrent_params::flag_auto_managed
+			| add_torrent_params::flag_paused);
+		atp.have_pieces.resize(atp.ti->num_pieces(), true);
+		torrents.push_back(std::move(atp));
+		std::fprintf(stderr, "\rcreating torrents: %d/%d", t + 1, num_torrents);
+	}
+	std::fprintf(stderr, "\n");
+
+	settings_pack pack;
+	pack.set_int(settings_pack::alert_mask, alert::status_notification
+		| alert::error_notification);
+	pack.set_str(settings_pack::listen_interfaces, "127.0.0.1:0");
+	pack.set_bool(settings_pack::enable_dht, false);
+	pack.set_bool(settings_pack::enable_lsd, false);
+	pack.set_bool(settings_pack::enable_upnp, false);
+	pack.set_bool(settings_pack::enable_natpmp, false);
+	pack.set_int(settings_pack::stat_threads, stat_threads);
+	pack.set_int(settings_pack::aio_threads, aio_threads);
+	session ses(pack);
+
+	auto const start = std::chrono::steady_clock::now();
+	for (auto& atp : torrents) ses.async_add_torrent(std::move(atp));
+
+	int checked = 0;
+	int rejected = 0;
+	std::vector<alert*> alerts;
+	while (checked + rejected < num_torrents)
+	{
+		ses.wait_for_alert(seconds(1));
+		ses.pop_alerts(&alerts);
+		for (alert const* a : alerts)
+		{
+			if (alert_cast<torrent_checked_alert>(a)) ++checked;
+			else if (auto const* r = alert_cast<fastresume_rejected_alert>(a))
+			{
+				// a rejected torrent falls back to a full check, which
+				// would be benchmarking something else
+				if (rejected == 0)
+					std::fprintf(stderr, "\nresume data rejected: %s\n", r->message().c_str());
+				++rejected;
+			}
+			else if (auto const* e = alert_cast<add_torrent_alert>(a))
+			{
+				if (e->error)
+				{
+					std::fprintf(stderr, "\nfailed to add torrent: %s\n"
+						, e->error.message().c_str());
+					return 1;
+				}
+			}
+		}
+		std::fprintf(stderr, "\rchecked: %d/%d", checked + rejected, num_torrents);
+	}
+	auto const end = std::chrono::steady_clock::now();
+	std::fprintf(stderr, "\n");
+
+	double const elapsed = std::chrono::duration<double>(end - start).count();
+	std::printf("checked %d torrents (%d files) in %.2f s, %d rejected\n"
+		, num_torrents, num_torrents * num_files, elapsed, rejected);
+	return rejected > 0 ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/create_torrent.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_create_torrent [options] <file or directory>\n\n"
+		"hashes the files like creating a torrent and reports the throughput\n\n"
+		"OPTIONS:\n"
+		"-r <threads>   the number of reader threads (default 2)\n"
+		"-t <threads>   the number of hasher threads (default: one per core)\n"
+		"-s <size>      the size of each read, in kiB (default 4096)\n"
+		"-p <size>      the piece size, in kiB (default 1024)\n");
+}
+
+std::string branch_path(std::string const& f)
+{
+	if (f.empty()) return f;
+	if (f == "/") return "";
+
+	int len = int(f.size());
+	// if the last character is / or \ ignore it
+	if (f[len - 1] == '/' || f[len - 1] == '\\') --len;
+	while (len > 0)
+	{
+		--len;
+		if (f[len] == '/' || f[len] == '\\')
+			break;
+	}
+
+	if (f[len] == '/' || f[len] == '\\') ++len;
+	return std::string(f.c_str(), std::size_t(len));
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	piece_hash_settings sett;
+	int piece_size = 1024 * 1024;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'r': sett.reader_threads = value; break;
+			case 't': sett.hasher_threads = value; break;
+			case 's': sett.read_size = value * 1024; break;
+			case 'p': piece_size = value * 1024; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const path = argv[0];
+	file_storage fs;
+	add_files(fs, path);
+	if (fs.num_files() == 0)
+	{
+		std::fprintf(stderr, "no files found in \"%s\"\n", path.c_str());
+		return 1;
+	}
+
+	create_torrent t(fs, piece_size);
+	int const num_pieces = t.num_pieces();
+
+	auto const start = std::chrono::steady_clock::now();
+	error_code ec;
+	set_piece_hashes(t, branch_path(path), sett, [&](piece_index_t const p)
+	{
+		std::fprintf(stderr, "\r%d/%d", static_cast<int>(p) + 1, num_pieces);
+	}, ec);
+	auto const end = std::chrono::steady_clock::now();
+	std::fprintf(stderr, "\n");
+
+	if (ec)
+	{
+		std::fprintf(stderr, "failed to hash files: %s\n", ec.message().c_str());
+		return 1;
+	}
+
+	double const seconds = std::chrono::duration<double>(end - start).count();
+	double const mbytes = double(t.files().total_size()) / 1000000.0;
+	std::printf("hashed %.1f MB (%d files, %d pieces) in %.2f s: %.1f MB/s\n"
+		, mbytes, fs.num_files(), num_pieces, seconds
+		, mbytes / std::max(seconds, 0.000001));
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pe_crypto.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if !defined TORRENT_DISABLE_ENCRYPTION && !defined TORRENT_DISABLE_EXTENSIONS
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_dh [options]\n\n"
+		"measures the number of Diffie-Hellman key exchanges per second, with\n"
+		"keypairs generated as part of the handshake and precomputed (as by\n"
+		"the dh_key_pool)\n\n"
+		"OPTIONS:\n"
+		"-n <handshakes>  the number of handshakes to time (default 200)\n");
+}
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point const start)
+{
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int rounds = 200;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': rounds = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc > 0 || rounds <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	// both sides generate a keypair and compute the shared secret
+	auto start = clock_type::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		dh_key_exchange DH1, DH2;
+		DH1.compute_secret(DH2.get_local_key());
+		DH2.compute_secret(DH1.get_local_key());
+		if (DH1.get_secret() != DH2.get_secret())
+		{
+			std::fprintf(stderr, "shared secrets differ\n");
+			return 1;
+		}
+	}
+	double const full_time = seconds_since(start);
+
+	// with precomputed keypairs, only the shared secret is computed
+	std::vector<dh_keypair> keys;
+	for (int i = 0; i < rounds * 2; ++i) keys.push_back(generate_dh_keypair());
+	start = clock_type::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		dh_key_exchange DH1(keys[std::size_t(i * 2)]);
+		dh_key_exchange DH2(keys[std::size_t(i * 2 + 1)]);
+		DH1.compute_secret(DH2.get_local_key());
+		DH2.compute_secret(DH1.get_local_key());
+		if (DH1.get_secret() != DH2.get_secret())
+		{
+			std::fprintf(stderr, "shared secrets differ\n");
+			return 1;
+		}
+	}
+	double const pooled_time = seconds_since(start);
+
+	std::printf("DH handshakes: %.0f /s, with precomputed keys: %.0f /s\n"
+		, rounds / full_time, rounds / pooled_time);
+	return 0;
+}
+
+#else
+
+int main()
+{
+	std::fprintf(stderr, "bench_dh requires encryption support\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/file.hpp"
+#include "libtorrent/allocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace lt;
+
+namespace {
+
+int const block_size = 16 * 1024;
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_direct_io [options] <file>\n\n"
+		"writes <file> and reads it back in random order, the way a seed\n"
+		"does, once through the OS cache and once with direct I/O. Reports\n"
+		"the throughput and how much of the file ends up in the OS cache, in\n"
+		"addition to libtorrent's own disk cache.\n\n"
+		"OPTIONS:\n"
+		"-s <MiB>       the size of the file (default 1024)\n"
+		"-t <threads>   the number of reader threads (default 4)\n");
+}
+
+// the number of bytes of the file resident in the OS page cache
+std::int64_t cached_bytes(std::string const& path)
+{
+#ifdef _WIN32
+	TORRENT_UNUSED(path);
+	return -1;
+#else
+	int const fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return -1;
+	off_t const size = ::lseek(fd, 0, SEEK_END);
+	std::int64_t ret = -1;
+	void* const map = size > 0
+		? ::mmap(nullptr, std::size_t(size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (map != MAP_FAILED)
+	{
+		long const page = ::sysconf(_SC_PAGESIZE);
+#ifdef __APPLE__
+		std::vector<char> pages(std::size_t((size + page - 1) / page));
+#else
+		std::vector<unsigned char> pages(std::size_t((size + page - 1) / page));
+#endif
+		if (::mincore(map, std::size_t(size), pages.data()) == 0)
+		{
+			ret = 0;
+			for (auto const p : pages) if (p & 1) ret += page;
+		}
+		::munmap(map, std::size_t(size));
+	}
+	::close(fd);
+	return ret;
+#endif
+}
+
+// evict the file from the OS page cache, to start from a cold cache
+void drop_cache(std::string const& path)
+{
+#if !defined _WIN32 && defined POSIX_FADV_DONTNEED
+	int const fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	::fdatasync(fd);
+	::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	::close(fd);
+#else
+	TORRENT_UNUSED(path);
+#endif
+}
+
+void print_cached(std::string const& path)
+{
+	std::int64_t const cached = cached_bytes(path);
+	if (cached < 0) std::printf("  OS cache:      n/a\n");
+	else std::printf("  OS cache:      %.1f MiB\n", double(cached) / 1024 / 1024);
+}
+
+double seconds(std::chrono::high_resolution_clock::duration const d)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000000.0;
+}
+
+bool run(std::string const& path, std::uint32_t const flags, int const num_blocks
+	, int const num_threads)
+{
+	using clock = std::chrono::high_resolution_clock;
+	double const mib = double(num_blocks) * block_size / 1024 / 1024;
+
+	// write the file sequentially
+	drop_cache(path);
+	{
+		error_code ec;
+		file f(path, file::read_write | flags, ec);
+		if (ec)
+		{
+			std::fprintf(stderr, "failed to open \"%s\": %s\n", path.c_str(), ec.message().c_str());
+			return false;
+		}
+		char* buf = page_aligned_allocator::malloc(block_size);
+		std::fill(buf, buf + block_size, 'x');
+		auto const start = clock::now();
+		for (int i = 0; i < num_blocks; ++i)
+		{
+			iovec_t b = {buf, std::size_t(block_size)};
+			if (f.writev(std::int64_t(i) * block_size, b, ec) != block_size || ec)
+			{
+				std::fprintf(stderr, "write failed: %s\n", ec.message().c_str());
+				page_aligned_allocator::free(buf);
+				return false;
+			}
+		}
+		double const t = seconds(clock::now() - start);
+		page_aligned_allocator::free(buf);
+		std::printf("  write:         %.0f MiB/s\n", mib / t);
+	}
+	print_cached(path);
+
+	// read every block once, in random order, from several threads
+	drop_cache(path);
+	std::vector<int> order(static_cast<std::size_t>(num_blocks));
+	for (int i = 0; i < num_blocks; ++i) order[std::size_t(i)] = i;
+	std::shuffle(order.begin(), order.end(), std::mt19937(0x1337));
+
+	error_code ec;
+	file f(path, file::read_only | flags, ec);
+	if (ec)
+	{
+		std::fprintf(stderr, "failed to open \"%s\": %s\n", path.c_str(), ec.message().c_str());
+		return false;
+	}
+	std::atomic<int> next{0};
+	std::atomic<bool> failed{false};
+	auto const start = clock::now();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; ++t)
+	{
+		threads.emplace_back([&]
+		{
+			char* buf = page_aligned_allocator::malloc(block_size);
+			for (int i = next++; i < num_blocks; i = next++)
+			{
+				error_code err;
+				iovec_t b = {buf, std::size_t(block_size)};
+				if (f.readv(std::int64_t(order[std::size_t(i)]) * block_size, b, err) != block_size)
+					failed = true;
+			}
+			page_aligned_allocator::free(buf);
+		});
+	}
+	for (auto& t : threads) t.join();
+	double const t = seconds(clock::now() - start);
+	if (failed)
+	{
+		std::fprintf(stderr, "read failed\n");
+		return false;
+	}
+	std::printf("  random read:   %.0f MiB/s\n", mib / t);
+	print_cached(path);
+	return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int size_mib = 1024;
+	int num_threads = 4;
+
+	--argc;
+	++argv;
+	while (argc > 0 && argv[0][0] == '-')
+	{
+		if (argc < 2)
+		{
+			print_usage();
+			return 1;
+		}
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 's': size_mib = value; break;
+			case 't': num_threads = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || size_mib <= 0 || num_threads <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const path = argv[0];
+	int const num_blocks = int(std::int64_t(size_mib) * 1024 * 1024 / block_size);
+
+	std::printf("%d MiB, %d reader threads\n\nbuffered:\n", size_mib, num_threads);
+	if (!run(path, 0, num_blocks, num_threads)) return 1;
+	std::printf("\ndirect I/O:\n");
+	if (!run(path, file::direct_io, num_blocks, num_threads)) return 1;
+
+	std::remove(path.c_str());
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/file_storage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#if defined __linux__
+#include <unistd.h>
+#endif
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_file_storage [options]\n\n"
+		"builds a synthetic file_storage and reports its memory footprint and\n"
+		"the latency of looking up files by offset\n\n"
+		"OPTIONS:\n"
+		"-n <files>     the number of files (default 5000000)\n"
+		"-d <files>     the number of files per directory (default 1000)\n"
+		"-s <size>      the average file size, in bytes (default 4096)\n"
+		"-p <size>      the piece size, in kiB (default 1024)\n"
+		"-l <lookups>   the number of lookups to time (default 1000000)\n");
+}
+
+// the resident set size of this process, in bytes. Only supported on linux,
+// returns 0 elsewhere
+std::int64_t resident_memory()
+{
+#if defined __linux__
+	FILE* f = std::fopen("/proc/self/statm", "r");
+	if (f == nullptr) return 0;
+	long pages = 0;
+	long resident = 0;
+	int const ret = std::fscanf(f, "%ld %ld", &pages, &resident);
+	std::fclose(f);
+	if (ret != 2) return 0;
+	return std::int64_t(resident) * ::sysconf(_SC_PAGESIZE);
+#else
+	return 0;
+#endif
+}
+
+double elapsed_ns(std::chrono::steady_clock::time_point const start, int const n)
+{
+	auto const end = std::chrono::steady_clock::now();
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count())
+		/ std::max(n, 1);
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_files = 5000000;
+	int files_per_dir = 1000;
+	int file_size = 4096;
+	int piece_size = 1024 * 1024;
+	int num_lookups = 1000000;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': num_files = value; break;
+			case 'd': files_per_dir = value; break;
+			case 's': file_size = value; break;
+			case 'p': piece_size = value * 1024; break;
+			case 'l': num_lookups = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 0 || num_files <= 0 || files_per_dir <= 0 || file_size <= 0
+		|| piece_size <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::mt19937 rng(0x1337);
+	std::uniform_int_distribution<int> size_dist(0, file_size * 2);
+
+	std::int64_t const mem_before = resident_memory();
+	auto start = std::chrono::steady_clock::now();
+
+	file_storage fs;
+	for (int i = 0; i < num_files; ++i)
+	{
+		std::string const path = "bench/dir-" + std::to_string(i / files_per_dir)
+			+ "/file-" + std::to_string(i);
+		fs.add_file(path, size_dist(rng));
+	}
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(int((fs.total_size() + piece_size - 1) / piece_size));
+
+	double const build_ns = elapsed_ns(start, num_files);
+	std::int64_t const mem_after = resident_memory();
+
+	std::printf("files: %d directories: %d pieces: %d total size: %.1f GB\n"
+		, fs.num_files(), int(fs.paths().size()), fs.num_pieces()
+		, double(fs.total_size()) / 1000000000.0);
+	std::printf("build: %.0f ns per file\n", build_ns);
+	if (mem_after > 0)
+	{
+		std::printf("memory: %.1f MB (%.1f bytes per file)\n"
+			, double(mem_after - mem_before) / 1000000.0
+			, double(mem_after - mem_before) / num_files);
+	}
+
+	std::uniform_int_distribution<std::int64_t> offset_dist(0, fs.total_size() - 1);
+	std::uniform_int_distribution<int> piece_dist(0, fs.num_pieces() - 1);
+	std::uniform_int_distribution<int> file_dist(0, fs.num_files() - 1);
+
+	// accumulate the results to keep the lookups from being optimized away
+	std::int64_t sum = 0;
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_lookups; ++i)
+		sum += static_cast<int>(fs.file_index_at_offset(offset_dist(rng)));
+	std::printf("file_index_at_offset: %.0f ns\n", elapsed_ns(start, num_lookups));
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_lookups; ++i)
+	{
+		std::vector<file_slice> const slices = fs.map_block(
+			piece_index_t(piece_dist(rng)), 0, 0x4000);
+		sum += std::int64_t(slices.size());
+	}
+	std::printf("map_block (16 kiB): %.0f ns\n", elapsed_ns(start, num_lookups));
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_lookups; ++i)
+	{
+		peer_request const r = fs.map_file(file_index_t(file_dist(rng)), 0, 1);
+		sum += r.start;
+	}
+	std::printf("map_file: %.0f ns\n", elapsed_ns(start, num_lookups));
+
+	return sum == 42 ? 1 : 0;
+}
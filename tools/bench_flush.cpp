@@ -0,0 +1,200 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/disk_io_thread.hpp"
+#include "libtorrent/disk_interface.hpp"
+#include "libtorrent/file_storage.hpp"
+#include "libtorrent/storage.hpp"
+#include "libtorrent/settings_pack.hpp"
+#include "libtorrent/performance_counters.hpp"
+#include "libtorrent/io_service.hpp"
+#include "libtorrent/aux_/path.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+int const block_size = 16 * 1024;
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_flush [options] <directory>\n\n"
+		"writes the pieces of a torrent to the disk cache, holds off flushing\n"
+		"them and measures the time to flush the whole cache to disk when the\n"
+		"files are released. This is done once with the pieces arriving in\n"
+		"order and once in random order. The torrent is saved in <directory>.\n\n"
+		"OPTIONS:\n"
+		"-p <pieces>   the number of pieces (default 1024)\n"
+		"-b <blocks>   the number of 16 kiB blocks per piece (default 16)\n");
+}
+
+void run_until(io_service& ios, bool const& done)
+{
+	while (!done)
+	{
+		ios.reset();
+		error_code ec;
+		ios.run_one(ec);
+		if (ec) return;
+	}
+}
+
+// piece 0 is never written, so that a write cache line spanning the whole
+// torrent is never complete and nothing is flushed until the files are
+// released
+void run(char const* name, std::string const& path, int const num_pieces
+	, int const blocks_per_piece, bool const shuffle)
+{
+	int const piece_size = block_size * blocks_per_piece;
+	int const total_blocks = (num_pieces - 1) * blocks_per_piece;
+
+	file_storage fs;
+	fs.add_file("bench_flush/test1.tmp", std::int64_t(piece_size) * num_pieces);
+	fs.set_piece_length(piece_size);
+	fs.set_num_pieces(num_pieces);
+
+	error_code ec;
+	remove_all(combine_path(path, "bench_flush"), ec);
+
+	io_service ios;
+	counters cnt;
+	disk_io_thread io(ios, cnt);
+	settings_pack sett;
+	sett.set_int(settings_pack::aio_threads, 1);
+	sett.set_int(settings_pack::cache_size, total_blocks + 256);
+	sett.set_int(settings_pack::write_cache_line_size, blocks_per_piece * num_pieces);
+	io.set_settings(&sett);
+
+	storage_params p;
+	p.files = &fs;
+	p.path = path;
+	p.mode = storage_mode_sparse;
+	auto st = io.new_torrent(default_storage_constructor, std::move(p)
+		, std::shared_ptr<void>());
+
+	std::vector<int> order;
+	for (int i = 1; i < num_pieces; ++i) order.push_back(i);
+	if (shuffle) std::shuffle(order.begin(), order.end(), std::mt19937(0x1337));
+
+	std::vector<char> data(std::size_t(block_size), 'x');
+	int num_written = 0;
+	int num_failed = 0;
+
+	for (int const piece : order)
+	{
+		std::vector<disk_write_block> blocks;
+		for (int b = 0; b < blocks_per_piece; ++b)
+		{
+			disk_buffer_holder buf = io.allocate_receive_buffer(
+				std::shared_ptr<disk_observer>());
+			std::memcpy(buf.get(), data.data(), std::size_t(block_size));
+			peer_request r;
+			r.piece = piece_index_t(piece);
+			r.start = b * block_size;
+			r.length = block_size;
+			blocks.push_back(disk_write_block{r, std::move(buf)
+				, [&](storage_error const& e)
+				{
+					++num_written;
+					if (e) ++num_failed;
+				}});
+		}
+		io.async_write_blocks(st, blocks);
+	}
+	io.submit_jobs();
+
+	bool done = false;
+	auto const start = clock_type::now();
+	io.async_release_files(st, [&done] { done = true; });
+	io.submit_jobs();
+	run_until(ios, done);
+	double const elapsed = total_microseconds(clock_type::now() - start) / 1000000.0;
+	io.abort(true);
+
+	std::int64_t const write_ops = cnt[counters::num_write_ops];
+	std::printf("%-14s %6d blocks %6d write ops (%6.1f blocks/op) %8.1f MB/s%s\n"
+		, name, total_blocks, int(write_ops)
+		, double(total_blocks) / double(std::max(write_ops, std::int64_t(1)))
+		, double(total_blocks) * block_size / 1000000.0 / elapsed
+		, num_written != total_blocks || num_failed > 0 ? " (write errors)" : "");
+
+	remove_all(combine_path(path, "bench_flush"), ec);
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_pieces = 1024;
+	int blocks_per_piece = 16;
+
+	--argc;
+	++argv;
+	while (argc > 0 && argv[0][0] == '-')
+	{
+		if (argc < 2)
+		{
+			print_usage();
+			return 1;
+		}
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'p': num_pieces = value; break;
+			case 'b': blocks_per_piece = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || num_pieces < 2 || blocks_per_piece <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const path = argv[0];
+	run("in order", path, num_pieces, blocks_per_piece, false);
+	run("random order", path, num_pieces, blocks_per_piece, true);
+	return 0;
+}
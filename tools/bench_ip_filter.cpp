@@ -0,0 +1,158 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/ip_filter.hpp"
+#include "libtorrent/address.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_ip_filter [options]\n\n"
+		"measures the time to load a synthetic IPv4 block list into an\n"
+		"ip_filter and the rate of address lookups in it\n\n"
+		"OPTIONS:\n"
+		"-r <rules>    the number of rules in the block list (default 500000)\n"
+		"-l <lookups>  the number of addresses to look up (default 5000000)\n");
+}
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point const start)
+{
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// block lists are mostly small ranges scattered over the address space
+std::vector<ip_range<address>> block_list(int const num_rules)
+{
+	std::mt19937 rng(0x1337);
+	std::vector<ip_range<address>> ret;
+	ret.reserve(std::size_t(num_rules));
+	for (int i = 0; i < num_rules; ++i)
+	{
+		std::uint32_t const first = std::uint32_t(rng());
+		std::uint32_t const len = std::uint32_t(rng() % 1024);
+		std::uint32_t const last = first > 0xffffffff - len ? 0xffffffff : first + len;
+		ret.push_back({address_v4(first), address_v4(last), ip_filter::blocked});
+	}
+	return ret;
+}
+
+// returns the number of blocked addresses, to keep the lookups from being
+// optimized away
+int lookup(char const* name, ip_filter const& f
+	, std::vector<address> const& addresses)
+{
+	int blocked = 0;
+	auto const start = clock_type::now();
+	for (auto const& a : addresses)
+		blocked += int(f.access(a) & ip_filter::blocked);
+	double const elapsed = seconds_since(start);
+	std::printf("%-24s %8.2f M lookups/s (%d blocked)\n", name
+		, double(addresses.size()) / elapsed / 1000000.0, blocked);
+	return blocked;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_rules = 500000;
+	int num_lookups = 5000000;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'r': num_rules = value; break;
+			case 'l': num_lookups = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc > 0 || num_rules <= 0 || num_lookups <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::vector<ip_range<address>> const rules = block_list(num_rules);
+
+	ip_filter one_by_one;
+	auto start = clock_type::now();
+	for (auto const& r : rules)
+		one_by_one.add_rule(r.first, r.last, r.flags);
+	std::printf("%-24s %8.3f s\n", "load with add_rule()", seconds_since(start));
+
+	ip_filter compacted = one_by_one;
+	start = clock_type::now();
+	compacted.compact();
+	std::printf("%-24s %8.3f s\n", "compact()", seconds_since(start));
+
+	ip_filter bulk;
+	start = clock_type::now();
+	bulk.add_rules(rules);
+	std::printf("%-24s %8.3f s\n", "load with add_rules()", seconds_since(start));
+
+	std::mt19937 rng(0x4242);
+	std::vector<address> addresses;
+	addresses.reserve(std::size_t(num_lookups));
+	for (int i = 0; i < num_lookups; ++i)
+		addresses.push_back(address_v4(std::uint32_t(rng())));
+
+	int const b1 = lookup("lookup (set)", one_by_one, addresses);
+	int const b2 = lookup("lookup (compacted)", compacted, addresses);
+	int const b3 = lookup("lookup (add_rules)", bulk, addresses);
+	if (b1 != b2 || b1 != b3)
+	{
+		std::fprintf(stderr, "filters disagree\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/part_file.hpp"
+#include "libtorrent/aux_/path.hpp"
+#include "libtorrent/error_code.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_part_file [options] <directory>\n\n"
+		"reads and writes pieces of a part file from several threads at once,\n"
+		"while another thread keeps flushing its header, and reports the\n"
+		"throughput. The part file is created in <directory>.\n\n"
+		"OPTIONS:\n"
+		"-t <threads>      the number of reader/writer threads (default 4)\n"
+		"-p <pieces>       the number of pieces per thread (default 256)\n"
+		"-i <iterations>   the number of times each piece is written (default 16)\n");
+}
+
+double seconds_since(std::chrono::steady_clock::time_point const start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_threads = 4;
+	int pieces_per_thread = 256;
+	int iterations = 16;
+
+	--argc;
+	++argv;
+	while (argc > 0 && argv[0][0] == '-')
+	{
+		if (argc < 2)
+		{
+			print_usage();
+			return 1;
+		}
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 't': num_threads = value; break;
+			case 'p': pieces_per_thread = value; break;
+			case 'i': iterations = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || num_threads <= 0 || pieces_per_thread <= 0 || iterations <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const dir = combine_path(argv[0], "bench_part_file");
+	error_code ec;
+	remove_all(dir, ec);
+
+	int const num_pieces = num_threads * pieces_per_thread;
+	int const piece_size = 0x4000;
+
+	std::atomic<std::int64_t> bytes{0};
+	std::atomic<int> errors{0};
+	std::atomic<bool> done{false};
+	std::atomic<int> flushes{0};
+
+	double elapsed;
+	{
+		part_file pf(dir, "bench.parts", num_pieces, piece_size);
+
+		auto const start = std::chrono::steady_clock::now();
+
+		// each thread writes and reads back its own set of pieces, interleaved
+		// with the others, and frees every third piece
+		std::vector<std::thread> threads;
+		for (int t = 0; t < num_threads; ++t)
+		{
+			threads.emplace_back([&, t]
+			{
+				std::vector<char> buf(static_cast<std::size_t>(piece_size), char(t));
+				for (int gen = 0; gen < iterations; ++gen)
+				{
+					for (int i = 0; i < pieces_per_thread; ++i)
+					{
+						piece_index_t const piece(i * num_threads + t);
+						error_code err;
+						iovec_t v = {buf.data(), buf.size()};
+						pf.writev(v, piece, 0, err);
+						if (!err) pf.readv(v, piece, 0, err);
+						if (err) ++errors;
+						bytes += 2 * piece_size;
+						if ((i + gen) % 3 == 0) pf.free_piece(piece);
+					}
+				}
+			});
+		}
+
+		std::thread flusher([&]
+		{
+			while (!done)
+			{
+				error_code err;
+				pf.flush_metadata(err);
+				if (err) ++errors;
+				++flushes;
+				std::this_thread::yield();
+			}
+		});
+
+		for (auto& t : threads) t.join();
+		done = true;
+		flusher.join();
+		elapsed = seconds_since(start);
+	}
+	remove_all(dir, ec);
+
+	std::printf("%d threads: %.1f MB/s (%d header flushes)\n", num_threads
+		, double(bytes) / 1000000.0 / elapsed, int(flushes));
+	if (errors > 0)
+	{
+		std::fprintf(stderr, "%d operations failed\n", int(errors));
+		return 1;
+	}
+	return 0;
+}
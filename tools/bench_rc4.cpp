@@ -0,0 +1,161 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/pe_crypto.hpp"
+#include "libtorrent/hasher.hpp"
+#include "libtorrent/span.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#if !defined TORRENT_DISABLE_ENCRYPTION && !defined TORRENT_DISABLE_EXTENSIONS
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_rc4 [options]\n\n"
+		"measures the throughput of RC4 message stream encryption for\n"
+		"messages of different sizes\n\n"
+		"OPTIONS:\n"
+		"-n <megabytes>  the amount of data to encrypt per message size\n"
+		"                (default 256)\n");
+}
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point const start)
+{
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// encrypts and decrypts the buffer in messages of msg_size bytes each,
+// returns false if the round trip didn't reproduce the plain text
+bool bench(int const msg_size, std::int64_t const total, std::vector<char>& buf)
+{
+	sha1_hash const key1 = hasher("test1_key", 8).final();
+	sha1_hash const key2 = hasher("test2_key", 8).final();
+	rc4_handler a;
+	a.set_outgoing_key(key1);
+	a.set_incoming_key(key2);
+	rc4_handler b;
+	b.set_outgoing_key(key2);
+	b.set_incoming_key(key1);
+
+	std::vector<char> const plain(buf.begin(), buf.begin() + msg_size);
+	std::int64_t const rounds = total / msg_size;
+
+	auto start = clock_type::now();
+	for (std::int64_t i = 0; i < rounds; ++i)
+	{
+		span<char> iovec(buf.data(), std::size_t(msg_size));
+		a.encrypt(iovec);
+	}
+	double const enc_time = seconds_since(start);
+
+	start = clock_type::now();
+	for (std::int64_t i = 0; i < rounds; ++i)
+	{
+		span<char> iovec(buf.data(), std::size_t(msg_size));
+		b.decrypt(iovec);
+	}
+	double const dec_time = seconds_since(start);
+
+	double const megabytes = double(rounds * msg_size) / 1000000.0;
+	std::printf("%6d bytes  encrypt: %8.1f MB/s  decrypt: %8.1f MB/s\n"
+		, msg_size, megabytes / enc_time, megabytes / dec_time);
+
+	return std::equal(plain.begin(), plain.end(), buf.begin());
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	std::int64_t megabytes = 256;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': megabytes = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc > 0 || megabytes <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	int const block_size = 16 * 1024;
+	std::vector<char> buf(block_size);
+	std::mt19937 rng(0x1337);
+	for (auto& c : buf) c = char(rng());
+
+	// most peer wire messages are a handful of bytes (have, request,
+	// choke), piece messages carry a 16 kiB block
+	for (int msg_size : { 5, 17, 68, 1024, block_size })
+	{
+		if (!bench(msg_size, megabytes * 1000000, buf))
+		{
+			std::fprintf(stderr, "RC4 round trip failed for %d byte messages\n"
+				, msg_size);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#else
+
+int main()
+{
+	std::fprintf(stderr, "bench_rc4 requires encryption support\n");
+	return 1;
+}
+
+#endif
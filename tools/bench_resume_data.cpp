@@ -0,0 +1,182 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/bencode.hpp"
+#include "libtorrent/entry.hpp"
+#include "libtorrent/address.hpp"
+#include "libtorrent/socket.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <new>
+
+using namespace lt;
+
+namespace {
+
+// the number of calls to operator new, to count the allocations made while
+// encoding
+std::atomic<std::int64_t> num_allocations(0);
+
+} // anonymous namespace
+
+void* operator new(std::size_t const size)
+{
+	++num_allocations;
+	void* ret = std::malloc(size == 0 ? 1 : size);
+	if (ret == nullptr) throw std::bad_alloc();
+	return ret;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_resume_data [options]\n\n"
+		"compares encoding resume data through an entry followed by bencode()\n"
+		"to encoding it directly with write_resume_data_buf()\n\n"
+		"OPTIONS:\n"
+		"-n <torrents>  the number of torrents to encode (default 50000)\n"
+		"-p <pieces>    the number of pieces per torrent (default 10000)\n"
+		"-e <peers>     the number of peers per torrent (default 200)\n"
+		"-t <trackers>  the number of trackers per torrent (default 10)\n");
+}
+
+add_torrent_params make_params(int const num_pieces, int const num_peers
+	, int const num_trackers)
+{
+	add_torrent_params atp;
+	atp.save_path = "/home/user/downloads";
+	atp.have_pieces.resize(num_pieces, false);
+	atp.verified_pieces.resize(num_pieces, false);
+	for (int i = 0; i < num_pieces; i += 3)
+		atp.have_pieces.set_bit(piece_index_t(i));
+	for (int i = 0; i < num_peers; ++i)
+	{
+		atp.peers.push_back(tcp::endpoint(address_v4(std::uint32_t(0x0a000000 + i))
+			, std::uint16_t(6881 + i)));
+	}
+	for (int i = 0; i < num_trackers; ++i)
+	{
+		atp.trackers.push_back("http://tracker" + std::to_string(i) + ".com/announce");
+		atp.tracker_tiers.push_back(i / 2);
+	}
+	atp.url_seeds.push_back("http://example.com/seed/");
+	atp.file_priorities.resize(100, 4);
+	for (int i = 0; i < 16; ++i)
+		atp.unfinished_pieces[piece_index_t(i * 7)].resize(64, true);
+	return atp;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_torrents = 50000;
+	int num_pieces = 10000;
+	int num_peers = 200;
+	int num_trackers = 10;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': num_torrents = value; break;
+			case 'p': num_pieces = value; break;
+			case 'e': num_peers = value; break;
+			case 't': num_trackers = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 0 || num_torrents <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	add_torrent_params const atp = make_params(num_pieces, num_peers, num_trackers);
+
+	// accumulate the sizes to keep the encoding from being optimized away
+	std::size_t total = 0;
+
+	std::int64_t allocs = num_allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		std::vector<char> buf;
+		bencode(std::back_inserter(buf), write_resume_data(atp));
+		total += buf.size();
+	}
+	double const entry_time = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	std::int64_t const entry_allocs = num_allocations - allocs;
+
+	allocs = num_allocations;
+	start = std::chrono::steady_clock::now();
+	std::vector<char> buf;
+	for (int i = 0; i < num_torrents; ++i)
+	{
+		buf.clear();
+		write_resume_data_buf(atp, buf);
+		total += buf.size();
+	}
+	double const direct_time = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	std::int64_t const direct_allocs = num_allocations - allocs;
+
+	std::printf("%d torrents, %d bytes of resume data each\n"
+		, num_torrents, int(buf.size()));
+	std::printf("entry + bencode():       %.2f s (%.1f us, %.1f allocations per torrent)\n"
+		, entry_time, entry_time * 1000000.0 / num_torrents
+		, double(entry_allocs) / num_torrents);
+	std::printf("write_resume_data_buf(): %.2f s (%.1f us, %.1f allocations per torrent)\n"
+		, direct_time, direct_time * 1000000.0 / num_torrents
+		, double(direct_allocs) / num_torrents);
+	return total == 0 ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/resume_store.hpp"
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/write_resume_data.hpp"
+#include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/torrent_status.hpp"
+#include "libtorrent/hex.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_resume_store [options] <directory>\n\n"
+		"compares saving and loading the resume state of many torrents as\n"
+		"one bencoded file per torrent to keeping it in a resume_store. The\n"
+		"files are created in <directory>. Run with a cold disk cache to see\n"
+		"the effect of disk latency on startup.\n\n"
+		"OPTIONS:\n"
+		"-n <torrents>  the number of torrents (default 50000)\n"
+		"-p <pieces>    the number of pieces per torrent (default 2000)\n");
+}
+
+void make_directory(std::string const& p)
+{
+#ifdef _WIN32
+	_mkdir(p.c_str());
+#else
+	mkdir(p.c_str(), 0777);
+#endif
+}
+
+double seconds_since(std::chrono::steady_clock::time_point const start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<add_torrent_params> make_torrents(int const num_torrents
+	, int const num_pieces)
+{
+	std::mt19937 rng(0x1234);
+	std::vector<add_torrent_params> ret;
+	ret.reserve(std::size_t(num_torrents));
+	for (int t = 0; t < num_torrents; ++t)
+	{
+		add_torrent_params atp;
+		for (auto& b : atp.info_hash) b = std::uint8_t(rng());
+		atp.save_path = "/home/user/downloads";
+		atp.name = "torrent " + std::to_string(t);
+		atp.file_priorities.resize(10, 4);
+		atp.have_pieces.resize(num_pieces, false);
+		for (int i = 0; i < num_pieces / 2; ++i)
+			atp.have_pieces.set_bit(piece_index_t(int(rng() % std::uint32_t(num_pieces))));
+		ret.push_back(std::move(atp));
+	}
+	return ret;
+}
+
+std::string resume_file(std::string const& dir, sha1_hash const& ih)
+{
+	return dir + "/" + aux::to_hex(ih) + ".resume";
+}
+
+// save the resume data of every torrent to its own file, the way an
+// application does without a resume_store
+bool save_files(std::string const& dir, std::vector<add_torrent_params> const& torrents)
+{
+	std::vector<char> buf;
+	for (auto const& atp : torrents)
+	{
+		buf.clear();
+		write_resume_data_buf(atp, buf);
+		std::ofstream out(resume_file(dir, atp.info_hash), std::ios_base::binary);
+		out.write(buf.data(), std::streamsize(buf.size()));
+		if (!out) return false;
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_torrents = 50000;
+	int num_pieces = 2000;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': num_torrents = value; break;
+			case 'p': num_pieces = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 1 || num_torrents <= 0 || num_pieces <= 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	std::string const dir = argv[0];
+	std::string const files_dir = dir + "/resume";
+	std::string const store_path = dir + "/resume.store";
+	make_directory(dir);
+	make_directory(files_dir);
+	std::remove(store_path.c_str());
+
+	std::vector<add_torrent_params> torrents = make_torrents(num_torrents, num_pieces);
+	std::printf("%d torrents, %d pieces each\n\n", num_torrents, num_pieces);
+
+	// saving the full state of every torrent
+	auto start = std::chrono::steady_clock::now();
+	if (!save_files(files_dir, torrents))
+	{
+		std::fprintf(stderr, "failed to write resume files\n");
+		return 1;
+	}
+	double const files_save = seconds_since(start);
+
+	error_code ec;
+	start = std::chrono::steady_clock::now();
+	{
+		resume_store store(store_path, ec);
+		for (auto const& atp : torrents)
+		{
+			if (ec) break;
+			store.save(atp, ec);
+		}
+		if (!ec) store.flush(ec);
+	}
+	double const store_save = seconds_since(start);
+	if (ec)
+	{
+		std::fprintf(stderr, "failed to save to the store: %s\n", ec.message().c_str());
+		return 1;
+	}
+
+	std::printf("save all:                  %8.3f s (files) %8.3f s (store)\n"
+		, files_save, store_save);
+
+	// a periodic checkpoint, where every torrent has completed a piece and
+	// its statistics have changed. Without the store, that means saving the
+	// full resume data of every torrent again
+	for (auto& atp : torrents)
+	{
+		atp.have_pieces.set_bit(piece_index_t(0));
+		atp.total_uploaded += 16384;
+	}
+
+	start = std::chrono::steady_clock::now();
+	save_files(files_dir, torrents);
+	double const files_checkpoint = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	{
+		resume_store store(store_path, ec);
+		torrent_status st;
+		for (auto const& atp : torrents)
+		{
+			if (ec) break;
+			store.piece_finished(atp.info_hash, piece_index_t(0), ec);
+			if (ec) break;
+			st.info_hash = atp.info_hash;
+			st.all_time_upload = atp.total_uploaded;
+			store.update_stats(st, ec);
+		}
+		if (!ec) store.flush(ec);
+	}
+	double const store_checkpoint = seconds_since(start);
+	if (ec)
+	{
+		std::fprintf(stderr, "failed to update the store: %s\n", ec.message().c_str());
+		return 1;
+	}
+
+	std::printf("checkpoint (incremental):  %8.3f s (files) %8.3f s (store)\n"
+		, files_checkpoint, store_checkpoint);
+
+	// startup, loading the state of every torrent
+	int loaded = 0;
+	start = std::chrono::steady_clock::now();
+	std::vector<char> buf;
+	for (auto const& atp : torrents)
+	{
+		std::ifstream in(resume_file(files_dir, atp.info_hash), std::ios_base::binary);
+		buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		add_torrent_params const p = read_resume_data(buf, ec);
+		if (!ec && p.have_pieces.size() == num_pieces) ++loaded;
+	}
+	double const files_load = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	{
+		resume_store store(store_path, ec);
+		for (auto const& ih : store.torrents())
+		{
+			add_torrent_params const p = store.load(ih, ec);
+			if (!ec && p.have_pieces.size() == num_pieces) ++loaded;
+		}
+	}
+	double const store_load = seconds_since(start);
+
+	std::printf("startup (load all):        %8.3f s (files) %8.3f s (store)\n"
+		, files_load, store_load);
+
+	if (loaded != 2 * num_torrents)
+	{
+		std::fprintf(stderr, "failed to load %d torrents\n", 2 * num_torrents - loaded);
+		return 1;
+	}
+	return 0;
+}
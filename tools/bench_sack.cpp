@@ -0,0 +1,154 @@
+/*
+
+Copyright (c) 2018, Arvid Norberg
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "libtorrent/utp_stream.hpp"
+#include "libtorrent/time.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace lt;
+
+namespace {
+
+void print_usage()
+{
+	std::fprintf(stderr, "usage: bench_sack [options]\n\n"
+		"measures the time to decode uTP selective ACK bitmasks, compared to\n"
+		"decoding them bit by bit\n\n"
+		"OPTIONS:\n"
+		"-n <acks>   the number of SACKs to decode (default 8333333, the\n"
+		"            number of ACKs of 100 seconds of a 1 Gbit/s stream\n"
+		"            with 1500 byte packets)\n"
+		"-s <bytes>  the size of each bitmask (default 32)\n");
+}
+
+double seconds_since(clock_type::time_point const start)
+{
+	return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// the straight-forward, bit-by-bit, decoding of a SACK bitmask
+int sack_bit_offsets_ref(std::vector<std::uint8_t> const& bitmask
+	, int const num_bits, std::uint16_t* offsets)
+{
+	int ret = 0;
+	for (int i = 0; i < num_bits; ++i)
+	{
+		if (bitmask[std::size_t(i / 8)] & (1 << (i % 8)))
+			offsets[ret++] = std::uint16_t(i);
+	}
+	return ret;
+}
+
+std::vector<std::uint8_t> make_sack(int const size, std::uint32_t seed)
+{
+	std::vector<std::uint8_t> ret(std::size_t(size), 0);
+	for (auto& b : ret)
+	{
+		seed = seed * 1664525 + 1013904223;
+		b = std::uint8_t(seed >> 24);
+	}
+	return ret;
+}
+
+} // anonymous namespace
+
+int main(int argc, char const* argv[])
+{
+	int num_acks = 1000000000 / (1500 * 8) * 100;
+	int sack_size = 32;
+
+	--argc;
+	++argv;
+	while (argc > 1 && argv[0][0] == '-')
+	{
+		int const value = std::atoi(argv[1]);
+		switch (argv[0][1])
+		{
+			case 'n': num_acks = value; break;
+			case 's': sack_size = value; break;
+			default:
+				print_usage();
+				return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc > 0 || num_acks <= 0 || sack_size <= 0 || sack_size > 255)
+	{
+		print_usage();
+		return 1;
+	}
+
+	// a few different bitmasks, to not only measure the branch predictor
+	std::vector<std::vector<std::uint8_t>> sacks;
+	for (std::uint32_t i = 0; i < 16; ++i)
+		sacks.push_back(make_sack(sack_size, i));
+
+	int const num_bits = sack_size * 8;
+	std::array<std::uint16_t, 255 * 8> offsets;
+	std::int64_t sum = 0;
+
+	auto start = clock_type::now();
+	for (int i = 0; i < num_acks; ++i)
+	{
+		auto const& s = sacks[std::size_t(i % 16)];
+		sum += sack_bit_offsets(s, num_bits, offsets);
+	}
+	double const word_wise = seconds_since(start);
+
+	start = clock_type::now();
+	for (int i = 0; i < num_acks; ++i)
+	{
+		auto const& s = sacks[std::size_t(i % 16)];
+		sum -= sack_bit_offsets_ref(s, num_bits, offsets.data());
+	}
+	double const bit_by_bit = seconds_since(start);
+
+	if (sum != 0)
+	{
+		std::fprintf(stderr, "sack_bit_offsets() disagrees with the reference\n");
+		return 1;
+	}
+
+	std::printf("%-24s %8.3f s (%6.1f ns/SACK)\n", "sack_bit_offsets()"
+		, word_wise, word_wise * 1e9 / num_acks);
+	std::printf("%-24s %8.3f s (%6.1f ns/SACK)\n", "bit by bit"
+		, bit_by_bit, bit_by_bit * 1e9 / num_acks);
+	return 0;
+}